@@ -19,44 +19,36 @@
  ***************************************************************************/
 
 #include "json.h"
+#include "json_internal.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <float.h>
 #include <sys/types.h>
-
-
-enum LEX_VALUE
-{ LEX_MORE = 0,
-	LEX_INVALID_CHARACTER,
-	LEX_TRUE,
-	LEX_FALSE,
-	LEX_NULL,
-	LEX_BEGIN_OBJECT,
-	LEX_END_OBJECT,
-	LEX_BEGIN_ARRAY,
-	LEX_END_ARRAY,
-	LEX_NAME_SEPARATOR,
-	LEX_VALUE_SEPARATOR,
-	LEX_STRING,
-	LEX_NUMBER,
-	LEX_ERROR,
-	LEX_MEMORY
-};
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+/* address and thread sanitizers report the aligned loads which json_cstring_span() makes past the end of a string, so those builds take the bytewise loop; valgrind's memcheck accepts them as partial loads */
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define JSON_SANITIZED 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+#define JSON_SANITIZED 1
+#endif
+#endif
 
 
 /* rc_string part */
 
-#define RSTRING_INCSTEP 5
-#define RSTRING_DEFAULT 8
-
-
-enum rui_string_error_codes
-{ RS_MEMORY, RS_OK = 1, RS_UNKNOWN };
-
-typedef enum rui_string_error_codes rstring_code;
-
 
 rcstring *
 rcs_create (size_t length)
@@ -107,10 +99,7 @@ rcs_resize (rcstring * rcs, size_t length)
 
 	temp = (char *)realloc (rcs->text, sizeof (char) * (length + 1));	/* length plus '\0' */
 	if (temp == NULL)
-	{
-		free (rcs);
-		return RS_MEMORY;
-	}
+		return RS_MEMORY;	/* the string is left as it was, for its owner to free */
 	rcs->text = temp;
 	rcs->max = length;
 	rcs->text[rcs->max] = '\0';
@@ -126,10 +115,11 @@ rcs_catcs (rcstring * pre, const char *pos, const size_t length)
 
 	if (pre->max < pre->length + length)
 	{
-		if (rcs_resize (pre, pre->length + length + RSTRING_INCSTEP) != RS_OK)
+		/* grow geometrically, so that appending n bytes one run at a time costs O(n) */
+		if (rcs_resize (pre, pre->length + length + (pre->max > RSTRING_INCSTEP ? pre->max : RSTRING_INCSTEP)) != RS_OK)
 			return RS_MEMORY;
 	}
-	strncpy (pre->text + pre->length, pos, length);
+	memcpy (pre->text + pre->length, pos, length);
 	pre->text[pre->length + length] = '\0';
 	pre->length += length;
 	return RS_OK;
@@ -143,7 +133,7 @@ rcs_catc (rcstring * pre, const char c)
 
 	if (pre->max <= pre->length)
 	{
-		if (rcs_resize (pre, pre->max + RSTRING_INCSTEP) != RS_OK)
+		if (rcs_resize (pre, pre->max + (pre->max > RSTRING_INCSTEP ? pre->max : RSTRING_INCSTEP)) != RS_OK)
 			return RS_MEMORY;
 	}
 	pre->text[pre->length] = c;
@@ -163,7 +153,7 @@ rcs_unwrap (rcstring * rcs)
 		out = NULL;
 	else
 	{
-		out = (char *)realloc (rcs->text, sizeof (char) * (strlen (rcs->text) + 1));
+		out = (char *)realloc (rcs->text, sizeof (char) * (rcs->length + 1));
 	}
 
 	free (rcs);
@@ -184,6 +174,615 @@ rcs_length (rcstring * rcs)
 /* end of rc_string part */
 
 
+/* scanning kernels */
+
+/**
+Counts the leading bytes of text which can be taken verbatim as part of a JSON string, stopping at the first quote, reverse solidus or control character
+@param text the bytes to scan
+@param length the number of bytes available in text
+@return the number of plain string bytes found at the beginning of text
+**/
+size_t
+json_string_span (const char *text, size_t length)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__) && defined(__GNUC__)
+	const __m128i quote = _mm_set1_epi8 ('\"');
+	const __m128i reverse_solidus = _mm_set1_epi8 ('\\');
+	const __m128i control = _mm_set1_epi8 (0x1F);
+	const __m128i zero = _mm_setzero_si128 ();
+
+	while (i + 16 <= length)
+	{
+		__m128i chunk, special;
+		int mask;
+
+		chunk = _mm_loadu_si128 ((const __m128i *) (text + i));
+		special = _mm_or_si128 (_mm_cmpeq_epi8 (chunk, quote), _mm_cmpeq_epi8 (chunk, reverse_solidus));
+		special = _mm_or_si128 (special, _mm_cmpeq_epi8 (_mm_subs_epu8 (chunk, control), zero));	/* bytes below 0x20 saturate to zero */
+		mask = _mm_movemask_epi8 (special);
+		if (mask != 0)
+			return i + __builtin_ctz (mask);
+		i += 16;
+	}
+#endif
+	while (i < length)
+	{
+		unsigned char c = (unsigned char) text[i];
+		if ((c == '\"') || (c == '\\') || (c < 0x20))
+			break;
+		i++;
+	}
+	return i;
+}
+
+
+/**
+Counts the leading bytes of a null-terminated string which don't need any special handling when copying JSON string text, stopping at the first quote, reverse solidus, control character or stop character
+@param text a null-terminated string
+@param stop an additional character which ends the run
+@return the number of plain bytes found at the beginning of text, which never includes the nul character
+**/
+static size_t
+json_cstring_span (const char *text, const char stop)
+{
+#if defined(__SSE2__) && defined(__GNUC__) && !defined(JSON_SANITIZED)
+	const __m128i quote = _mm_set1_epi8 ('\"');
+	const __m128i reverse_solidus = _mm_set1_epi8 ('\\');
+	const __m128i extra = _mm_set1_epi8 (stop);
+	const __m128i control = _mm_set1_epi8 (0x1F);
+	const __m128i zero = _mm_setzero_si128 ();
+	size_t misalignment = (size_t) ((uintptr_t) text & 15);
+	const char *block = text - misalignment;
+	__m128i chunk, special;
+	int mask;
+
+	/* aligned loads never cross a page boundary, so the bytes read before text or past its nul character are harmless */
+	for (;;)
+	{
+		chunk = _mm_load_si128 ((const __m128i *) block);
+		special = _mm_or_si128 (_mm_cmpeq_epi8 (chunk, quote), _mm_cmpeq_epi8 (chunk, reverse_solidus));
+		special = _mm_or_si128 (special, _mm_cmpeq_epi8 (chunk, extra));
+		special = _mm_or_si128 (special, _mm_cmpeq_epi8 (_mm_subs_epu8 (chunk, control), zero));	/* catches the nul character as well */
+		mask = _mm_movemask_epi8 (special) & (0xFFFF << misalignment);
+		if (mask != 0)
+			return (size_t) (block + __builtin_ctz (mask) - text);
+		block += 16;
+		misalignment = 0;
+	}
+#else
+	size_t i = 0;
+	unsigned char c;
+
+	for (;;)
+	{
+		c = (unsigned char) text[i];
+		if ((c == '\"') || (c == '\\') || (c == (unsigned char) stop) || (c < 0x20))
+			return i;
+		i++;
+	}
+#endif
+}
+
+
+#ifndef __SSSE3__
+/**
+Checks a byte sequence against the well-formed UTF-8 byte sequences listed in table 3-7 of the Unicode standard, which rejects overlong forms, surrogates and code points past U+10FFFF
+@param text the bytes to check
+@param length the number of bytes in text
+@return the number of bytes in the longest valid prefix of text, which is length if the whole sequence is valid
+**/
+static size_t
+json_utf8_span (const unsigned char *text, size_t length)
+{
+	size_t i = 0;
+	size_t continuations;
+	unsigned char low, high;
+
+	while (i < length)
+	{
+#ifdef __SSE2__
+		/* skip ASCII 16 bytes at a time */
+		while ((i + 16 <= length) && (_mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i *) (text + i))) == 0))
+			i += 16;
+		if (i == length)
+			break;
+#endif
+		if (text[i] < 0x80)
+		{
+			i++;
+			continue;
+		}
+
+		/* set the accepted range of the second byte and the number of continuation bytes */
+		low = 0x80;
+		high = 0xBF;
+		if ((text[i] >= 0xC2) && (text[i] <= 0xDF))
+			continuations = 1;
+		else if (text[i] == 0xE0)
+		{
+			low = 0xA0;	/* overlong */
+			continuations = 2;
+		}
+		else if (text[i] == 0xED)
+		{
+			high = 0x9F;	/* surrogates */
+			continuations = 2;
+		}
+		else if ((text[i] >= 0xE1) && (text[i] <= 0xEF))
+			continuations = 2;
+		else if (text[i] == 0xF0)
+		{
+			low = 0x90;	/* overlong */
+			continuations = 3;
+		}
+		else if ((text[i] >= 0xF1) && (text[i] <= 0xF3))
+			continuations = 3;
+		else if (text[i] == 0xF4)
+		{
+			high = 0x8F;	/* past U+10FFFF */
+			continuations = 3;
+		}
+		else
+			return i;
+
+		if ((i + continuations >= length) || (text[i + 1] < low) || (text[i + 1] > high))
+			return i;
+		if ((continuations > 1) && ((text[i + 2] & 0xC0) != 0x80))
+			return i;
+		if ((continuations > 2) && ((text[i + 3] & 0xC0) != 0x80))
+			return i;
+		i += continuations + 1;
+	}
+	return i;
+}
+#endif
+
+
+#ifdef __SSSE3__
+/* the SSSE3 kernel follows the lookup algorithm by John Keiser and Daniel Lemire: each pair of consecutive bytes is classified through three nibble lookup tables and the error bits of the tables are and-ed together */
+#define UTF8_TOO_SHORT 0x01	/* 11______ 0_______ or 11______ 11______ */
+#define UTF8_TOO_LONG 0x02	/* 0_______ 10______ */
+#define UTF8_OVERLONG_3 0x04	/* 11100000 100_____ */
+#define UTF8_TOO_LARGE 0x08	/* 11110100 1001____ and above */
+#define UTF8_SURROGATE 0x10	/* 11101101 101_____ */
+#define UTF8_OVERLONG_2 0x20	/* 1100000_ 10______ */
+#define UTF8_TOO_LARGE_1000 0x40	/* 11110101 1000____ and above */
+#define UTF8_OVERLONG_4 0x40	/* 11110000 1000____ */
+#define UTF8_TWO_CONTS 0x80	/* 10______ 10______ */
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+
+static __m128i
+json_utf8_block_errors (__m128i input, __m128i previous)
+{
+	const __m128i nibble = _mm_set1_epi8 (0x0F);
+	const __m128i byte_1_high_table = _mm_setr_epi8 (UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+							 UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+							 UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+							 UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+							 UTF8_TOO_SHORT,
+							 UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+							 UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+	const __m128i byte_1_low_table = _mm_setr_epi8 (UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+							UTF8_CARRY | UTF8_OVERLONG_2,
+							UTF8_CARRY,
+							UTF8_CARRY,
+							UTF8_CARRY | UTF8_TOO_LARGE,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+							UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000);
+	const __m128i byte_2_high_table = _mm_setr_epi8 (UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+							 UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+							 UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+							 UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+							 UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+							 UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+							 UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+	__m128i prev1, prev2, prev3, special, must_continue;
+
+	prev1 = _mm_alignr_epi8 (input, previous, 15);
+	special = _mm_and_si128 (_mm_shuffle_epi8 (byte_1_high_table, _mm_and_si128 (_mm_srli_epi16 (prev1, 4), nibble)),
+				 _mm_shuffle_epi8 (byte_1_low_table, _mm_and_si128 (prev1, nibble)));
+	special = _mm_and_si128 (special, _mm_shuffle_epi8 (byte_2_high_table, _mm_and_si128 (_mm_srli_epi16 (input, 4), nibble)));
+
+	/* the third and fourth bytes of three and four byte sequences must be continuations, which the tables above can't see */
+	prev2 = _mm_alignr_epi8 (input, previous, 14);
+	prev3 = _mm_alignr_epi8 (input, previous, 13);
+	must_continue = _mm_or_si128 (_mm_subs_epu8 (prev2, _mm_set1_epi8 ((char) 0xDF)), _mm_subs_epu8 (prev3, _mm_set1_epi8 ((char) 0xEF)));
+	must_continue = _mm_and_si128 (_mm_cmpgt_epi8 (must_continue, _mm_setzero_si128 ()), _mm_set1_epi8 ((char) 0x80));
+	return _mm_xor_si128 (must_continue, special);
+}
+#endif
+
+
+/**
+Checks if a byte sequence is well-formed UTF-8
+@param text the bytes to check
+@param length the number of bytes in text
+@return 1 if text is valid UTF-8, 0 otherwise
+**/
+int
+json_utf8_valid (const char *text, size_t length)
+{
+#ifdef __SSSE3__
+	const __m128i incomplete_limit = _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char) 0xEF, (char) 0xDF, (char) 0xBF);
+	__m128i error = _mm_setzero_si128 ();
+	__m128i previous = _mm_setzero_si128 ();
+	__m128i incomplete = _mm_setzero_si128 ();
+	__m128i input;
+	char tail[16];
+	size_t i = 0;
+
+	for (;;)
+	{
+		if (i + 16 <= length)
+			input = _mm_loadu_si128 ((const __m128i *) (text + i));
+		else
+		{
+			/* the zero padding makes any sequence cut short by the end of text show up as an error */
+			memset (tail, 0, sizeof (tail));
+			memcpy (tail, text + i, length - i);
+			input = _mm_loadu_si128 ((const __m128i *) tail);
+		}
+
+		if (_mm_movemask_epi8 (input) == 0)
+		{
+			error = _mm_or_si128 (error, incomplete);	/* ASCII block: the previous block must not end in the middle of a sequence */
+			incomplete = _mm_setzero_si128 ();
+		}
+		else
+		{
+			error = _mm_or_si128 (error, json_utf8_block_errors (input, previous));
+			incomplete = _mm_subs_epu8 (input, incomplete_limit);
+		}
+		previous = input;
+
+		if (i + 16 > length)
+			break;
+		i += 16;
+	}
+	error = _mm_or_si128 (error, incomplete);
+	return _mm_movemask_epi8 (_mm_cmpeq_epi8 (error, _mm_setzero_si128 ())) == 0xFFFF;
+#else
+	return json_utf8_span ((const unsigned char *) text, length) == length;
+#endif
+}
+
+
+/* end of scanning kernels */
+
+
+/**
+Appends the escaped version of a UTF-8 c-string to a rcstring
+@param output the rcstring which receives the escaped text
+@param text an UTF-8 c-string
+@return RS_OK on success, RS_MEMORY otherwise
+**/
+static rstring_code
+rcs_catescaped (rcstring * output, const char *text)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i, run;
+	char buffer[7] = "\\u00";
+
+	assert (output != NULL);
+	assert (text != NULL);
+
+	for (i = 0;; i++)
+	{
+		/* copy the run of characters which don't need escaping in one go */
+		run = json_cstring_span (text + i, '/');
+		if (run > 0)
+		{
+			if (rcs_catcs (output, text + i, run) != RS_OK)
+				return RS_MEMORY;
+			i += run;
+		}
+
+		switch (text[i])
+		{
+		case '\0':
+			return RS_OK;
+
+		case '\\':
+			buffer[1] = '\\';
+			break;
+
+		case '\"':
+			buffer[1] = '\"';
+			break;
+
+		case '/':
+			buffer[1] = '/';
+			break;
+
+		case '\b':
+			buffer[1] = 'b';
+			break;
+
+		case '\f':
+			buffer[1] = 'f';
+			break;
+
+		case '\n':
+			buffer[1] = 'n';
+			break;
+
+		case '\r':
+			buffer[1] = 'r';
+			break;
+
+		case '\t':
+			buffer[1] = 't';
+			break;
+
+		default:	/* remaining control characters */
+			buffer[1] = 'u';
+			buffer[4] = hex[(text[i] >> 4) & 0x0F];
+			buffer[5] = hex[text[i] & 0x0F];
+			if (rcs_catcs (output, buffer, 6) != RS_OK)
+				return RS_MEMORY;
+			continue;
+		}
+		if (rcs_catcs (output, buffer, 2) != RS_OK)
+			return RS_MEMORY;
+	}
+}
+
+
+int
+json_text_needs_escaping (const char *text)
+{
+	return text[json_cstring_span (text, '\"')] != '\0';
+}
+
+
+/* member index part */
+
+/**
+The lookup index of a container node. For a JSON_OBJECT the slots form an open addressing hash table of its labels, which uses linear probing and is kept at most half full. For a JSON_ARRAY the first count slots hold its elements in order
+**/
+struct json_index
+{
+	size_t count;		/* number of children held by the index */
+	size_t capacity;	/* number of slots, always a power of two */
+	json_t **slots;
+};
+
+
+/**
+Hashes a text with 32-bit FNV-1a
+@param text the text to hash
+@param length the number of bytes in text
+@return the text's hash
+**/
+uint32_t
+json_hash_text (const char *text, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char) text[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+
+/**
+Hashes the text of a label as it reads once unescaped, which is what the member index is keyed by, so that a label is found by either form of its text
+@param text the label's nul-terminated text
+@param length the number of bytes in text
+@param plain set if text holds no escape sequences, as is the case of labels flagged JSON_FLAG_NEEDS_ESCAPING
+@return the hash of the unescaped text
+**/
+uint32_t
+json_hash_label_text (const char *text, size_t length, int plain)
+{
+	struct json_text_reader reader;
+	uint32_t hash = 2166136261u;
+	int c;
+
+	if (plain || (memchr (text, '\\', length) == NULL))
+		return json_hash_text (text, length);	/* the text reads as it is written */
+
+	json_text_reader_init_text (&reader, text, 0);
+	while ((c = json_text_reader_next (&reader)) != -1)
+	{
+		hash ^= (unsigned char) c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+
+/**
+@param label a label
+@return the hash of the label's unescaped text, which is never stored here: indexes are built through const pointers by concurrent readers, who must leave the tree untouched
+**/
+uint32_t
+json_label_hash (const json_t * label)
+{
+	if (label->flags & JSON_FLAG_HASHED)
+		return label->hash;
+	return json_hash_label_text (label->text, strlen (label->text), label->flags & JSON_FLAG_NEEDS_ESCAPING);
+}
+
+
+/**
+Stores the hash of a label's text in the label, as it joins an object
+@param label a label
+**/
+static void
+json_keep_label_hash (json_t * label)
+{
+	if (!(label->flags & JSON_FLAG_HASHED))
+	{
+		label->hash = json_hash_label_text (label->text, strlen (label->text), label->flags & JSON_FLAG_NEEDS_ESCAPING);
+		label->flags |= JSON_FLAG_HASHED;
+	}
+}
+
+
+static void
+json_index_free (struct json_index **index)
+{
+	if (*index != NULL)
+	{
+		free ((*index)->slots);
+		free (*index);
+		*index = NULL;
+	}
+}
+
+
+static void
+json_index_place (struct json_index *index, json_t * label)
+{
+	size_t mask = index->capacity - 1;
+	size_t i = json_label_hash (label) & mask;
+
+	/* labels sharing a text are kept in insertion order along the probe sequence, which lets lookups find the first one */
+	while (index->slots[i] != NULL)
+		i = (i + 1) & mask;
+	index->slots[i] = label;
+	index->count++;
+}
+
+
+static enum json_error
+json_index_insert (struct json_index *index, json_t * label)
+{
+	if ((index->count + 1) * 2 > index->capacity)
+	{
+		json_t **old_slots = index->slots;
+		size_t old_capacity = index->capacity;
+		size_t i;
+
+		index->slots = (json_t **)calloc (old_capacity * 2, sizeof (json_t *));
+		if (index->slots == NULL)
+		{
+			index->slots = old_slots;
+			return JSON_MEMORY;
+		}
+		index->capacity = old_capacity * 2;
+		index->count = 0;
+
+		/* rehashing in slot order would break the order of equal labels, so walk the probe clusters from their starts */
+		for (i = 0; i < old_capacity; i++)
+		{
+			if ((old_slots[i] == NULL) && (old_slots[(i + 1) % old_capacity] != NULL))
+			{
+				size_t j = (i + 1) % old_capacity;
+				while (old_slots[j] != NULL)
+				{
+					json_index_place (index, old_slots[j]);
+					j = (j + 1) % old_capacity;
+				}
+			}
+		}
+		free (old_slots);
+	}
+	json_index_place (index, label);
+	return JSON_OK;
+}
+
+
+static void
+json_index_remove (struct json_index *index, json_t * label)
+{
+	size_t mask = index->capacity - 1;
+	size_t i = json_label_hash (label) & mask;
+	size_t j, home;
+
+	while (index->slots[i] != label)
+	{
+		if (index->slots[i] == NULL)
+			return;	/* not indexed */
+		i = (i + 1) & mask;
+	}
+
+	/* backward shift deletion: pull the followers of the cluster back so that no probe sequence gets broken */
+	index->slots[i] = NULL;
+	index->count--;
+	for (j = (i + 1) & mask; index->slots[j] != NULL; j = (j + 1) & mask)
+	{
+		home = json_label_hash (index->slots[j]) & mask;
+		if (((j > i) && ((home <= i) || (home > j))) || ((j < i) && ((home <= i) && (home > j))))
+		{
+			index->slots[i] = index->slots[j];
+			index->slots[j] = NULL;
+			i = j;
+		}
+	}
+}
+
+
+static json_t *
+json_index_find (const struct json_index *index, const char *text_label, uint32_t hash)
+{
+	size_t mask = index->capacity - 1;
+	size_t i;
+
+	for (i = hash & mask; index->slots[i] != NULL; i = (i + 1) & mask)
+	{
+		if ((json_label_hash (index->slots[i]) == hash) && (strcmp (index->slots[i]->text, text_label) == 0))
+			return index->slots[i];
+	}
+	return NULL;
+}
+
+
+static enum json_error
+json_index_append (struct json_index *index, json_t * element)
+{
+	if (index->count == index->capacity)
+	{
+		json_t **temp = (json_t **)realloc (index->slots, index->capacity * 2 * sizeof (json_t *));
+		if (temp == NULL)
+			return JSON_MEMORY;
+		index->slots = temp;
+		index->capacity *= 2;
+	}
+	index->slots[index->count++] = element;
+	return JSON_OK;
+}
+
+
+static void
+json_index_erase (struct json_index *index, json_t * element)
+{
+	size_t i = index->count;
+
+	/* the vector only holds the elements of arrays being edited, as json_free_value() drops it before freeing an array; json_detach() takes appended elements off the back most often */
+	while (i > 0)
+	{
+		i--;
+		if (index->slots[i] == element)
+		{
+			memmove (index->slots + i, index->slots + i + 1, (index->count - i - 1) * sizeof (json_t *));
+			index->count--;
+			return;
+		}
+	}
+}
+
+
+/* end of member index part */
+
+
 enum json_error
 json_stream_parse (FILE * file, json_t ** document)
 {
@@ -253,6 +852,10 @@ json_new_value (const enum json_value_type type)
 	new_object->previous = NULL;
 	new_object->next = NULL;
 	new_object->type = type;
+	new_object->flags = 0;
+	new_object->hash = 0;
+	new_object->index = NULL;
+	new_object->digest = 0;
 	return new_object;
 }
 
@@ -285,6 +888,24 @@ json_new_string (const char *text)
 	new_object->previous = NULL;
 	new_object->next = NULL;
 	new_object->type = JSON_STRING;
+	new_object->flags = 0;
+	new_object->hash = 0;
+	new_object->index = NULL;
+	new_object->digest = 0;
+	return new_object;
+}
+
+
+json_t *
+json_new_plain_string (const char *text)
+{
+	json_t *new_object;
+
+	assert (text != NULL);
+
+	new_object = json_new_string (text);
+	if ((new_object != NULL) && json_text_needs_escaping (text))
+		new_object->flags = JSON_FLAG_NEEDS_ESCAPING;
 	return new_object;
 }
 
@@ -317,6 +938,10 @@ json_new_number (const char *text)
 	new_object->previous = NULL;
 	new_object->next = NULL;
 	new_object->type = JSON_NUMBER;
+	new_object->flags = 0;
+	new_object->hash = 0;
+	new_object->index = NULL;
+	new_object->digest = 0;
 	return new_object;
 }
 
@@ -356,62 +981,102 @@ json_new_false (void)
 }
 
 
+/**
+Discards the memoized structural hashes of a node and of its ancestors, as a node below them changed
+**/
 static void
-intern_json_free_value (json_t ** value)
+json_forget_digests (json_t * node)
 {
-	assert (value != NULL);
-	assert ((*value) != NULL);
-	assert ((*value)->child == NULL);
+	/* a memoized node only has memoized nodes below it, so the walk stops at the first node without one */
+	while ((node != NULL) && (node->flags & JSON_FLAG_DIGESTED))
+	{
+		node->flags &= ~JSON_FLAG_DIGESTED;
+		node = node->parent;
+	}
+}
+
 
+/**
+Takes a node out of its parent's children list, keeping the parent's index and memoized hashes in step
+**/
+static void
+json_unlink (json_t * value)
+{
 	/* fixing sibling linked list connections */
-	if ((*value)->previous && (*value)->next)
+	if (value->previous && value->next)
 	{
-		(*value)->previous->next = (*value)->next;
-		(*value)->next->previous = (*value)->previous;
+		value->previous->next = value->next;
+		value->next->previous = value->previous;
 	}
 	else
 	{
-		if ((*value)->previous)
+		if (value->previous)
 		{
-			(*value)->previous->next = NULL;
+			value->previous->next = NULL;
 		}
-		if ((*value)->next)
+		if (value->next)
 		{
-			(*value)->next->previous = NULL;
+			value->next->previous = NULL;
 		}
 	}
 
 	/*fixing parent node connections */
-	if ((*value)->parent)
+	if (value->parent)
 	{
+		json_forget_digests (value->parent);
+		if (value->parent->index != NULL)
+		{
+			if (value->parent->type == JSON_ARRAY)
+				json_index_erase (value->parent->index, value);
+			else
+				json_index_remove (value->parent->index, value);
+		}
+
 		/* fix the tree connection to the first node in the children's list */
-		if ((*value)->parent->child == (*value))
+		if (value->parent->child == value)
 		{
-			if ((*value)->next)
+			if (value->next)
 			{
-				(*value)->parent->child = (*value)->next;	/* the parent node always points to the first node in the children linked list */
+				value->parent->child = value->next;	/* the parent node always points to the first node in the children linked list */
 			}
 			else
 			{
-				(*value)->parent->child = NULL;
+				value->parent->child = NULL;
 			}
 		}
 
 		/* fix the tree connection to the last node in the children's list */
-		if ((*value)->parent->child_end == (*value))
+		if (value->parent->child_end == value)
 		{
-			if ((*value)->previous)
+			if (value->previous)
 			{
-				(*value)->parent->child_end = (*value)->previous;	/* the parent node always points to the last node in the children linked list */
+				value->parent->child_end = value->previous;	/* the parent node always points to the last node in the children linked list */
 			}
 			else
 			{
-				(*value)->parent->child_end = NULL;
+				value->parent->child_end = NULL;
 			}
 		}
 	}
+}
+
+
+static void
+intern_json_free_value (json_t ** value)
+{
+	assert (value != NULL);
+	assert ((*value) != NULL);
+	assert ((*value)->child == NULL);
+
+	json_unlink (*value);
 
 	/*finally, freeing the memory allocated for this value */
+	json_index_free (&(*value)->index);
+	if ((*value)->flags & JSON_FLAG_ARENA)
+	{
+		(*value) = NULL;	/* the node and its text go away with the arena */
+		return;
+	}
 	if ((*value)->text != NULL)
 	{
 		free ((*value)->text);
@@ -435,6 +1100,8 @@ json_free_value (json_t ** value)
 
 		if (cursor->child)
 		{
+			/* the whole container goes away, so its index isn't kept up to date child by child */
+			json_index_free (&cursor->index);
 			cursor = cursor->child;
 			continue;
 		}
@@ -451,15 +1118,13 @@ json_free_value (json_t ** value)
 }
 
 
-enum json_error
-json_insert_child (json_t * parent, json_t * child)
+/**
+Enforces the tree structure: what kinds of nodes a node of each type may hold as children
+@return JSON_OK or JSON_BAD_TREE_STRUCTURE
+**/
+static enum json_error
+json_check_child (const json_t * parent, const json_t * child)
 {
-	/*TODO change the child list from FIFO to LIFO, in order to get rid of the child_end pointer */
-	assert (parent != NULL);	/* the parent must exist */
-	assert (child != NULL);	/* the child must exist */
-	assert (parent != child);	/* parent and child must not be the same. if they are, it will enter an infinite loop */
-
-	/* enforce tree structure correctness */
 	switch (parent->type)
 	{
 	case JSON_STRING:
@@ -516,6 +1181,47 @@ json_insert_child (json_t * parent, json_t * child)
 		return JSON_BAD_TREE_STRUCTURE;
 	}
 
+	return JSON_OK;
+}
+
+
+void
+json_detach (json_t * node)
+{
+	assert (node != NULL);
+
+	json_unlink (node);
+	node->parent = NULL;
+	node->previous = NULL;
+	node->next = NULL;
+}
+
+
+enum json_error
+json_insert_child (json_t * parent, json_t * child)
+{
+	enum json_error error;
+
+	/*TODO change the child list from FIFO to LIFO, in order to get rid of the child_end pointer */
+	assert (parent != NULL);	/* the parent must exist */
+	assert (child != NULL);	/* the child must exist */
+	assert (parent != child);	/* parent and child must not be the same. if they are, it will enter an infinite loop */
+
+	/* enforce tree structure correctness */
+	if ((error = json_check_child (parent, child)) != JSON_OK)
+		return error;
+	if (parent->type == JSON_OBJECT)
+		json_keep_label_hash (child);
+
+	if (parent->index != NULL)
+	{
+		if (((parent->type == JSON_ARRAY) ? json_index_append (parent->index, child) : json_index_insert (parent->index, child)) != JSON_OK)
+		{
+			json_index_free (&parent->index);	/* lookups fall back to walking the children */
+		}
+	}
+
+	json_forget_digests (parent);
 	child->parent = parent;
 	if (parent->child)
 	{
@@ -533,6 +1239,44 @@ json_insert_child (json_t * parent, json_t * child)
 }
 
 
+enum json_error
+json_insert_child_before (json_t * sibling, json_t * child)
+{
+	enum json_error error;
+	json_t *parent;
+
+	assert (sibling != NULL);
+	assert (sibling->parent != NULL);
+	assert (child != NULL);
+	assert (sibling != child);
+
+	parent = sibling->parent;
+	if ((error = json_check_child (parent, child)) != JSON_OK)
+		return error;
+	if (parent->type == JSON_OBJECT)
+		json_keep_label_hash (child);
+
+	if (parent->index != NULL)
+	{
+		/* an element vector can't take the shift of the positions cheaply, so arrays rebuild it on demand */
+		if ((parent->type == JSON_ARRAY) || (json_index_insert (parent->index, child) != JSON_OK))
+			json_index_free (&parent->index);
+	}
+
+	json_forget_digests (parent);
+	child->parent = parent;
+	child->next = sibling;
+	child->previous = sibling->previous;
+	if (sibling->previous != NULL)
+		sibling->previous->next = child;
+	else
+		parent->child = child;
+	sibling->previous = child;
+
+	return JSON_OK;
+}
+
+
 enum json_error
 json_insert_pair_into_object (json_t * parent, const char *text_label, json_t * value)
 {
@@ -600,7 +1344,14 @@ json_tree_to_string (json_t * root, char **text)
 			{
 				return JSON_MEMORY;
 			}
-			if (rcs_catcs (output, cursor->text, strlen (cursor->text)) != RS_OK)
+			if (cursor->flags & JSON_FLAG_NEEDS_ESCAPING)
+			{
+				if (rcs_catescaped (output, cursor->text) != RS_OK)
+				{
+					return JSON_MEMORY;
+				}
+			}
+			else if (rcs_catcs (output, cursor->text, strlen (cursor->text)) != RS_OK)
 			{
 				return JSON_MEMORY;
 			}
@@ -820,7 +1571,20 @@ json_stream_output (FILE * file, json_t * root)
 		case JSON_STRING:
 			/* append the "text"\0, which means 1 + wcslen(cursor->text) + 1 + 1 */
 			/* set the new output size */
-			fprintf (file, "\"%s\"", cursor->text);
+			if (cursor->flags & JSON_FLAG_NEEDS_ESCAPING)
+			{
+				char *escaped = json_escape (cursor->text);
+				if (escaped == NULL)
+				{
+					return JSON_MEMORY;
+				}
+				fprintf (file, "\"%s\"", escaped);
+				free (escaped);
+			}
+			else
+			{
+				fprintf (file, "\"%s\"", cursor->text);
+			}
 
 			if (cursor->parent != NULL)
 			{
@@ -977,59 +1741,320 @@ json_stream_output (FILE * file, json_t * root)
 }
 
 
-void
-json_strip_white_spaces (char *text)
+/**
+Starts a new line indented to a nesting level
+@param output the text being written
+@param indentation the indentation
+@param depth the nesting level
+@return RS_OK or RS_MEMORY
+**/
+static rstring_code
+json_formatted_line (rcstring * output, const struct json_indentation *indentation, size_t depth)
 {
-	size_t in, out, length;
-	int state;
+	char run[64];
+	size_t count = depth * indentation->width, length;
 
-	assert (text != NULL);
+	if (rcs_catc (output, '\n') != RS_OK)
+		return RS_MEMORY;
+	memset (run, indentation->character, sizeof (run));
+	for (; count > 0; count -= length)
+	{
+		length = (count < sizeof (run)) ? count : sizeof (run);
+		if (rcs_catcs (output, run, length) != RS_OK)
+			return RS_MEMORY;
+	}
+	return RS_OK;
+}
+
+
+/**
+Writes a document tree with indentation in a single walk, laid out as json_format_chunk() lays out text
+@param root the root of the tree
+@param indentation the indentation, or NULL for a tab per nesting level
+@param output receives the text
+@param file if not NULL, a stream into which output is emptied whenever it fills up
+@return JSON_OK, JSON_BAD_TREE_STRUCTURE, JSON_MEMORY or JSON_UNKNOWN_PROBLEM if file could not be written
+**/
+static enum json_error
+json_formatted_output (const json_t * root, const struct json_indentation *indentation, rcstring * output, FILE * file)
+{
+	const struct json_indentation tabs = { '\t', 1 };
+	const json_t *node = root;
+	size_t depth = 0;
+	rstring_code status = RS_OK;
 
-	in = 0;
-	out = 0;
-	length = strlen (text);
-	state = 0;		/* possible states: 0 -> document, 1 -> inside a string */
+	if (indentation == NULL)
+		indentation = &tabs;
 
-	while (in < length)
+	for (;;)
 	{
-		switch (text[in])
+		/* write the value at node, going down to the first child of containers and labels */
+		switch (node->type)
 		{
-		case '\x20':	/* space */
-		case '\x09':	/* horizontal tab */
-		case '\x0A':	/* line feed or new line */
-		case '\x0D':	/* Carriage return */
-			if (state == 1)
+		case JSON_STRING:
+			status = rcs_catc (output, '\"');
+			if (status == RS_OK)
+				status = (node->flags & JSON_FLAG_NEEDS_ESCAPING) ? rcs_catescaped (output, node->text) : rcs_catcs (output, node->text, strlen (node->text));
+			if (status == RS_OK)
+				status = rcs_catc (output, '\"');
+			if (((node->parent != NULL) && (node->parent->type == JSON_OBJECT)) || ((node == root) && (node->child != NULL)))
+			{
+				/* a label, whose value follows on the same line */
+				if ((node->child == NULL) || (node->child->next != NULL))
+					return JSON_BAD_TREE_STRUCTURE;
+				if ((status == RS_OK) && ((status = rcs_catc (output, ':')) == RS_OK))
+					status = rcs_catc (output, ' ');
+				node = node->child;
+				if (status != RS_OK)
+					return JSON_MEMORY;
+				continue;
+			}
+			if (node->child != NULL)
+				return JSON_BAD_TREE_STRUCTURE;
+			break;
+		case JSON_NUMBER:
+			status = rcs_catcs (output, node->text, strlen (node->text));
+			break;
+		case JSON_TRUE:
+			status = rcs_catcs (output, "true", 4);
+			break;
+		case JSON_FALSE:
+			status = rcs_catcs (output, "false", 5);
+			break;
+		case JSON_NULL:
+			status = rcs_catcs (output, "null", 4);
+			break;
+		case JSON_OBJECT:
+		case JSON_ARRAY:
+			status = rcs_catc (output, (node->type == JSON_OBJECT) ? '{' : '[');
+			if (node->child != NULL)
 			{
-				text[out++] = text[in];
+				if (status == RS_OK)
+					status = json_formatted_line (output, indentation, ++depth);
+				node = node->child;
+				if (status != RS_OK)
+					return JSON_MEMORY;
+				continue;
 			}
+			if (status == RS_OK)
+				status = rcs_catc (output, (node->type == JSON_OBJECT) ? '}' : ']');
 			break;
+		default:
+			return JSON_BAD_TREE_STRUCTURE;
+		}
+		if (status != RS_OK)
+			return JSON_MEMORY;
 
-		case '\"':
-			switch (state)
+		/* close the containers which are done, up to the next sibling */
+		while ((node != root) && (node->next == NULL))
+		{
+			node = node->parent;
+			if ((node->type == JSON_OBJECT) || (node->type == JSON_ARRAY))
 			{
-			case 0:	/* not inside a JSON string */
-				state = 1;
-				break;
+				if ((json_formatted_line (output, indentation, --depth) != RS_OK) || (rcs_catc (output, (node->type == JSON_OBJECT) ? '}' : ']') != RS_OK))
+					return JSON_MEMORY;
+			}
+		}
+		if ((file != NULL) && (output->length >= 4096))
+		{
+			if (fwrite (output->text, 1, output->length, file) != output->length)
+				return JSON_UNKNOWN_PROBLEM;
+			output->length = 0;
+		}
+		if (node == root)
+			return JSON_OK;
 
-			case 1:	/* inside a JSON string */
-				if (text[in - 1] != '\\')
-				{
-					state = 0;
-				}
-				break;
+		if ((rcs_catc (output, ',') != RS_OK) || (json_formatted_line (output, indentation, depth) != RS_OK))
+			return JSON_MEMORY;
+		node = node->next;
+	}
+}
 
-			default:
-				assert (0);
-			}
-			text[out++] = text[in];
-			break;
 
-		default:
-			text[out++] = text[in];
+enum json_error
+json_tree_to_formatted_string (const json_t * root, char **text, const struct json_indentation *indentation)
+{
+	rcstring *output;
+	enum json_error error;
+
+	assert (root != NULL);
+	assert (text != NULL);
+
+	if ((output = rcs_create (RSTRING_DEFAULT)) == NULL)
+		return JSON_MEMORY;
+	if ((error = json_formatted_output (root, indentation, output, NULL)) != JSON_OK)
+	{
+		rcs_free (&output);
+		return error;
+	}
+	*text = rcs_unwrap (output);
+	return JSON_OK;
+}
+
+
+enum json_error
+json_stream_output_formatted (FILE * file, const json_t * root, const struct json_indentation *indentation)
+{
+	rcstring *output;
+	enum json_error error;
+
+	assert (file != NULL);
+	assert (root != NULL);
+
+	if ((output = rcs_create (RSTRING_DEFAULT)) == NULL)
+		return JSON_MEMORY;
+	error = json_formatted_output (root, indentation, output, file);
+	if ((error == JSON_OK) && ((fwrite (output->text, 1, output->length, file) != output->length) || (fputc ('\n', file) == EOF)))
+		error = JSON_UNKNOWN_PROBLEM;
+	rcs_free (&output);
+	return error;
+}
+
+
+/**
+Finds the quotes, reverse solidi and white spaces among 64 bytes of text
+@param block the 64 bytes
+@param quote receives a bit per quote, the lowest for the first byte
+@param reverse_solidus receives a bit per reverse solidus
+@param blank receives a bit per white space
+**/
+static void
+json_minify_classify (const char *block, uint64_t * quote, uint64_t * reverse_solidus, uint64_t * blank)
+{
+	int i;
+
+#if defined(__SSE2__) && defined(__GNUC__)
+	const __m128i quotes = _mm_set1_epi8 ('\"');
+	const __m128i reverse_solidi = _mm_set1_epi8 ('\\');
+	const __m128i spaces = _mm_set1_epi8 ('\x20');
+	const __m128i tabs = _mm_set1_epi8 ('\x09');
+	const __m128i line_feeds = _mm_set1_epi8 ('\x0A');
+	const __m128i carriage_returns = _mm_set1_epi8 ('\x0D');
+
+	*quote = *reverse_solidus = *blank = 0;
+	for (i = 0; i < 64; i += 16)
+	{
+		__m128i chunk, blanks;
+
+		chunk = _mm_loadu_si128 ((const __m128i *) (block + i));
+		blanks = _mm_or_si128 (_mm_cmpeq_epi8 (chunk, spaces), _mm_cmpeq_epi8 (chunk, tabs));
+		blanks = _mm_or_si128 (blanks, _mm_or_si128 (_mm_cmpeq_epi8 (chunk, line_feeds), _mm_cmpeq_epi8 (chunk, carriage_returns)));
+		*quote |= (uint64_t) (uint16_t) _mm_movemask_epi8 (_mm_cmpeq_epi8 (chunk, quotes)) << i;
+		*reverse_solidus |= (uint64_t) (uint16_t) _mm_movemask_epi8 (_mm_cmpeq_epi8 (chunk, reverse_solidi)) << i;
+		*blank |= (uint64_t) (uint16_t) _mm_movemask_epi8 (blanks) << i;
+	}
+#else
+	*quote = *reverse_solidus = *blank = 0;
+	for (i = 0; i < 64; i++)
+	{
+		char c = block[i];
+
+		*quote |= (uint64_t) (c == '\"') << i;
+		*reverse_solidus |= (uint64_t) (c == '\\') << i;
+		*blank |= (uint64_t) ((c == '\x20') || (c == '\x09') || (c == '\x0A') || (c == '\x0D')) << i;
+	}
+#endif
+}
+
+
+/**
+Strips the white spaces from 64 bytes of text, a word of bit masks at a time: the escaped bytes follow from the runs of reverse solidi, the strings from a running parity of the unescaped quotes, and the bytes kept are all but the white spaces found neither escaped nor within a string
+@param minifier the state left by the previous bytes, which is updated
+@param block the 64 bytes
+@param output receives the bytes kept. It may overlap block, as long as it doesn't start past it
+@return the number of bytes written to output
+**/
+static size_t
+json_minify_block (struct json_minifier *minifier, const char *block, char *output)
+{
+	const uint64_t even = 0x5555555555555555ULL;
+	uint64_t quote, reverse_solidus, blank, escaped, follows, starts, runs, string, keep, group;
+	char copy[64];
+	size_t out = 0;
+	int i, j;
+
+	memcpy (copy, block, sizeof (copy));	/* output may overwrite block */
+	json_minify_classify (copy, &quote, &reverse_solidus, &blank);
+
+	/* a run of reverse solidi escapes the byte after it when it is of odd length */
+	reverse_solidus &= ~(uint64_t) minifier->escaped;
+	follows = (reverse_solidus << 1) | (uint64_t) minifier->escaped;
+	starts = reverse_solidus & ~even & ~follows;
+	runs = starts + reverse_solidus;
+	minifier->escaped = runs < starts;	/* the run carried out of the last byte */
+	escaped = (even ^ (runs << 1)) & follows;
+
+	/* a prefix parity of the quotes, which sets the bits from an opening quote up to its closing one */
+	string = quote & ~escaped;
+	string ^= string << 1;
+	string ^= string << 2;
+	string ^= string << 4;
+	string ^= string << 8;
+	string ^= string << 16;
+	string ^= string << 32;
+	if (minifier->in_string)
+		string = ~string;
+	minifier->in_string = (int) (string >> 63);
+
+	keep = ~(blank & ~string & ~escaped);
+	for (i = 0; i < 64; i += 8)
+	{
+		group = (keep >> i) & 0xFF;
+		if (group == 0xFF)
+		{
+			memcpy (output + out, copy + i, 8);
+			out += 8;
 		}
-		++in;
+		else
+			for (j = 0; j < 8; j++)
+			{
+				output[out] = copy[i + j];
+				out += (group >> j) & 1;
+			}
+	}
+	return out;
+}
+
+
+size_t
+json_minify (struct json_minifier *minifier, const char *input, size_t length, char *output)
+{
+	size_t in = 0, out = 0;
+
+	assert (minifier != NULL);
+	assert ((input != NULL) || (length == 0));
+	assert ((output != NULL) || (length == 0));
+
+	for (; in + 64 <= length; in += 64)
+		out += json_minify_block (minifier, input + in, output + out);
+
+	/* the bytes left over, one at a time, as json_minify_block() would take them */
+	for (; in < length; in++)
+	{
+		char c = input[in];
+
+		if (minifier->escaped)
+			minifier->escaped = 0;
+		else if (c == '\\')
+			minifier->escaped = 1;
+		else if (c == '\"')
+			minifier->in_string = !minifier->in_string;
+		else if (!minifier->in_string && ((c == '\x20') || (c == '\x09') || (c == '\x0A') || (c == '\x0D')))
+			continue;
+		output[out++] = c;
 	}
-	text[out] = '\0';
+	return out;
+}
+
+
+void
+json_strip_white_spaces (char *text)
+{
+	struct json_minifier minifier = { 0, 0 };
+
+	assert (text != NULL);
+
+	text[json_minify (&minifier, text, strlen (text), text)] = '\0';
 }
 
 
@@ -1132,84 +2157,294 @@ json_format_string (const char *text)
 	return rcs_unwrap (output);
 }
 
+void
+json_formatter_init (struct json_formatter *formatter, const struct json_indentation *indentation)
+{
+	assert (formatter != NULL);
+
+	memset (formatter, 0, sizeof (struct json_formatter));
+	if (indentation != NULL)
+		formatter->indentation = *indentation;
+	else
+	{
+		formatter->indentation.character = '\t';
+		formatter->indentation.width = 1;
+	}
+}
+
 
-char *
-json_escape (const char *text)
+size_t
+json_format_chunk (struct json_formatter *formatter, const char *input, size_t length, size_t * used, char *output, size_t size)
 {
-	rcstring *output;
-	size_t i, length;
-	char buffer[7];
-	/* check if pre-conditions are met */
-	assert (text != NULL);
+	size_t in = 0, out = 0, run;
+	char c;
 
-	/* defining the temporary variables */
-	length = strlen (text);
-	output = rcs_create (length);
-	if (output == NULL)
-		return NULL;
-	for (i = 0; i < length; i++)
+	assert (formatter != NULL);
+	assert ((input != NULL) || (length == 0));
+	assert (used != NULL);
+	assert (output != NULL);
+	assert (size >= 2);	/* room for the longest piece written at once */
+
+	for (;;)
 	{
-		if (text[i] == '\\')
-		{
-			rcs_catcs (output, "\\\\", 2);
-		}
-		else if (text[i] == '\"')
-		{
-			rcs_catcs (output, "\\\"", 2);
-		}
-		else if (text[i] == '/')
-		{
-			rcs_catcs (output, "\\/", 2);
-		}
-		else if (text[i] == '\b')
-		{
-			rcs_catcs (output, "\\b", 2);
-		}
-		else if (text[i] == '\f')
-		{
-			rcs_catcs (output, "\\f", 2);
-		}
-		else if (text[i] == '\n')
+		/* what the last byte left to write comes first */
+		run = (formatter->pending < size - out) ? formatter->pending : size - out;
+		memset (output + out, formatter->indentation.character, run);
+		out += run;
+		formatter->pending -= run;
+		if (formatter->pending > 0)
+			break;
+		if (formatter->closing != '\0')
 		{
-			rcs_catcs (output, "\\n", 2);
+			if (out == size)
+				break;
+			output[out++] = formatter->closing;
+			formatter->closing = '\0';
 		}
-		else if (text[i] == '\r')
+		if ((in == length) || (size - out < 2))
+			break;
+
+		if (formatter->escaped)
 		{
-			rcs_catcs (output, "\\r", 2);
+			output[out++] = input[in++];
+			formatter->escaped = 0;
+			continue;
 		}
-		else if (text[i] == '\t')
+		if (formatter->in_string)
 		{
-			rcs_catcs (output, "\\t", 2);
+			run = json_string_span (input + in, (length - in < size - out) ? length - in : size - out);
+			memcpy (output + out, input + in, run);
+			in += run;
+			out += run;
+			if ((in == length) || (out == size))
+				continue;
+			c = input[in++];
+			if (c == '\\')
+				formatter->escaped = 1;
+			else if (c == '\"')
+				formatter->in_string = 0;
+			output[out++] = c;
+			continue;
 		}
-		else if (text[i] < 0)	/* non-BMP character */
+
+		c = input[in];
+		if ((c == '\x20') || (c == '\x09') || (c == '\x0A') || (c == '\x0D'))
 		{
-			rcs_catc (output, text[i]);
+			in++;
+			continue;
 		}
-		else if (text[i] < 0x20)
+		if (formatter->opened)
 		{
-			sprintf (buffer, "\\u%4.4x", text[i]);
-			rcs_catcs (output, buffer, 6);
+			/* an empty container stays on its line, otherwise its first value starts the next one */
+			formatter->opened = 0;
+			if ((c == '}') || (c == ']'))
+			{
+				formatter->depth--;
+				output[out++] = c;
+				in++;
+				continue;
+			}
+			output[out++] = '\n';
+			formatter->pending = formatter->depth * formatter->indentation.width;
+			continue;
 		}
-		else
+
+		in++;
+		switch (c)
 		{
-			rcs_catc (output, text[i]);
+		case '{':
+		case '[':
+			formatter->depth++;
+			formatter->opened = 1;
+			output[out++] = c;
+			break;
+
+		case '}':
+		case ']':
+			if (formatter->depth > 0)
+				formatter->depth--;
+			output[out++] = '\n';
+			formatter->pending = formatter->depth * formatter->indentation.width;
+			formatter->closing = c;
+			break;
+
+		case ',':
+			output[out++] = ',';
+			output[out++] = '\n';
+			formatter->pending = formatter->depth * formatter->indentation.width;
+			break;
+
+		case ':':
+			output[out++] = ':';
+			output[out++] = ' ';
+			break;
+
+		case '\"':
+			formatter->in_string = 1;
+			output[out++] = c;
+			break;
+
+		default:
+			output[out++] = c;
 		}
 	}
-	return rcs_unwrap (output);
+
+	*used = in;
+	return out;
 }
 
 
-char *
-json_unescape (const char *text)
+enum json_error
+json_format_stream (FILE * input, FILE * output, const struct json_indentation *indentation)
 {
-	char *result = (char *)malloc (strlen (text) + 1);
+	struct json_formatter formatter;
+	char in[4096], out[4096];
+	size_t length, used, offset, written;
+
+	assert (input != NULL);
+	assert (output != NULL);
+
+	json_formatter_init (&formatter, indentation);
+	do
+	{
+		length = fread (in, 1, sizeof (in), input);
+		if (ferror (input))
+			return JSON_UNKNOWN_PROBLEM;
+
+		/* an empty chunk flushes what the formatter still holds */
+		offset = 0;
+		do
+		{
+			written = json_format_chunk (&formatter, in + offset, length - offset, &used, out, sizeof (out));
+			offset += used;
+			if (fwrite (out, 1, written, output) != written)
+				return JSON_UNKNOWN_PROBLEM;
+		}
+		while ((offset < length) || (written == sizeof (out)));
+	}
+	while (length > 0);
+
+	if (fputc ('\n', output) == EOF)
+		return JSON_UNKNOWN_PROBLEM;
+	if ((formatter.depth > 0) || formatter.in_string)
+		return JSON_INCOMPLETE_DOCUMENT;
+	return JSON_OK;
+}
+
+
+/**
+Writes a whole buffer to a file descriptor
+@param descriptor the file descriptor
+@param buffer the bytes to write
+@param length the number of bytes in buffer
+@return 1 if all were written, 0 otherwise
+**/
+static int
+json_write_all (int descriptor, const char *buffer, size_t length)
+{
+	ssize_t written;
+
+	while (length > 0)
+	{
+		if ((written = write (descriptor, buffer, length)) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		buffer += written;
+		length -= (size_t) written;
+	}
+	return 1;
+}
+
+
+enum json_error
+json_format_descriptor (int input, int output, const struct json_indentation *indentation)
+{
+	struct json_formatter formatter;
+	char in[4096], out[4096];
+	size_t used, offset, written;
+	ssize_t length;
+
+	json_formatter_init (&formatter, indentation);
+	do
+	{
+		if ((length = read (input, in, sizeof (in))) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return JSON_UNKNOWN_PROBLEM;
+		}
+
+		/* an empty chunk flushes what the formatter still holds */
+		offset = 0;
+		do
+		{
+			written = json_format_chunk (&formatter, in + offset, (size_t) length - offset, &used, out, sizeof (out));
+			offset += used;
+			if (!json_write_all (output, out, written))
+				return JSON_UNKNOWN_PROBLEM;
+		}
+		while ((offset < (size_t) length) || (written == sizeof (out)));
+	}
+	while (length != 0);
+
+	if (!json_write_all (output, "\n", 1))
+		return JSON_UNKNOWN_PROBLEM;
+	if ((formatter.depth > 0) || formatter.in_string)
+		return JSON_INCOMPLETE_DOCUMENT;
+	return JSON_OK;
+}
+
+
+char *
+json_escape (const char *text)
+{
+	rcstring *output;
+	/* check if pre-conditions are met */
+	assert (text != NULL);
+
+	/* defining the temporary variables */
+	output = rcs_create (strlen (text));
+	if (output == NULL)
+		return NULL;
+	if (rcs_catescaped (output, text) != RS_OK)
+	{
+		rcs_free (&output);
+		return NULL;
+	}
+	return rcs_unwrap (output);
+}
+
+
+char *
+json_unescape (const char *text)
+{
+	char *result;
 	size_t r;		/* read cursor */
 	size_t w;		/* write cursor */
+	size_t run;
 
 	assert (text);
 
+	result = (char *)malloc (strlen (text) + 1);
+	if (result == NULL)
+		return NULL;
+
 	for (r = w = 0; text[r]; r++)
 	{
+		/* copy everything up to the next escape sequence in one go */
+		run = json_cstring_span (text + r, '\\');
+		if (run > 0)
+		{
+			memcpy (result + w, text + r, run);
+			r += run;
+			w += run;
+			if (text[r] == '\0')
+				break;
+		}
+
 		switch (text[r])
 		{
 		case '\\':
@@ -1366,12 +2601,16 @@ json_jpi_init (struct json_parsing_info *jpi)
 	jpi->cursor = NULL;
 	jpi->line = 1;
 	jpi->string_length_limit_reached = 0;
+	jpi->validate_utf8 = 0;
+	jpi->index_arrays = 0;
 }
 
 
 int
-lexer (const char *buffer, const char **p, unsigned int *state, rcstring ** text, size_t *line)
+lexer (const char *buffer, const char **p, unsigned int *state, rcstring ** text, size_t *line, int validate_utf8)
 {
+	size_t run;
+
 	assert (buffer != NULL);
 	assert (p != NULL);
 	assert (state != NULL);
@@ -1475,6 +2714,16 @@ lexer (const char *buffer, const char **p, unsigned int *state, rcstring ** text
 		case 1:	/* inside a JSON string */
 			{
 				assert (*text != NULL);
+				/* copy the run of plain characters up to the next quote, escape sequence or control character in one go */
+				run = json_cstring_span (*p, '\"');
+				if (run > 0)
+				{
+					if (rcs_catcs (*text, *p, run) != RS_OK)
+						return LEX_MEMORY;
+					*p += run;
+					if (**p == '\0')
+						break;	/* the string continues in the next fragment */
+				}
 				switch (**p)
 				{
 				case 1:
@@ -1514,6 +2763,11 @@ lexer (const char *buffer, const char **p, unsigned int *state, rcstring ** text
 
 				case '\"':	/* close JSON string */
 					/* it is expected that, in the routine that calls this function, text is set to NULL */
+					if (validate_utf8 && !json_utf8_valid ((*text)->text, (*text)->length))
+					{
+						rcs_free (text);
+						return LEX_INVALID_CHARACTER;
+					}
 					*state = 0;
 					++*p;
 					return LEX_STRING;
@@ -2147,12 +3401,16 @@ json_parse_fragment (struct json_parsing_info *info, const char *buffer)
 		{
 		case 0:	/* starting point */
 			{
-				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line))
+				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line, info->validate_utf8))
 				{
 				case LEX_BEGIN_OBJECT:
 					info->state = 1;	/* begin object */
 					break;
 
+				case LEX_BEGIN_ARRAY:
+					info->state = 7;	/* open array */
+					break;
+
 				case LEX_INVALID_CHARACTER:
 					return JSON_MALFORMED_DOCUMENT;
 					break;
@@ -2200,11 +3458,13 @@ json_parse_fragment (struct json_parsing_info *info, const char *buffer)
 				assert (info->cursor != NULL);
 				assert (info->cursor->type == JSON_OBJECT);
 
-				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line))
+				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line, info->validate_utf8))
 				{
 				case LEX_STRING:
 					if ((temp = json_new_value (JSON_STRING)) == NULL)
 						return JSON_MEMORY;
+					temp->hash = json_hash_label_text (info->lex_text->text, info->lex_text->length, 0);
+					temp->flags |= JSON_FLAG_HASHED;
 					temp->text = rcs_unwrap (info->lex_text), info->lex_text = NULL;
 					if (json_insert_child (info->cursor, temp) != JSON_OK)
 					{
@@ -2270,7 +3530,7 @@ json_parse_fragment (struct json_parsing_info *info, const char *buffer)
 				assert (info->cursor != NULL);
 				assert (info->cursor->type == JSON_OBJECT);
 
-				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line))
+				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line, info->validate_utf8))
 				{
 				case LEX_VALUE_SEPARATOR:
 					info->state = 4;	/* sibling, post-object */
@@ -2328,11 +3588,13 @@ json_parse_fragment (struct json_parsing_info *info, const char *buffer)
 				assert (info->cursor != NULL);
 				assert (info->cursor->type == JSON_OBJECT);
 
-				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line))
+				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line, info->validate_utf8))
 				{
 				case LEX_STRING:
 					if ((temp = json_new_value (JSON_STRING)) == NULL)
 						return JSON_MEMORY;
+					temp->hash = json_hash_label_text (info->lex_text->text, info->lex_text->length, 0);
+					temp->flags |= JSON_FLAG_HASHED;
 					temp->text = rcs_unwrap (info->lex_text), info->lex_text = NULL;
 					if (json_insert_child (info->cursor, temp) != JSON_OK)
 					{
@@ -2365,7 +3627,7 @@ json_parse_fragment (struct json_parsing_info *info, const char *buffer)
 				assert (info->cursor != NULL);
 				assert (info->cursor->type == JSON_STRING);
 
-				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line))
+				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line, info->validate_utf8))
 				{
 				case LEX_NAME_SEPARATOR:
 					info->state = 6;	/* label, pos label:value separator */
@@ -2389,7 +3651,7 @@ json_parse_fragment (struct json_parsing_info *info, const char *buffer)
 				assert (info->cursor != NULL);
 				assert (info->cursor->type == JSON_STRING);
 
-				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line))
+				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line, info->validate_utf8))
 				{
 				case LEX_STRING:
 					if ((temp = json_new_value (JSON_STRING)) == NULL)
@@ -2546,6 +3808,13 @@ json_parse_fragment (struct json_parsing_info *info, const char *buffer)
 					info->cursor = temp;
 					temp = NULL;
 				}
+				if (info->index_arrays)
+				{
+					if (json_build_index (info->cursor) != JSON_OK)
+					{
+						return JSON_MEMORY;
+					}
+				}
 				info->state = 8;	/* just entered an array */
 			}
 			break;
@@ -2556,7 +3825,7 @@ json_parse_fragment (struct json_parsing_info *info, const char *buffer)
 				assert (info->cursor != NULL);
 				assert (info->cursor->type == JSON_ARRAY);
 
-				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line))
+				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line, info->validate_utf8))
 				{
 				case LEX_STRING:
 					if ((temp = json_new_value (JSON_STRING)) == NULL)
@@ -2676,7 +3945,7 @@ json_parse_fragment (struct json_parsing_info *info, const char *buffer)
 			{
 				/*TODO perform tree sanity checks */
 				assert (info->cursor != NULL);
-				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line))
+				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line, info->validate_utf8))
 				{
 				case LEX_VALUE_SEPARATOR:
 					info->state = 8;
@@ -2737,7 +4006,7 @@ json_parse_fragment (struct json_parsing_info *info, const char *buffer)
 			{
 				/* perform tree sanity check */
 				assert (info->cursor->parent == NULL);
-				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line))
+				switch (lexer (buffer, &info->p, &info->lex_state, &info->lex_text, &info->line, info->validate_utf8))
 				{
 				case LEX_MORE:
 					return JSON_WAITING_FOR_EOF;
@@ -2801,385 +4070,583 @@ json_parse_document (json_t ** root, const char *text)
 }
 
 
-enum json_error
-json_saxy_parse (struct json_saxy_parser_status *jsps, struct json_saxy_functions *jsf, char c)
-{
-	/* make sure everything is in it's place */
-	assert (jsps != NULL);
-	assert (jsf != NULL);
-
-	/* goto where we left off */
-	switch (jsps->state)
-	{
-	case 0:		/* general state. everything goes. */
-		goto state0;
-		break;
-	case 1:		/* parse string */
-		goto state1;
-		break;
-	case 2:		/* parse string: escaped character */
-		goto state2;
-		break;
-	case 3:		/* parse string: escaped unicode 1 */
-		goto state3;
-		break;
-	case 4:		/* parse string: escaped unicode 2 */
-		goto state4;
-		break;
-	case 5:		/* parse string: escaped unicode 3 */
-		goto state5;
-		break;
-	case 6:		/* parse string: escaped unicode 4 */
-		goto state6;
-		break;
-	case 7:		/* parse true: tr */
-		goto state7;
-		break;
-	case 8:		/* parse true: tru */
-		goto state8;
-		break;
-	case 9:		/* parse true: true */
-		goto state9;
-		break;
-	case 10:		/* parse false: fa */
-		goto state10;
-		break;
-	case 11:		/* parse false: fal */
-		goto state11;
-		break;
-	case 12:		/* parse false: fals */
-		goto state12;
-		break;
-	case 13:		/* parse false: false */
-		goto state13;
-		break;
-	case 14:		/* parse null: nu */
-		goto state14;
-		break;
-	case 15:		/* parse null: nul */
-		goto state15;
-		break;
-	case 16:		/* parse null: null */
-		goto state16;
-		break;
-	case 17:		/* parse number: 0 */
-		goto state17;
-		break;
-	case 18:		/* parse number: start fraccional part */
-		goto state18;
-		break;
-	case 19:		/* parse number: fraccional part */
-		goto state19;
-		break;
-	case 20:		/* parse number: start exponent part */
-		goto state20;
-		break;
-	case 21:		/* parse number: exponent part */
-		goto state21;
-		break;
-	case 22:		/* parse number: exponent sign part */
-		goto state22;
-		break;
-	case 23:		/* parse number: start negative */
-		goto state23;
-		break;
-	case 24:		/* parse number: decimal part */
-		goto state24;
-		break;
-	case 25:		/* open object */
-		goto state25;
-		break;
-	case 26:		/* close object/array */
-		goto state26;
-		break;
-	case 27:		/* sibling followup */
-		goto state27;
-		break;
+/* the number of container nesting levels json_validate() tracks without touching the heap */
+#define JSON_VALIDATE_DEPTH 4096
 
-	default:		/* oops... this should never be reached */
-		return JSON_UNKNOWN_PROBLEM;
-	}
 
-      state0:			/* starting point */
+size_t
+json_validate_white_spaces (const char *buffer, size_t length, size_t pos)
+{
+	while (pos < length)
 	{
-		switch (c)
+		switch (buffer[pos])
 		{
-		case '\x20':
-		case '\x09':
-		case '\x0A':
-		case '\x0D':	/* JSON insignificant white spaces */
+		case '\x20':	/* space */
+		case '\x09':	/* horizontal tab */
+		case '\x0A':	/* line feed or new line */
+		case '\x0D':	/* Carriage return */
+			pos++;
 			break;
 
-		case '\"':	/* starting a string */
-			jsps->string_length_limit_reached = 0;
-			jsps->state = 1;
-			break;
+		default:
+			return pos;
+		}
+	}
+	return pos;
+}
 
-		case '{':
-			if (jsf->open_object != NULL)
-				jsf->open_object ();
-			jsps->state = 25;	/*open object */
-			break;
 
-		case '}':
-			if (jsf->close_object != NULL)
-				jsf->close_object ();
-			jsps->state = 26;	/* close object/array */
-			break;
+static int
+json_is_hex_digit (const char c)
+{
+	return ((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'f')) || ((c >= 'A') && (c <= 'F'));
+}
 
-		case '[':
-			if (jsf->open_array != NULL)
-				jsf->open_array ();
-/*                      jsps->state = 0;        // redundant*/
-			break;
 
-		case ']':
-			if (jsf->close_array != NULL)
-				jsf->close_array ();
-			jsps->state = 26;	/* close object/array */
-			break;
+enum json_error
+json_validate_string (const char *buffer, size_t length, size_t * pos)
+{
+	size_t i = *pos + 1;	/* skip the opening quote */
+	size_t digit;
 
-		case 't':
-			jsps->state = 7;	/* parse true: tr */
-			break;
+	for (;;)
+	{
+		i += json_string_span (buffer + i, length - i);
+		if (i == length)
+		{
+			*pos = i;
+			return JSON_INCOMPLETE_DOCUMENT;
+		}
 
-		case 'f':
-			jsps->state = 10;	/* parse false: fa */
-			break;
+		switch (buffer[i])
+		{
+		case '\"':	/* close JSON string */
+			*pos = i + 1;
+			return JSON_OK;
 
-		case 'n':
-			jsps->state = 14;	/* parse null: nu */
-			break;
+		case '\\':	/* escape sequence */
+			if (i + 1 == length)
+			{
+				*pos = length;
+				return JSON_INCOMPLETE_DOCUMENT;
+			}
+			switch (buffer[i + 1])
+			{
+			case '\\':
+			case '\"':
+			case '/':
+			case 'b':
+			case 'f':
+			case 'n':
+			case 'r':
+			case 't':
+				i += 2;
+				break;
 
-		case ':':
-			if (jsf->label_value_separator != NULL)
-				jsf->label_value_separator ();
-/*                      jsps->state = 0;        // redundant*/
-			break;
-
-		case ',':
-			if (jsf->sibling_separator != NULL)
-				jsf->sibling_separator ();
-			jsps->state = 27;	/* sibling followup */
-			break;
+			case 'u':
+				for (digit = i + 2; digit < i + 6; digit++)
+				{
+					if (digit == length)
+					{
+						*pos = length;
+						return JSON_INCOMPLETE_DOCUMENT;
+					}
+					if (!json_is_hex_digit (buffer[digit]))
+					{
+						*pos = digit;
+						return JSON_ILLEGAL_CHARACTER;
+					}
+				}
+				i += 6;
+				break;
 
-		case '0':
-			jsps->string_length_limit_reached = 0;
-			jsps->state = 17;	/* parse number: 0 */
-			if ((jsps->temp = rcs_create (5)) == NULL)
-			{
-				return JSON_MEMORY;
-			}
-			if (rcs_catc ((jsps->temp), '0') != RS_OK)
-			{
-				return JSON_MEMORY;
+			default:
+				*pos = i + 1;
+				return JSON_ILLEGAL_CHARACTER;
 			}
 			break;
 
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			jsps->string_length_limit_reached = 0;
-			jsps->state = 24;	/* parse number: decimal */
-			if ((jsps->temp = rcs_create (5)) == NULL)
-			{
-				return JSON_MEMORY;
-			}
-			if (rcs_catc ((jsps->temp), c) != RS_OK)
-			{
-				return JSON_MEMORY;
-			}
-			break;
+		default:
+			/* ASCII control characters can only be present in a JSON string if they are escaped */
+			*pos = i;
+			return JSON_ILLEGAL_CHARACTER;
+		}
+	}
+}
 
-		case '-':
-			jsps->string_length_limit_reached = 0;
-			jsps->state = 23;	/* number: */
-			jsps->temp = NULL;
-			if ((jsps->temp = rcs_create (5)) == NULL)
-			{
-				return JSON_MEMORY;
-			}
-			if (rcs_catc ((jsps->temp), '-') != RS_OK)
-			{
-				return JSON_MEMORY;
-			}
 
-			break;
+enum json_error
+json_validate_literal (const char *buffer, size_t length, size_t * pos, const char *literal, size_t literal_length)
+{
+	size_t i;
 
-		default:
+	for (i = 0; i < literal_length; i++)
+	{
+		if (*pos + i == length)
+		{
+			*pos = length;
+			return JSON_INCOMPLETE_DOCUMENT;
+		}
+		if (buffer[*pos + i] != literal[i])
+		{
+			*pos += i;
 			return JSON_ILLEGAL_CHARACTER;
-			break;
 		}
-		return JSON_OK;
 	}
+	*pos += literal_length;
+	return JSON_OK;
+}
 
-      state1:			/* parse string */
+
+enum json_error
+json_validate_number (const char *buffer, size_t length, size_t * pos)
+{
+	size_t i = *pos;
+
+#define JSON_DIGIT_AT(i) (((i) < length) && (buffer[(i)] >= '0') && (buffer[(i)] <= '9'))
+#define JSON_EXPECT_DIGIT(i) \
+	do { \
+		if ((i) == length) { *pos = length; return JSON_INCOMPLETE_DOCUMENT; } \
+		if (!JSON_DIGIT_AT (i)) { *pos = (i); return JSON_ILLEGAL_CHARACTER; } \
+	} while (0)
+
+	if (buffer[i] == '-')
+		i++;
+	JSON_EXPECT_DIGIT (i);
+	if (buffer[i] == '0')
+		i++;
+	else
 	{
-		switch (c)
+		while (JSON_DIGIT_AT (i))
+			i++;
+	}
+
+	if ((i < length) && (buffer[i] == '.'))	/* fraction */
+	{
+		i++;
+		JSON_EXPECT_DIGIT (i);
+		while (JSON_DIGIT_AT (i))
+			i++;
+	}
+
+	if ((i < length) && ((buffer[i] == 'e') || (buffer[i] == 'E')))	/* exponent */
+	{
+		i++;
+		if ((i < length) && ((buffer[i] == '-') || (buffer[i] == '+')))
+			i++;
+		JSON_EXPECT_DIGIT (i);
+		while (JSON_DIGIT_AT (i))
+			i++;
+	}
+
+#undef JSON_EXPECT_DIGIT
+#undef JSON_DIGIT_AT
+
+	*pos = i;
+	return JSON_OK;
+}
+
+
+enum json_error
+json_validate (const char *buffer, size_t length, size_t * error_offset)
+{
+	unsigned char inline_stack[JSON_VALIDATE_DEPTH / 8];	/* bit stack of the open containers: set for objects, clear for arrays */
+	unsigned char *stack = inline_stack;
+	size_t stack_size = sizeof (inline_stack);
+	size_t depth = 0;
+	size_t pos;
+	int closing;
+	enum json_error error = JSON_OK;
+	enum
+	{
+		VALIDATE_VALUE,	/* expecting a value */
+		VALIDATE_FIRST_VALUE,	/* just entered an array */
+		VALIDATE_MEMBER,	/* expecting a label */
+		VALIDATE_FIRST_MEMBER,	/* just entered an object */
+		VALIDATE_NAME_SEPARATOR,	/* label, pre name separator */
+		VALIDATE_FOLLOWUP,	/* finished a value, expecting a sibling or the end of the container */
+		VALIDATE_END	/* finished document. only accept whitespaces until EOF */
+	} state;
+
+	assert ((buffer != NULL) || (length == 0));
+
+	/* only objects are accepted as the document root, as in json_parse_fragment() */
+	pos = json_validate_white_spaces (buffer, length, 0);
+	if (pos == length)
+	{
+		error = JSON_INCOMPLETE_DOCUMENT;
+		goto end;
+	}
+	if (buffer[pos] != '{')
+	{
+		error = JSON_MALFORMED_DOCUMENT;
+		goto end;
+	}
+	pos++;
+	stack[0] = 1;
+	depth = 1;
+	state = VALIDATE_FIRST_MEMBER;
+
+	while (state != VALIDATE_END)
+	{
+		pos = json_validate_white_spaces (buffer, length, pos);
+		if (pos == length)
 		{
-		case '\\':
-			if (!jsps->string_length_limit_reached)
+			error = JSON_INCOMPLETE_DOCUMENT;
+			goto end;
+		}
+
+		closing = 0;
+		switch (state)
+		{
+		case VALIDATE_FIRST_MEMBER:
+			if (buffer[pos] == '}')
 			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH - 1)	/* check if there is space for a two character escape sequence */
-				{
-					if (rcs_catc ((jsps->temp), '\\') != RS_OK)
-					{
-						return JSON_MEMORY;
-					}
-				}
-				else
-				{
-					jsps->string_length_limit_reached = 1;
-				}
+				closing = 1;
+				break;
 			}
-			jsps->state = 2;	/* parse string: escaped character */
-			break;
-
-		case '\"':	/* end of string */
-			if ((jsps->temp) != NULL)
+			/* fall through */
+		case VALIDATE_MEMBER:
+			if (buffer[pos] != '\"')
 			{
-				jsps->state = 0;	/* starting point */
-				if (jsf->new_string != NULL)
-					jsf->new_string (((jsps->temp))->text);	/*copied or integral? */
-				rcs_free (&jsps->temp);
+				error = JSON_MALFORMED_DOCUMENT;
+				goto end;
 			}
-			else
-				return JSON_UNKNOWN_PROBLEM;
+			if ((error = json_validate_string (buffer, length, &pos)) != JSON_OK)
+				goto end;
+			state = VALIDATE_NAME_SEPARATOR;
 			break;
 
-		default:
-			if (!jsps->string_length_limit_reached)
+		case VALIDATE_NAME_SEPARATOR:
+			if (buffer[pos] != ':')
 			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH)	/* check if there is space for a two character escape sequence */
-				{
-					if (rcs_catc ((jsps->temp), c) != RS_OK)
-					{
-						return JSON_MEMORY;
-					}
-				}
-				else
-				{
-					jsps->string_length_limit_reached = 1;
-				}
+				error = JSON_MALFORMED_DOCUMENT;
+				goto end;
 			}
+			pos++;
+			state = VALIDATE_VALUE;
 			break;
-		}
-		return JSON_OK;
-	}
 
-      state2:			/* parse string: escaped character */
-	{
-		switch (c)
-		{
-		case '\"':
-		case '\\':
-		case '/':
-		case 'b':
-		case 'f':
-		case 'n':
-		case 'r':
-		case 't':
-			if (!jsps->string_length_limit_reached)
+		case VALIDATE_FIRST_VALUE:
+			if (buffer[pos] == ']')
 			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH)
+				closing = 1;
+				break;
+			}
+			/* fall through */
+		case VALIDATE_VALUE:
+			state = VALIDATE_FOLLOWUP;
+			switch (buffer[pos])
+			{
+			case '{':
+			case '[':
+				if (depth == stack_size * 8)
 				{
-					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					unsigned char *temp = (unsigned char *)malloc (stack_size * 2);
+					if (temp == NULL)
 					{
-						return JSON_MEMORY;
+						error = JSON_MEMORY;
+						goto end;
 					}
+					memcpy (temp, stack, stack_size);
+					if (stack != inline_stack)
+						free (stack);
+					stack = temp;
+					stack_size *= 2;
+				}
+				if (buffer[pos] == '{')
+				{
+					stack[depth / 8] |= (1 << (depth % 8));
+					state = VALIDATE_FIRST_MEMBER;
 				}
 				else
 				{
-					jsps->string_length_limit_reached = 1;
+					stack[depth / 8] &= ~(1 << (depth % 8));
+					state = VALIDATE_FIRST_VALUE;
 				}
+				depth++;
+				pos++;
+				break;
+
+			case '\"':
+				error = json_validate_string (buffer, length, &pos);
+				break;
+
+			case 't':
+				error = json_validate_literal (buffer, length, &pos, "true", 4);
+				break;
+
+			case 'f':
+				error = json_validate_literal (buffer, length, &pos, "false", 5);
+				break;
+
+			case 'n':
+				error = json_validate_literal (buffer, length, &pos, "null", 4);
+				break;
+
+			case '-':
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+			case '8':
+			case '9':
+				error = json_validate_number (buffer, length, &pos);
+				break;
+
+			default:
+				error = JSON_MALFORMED_DOCUMENT;
+				break;
 			}
+			if (error != JSON_OK)
+				goto end;
 			break;
 
-		case 'u':
-			if (!jsps->string_length_limit_reached)
+		case VALIDATE_FOLLOWUP:
+			switch (buffer[pos])
 			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH - 4)
+			case ',':
+				pos++;
+				if (stack[(depth - 1) / 8] & (1 << ((depth - 1) % 8)))
+					state = VALIDATE_MEMBER;
+				else
+					state = VALIDATE_VALUE;
+				break;
+
+			case '}':
+				if (!(stack[(depth - 1) / 8] & (1 << ((depth - 1) % 8))))
 				{
-					if (rcs_catc ((jsps->temp), 'u') != RS_OK)
-					{
-						return JSON_MEMORY;
-					}
+					error = JSON_MALFORMED_DOCUMENT;
+					goto end;
 				}
-				else
+				closing = 1;
+				break;
+
+			case ']':
+				if (stack[(depth - 1) / 8] & (1 << ((depth - 1) % 8)))
 				{
-					jsps->string_length_limit_reached = 1;
+					error = JSON_MALFORMED_DOCUMENT;
+					goto end;
 				}
+				closing = 1;
+				break;
+
+			default:
+				error = JSON_MALFORMED_DOCUMENT;
+				goto end;
 			}
-			jsps->state = 3;	/* parse string: escaped unicode 1; */
 			break;
 
 		default:
-			return JSON_ILLEGAL_CHARACTER;
+			assert (0);
 			break;
 		}
-		return JSON_OK;
+
+		if (closing)
+		{
+			pos++;
+			depth--;
+			state = (depth == 0) ? VALIDATE_END : VALIDATE_FOLLOWUP;
+		}
 	}
 
-      state3:			/* parse string: escaped unicode 1 */
+	/* only whitespaces may follow the document */
+	pos = json_validate_white_spaces (buffer, length, pos);
+	if (pos != length)
+		error = JSON_MALFORMED_DOCUMENT;
+
+      end:
+	if (stack != inline_stack)
+		free (stack);
+	if ((error != JSON_OK) && (error_offset != NULL))
+		*error_offset = pos;
+	return error;
+}
+
+
+enum json_error
+json_saxy_parse (struct json_saxy_parser_status *jsps, struct json_saxy_functions *jsf, char c)
+{
+	/* make sure everything is in it's place */
+	assert (jsps != NULL);
+	assert (jsf != NULL);
+
+	/* goto where we left off */
+	switch (jsps->state)
 	{
-		switch (c)
-		{
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-		case 'a':
-		case 'b':
-		case 'c':
-		case 'd':
-		case 'e':
-		case 'f':
-		case 'A':
-		case 'B':
-		case 'C':
-		case 'D':
-		case 'E':
-		case 'F':
-			if (!jsps->string_length_limit_reached)
-			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH - 3)
-				{
-					if (rcs_catc ((jsps->temp), 'u') != RS_OK)
-					{
-						return JSON_MEMORY;
-					}
-				}
-				else
-				{
-					jsps->string_length_limit_reached = 1;
-				}
-			}
-			jsps->state = 4;	/* parse string. escaped unicode 2 */
-			break;
+	case 0:		/* general state. everything goes. */
+		goto state0;
+		break;
+	case 1:		/* parse string */
+		goto state1;
+		break;
+	case 2:		/* parse string: escaped character */
+		goto state2;
+		break;
+	case 3:		/* parse string: escaped unicode 1 */
+		goto state3;
+		break;
+	case 4:		/* parse string: escaped unicode 2 */
+		goto state4;
+		break;
+	case 5:		/* parse string: escaped unicode 3 */
+		goto state5;
+		break;
+	case 6:		/* parse string: escaped unicode 4 */
+		goto state6;
+		break;
+	case 7:		/* parse true: tr */
+		goto state7;
+		break;
+	case 8:		/* parse true: tru */
+		goto state8;
+		break;
+	case 9:		/* parse true: true */
+		goto state9;
+		break;
+	case 10:		/* parse false: fa */
+		goto state10;
+		break;
+	case 11:		/* parse false: fal */
+		goto state11;
+		break;
+	case 12:		/* parse false: fals */
+		goto state12;
+		break;
+	case 13:		/* parse false: false */
+		goto state13;
+		break;
+	case 14:		/* parse null: nu */
+		goto state14;
+		break;
+	case 15:		/* parse null: nul */
+		goto state15;
+		break;
+	case 16:		/* parse null: null */
+		goto state16;
+		break;
+	case 17:		/* parse number: 0 */
+		goto state17;
+		break;
+	case 18:		/* parse number: start fraccional part */
+		goto state18;
+		break;
+	case 19:		/* parse number: fraccional part */
+		goto state19;
+		break;
+	case 20:		/* parse number: start exponent part */
+		goto state20;
+		break;
+	case 21:		/* parse number: exponent part */
+		goto state21;
+		break;
+	case 22:		/* parse number: exponent sign part */
+		goto state22;
+		break;
+	case 23:		/* parse number: start negative */
+		goto state23;
+		break;
+	case 24:		/* parse number: decimal part */
+		goto state24;
+		break;
+	case 25:		/* open object */
+		goto state25;
+		break;
+	case 26:		/* close object/array */
+		goto state26;
+		break;
+	case 27:		/* sibling followup */
+		goto state27;
+		break;
 
-		default:
-			return JSON_ILLEGAL_CHARACTER;
-		}
-		return JSON_OK;
+	default:		/* oops... this should never be reached */
+		return JSON_UNKNOWN_PROBLEM;
 	}
 
-      state4:			/* parse string: escaped unicode 2 */
+      state0:			/* starting point */
 	{
 		switch (c)
 		{
+		case '\x20':
+		case '\x09':
+		case '\x0A':
+		case '\x0D':	/* JSON insignificant white spaces */
+			break;
+
+		case '\"':	/* starting a string */
+			jsps->string_length_limit_reached = 0;
+			jsps->state = 1;
+			if ((jsps->temp = rcs_create (RSTRING_DEFAULT)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			break;
+
+		case '{':
+			if (jsf->open_object != NULL)
+				jsf->open_object ();
+			jsps->state = 25;	/*open object */
+			break;
+
+		case '}':
+			if (jsf->close_object != NULL)
+				jsf->close_object ();
+			jsps->state = 26;	/* close object/array */
+			break;
+
+		case '[':
+			if (jsf->open_array != NULL)
+				jsf->open_array ();
+/*                      jsps->state = 0;        // redundant*/
+			break;
+
+		case ']':
+			if (jsf->close_array != NULL)
+				jsf->close_array ();
+			jsps->state = 26;	/* close object/array */
+			break;
+
+		case 't':
+			jsps->state = 7;	/* parse true: tr */
+			break;
+
+		case 'f':
+			jsps->state = 10;	/* parse false: fa */
+			break;
+
+		case 'n':
+			jsps->state = 14;	/* parse null: nu */
+			break;
+
+		case ':':
+			if (jsf->label_value_separator != NULL)
+				jsf->label_value_separator ();
+/*                      jsps->state = 0;        // redundant*/
+			break;
+
+		case ',':
+			if (jsf->sibling_separator != NULL)
+				jsf->sibling_separator ();
+			jsps->state = 27;	/* sibling followup */
+			break;
+
 		case '0':
+			jsps->string_length_limit_reached = 0;
+			jsps->state = 17;	/* parse number: 0 */
+			if ((jsps->temp = rcs_create (5)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			if (rcs_catc ((jsps->temp), '0') != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+			break;
+
 		case '1':
 		case '2':
 		case '3':
@@ -3189,23 +4656,50 @@ json_saxy_parse (struct json_saxy_parser_status *jsps, struct json_saxy_function
 		case '7':
 		case '8':
 		case '9':
-		case 'a':
-		case 'b':
-		case 'c':
-		case 'd':
-		case 'e':
-		case 'f':
-		case 'A':
-		case 'B':
-		case 'C':
-		case 'D':
-		case 'E':
-		case 'F':
+			jsps->string_length_limit_reached = 0;
+			jsps->state = 24;	/* parse number: decimal */
+			if ((jsps->temp = rcs_create (5)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			if (rcs_catc ((jsps->temp), c) != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+			break;
+
+		case '-':
+			jsps->string_length_limit_reached = 0;
+			jsps->state = 23;	/* number: */
+			jsps->temp = NULL;
+			if ((jsps->temp = rcs_create (5)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			if (rcs_catc ((jsps->temp), '-') != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state1:			/* parse string */
+	{
+		switch (c)
+		{
+		case '\\':
 			if (!jsps->string_length_limit_reached)
 			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH - 2)
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH - 1)	/* check if there is space for a two character escape sequence */
 				{
-					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					if (rcs_catc ((jsps->temp), '\\') != RS_OK)
 					{
 						return JSON_MEMORY;
 					}
@@ -3215,11 +4709,193 @@ json_saxy_parse (struct json_saxy_parser_status *jsps, struct json_saxy_function
 					jsps->string_length_limit_reached = 1;
 				}
 			}
-			jsps->state = 5;	/* parse string. escaped unicode 3 */
+			jsps->state = 2;	/* parse string: escaped character */
+			break;
+
+		case '\"':	/* end of string */
+			if ((jsps->temp) != NULL)
+			{
+				if (jsps->validate_utf8 && !json_utf8_valid (jsps->temp->text, jsps->temp->length))
+				{
+					rcs_free (&jsps->temp);
+					return JSON_ILLEGAL_CHARACTER;
+				}
+				jsps->state = 0;	/* starting point */
+				if (jsf->new_string != NULL)
+					jsf->new_string (((jsps->temp))->text);	/*copied or integral? */
+				rcs_free (&jsps->temp);
+			}
+			else
+				return JSON_UNKNOWN_PROBLEM;
 			break;
 
 		default:
-			return JSON_ILLEGAL_CHARACTER;
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH)	/* check if there is space for a two character escape sequence */
+				{
+					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state2:			/* parse string: escaped character */
+	{
+		switch (c)
+		{
+		case '\"':
+		case '\\':
+		case '/':
+		case 'b':
+		case 'f':
+		case 'n':
+		case 'r':
+		case 't':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH)
+				{
+					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+			break;
+
+		case 'u':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH - 4)
+				{
+					if (rcs_catc ((jsps->temp), 'u') != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+			jsps->state = 3;	/* parse string: escaped unicode 1; */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state3:			/* parse string: escaped unicode 1 */
+	{
+		switch (c)
+		{
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+		case 'a':
+		case 'b':
+		case 'c':
+		case 'd':
+		case 'e':
+		case 'f':
+		case 'A':
+		case 'B':
+		case 'C':
+		case 'D':
+		case 'E':
+		case 'F':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH - 3)
+				{
+					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+			jsps->state = 4;	/* parse string. escaped unicode 2 */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+		}
+		return JSON_OK;
+	}
+
+      state4:			/* parse string: escaped unicode 2 */
+	{
+		switch (c)
+		{
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+		case 'a':
+		case 'b':
+		case 'c':
+		case 'd':
+		case 'e':
+		case 'f':
+		case 'A':
+		case 'B':
+		case 'C':
+		case 'D':
+		case 'E':
+		case 'F':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH - 2)
+				{
+					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+			jsps->state = 5;	/* parse string. escaped unicode 3 */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
 		}
 		return JSON_OK;
 	}
@@ -3319,894 +4995,2426 @@ json_saxy_parse (struct json_saxy_parser_status *jsps, struct json_saxy_function
 		default:
 			return JSON_ILLEGAL_CHARACTER;
 		}
-		return JSON_OK;
+		return JSON_OK;
+	}
+
+      state7:			/* parse true: tr */
+	{
+		if (c != 'r')
+		{
+			return JSON_ILLEGAL_CHARACTER;
+		}
+
+		jsps->state = 8;	/* parse true: tru */
+		return JSON_OK;
+	}
+
+      state8:			/* parse true: tru */
+	{
+		if (c != 'u')
+		{
+			return JSON_ILLEGAL_CHARACTER;
+		}
+
+		jsps->state = 9;	/* parse true: true */
+		return JSON_OK;
+	}
+
+      state9:			/* parse true: true */
+	{
+		if (c != 'e')
+		{
+			return JSON_ILLEGAL_CHARACTER;
+		}
+
+		jsps->state = 0;	/* back to general state. */
+		if (jsf->new_true != NULL)
+			jsf->new_true ();
+		return JSON_OK;
+	}
+
+      state10:			/* parse false: fa */
+	{
+		if (c != 'a')
+		{
+			return JSON_ILLEGAL_CHARACTER;
+		}
+
+		jsps->state = 11;	/* parse true: fal */
+		return JSON_OK;
+	}
+
+      state11:			/* parse false: fal */
+	{
+		if (c != 'l')
+		{
+			return JSON_ILLEGAL_CHARACTER;
+		}
+
+		jsps->state = 12;	/* parse true: fals */
+		return JSON_OK;
+	}
+
+      state12:			/* parse false: fals */
+	{
+		if (c != 's')
+		{
+			return JSON_ILLEGAL_CHARACTER;
+		}
+
+		jsps->state = 13;	/* parse true: false */
+		return JSON_OK;
+	}
+
+      state13:			/* parse false: false */
+	{
+		if (c != 'e')
+		{
+			return JSON_ILLEGAL_CHARACTER;
+		}
+
+		jsps->state = 0;	/* general state. everything goes. */
+		if (jsf->new_false != NULL)
+			jsf->new_false ();
+		return JSON_OK;
+	}
+
+      state14:			/* parse null: nu */
+	{
+		if (c != 'u')
+		{
+			return JSON_ILLEGAL_CHARACTER;
+		}
+
+		jsps->state = 15;	/* parse null: nul */
+		return JSON_OK;
+	}
+
+      state15:			/* parse null: nul */
+	{
+		if (c != 'l')
+		{
+			return JSON_ILLEGAL_CHARACTER;
+		}
+
+		jsps->state = 16;	/* parse null: null */
+		return JSON_OK;
+	}
+
+      state16:			/* parse null: null */
+	{
+		if (c != 'l')
+		{
+			return JSON_ILLEGAL_CHARACTER;
+		}
+
+		jsps->state = 0;	/* general state. everything goes. */
+		if (jsf->new_null != NULL)
+			jsf->new_null ();
+		return JSON_OK;
+	}
+
+      state17:			/* parse number: 0 */
+	{
+		switch (c)
+		{
+		case '.':
+			if ((jsps->temp = rcs_create (5)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			if (rcs_catc ((jsps->temp), '.') != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+			jsps->state = 18;	/* parse number: fraccional part */
+			break;
+
+		case '\x20':
+		case '\x09':
+		case '\x0A':
+		case '\x0D':	/* JSON insignificant white spaces */
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			jsps->state = 0;
+			break;
+
+		case '}':
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			if (jsf->open_object != NULL)
+				jsf->close_object ();
+			jsps->state = 26;	/* close object/array */
+			break;
+
+		case ']':
+
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			if (jsf->open_object != NULL)
+				jsf->close_array ();
+			jsps->state = 26;	/* close object/array */
+			break;
+
+		case ',':
+
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			if (jsf->open_object != NULL)
+				jsf->label_value_separator ();
+			jsps->state = 27;	/* sibling followup */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+
+		return JSON_OK;
+	}
+
+      state18:			/* parse number: start fraccional part */
+	{
+		switch (c)
+		{
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH / 2)
+				{
+					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+			jsps->state = 19;	/* parse number: fractional part */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state19:			/* parse number: fraccional part */
+	{
+		switch (c)
+		{
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH / 2)
+				{
+					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+/*                      jsps->state = 19;       // parse number: fractional part*/
+			break;
+
+		case 'e':
+		case 'E':
+			if (rcs_catc ((jsps->temp), c) != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+
+			jsps->state = 20;	/* parse number: start exponent part */
+			break;
+
+
+		case '\x20':
+		case '\x09':
+		case '\x0A':
+		case '\x0D':	/* JSON insignificant white spaces */
+
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			jsps->state = 0;
+			break;
+
+		case '}':
+
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			if (jsf->open_object != NULL)
+				jsf->close_object ();
+			jsps->state = 26;	/* close object/array */
+			break;
+
+		case ']':
+			if (jsf->new_number != NULL)
+			{
+				if ((jsps->temp) == NULL)
+					return JSON_MEMORY;
+				jsf->new_number ((jsps->temp)->text);
+				rcs_free (&jsps->temp);
+			}
+			else
+			{
+				rcs_free (&jsps->temp);
+				jsps->temp = NULL;
+			}
+			if (jsf->open_object != NULL)
+				jsf->close_array ();
+			jsps->state = 26;	/* close object/array */
+			break;
+
+		case ',':
+
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			if (jsf->label_value_separator != NULL)
+				jsf->label_value_separator ();
+			jsps->state = 27;	/* sibling followup */
+			break;
+
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state20:			/* parse number: start exponent part */
+	{
+		switch (c)
+		{
+		case '+':
+		case '-':
+			jsps->string_length_limit_reached = 0;
+			if (rcs_catc ((jsps->temp), c) != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+
+			jsps->state = 22;	/* parse number: exponent sign part */
+			break;
+
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH)
+				{
+					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+			jsps->state = 21;	/* parse number: exponent part */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state21:			/* parse number: exponent part */
+	{
+		switch (c)
+		{
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH)
+				{
+					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+/*                              jsps->state = 21;       // parse number: exponent part*/
+			break;
+
+		case '\x20':
+		case '\x09':
+		case '\x0A':
+		case '\x0D':	/* JSON insignificant white spaces */
+
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			jsps->state = 0;
+			break;
+
+		case '}':
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			if (jsf->open_object != NULL)
+				jsf->close_object ();
+			jsps->state = 26;	/* close object */
+			break;
+
+		case ']':
+			if (jsf->new_number != NULL)
+			{
+				if ((jsps->temp) == NULL)
+					return JSON_MEMORY;
+				jsf->new_number ((jsps->temp)->text);
+				free (jsps->temp);
+				jsps->temp = NULL;
+			}
+			else
+			{
+				free ((jsps->temp));
+				jsps->temp = NULL;
+			}
+			if (jsf->open_object != NULL)
+				jsf->close_array ();
+			jsps->state = 26;	/* close object/array */
+			break;
+
+		case ',':
+			if (jsf->new_number != NULL)
+			{
+				if ((jsps->temp) == NULL)
+					return JSON_MEMORY;
+				jsf->new_number ((jsps->temp)->text);
+				free ((jsps->temp));
+				jsps->temp = NULL;
+			}
+			else
+			{
+				free (jsps->temp);
+				jsps->temp = NULL;
+			}
+			if (jsf->label_value_separator != NULL)
+				jsf->label_value_separator ();
+			jsps->state = 27;	/* sibling followup */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state22:			/* parse number: start exponent part */
+	{
+		switch (c)
+		{
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH)
+				{
+					rcs_catc ((jsps->temp), c);
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+			jsps->state = 21;	/* parse number: exponent part */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state23:			/* parse number: start negative */
+	{
+		switch (c)
+		{
+		case '0':
+			rcs_catc ((jsps->temp), c);
+			jsps->state = 17;	/* parse number: 0 */
+			break;
+
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH / 2)
+				{
+					if ((jsps->temp = rcs_create (5)) == NULL)
+					{
+						return JSON_MEMORY;
+					}
+					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+					else
+					{
+						jsps->string_length_limit_reached = 1;
+					}
+				}
+			}
+			jsps->state = 24;	/* parse number: start decimal part */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state24:			/* parse number: decimal part */
+	{
+		switch (c)
+		{
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			if (!jsps->string_length_limit_reached)
+			{
+				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH / 2)
+				{
+					if ((jsps->temp = rcs_create (5)) == NULL)
+					{
+						return JSON_MEMORY;
+					}
+					if (rcs_catc ((jsps->temp), c) != RS_OK)
+					{
+						return JSON_MEMORY;
+					}
+				}
+				else
+				{
+					jsps->string_length_limit_reached = 1;
+				}
+			}
+/*                              jsps->state = 24;       // parse number: decimal part*/
+			break;
+
+		case '.':
+			if ((jsps->temp = rcs_create (5)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			if (rcs_catc ((jsps->temp), '.') != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+
+			jsps->state = 18;	/* parse number: start exponent part */
+			break;
+
+		case 'e':
+		case 'E':
+			if ((jsps->temp = rcs_create (5)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			if (rcs_catc ((jsps->temp), c) != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+
+			jsps->string_length_limit_reached = 0;	/* reset to accept the exponential part */
+			jsps->state = 20;	/* parse number: start exponent part */
+			break;
+
+		case '\x20':
+		case '\x09':
+		case '\x0A':
+		case '\x0D':	/* JSON insignificant white spaces */
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			jsps->state = 0;
+			break;
+
+		case '}':
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			if (jsf->open_object != NULL)
+				jsf->close_object ();
+			jsps->state = 26;	/* close object/array */
+			break;
+
+		case ']':
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			if (jsf->open_object != NULL)
+				jsf->close_array ();
+			jsps->state = 26;	/* close object/array */
+			break;
+
+		case ',':
+			if ((jsps->temp) == NULL)
+				return JSON_MEMORY;
+			if (jsf->new_number != NULL)
+			{
+				jsf->new_number ((jsps->temp)->text);
+			}
+			rcs_free (&jsps->temp);
+
+			if (jsf->label_value_separator != NULL)
+				jsf->label_value_separator ();
+			jsps->state = 27;	/* sibling followup */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state25:			/* open object */
+	{
+		switch (c)
+		{
+		case '\x20':
+		case '\x09':
+		case '\x0A':
+		case '\x0D':	/* JSON insignificant white spaces */
+			break;
+
+		case '\"':
+			jsps->string_length_limit_reached = 0;
+			jsps->state = 1;
+			if ((jsps->temp = rcs_create (RSTRING_DEFAULT)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			break;
+
+		case '}':
+			if (jsf->close_object != NULL)
+				jsf->close_object ();
+			jsps->state = 26;	/* close object */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state26:			/* close object/array */
+	{
+		switch (c)
+		{
+		case '\x20':
+		case '\x09':
+		case '\x0A':
+		case '\x0D':	/* JSON insignificant white spaces */
+			break;
+
+		case '}':
+			if (jsf->close_object != NULL)
+				jsf->close_object ();
+/*                      jsp->state = 26;        // close object*/
+			break;
+
+		case ']':
+			if (jsf->close_array != NULL)
+				jsf->close_array ();
+/*                      jsps->state = 26;       // close object/array*/
+			break;
+
+		case ',':
+			if (jsf->sibling_separator != NULL)
+				jsf->sibling_separator ();
+			jsps->state = 27;	/* sibling followup */
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+      state27:			/* sibling followup */
+	{
+		switch (c)
+		{
+		case '\x20':
+		case '\x09':
+		case '\x0A':
+		case '\x0D':	/* JSON insignificant white spaces */
+			break;
+
+		case '\"':
+			jsps->string_length_limit_reached = 0;
+			jsps->state = 1;
+			if ((jsps->temp = rcs_create (RSTRING_DEFAULT)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			break;
+
+		case '{':
+			if (jsf->open_object != NULL)
+				jsf->open_object ();
+			jsps->state = 25;	/*open object */
+			break;
+
+		case '[':
+			if (jsf->open_array != NULL)
+				jsf->open_array ();
+/*                      jsps->state = 0;        // redundant*/
+			break;
+
+		case 't':
+			jsps->state = 7;	/* parse true: tr */
+			break;
+
+		case 'f':
+			jsps->state = 10;	/* parse false: fa */
+			break;
+
+		case 'n':
+			jsps->state = 14;	/* parse null: nu */
+			break;
+
+		case '0':
+			jsps->state = 17;	/* parse number: 0 */
+			if ((jsps->temp = rcs_create (5)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			if (rcs_catc ((jsps->temp), '0') != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+			break;
+
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			jsps->state = 24;	/* parse number: decimal */
+			if ((jsps->temp = rcs_create (5)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			if (rcs_catc ((jsps->temp), c) != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+			break;
+
+		case '-':
+			jsps->state = 23;	/* number: */
+			if ((jsps->temp = rcs_create (RSTRING_DEFAULT)) == NULL)
+			{
+				return JSON_MEMORY;
+			}
+			if (rcs_catc ((jsps->temp), '-') != RS_OK)
+			{
+				return JSON_MEMORY;
+			}
+			break;
+
+		default:
+			return JSON_ILLEGAL_CHARACTER;
+			break;
+		}
+		return JSON_OK;
+	}
+
+	return JSON_UNKNOWN_PROBLEM;
+}
+
+
+/**
+Builds the index of a container node without touching the node
+@param node a json_value of type JSON_OBJECT or JSON_ARRAY
+@return the index or NULL if memory ran out
+**/
+static struct json_index *
+json_index_new (const json_t * node)
+{
+	struct json_index *index;
+	json_t *cursor;
+	enum json_error error;
+
+	if ((index = (struct json_index *)malloc (sizeof (struct json_index))) == NULL)
+		return NULL;
+	index->count = 0;
+	index->capacity = 8;
+	while (index->capacity < JSON_INDEX_THRESHOLD * 4)
+		index->capacity *= 2;
+	if ((index->slots = (json_t **)calloc (index->capacity, sizeof (json_t *))) == NULL)
+	{
+		free (index);
+		return NULL;
+	}
+
+	for (cursor = node->child; cursor != NULL; cursor = cursor->next)
+	{
+		if (node->type == JSON_ARRAY)
+			error = json_index_append (index, cursor);
+		else
+			error = json_index_insert (index, cursor);
+		if (error != JSON_OK)
+		{
+			json_index_free (&index);
+			return NULL;
+		}
+	}
+	return index;
+}
+
+
+/**
+@param node a container node
+@return the node's index or NULL if it has none. The load pairs with the publication in json_build_index(), so that an index is only ever seen whole
+**/
+static struct json_index *
+json_index_of (const json_t * node)
+{
+	return __atomic_load_n (&node->index, __ATOMIC_ACQUIRE);
+}
+
+
+enum json_error
+json_build_index (json_t * node)
+{
+	struct json_index *index, *expected = NULL;
+
+	assert (node != NULL);
+	assert ((node->type == JSON_OBJECT) || (node->type == JSON_ARRAY));
+
+	if (json_index_of (node) != NULL)
+		return JSON_OK;
+	if ((index = json_index_new (node)) == NULL)
+		return JSON_MEMORY;
+
+	/* readers may be building the same index at the same time: the first one to publish it wins, the others drop theirs */
+	if (!__atomic_compare_exchange_n (&node->index, &expected, index, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		json_index_free (&index);
+	return JSON_OK;
+}
+
+
+size_t
+json_array_size (const json_t * array)
+{
+	struct json_index *index;
+	json_t *cursor;
+	size_t count = 0;
+
+	assert (array != NULL);
+	assert (array->type == JSON_ARRAY);
+
+	/* the index is a cache, which is why it may be built through a const pointer, and published whole so that concurrent readers are safe */
+	if (((index = json_index_of (array)) != NULL) || ((json_build_index ((json_t *) array) == JSON_OK) && ((index = json_index_of (array)) != NULL)))
+		return index->count;
+
+	for (cursor = array->child; cursor != NULL; cursor = cursor->next)
+		count++;
+	return count;
+}
+
+
+json_t *
+json_array_get (const json_t * array, size_t position)
+{
+	struct json_index *index;
+	json_t *cursor;
+
+	assert (array != NULL);
+	assert (array->type == JSON_ARRAY);
+
+	if (((index = json_index_of (array)) != NULL) || ((json_build_index ((json_t *) array) == JSON_OK) && ((index = json_index_of (array)) != NULL)))
+		return (position < index->count) ? index->slots[position] : NULL;
+
+	for (cursor = array->child; (cursor != NULL) && (position > 0); cursor = cursor->next)
+		position--;
+	return cursor;
+}
+
+
+/**
+Looks up a label by its text and hash, going through the object's index if it has one and building the index once scans get long
+@param object a json_value of type JSON_OBJECT
+@param text_label the label's text
+@param hash the hash of text_label, as computed by json_hash_label_text()
+@return the first label holding text_label or NULL if there is none
+**/
+json_t *
+json_find_label (const json_t * object, const char *text_label, uint32_t hash)
+{
+	struct json_index *index;
+	json_t *cursor;
+	size_t scanned = 0;
+
+	if ((index = json_index_of (object)) != NULL)
+		return json_index_find (index, text_label, hash);
+
+	for (cursor = object->child; cursor != NULL; cursor = cursor->next)
+	{
+		scanned++;
+		if ((cursor->flags & JSON_FLAG_HASHED) && (cursor->hash != hash))
+			continue;
+		if (strcmp (cursor->text, text_label) == 0)
+			break;
+	}
+
+	/* wide objects get an index once lookups start paying for long scans. The index is a cache, which is why it may be built through a const pointer, and published whole so that concurrent readers are safe */
+	if (scanned > JSON_INDEX_THRESHOLD)
+		json_build_index ((json_t *) object);
+	return cursor;
+}
+
+
+json_t *
+json_find_first_label (const json_t * object, const char *text_label)
+{
+	assert (object != NULL);
+	assert (text_label != NULL);
+	assert (object->type == JSON_OBJECT);
+
+	return json_find_label (object, text_label, json_hash_label_text (text_label, strlen (text_label), 0));
+}
+
+
+int
+json_text_reads (const char *text, int plain, const char *reading)
+{
+	struct json_text_reader reader;
+	int c;
+
+	if (plain || (strchr (text, '\\') == NULL))
+		return strcmp (text, reading) == 0;	/* the text is written as it reads */
+
+	json_text_reader_init_text (&reader, text, 0);
+	while ((c = json_text_reader_next (&reader)) != -1)
+	{
+		if (c != (unsigned char) *reading++)
+			return 0;
+	}
+	return *reading == '\0';
+}
+
+
+/**
+Tells whether a label reads as a given text once unescaped
+@param label a label
+@param text the unescaped text
+@return 1 if it does, 0 otherwise
+**/
+static int
+json_label_reads (const json_t * label, const char *text)
+{
+	return json_text_reads (label->text, (label->flags & JSON_FLAG_NEEDS_ESCAPING) != 0, text);
+}
+
+
+json_t *
+json_find_reading_label (const json_t * object, const char *text, uint32_t hash)
+{
+	struct json_index *index;
+	json_t *cursor;
+	size_t scanned = 0;
+	size_t mask, i;
+
+	/* the index is keyed by the unescaped text of the labels, whichever way they are written */
+	if ((index = json_index_of (object)) != NULL)
+	{
+		mask = index->capacity - 1;
+		for (i = hash & mask; index->slots[i] != NULL; i = (i + 1) & mask)
+		{
+			if ((json_label_hash (index->slots[i]) == hash) && json_label_reads (index->slots[i], text))
+				return index->slots[i];
+		}
+		return NULL;
+	}
+
+	for (cursor = object->child; cursor != NULL; cursor = cursor->next)
+	{
+		scanned++;
+		if ((cursor->flags & JSON_FLAG_HASHED) && (cursor->hash != hash))
+			continue;
+		if (json_label_reads (cursor, text))
+			break;
+	}
+	if (scanned > JSON_INDEX_THRESHOLD)
+		json_build_index ((json_t *) object);
+	return cursor;
+}
+
+
+/* JSON pointer part */
+
+struct json_pointer *
+json_pointer_compile (const char *pointer)
+{
+	struct json_pointer *compiled;
+	size_t length, count, i, segment;
+	char *text;
+
+	assert (pointer != NULL);
+
+	if ((pointer[0] != '\0') && (pointer[0] != '/'))
+		return NULL;	/* a non-empty pointer starts with a reference token */
+
+	length = strlen (pointer);
+	for (count = 0, i = 0; i < length; i++)
+	{
+		if (pointer[i] == '/')
+			count++;
+		else if ((pointer[i] == '~') && (pointer[i + 1] != '0') && (pointer[i + 1] != '1'))
+			return NULL;	/* only ~0 and ~1 are valid escape sequences */
+	}
+
+	/* the unescaped tokens are never longer than the pointer itself */
+	compiled = (struct json_pointer *)malloc (sizeof (struct json_pointer) + count * sizeof (struct json_pointer_segment) + length + 1);
+	if (compiled == NULL)
+		return NULL;
+	compiled->count = count;
+	compiled->segments = (struct json_pointer_segment *)(compiled + 1);
+	text = (char *)(compiled->segments + count);
+
+	for (segment = 0, i = 0; segment < count; segment++)
+	{
+		struct json_pointer_segment *current = &compiled->segments[segment];
+		size_t token_length = 0;
+
+		i++;		/* skip the '/' */
+		current->text = text;
+		while ((i < length) && (pointer[i] != '/'))
+		{
+			if (pointer[i] == '~')
+			{
+				text[token_length++] = (pointer[i + 1] == '0') ? '~' : '/';
+				i += 2;
+			}
+			else
+				text[token_length++] = pointer[i++];
+		}
+		text[token_length] = '\0';
+		text += token_length + 1;
+		current->hash = json_hash_text (current->text, token_length);
+
+		/* array positions are decimal numbers without leading zeros */
+		current->is_position = (token_length > 0) && ((current->text[0] != '0') || (token_length == 1));
+		current->position = 0;
+		for (token_length = 0; current->is_position && (current->text[token_length] != '\0'); token_length++)
+		{
+			char c = current->text[token_length];
+			if ((c < '0') || (c > '9') || (current->position > (SIZE_MAX - (c - '0')) / 10))
+				current->is_position = 0;
+			else
+				current->position = current->position * 10 + (c - '0');
+		}
+	}
+	return compiled;
+}
+
+
+json_t *
+json_pointer_eval (const struct json_pointer *pointer, const json_t * root)
+{
+	const json_t *cursor = root, *label;
+	const struct json_pointer_segment *segment;
+	size_t i;
+
+	assert (pointer != NULL);
+	assert (root != NULL);
+
+	for (i = 0; (i < pointer->count) && (cursor != NULL); i++)
+	{
+		segment = &pointer->segments[i];
+		switch (cursor->type)
+		{
+		case JSON_OBJECT:
+			label = json_find_reading_label (cursor, segment->text, segment->hash);
+			cursor = (label != NULL) ? label->child : NULL;	/* the value of the label:value pair */
+			break;
+
+		case JSON_ARRAY:
+			cursor = segment->is_position ? json_array_get (cursor, segment->position) : NULL;
+			break;
+
+		default:
+			cursor = NULL;	/* scalars have no children to descend into */
+			break;
+		}
 	}
+	return (json_t *) cursor;
+}
 
-      state7:			/* parse true: tr */
-	{
-		if (c != 'r')
-		{
-			return JSON_ILLEGAL_CHARACTER;
-		}
 
-		jsps->state = 8;	/* parse true: tru */
-		return JSON_OK;
+void
+json_pointer_free (struct json_pointer **pointer)
+{
+	assert (pointer != NULL);
+	if (*pointer != NULL)
+	{
+		free (*pointer);
+		*pointer = NULL;
 	}
+}
 
-      state8:			/* parse true: tru */
-	{
-		if (c != 'u')
-		{
-			return JSON_ILLEGAL_CHARACTER;
-		}
 
-		jsps->state = 9;	/* parse true: true */
-		return JSON_OK;
-	}
+/* end of JSON pointer part */
 
-      state9:			/* parse true: true */
-	{
-		if (c != 'e')
-		{
-			return JSON_ILLEGAL_CHARACTER;
-		}
 
-		jsps->state = 0;	/* back to general state. */
-		if (jsf->new_true != NULL)
-			jsf->new_true ();
-		return JSON_OK;
-	}
+/* clone part */
 
-      state10:			/* parse false: fa */
-	{
-		if (c != 'a')
-		{
-			return JSON_ILLEGAL_CHARACTER;
-		}
+#define JSON_ARENA_BLOCK_SIZE 65536
+#define JSON_ARENA_ALIGNMENT (sizeof (void *))
 
-		jsps->state = 11;	/* parse true: fal */
-		return JSON_OK;
-	}
 
-      state11:			/* parse false: fal */
-	{
-		if (c != 'l')
-		{
-			return JSON_ILLEGAL_CHARACTER;
-		}
+struct json_arena_block
+{
+	struct json_arena_block *next;
+	size_t size;		/* usable bytes in data */
+	size_t used;
+	char data[];
+};
 
-		jsps->state = 12;	/* parse true: fals */
-		return JSON_OK;
-	}
 
-      state12:			/* parse false: fals */
-	{
-		if (c != 's')
-		{
-			return JSON_ILLEGAL_CHARACTER;
-		}
+struct json_arena
+{
+	struct json_arena_block *blocks;	/* the block being allocated from comes first */
+	size_t block_size;
+	char **labels;		/* open addressing table of the interned label texts */
+	size_t label_count;
+	size_t label_capacity;
+};
 
-		jsps->state = 13;	/* parse true: false */
-		return JSON_OK;
-	}
 
-      state13:			/* parse false: false */
-	{
-		if (c != 'e')
-		{
-			return JSON_ILLEGAL_CHARACTER;
-		}
+struct json_arena *
+json_arena_new (size_t block_size)
+{
+	struct json_arena *arena = (struct json_arena *)calloc (1, sizeof (struct json_arena));
 
-		jsps->state = 0;	/* general state. everything goes. */
-		if (jsf->new_false != NULL)
-			jsf->new_false ();
-		return JSON_OK;
+	if (arena != NULL)
+		arena->block_size = (block_size == 0) ? JSON_ARENA_BLOCK_SIZE : block_size;
+	return arena;
+}
+
+
+static void *
+json_arena_alloc (struct json_arena *arena, size_t size)
+{
+	struct json_arena_block *block = arena->blocks;
+	size_t block_size;
+	void *memory;
+
+	size = (size + JSON_ARENA_ALIGNMENT - 1) & ~(JSON_ARENA_ALIGNMENT - 1);
+	if ((block == NULL) || (block->size - block->used < size))
+	{
+		block_size = (size > arena->block_size) ? size : arena->block_size;
+		block = (struct json_arena_block *)malloc (sizeof (struct json_arena_block) + block_size);
+		if (block == NULL)
+			return NULL;
+		block->size = block_size;
+		block->used = 0;
+		block->next = arena->blocks;
+		arena->blocks = block;
 	}
+	memory = block->data + block->used;
+	block->used += size;
+	return memory;
+}
 
-      state14:			/* parse null: nu */
+
+/**
+Returns the arena's copy of a label's text, making one if there is none yet
+@param label the label whose text is needed
+@return the shared text or NULL if memory ran out
+**/
+static char *
+json_arena_intern (struct json_arena *arena, const json_t * label)
+{
+	uint32_t hash;
+	size_t length = strlen (label->text);
+	size_t i, slot, capacity;
+	char **grown, *text;
+
+	hash = json_hash_text (label->text, length);	/* the texts are shared as they are written */
+
+	if (2 * (arena->label_count + 1) > arena->label_capacity)
 	{
-		if (c != 'u')
+		capacity = (arena->label_capacity == 0) ? 64 : arena->label_capacity * 2;
+		grown = (char **)calloc (capacity, sizeof (char *));
+		if (grown == NULL)
+			return NULL;
+		for (i = 0; i < arena->label_capacity; i++)
 		{
-			return JSON_ILLEGAL_CHARACTER;
+			if (arena->labels[i] == NULL)
+				continue;
+			slot = json_hash_text (arena->labels[i], strlen (arena->labels[i])) & (capacity - 1);
+			while (grown[slot] != NULL)
+				slot = (slot + 1) & (capacity - 1);
+			grown[slot] = arena->labels[i];
 		}
-
-		jsps->state = 15;	/* parse null: nul */
-		return JSON_OK;
+		free (arena->labels);
+		arena->labels = grown;
+		arena->label_capacity = capacity;
 	}
 
-      state15:			/* parse null: nul */
+	for (slot = hash & (arena->label_capacity - 1); arena->labels[slot] != NULL; slot = (slot + 1) & (arena->label_capacity - 1))
 	{
-		if (c != 'l')
-		{
-			return JSON_ILLEGAL_CHARACTER;
-		}
+		if (strcmp (arena->labels[slot], label->text) == 0)
+			return arena->labels[slot];
+	}
 
-		jsps->state = 16;	/* parse null: null */
-		return JSON_OK;
+	text = (char *)json_arena_alloc (arena, length + 1);
+	if (text == NULL)
+		return NULL;
+	memcpy (text, label->text, length + 1);
+	arena->labels[slot] = text;
+	arena->label_count++;
+	return text;
+}
+
+
+void
+json_arena_reset (struct json_arena *arena)
+{
+	struct json_arena_block *block;
+
+	assert (arena != NULL);
+
+	/* keep the oldest block, which is the last one in the list */
+	while ((arena->blocks != NULL) && (arena->blocks->next != NULL))
+	{
+		block = arena->blocks;
+		arena->blocks = block->next;
+		free (block);
 	}
+	if (arena->blocks != NULL)
+		arena->blocks->used = 0;
+	if (arena->labels != NULL)
+		memset (arena->labels, 0, arena->label_capacity * sizeof (char *));
+	arena->label_count = 0;
+}
 
-      state16:			/* parse null: null */
+
+void
+json_arena_free (struct json_arena **arena)
+{
+	struct json_arena_block *block;
+
+	assert (arena != NULL);
+	if (*arena != NULL)
 	{
-		if (c != 'l')
+		while ((block = (*arena)->blocks) != NULL)
 		{
-			return JSON_ILLEGAL_CHARACTER;
+			(*arena)->blocks = block->next;
+			free (block);
 		}
-
-		jsps->state = 0;	/* general state. everything goes. */
-		if (jsf->new_null != NULL)
-			jsf->new_null ();
-		return JSON_OK;
+		free ((*arena)->labels);
+		free (*arena);
+		*arena = NULL;
 	}
+}
 
-      state17:			/* parse number: 0 */
-	{
-		switch (c)
-		{
-		case '.':
-			if ((jsps->temp = rcs_create (5)) == NULL)
-			{
-				return JSON_MEMORY;
-			}
-			if (rcs_catc ((jsps->temp), '.') != RS_OK)
-			{
-				return JSON_MEMORY;
-			}
-			jsps->state = 18;	/* parse number: fraccional part */
-			break;
 
-		case '\x20':
-		case '\x09':
-		case '\x0A':
-		case '\x0D':	/* JSON insignificant white spaces */
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
+/**
+Copies a single node, without its links to other nodes, on the heap or in an arena
+@param arena the arena to allocate from or NULL for the heap
+@return the copy or NULL if memory ran out
+**/
+static json_t *
+json_clone_node (const json_t * node, struct json_arena *arena)
+{
+	json_t *copy;
+	size_t length;
 
-			jsps->state = 0;
-			break;
+	copy = (arena == NULL) ? (json_t *)malloc (sizeof (json_t)) : (json_t *)json_arena_alloc (arena, sizeof (json_t));
+	if (copy == NULL)
+		return NULL;
 
-		case '}':
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
+	copy->type = node->type;
+	copy->flags = node->flags & (JSON_FLAG_NEEDS_ESCAPING | JSON_FLAG_HASHED);
+	copy->flags |= node->flags & JSON_FLAG_DIGESTED;
+	copy->hash = node->hash;
+	copy->digest = node->digest;
+	copy->index = NULL;
+	copy->parent = NULL;
+	copy->child = NULL;
+	copy->child_end = NULL;
+	copy->previous = NULL;
+	copy->next = NULL;
+	copy->text = NULL;
+	if (arena != NULL)
+		copy->flags |= JSON_FLAG_ARENA;
+
+	if (node->text == NULL)
+		return copy;
+
+	if ((arena != NULL) && (node->parent != NULL) && (node->parent->type == JSON_OBJECT))
+		copy->text = json_arena_intern (arena, node);
+	else
+	{
+		length = strlen (node->text) + 1;
+		copy->text = (arena == NULL) ? (char *)malloc (length) : (char *)json_arena_alloc (arena, length);
+		if (copy->text != NULL)
+			memcpy (copy->text, node->text, length);
+	}
+	if (copy->text == NULL)
+	{
+		if (arena == NULL)
+			free (copy);
+		return NULL;
+	}
+	return copy;
+}
 
-			if (jsf->open_object != NULL)
-				jsf->close_object ();
-			jsps->state = 26;	/* close object/array */
-			break;
 
-		case ']':
+/**
+Copies a subtree by walking the original and the copy in lockstep, linking the copies directly since they are known to be well placed
+@param arena the arena to allocate from or NULL for the heap
+@return the copy or NULL if memory ran out
+**/
+static json_t *
+json_clone_tree (const json_t * node, struct json_arena *arena)
+{
+	const json_t *original = node;
+	json_t *root, *copy, *cursor;
 
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
+	if ((root = json_clone_node (node, arena)) == NULL)
+		return NULL;
+
+	cursor = root;
+	for (;;)
+	{
+		json_t *parent;
+
+		if (original->child != NULL)
+		{
+			original = original->child;
+			parent = cursor;
+		}
+		else
+		{
+			while ((original != node) && (original->next == NULL))
 			{
-				jsf->new_number ((jsps->temp)->text);
+				original = original->parent;
+				cursor = cursor->parent;
 			}
-			rcs_free (&jsps->temp);
+			if (original == node)
+				break;
+			original = original->next;
+			parent = cursor->parent;
+		}
 
-			if (jsf->open_object != NULL)
-				jsf->close_array ();
-			jsps->state = 26;	/* close object/array */
-			break;
+		if ((copy = json_clone_node (original, arena)) == NULL)
+		{
+			json_free_value (&root);
+			return NULL;
+		}
+		copy->parent = parent;
+		copy->previous = parent->child_end;
+		if (parent->child_end != NULL)
+			parent->child_end->next = copy;
+		else
+			parent->child = copy;
+		parent->child_end = copy;
+		cursor = copy;
+	}
+	return root;
+}
 
-		case ',':
 
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
+json_t *
+json_clone (const json_t * node)
+{
+	assert (node != NULL);
 
-			if (jsf->open_object != NULL)
-				jsf->label_value_separator ();
-			jsps->state = 27;	/* sibling followup */
-			break;
+	return json_clone_tree (node, NULL);
+}
 
-		default:
-			return JSON_ILLEGAL_CHARACTER;
-			break;
-		}
 
-		return JSON_OK;
-	}
+json_t *
+json_clone_into_arena (const json_t * node, struct json_arena *arena)
+{
+	assert (node != NULL);
+	assert (arena != NULL);
 
-      state18:			/* parse number: start fraccional part */
-	{
-		switch (c)
-		{
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			if (!jsps->string_length_limit_reached)
-			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH / 2)
-				{
-					if (rcs_catc ((jsps->temp), c) != RS_OK)
-					{
-						return JSON_MEMORY;
-					}
-				}
-				else
-				{
-					jsps->string_length_limit_reached = 1;
-				}
-			}
-			jsps->state = 19;	/* parse number: fractional part */
-			break;
+	return json_clone_tree (node, arena);
+}
 
-		default:
-			return JSON_ILLEGAL_CHARACTER;
-			break;
-		}
-		return JSON_OK;
+
+/* structural comparison part */
+
+#define JSON_HASH_DEPTH 64
+
+
+void
+json_text_reader_init_text (struct json_text_reader *reader, const char *text, int plain)
+{
+	reader->p = text;
+	reader->plain = plain;
+	reader->pending_count = 0;
+	reader->pending_position = 0;
+}
+
+
+void
+json_text_reader_init (struct json_text_reader *reader, const json_t * node)
+{
+	json_text_reader_init_text (reader, node->text, (node->flags & JSON_FLAG_NEEDS_ESCAPING) != 0);
+}
+
+
+static int
+json_hex_value (const char *p, unsigned long *value)
+{
+	int i;
+
+	*value = 0;
+	for (i = 0; i < 4; i++)
+	{
+		if ((p[i] >= '0') && (p[i] <= '9'))
+			*value = (*value << 4) | (unsigned long) (p[i] - '0');
+		else if ((p[i] >= 'a') && (p[i] <= 'f'))
+			*value = (*value << 4) | (unsigned long) (p[i] - 'a' + 10);
+		else if ((p[i] >= 'A') && (p[i] <= 'F'))
+			*value = (*value << 4) | (unsigned long) (p[i] - 'A' + 10);
+		else
+			return 0;
 	}
+	return 1;
+}
 
-      state19:			/* parse number: fraccional part */
+
+/**
+@return the next unescaped byte or -1 at the end of the text
+**/
+int
+json_text_reader_next (struct json_text_reader *reader)
+{
+	unsigned long code, low;
+	const char *p = reader->p;
+
+	if (reader->pending_position < reader->pending_count)
+		return reader->pending[reader->pending_position++];
+	if (*p == '\0')
+		return -1;
+	if (reader->plain || (*p != '\\') || (p[1] == '\0'))
 	{
-		switch (c)
+		reader->p++;
+		return (unsigned char) *p;
+	}
+
+	reader->p += 2;
+	switch (p[1])
+	{
+	case 'b':
+		return '\b';
+	case 'f':
+		return '\f';
+	case 'n':
+		return '\n';
+	case 'r':
+		return '\r';
+	case 't':
+		return '\t';
+	case 'u':
+		if (!json_hex_value (p + 2, &code))
+			return 'u';	/* not a valid escape sequence, kept as it was written minus the backslash */
+		reader->p += 4;
+		if ((code >= 0xD800) && (code < 0xDC00) && (p[6] == '\\') && (p[7] == 'u') && json_hex_value (p + 8, &low) && (low >= 0xDC00) && (low < 0xE000))
 		{
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			if (!jsps->string_length_limit_reached)
-			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH / 2)
-				{
-					if (rcs_catc ((jsps->temp), c) != RS_OK)
-					{
-						return JSON_MEMORY;
-					}
-				}
-				else
-				{
-					jsps->string_length_limit_reached = 1;
-				}
-			}
-/*                      jsps->state = 19;       // parse number: fractional part*/
-			break;
+			code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+			reader->p += 6;
+		}
+		reader->pending_position = 0;
+		reader->pending_count = 0;
+		if (code < 0x80)
+			return (int) code;
+		if (code < 0x800)
+		{
+			reader->pending[0] = (unsigned char) (0x80 | (code & 0x3F));
+			reader->pending_count = 1;
+			return (int) (0xC0 | (code >> 6));
+		}
+		if (code < 0x10000)
+		{
+			reader->pending[0] = (unsigned char) (0x80 | ((code >> 6) & 0x3F));
+			reader->pending[1] = (unsigned char) (0x80 | (code & 0x3F));
+			reader->pending_count = 2;
+			return (int) (0xE0 | (code >> 12));
+		}
+		reader->pending[0] = (unsigned char) (0x80 | ((code >> 12) & 0x3F));
+		reader->pending[1] = (unsigned char) (0x80 | ((code >> 6) & 0x3F));
+		reader->pending[2] = (unsigned char) (0x80 | (code & 0x3F));
+		reader->pending_count = 3;
+		return (int) (0xF0 | (code >> 18));
+	default:
+		return (unsigned char) p[1];	/* \" \\ \/ */
+	}
+}
 
-		case 'e':
-		case 'E':
-			if (rcs_catc ((jsps->temp), c) != RS_OK)
-			{
-				return JSON_MEMORY;
-			}
 
-			jsps->state = 20;	/* parse number: start exponent part */
-			break;
+/**
+Compares the unescaped texts of two string nodes
+**/
+static int
+json_text_equal (const json_t * a, const json_t * b)
+{
+	struct json_text_reader ra, rb;
+	int c;
 
+	if ((((a->flags ^ b->flags) & JSON_FLAG_NEEDS_ESCAPING) == 0) && (strcmp (a->text, b->text) == 0))
+		return 1;	/* the same text written the same way */
 
-		case '\x20':
-		case '\x09':
-		case '\x0A':
-		case '\x0D':	/* JSON insignificant white spaces */
+	json_text_reader_init (&ra, a);
+	json_text_reader_init (&rb, b);
+	do
+	{
+		c = json_text_reader_next (&ra);
+		if (c != json_text_reader_next (&rb))
+			return 0;
+	}
+	while (c != -1);
+	return 1;
+}
 
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
 
-			jsps->state = 0;
-			break;
+static uint64_t
+json_mix (uint64_t x)
+{
+	/* the splitmix64 finalizer */
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ull;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBull;
+	x ^= x >> 31;
+	return x;
+}
 
-		case '}':
 
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
+static uint64_t
+json_text_digest (const json_t * node)
+{
+	struct json_text_reader reader;
+	uint64_t hash = 14695981039346656037ull;
+	int c;
 
-			if (jsf->open_object != NULL)
-				jsf->close_object ();
-			jsps->state = 26;	/* close object/array */
-			break;
+	json_text_reader_init (&reader, node);
+	while ((c = json_text_reader_next (&reader)) != -1)
+	{
+		hash ^= (unsigned char) c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
 
-		case ']':
-			if (jsf->new_number != NULL)
-			{
-				if ((jsps->temp) == NULL)
-					return JSON_MEMORY;
-				jsf->new_number ((jsps->temp)->text);
-				rcs_free (&jsps->temp);
-			}
-			else
-			{
-				rcs_free (&jsps->temp);
-				jsps->temp = NULL;
-			}
-			if (jsf->open_object != NULL)
-				jsf->close_array ();
-			jsps->state = 26;	/* close object/array */
-			break;
 
-		case ',':
+/**
+A number reduced to its sign, its significant digits and the position of the decimal point relative to them, so that equal values written differently compare alike
+**/
+struct json_decimal
+{
+	int negative;
+	const char *first;	/* the first significant digit, or NULL if the number is zero */
+	const char *last;	/* the last significant digit. A decimal point may lie between first and last */
+	long point;		/* the value is 0.<digits> times 10 to the power of point */
+};
 
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
 
-			if (jsf->label_value_separator != NULL)
-				jsf->label_value_separator ();
-			jsps->state = 27;	/* sibling followup */
-			break;
+static void
+json_decimal_parse (const char *text, struct json_decimal *decimal)
+{
+	const char *p = text;
+	long integer_digits = -1, position = 0, first_position = 0, exponent = 0;
+	int exponent_negative = 0;
 
+	decimal->negative = (*p == '-');
+	if (*p == '-')
+		p++;
+	decimal->first = NULL;
+	decimal->last = NULL;
 
-		default:
-			return JSON_ILLEGAL_CHARACTER;
-			break;
+	for (; ((*p >= '0') && (*p <= '9')) || (*p == '.'); p++)
+	{
+		if (*p == '.')
+		{
+			integer_digits = position;
+			continue;
 		}
-		return JSON_OK;
+		if (*p != '0')
+		{
+			if (decimal->first == NULL)
+			{
+				decimal->first = p;
+				first_position = position;
+			}
+			decimal->last = p;
+		}
+		position++;
 	}
+	if (integer_digits < 0)
+		integer_digits = position;	/* there was no decimal point */
 
-      state20:			/* parse number: start exponent part */
+	if ((*p == 'e') || (*p == 'E'))
 	{
-		switch (c)
+		p++;
+		exponent_negative = (*p == '-');
+		if ((*p == '-') || (*p == '+'))
+			p++;
+		for (; (*p >= '0') && (*p <= '9'); p++)
 		{
-		case '+':
-		case '-':
-			jsps->string_length_limit_reached = 0;
-			if (rcs_catc ((jsps->temp), c) != RS_OK)
-			{
-				return JSON_MEMORY;
-			}
+			if (exponent < 100000000L)	/* way past what a double holds, yet still exact for comparisons */
+				exponent = exponent * 10 + (*p - '0');
+		}
+	}
+	decimal->point = integer_digits - first_position + (exponent_negative ? -exponent : exponent);
+}
 
-			jsps->state = 22;	/* parse number: exponent sign part */
-			break;
 
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			if (!jsps->string_length_limit_reached)
-			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH)
-				{
-					if (rcs_catc ((jsps->temp), c) != RS_OK)
-					{
-						return JSON_MEMORY;
-					}
+static int
+json_decimal_equal (const json_t * a, const json_t * b)
+{
+	struct json_decimal x, y;
+	const char *p, *q;
 
-				}
-				else
-				{
-					jsps->string_length_limit_reached = 1;
-				}
-			}
-			jsps->state = 21;	/* parse number: exponent part */
-			break;
+	json_decimal_parse (a->text, &x);
+	json_decimal_parse (b->text, &y);
+	if ((x.first == NULL) || (y.first == NULL))
+		return x.first == y.first;	/* zero equals zero whatever its sign */
+	if ((x.negative != y.negative) || (x.point != y.point))
+		return 0;
 
-		default:
-			return JSON_ILLEGAL_CHARACTER;
-			break;
-		}
-		return JSON_OK;
+	for (p = x.first, q = y.first;; p++, q++)
+	{
+		if (*p == '.')
+			p++;
+		if (*q == '.')
+			q++;
+		if (*p != *q)
+			return 0;
+		if ((p == x.last) || (q == y.last))
+			return (p == x.last) && (q == y.last);
 	}
+}
 
-      state21:			/* parse number: exponent part */
+
+static uint64_t
+json_decimal_digest (const json_t * node)
+{
+	struct json_decimal decimal;
+	uint64_t hash = 14695981039346656037ull;
+	const char *p;
+
+	json_decimal_parse (node->text, &decimal);
+	if (decimal.first == NULL)
+		return json_mix (JSON_NUMBER);
+	for (p = decimal.first; p <= decimal.last; p++)
 	{
-		switch (c)
-		{
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			if (!jsps->string_length_limit_reached)
-			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH)
-				{
-					if (rcs_catc ((jsps->temp), c) != RS_OK)
-					{
-						return JSON_MEMORY;
-					}
-				}
-				else
-				{
-					jsps->string_length_limit_reached = 1;
-				}
-			}
-/*                              jsps->state = 21;       // parse number: exponent part*/
-			break;
+		if (*p == '.')
+			continue;
+		hash ^= (unsigned char) *p;
+		hash *= 1099511628211ull;
+	}
+	return json_mix (hash ^ json_mix ((uint64_t) decimal.point * 2 + (uint64_t) decimal.negative));
+}
 
-		case '\x20':
-		case '\x09':
-		case '\x0A':
-		case '\x0D':	/* JSON insignificant white spaces */
 
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
+/**
+The hash of a node without children, or the seed of the hash of a container
+**/
+static uint64_t
+json_leaf_digest (const json_t * node)
+{
+	switch (node->type)
+	{
+	case JSON_STRING:
+		return json_mix (json_text_digest (node) + JSON_STRING);
+	case JSON_NUMBER:
+		return json_decimal_digest (node);
+	default:
+		return json_mix ((uint64_t) node->type + 0x9E3779B97F4A7C15ull);
+	}
+}
+
+
+/**
+The state of a container whose children are being hashed
+**/
+struct json_hash_frame
+{
+	uint64_t accumulator;
+	size_t count;
+};
 
-			jsps->state = 0;
-			break;
 
-		case '}':
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
+enum json_error
+json_hash (const json_t * node, int memoize, uint64_t * hash)
+{
+	struct json_hash_frame local[JSON_HASH_DEPTH], *frames = local, *grown;
+	size_t depth = 0, capacity = JSON_HASH_DEPTH;
+	const json_t *cursor = node;
+	json_t *finished;
+	uint64_t digest;
 
-			if (jsf->open_object != NULL)
-				jsf->close_object ();
-			jsps->state = 26;	/* close object */
-			break;
+	assert (node != NULL);
+	assert (hash != NULL);
 
-		case ']':
-			if (jsf->new_number != NULL)
+	for (;;)
+	{
+		/* descend as far as the first node whose hash is known */
+		if (cursor->flags & JSON_FLAG_DIGESTED)
+			digest = cursor->digest;
+		else if (cursor->child == NULL)
+			digest = json_leaf_digest (cursor);
+		else
+		{
+			if (depth == capacity)
 			{
-				if ((jsps->temp) == NULL)
+				grown = (struct json_hash_frame *)((frames == local) ? malloc (2 * capacity * sizeof (struct json_hash_frame)) : realloc (frames, 2 * capacity * sizeof (struct json_hash_frame)));
+				if (grown == NULL)
+				{
+					if (frames != local)
+						free (frames);
 					return JSON_MEMORY;
-				jsf->new_number ((jsps->temp)->text);
-				free (jsps->temp);
-				jsps->temp = NULL;
-			}
-			else
+				}
+				if (frames == local)
+					memcpy (grown, local, sizeof (local));
+				frames = grown;
+				capacity *= 2;
+			}
+			frames[depth].accumulator = 0;
+			frames[depth].count = 0;
+			depth++;
+			cursor = cursor->child;
+			continue;
+		}
+
+		/* fold finished nodes into their parents, climbing while the parents are done too */
+		for (;;)
+		{
+			finished = (json_t *) cursor;
+			if (memoize)
 			{
-				free ((jsps->temp));
-				jsps->temp = NULL;
+				finished->digest = digest;
+				finished->flags |= JSON_FLAG_DIGESTED;
 			}
-			if (jsf->open_object != NULL)
-				jsf->close_array ();
-			jsps->state = 26;	/* close object/array */
-			break;
-
-		case ',':
-			if (jsf->new_number != NULL)
+			if (finished == node)
 			{
-				if ((jsps->temp) == NULL)
-					return JSON_MEMORY;
-				jsf->new_number ((jsps->temp)->text);
-				free ((jsps->temp));
-				jsps->temp = NULL;
+				if (frames != local)
+					free (frames);
+				*hash = digest;
+				return JSON_OK;
 			}
+
+			/* arrays are ordered, objects are sets of members and labels hold a single value */
+			if (finished->parent->type == JSON_ARRAY)
+				frames[depth - 1].accumulator = frames[depth - 1].accumulator * 0x100000001B3ull + digest;
 			else
+				frames[depth - 1].accumulator += digest;
+			frames[depth - 1].count++;
+
+			if (finished->next != NULL)
 			{
-				free (jsps->temp);
-				jsps->temp = NULL;
+				cursor = finished->next;
+				break;
 			}
-			if (jsf->label_value_separator != NULL)
-				jsf->label_value_separator ();
-			jsps->state = 27;	/* sibling followup */
-			break;
 
-		default:
-			return JSON_ILLEGAL_CHARACTER;
-			break;
+			cursor = finished->parent;
+			depth--;
+			if (cursor->type == JSON_STRING)
+				digest = json_mix (json_text_digest (cursor) * 31 + frames[depth].accumulator);	/* a label:value pair */
+			else
+				digest = json_mix (json_leaf_digest (cursor) ^ json_mix (frames[depth].accumulator + frames[depth].count));
 		}
-		return JSON_OK;
 	}
+}
 
-      state22:			/* parse number: start exponent part */
+
+/**
+Finds a member of an object whose label reads like a given label once unescaped, and counts how many do
+@param object the object to search
+@param label the label to match
+@param count receives the number of labels of object which read like label
+@return one of these labels or NULL if there is none
+**/
+static const json_t *
+json_equal_member (const json_t * object, const json_t * label, size_t *count)
+{
+	const struct json_index *index;
+	const json_t *cursor, *match = NULL;
+	uint32_t hash = json_label_hash (label);
+	size_t scanned = 0;
+	size_t mask, i;
+
+	*count = 0;
+
+	/* the index is keyed by unescaped text, so the labels which read alike share a probe sequence */
+	if ((index = json_index_of (object)) != NULL)
 	{
-		switch (c)
+		mask = index->capacity - 1;
+		for (i = hash & mask; index->slots[i] != NULL; i = (i + 1) & mask)
 		{
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			if (!jsps->string_length_limit_reached)
+			if ((json_label_hash (index->slots[i]) == hash) && json_text_equal (index->slots[i], label))
 			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH)
-				{
-					rcs_catc ((jsps->temp), c);
-				}
-				else
-				{
-					jsps->string_length_limit_reached = 1;
-				}
+				if (match == NULL)
+					match = index->slots[i];
+				++*count;
 			}
-			jsps->state = 21;	/* parse number: exponent part */
-			break;
-
-		default:
-			return JSON_ILLEGAL_CHARACTER;
-			break;
 		}
-		return JSON_OK;
+		return match;
 	}
 
-      state23:			/* parse number: start negative */
+	for (cursor = object->child; cursor != NULL; cursor = cursor->next)
 	{
-		switch (c)
+		scanned++;
+		if ((cursor->flags & JSON_FLAG_HASHED) && (cursor->hash != hash))
+			continue;
+		if (json_text_equal (cursor, label))
 		{
-		case '0':
-			rcs_catc ((jsps->temp), c);
-			jsps->state = 17;	/* parse number: 0 */
-			break;
+			if (match == NULL)
+				match = cursor;
+			++*count;
+		}
+	}
+	if (scanned > JSON_INDEX_THRESHOLD)
+		json_build_index ((json_t *) object);
+	return match;
+}
 
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			if (!jsps->string_length_limit_reached)
-			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH / 2)
-				{
-					if ((jsps->temp = rcs_create (5)) == NULL)
-					{
-						return JSON_MEMORY;
-					}
-					if (rcs_catc ((jsps->temp), c) != RS_OK)
-					{
-						return JSON_MEMORY;
-					}
-					else
-					{
-						jsps->string_length_limit_reached = 1;
-					}
-				}
-			}
-			jsps->state = 24;	/* parse number: start decimal part */
-			break;
 
-		default:
-			return JSON_ILLEGAL_CHARACTER;
+json_t *
+json_find_equal_label (const json_t * object, const json_t * label)
+{
+	size_t count;
+
+	return (json_t *) json_equal_member (object, label, &count);
+}
+
+
+/**
+Finds the member of an object which pairs with a label of another object. Labels which repeat a text pair up in document order, the first with the first, the second with the second and so on, which keeps the comparison symmetric
+@param object the object to search
+@param label a label of the other object
+@return the label or NULL if there is none
+**/
+static const json_t *
+json_equal_pair (const json_t * object, const json_t * label)
+{
+	const json_t *cursor, *match;
+	size_t count, own, rank = 0;
+
+	match = json_equal_member (object, label, &count);
+	if (match == NULL)
+		return NULL;
+	json_equal_member (label->parent, label, &own);
+	if ((count == 1) && (own == 1))
+		return match;	/* the usual case of a label which doesn't repeat */
+
+	for (cursor = label->previous; cursor != NULL; cursor = cursor->previous)
+	{
+		if (json_text_equal (cursor, label))
+			rank++;
+	}
+	for (match = object->child; match != NULL; match = match->next)
+	{
+		if (json_text_equal (match, label) && (rank-- == 0))
 			break;
-		}
-		return JSON_OK;
 	}
+	return match;
+}
 
-      state24:			/* parse number: decimal part */
+
+static size_t
+json_count_children (const json_t * node)
+{
+	const struct json_index *index;
+	const json_t *cursor;
+	size_t count = 0;
+
+	if ((index = json_index_of (node)) != NULL)
+		return index->count;
+	for (cursor = node->child; cursor != NULL; cursor = cursor->next)
+		count++;
+	return count;
+}
+
+
+int
+json_equal (const json_t * a, const json_t * b)
+{
+	const json_t *x = a, *y = b;
+
+	assert (a != NULL);
+	assert (b != NULL);
+
+	/* both trees are walked in lockstep, matching the members of objects by label */
+	for (;;)
 	{
-		switch (c)
+		if (x->type != y->type)
+			return 0;
+		if ((x->flags & y->flags & JSON_FLAG_DIGESTED) && (x->digest != y->digest))
+			return 0;
+
+		switch (x->type)
 		{
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			if (!jsps->string_length_limit_reached)
-			{
-				if (rcs_length ((jsps->temp)) < JSON_MAX_STRING_LENGTH / 2)
-				{
-					if ((jsps->temp = rcs_create (5)) == NULL)
-					{
-						return JSON_MEMORY;
-					}
-					if (rcs_catc ((jsps->temp), c) != RS_OK)
-					{
-						return JSON_MEMORY;
-					}
-				}
-				else
-				{
-					jsps->string_length_limit_reached = 1;
-				}
-			}
-/*                              jsps->state = 24;       // parse number: decimal part*/
+		case JSON_NUMBER:
+			if (!json_decimal_equal (x, y))
+				return 0;
+			break;
+		case JSON_STRING:
+			if (!json_text_equal (x, y) || ((x->child == NULL) != (y->child == NULL)))
+				return 0;
+			break;
+		case JSON_OBJECT:
+		case JSON_ARRAY:
+			if (json_count_children (x) != json_count_children (y))
+				return 0;
+			break;
+		default:
 			break;
+		}
 
-		case '.':
-			if ((jsps->temp = rcs_create (5)) == NULL)
-			{
-				return JSON_MEMORY;
-			}
-			if (rcs_catc ((jsps->temp), '.') != RS_OK)
-			{
-				return JSON_MEMORY;
-			}
+		if ((x->child != NULL) && (x != y))
+		{
+			x = x->child;
+			y = (x->parent->type == JSON_OBJECT) ? json_equal_pair (y, x) : y->child;
+			if (y == NULL)
+				return 0;
+			continue;
+		}
 
-			jsps->state = 18;	/* parse number: start exponent part */
-			break;
+		while ((x != a) && (x->next == NULL))
+		{
+			x = x->parent;
+			y = y->parent;
+		}
+		if (x == a)
+			return 1;
+		x = x->next;
+		y = (x->parent->type == JSON_OBJECT) ? json_equal_pair (y->parent, x) : y->next;
+		if (y == NULL)
+			return 0;
+	}
+}
 
-		case 'e':
-		case 'E':
-			if ((jsps->temp = rcs_create (5)) == NULL)
-			{
-				return JSON_MEMORY;
-			}
-			if (rcs_catc ((jsps->temp), c) != RS_OK)
-			{
-				return JSON_MEMORY;
-			}
 
-			jsps->string_length_limit_reached = 0;	/* reset to accept the exponential part */
-			jsps->state = 20;	/* parse number: start exponent part */
-			break;
+/* canonical form part */
 
-		case '\x20':
-		case '\x09':
-		case '\x0A':
-		case '\x0D':	/* JSON insignificant white spaces */
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
+/**
+Reads the unescaped text of a string node a UTF-16 code unit at a time, which is the order RFC 8785 sorts labels in
+**/
+struct json_unit_reader
+{
+	struct json_text_reader bytes;
+	int low;		/* the low surrogate of a code point read as a pair, or -1 */
+};
 
-			jsps->state = 0;
+
+static int
+json_unit_reader_next (struct json_unit_reader *reader)
+{
+	unsigned long code;
+	int c, count, i;
+
+	if (reader->low != -1)
+	{
+		c = reader->low;
+		reader->low = -1;
+		return c;
+	}
+	if ((c = json_text_reader_next (&reader->bytes)) < 0x80)
+		return c;	/* ASCII or the end of the text */
+
+	count = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : (c >= 0xC0) ? 1 : 0;
+	code = (unsigned long) c & (0x3F >> count);
+	for (i = 0; i < count; i++)
+	{
+		if ((c = json_text_reader_next (&reader->bytes)) == -1)
 			break;
+		code = (code << 6) | ((unsigned long) c & 0x3F);
+	}
+	if (code < 0x10000)
+		return (int) code;
+	code -= 0x10000;
+	reader->low = (int) (0xDC00 | (code & 0x3FF));
+	return (int) (0xD800 | (code >> 10));
+}
 
-		case '}':
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
 
-			if (jsf->open_object != NULL)
-				jsf->close_object ();
-			jsps->state = 26;	/* close object/array */
-			break;
+static int
+json_canonical_compare (const void *a, const void *b)
+{
+	struct json_unit_reader ra, rb;
+	int ca, cb;
 
-		case ']':
-			if ((jsps->temp) == NULL)
-				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
-			{
-				jsf->new_number ((jsps->temp)->text);
-			}
-			rcs_free (&jsps->temp);
+	json_text_reader_init (&ra.bytes, *(const json_t * const *)a);
+	json_text_reader_init (&rb.bytes, *(const json_t * const *)b);
+	ra.low = rb.low = -1;
+	do
+	{
+		ca = json_unit_reader_next (&ra);
+		cb = json_unit_reader_next (&rb);
+	}
+	while ((ca == cb) && (ca != -1));
+	return (ca < cb) ? -1 : (ca > cb);
+}
 
-			if (jsf->open_object != NULL)
-				jsf->close_array ();
-			jsps->state = 26;	/* close object/array */
-			break;
 
-		case ',':
-			if ((jsps->temp) == NULL)
+/**
+Writes a string with the minimal escaping of RFC 8785
+@return JSON_OK, JSON_ILLEGAL_CHARACTER if the text holds a lone surrogate or JSON_MEMORY
+**/
+static enum json_error
+json_canonical_string (rcstring * output, const json_t * node)
+{
+	static const char hex[] = "0123456789abcdef";
+	struct json_text_reader reader;
+	char buffer[256];
+	size_t length = 0;
+	int c, previous = 0;
+
+	if (rcs_catc (output, '\"') != RS_OK)
+		return JSON_MEMORY;
+	if (!(node->flags & JSON_FLAG_NEEDS_ESCAPING) && (strchr (node->text, '\\') == NULL))
+	{
+		/* parsed text without escape sequences is already in canonical form */
+		if (rcs_catcs (output, node->text, strlen (node->text)) != RS_OK)
+			return JSON_MEMORY;
+		return (rcs_catc (output, '\"') == RS_OK) ? JSON_OK : JSON_MEMORY;
+	}
+
+	json_text_reader_init (&reader, node);
+	while ((c = json_text_reader_next (&reader)) != -1)
+	{
+		if ((previous == 0xED) && (c >= 0xA0))
+			return JSON_ILLEGAL_CHARACTER;	/* an escaped surrogate without its other half */
+		previous = c;
+		if (length + 7 > sizeof (buffer))	/* room for the longest escape sequence and the closing quote */
+		{
+			if (rcs_catcs (output, buffer, length) != RS_OK)
 				return JSON_MEMORY;
-			if (jsf->new_number != NULL)
+			length = 0;
+		}
+		if ((c == '\"') || (c == '\\'))
+		{
+			buffer[length++] = '\\';
+			buffer[length++] = (char) c;
+		}
+		else if (c >= 0x20)
+			buffer[length++] = (char) c;
+		else
+		{
+			buffer[length++] = '\\';
+			switch (c)
 			{
-				jsf->new_number ((jsps->temp)->text);
+			case '\b':
+				buffer[length++] = 'b';
+				break;
+			case '\t':
+				buffer[length++] = 't';
+				break;
+			case '\n':
+				buffer[length++] = 'n';
+				break;
+			case '\f':
+				buffer[length++] = 'f';
+				break;
+			case '\r':
+				buffer[length++] = 'r';
+				break;
+			default:
+				memcpy (buffer + length, "u00", 3);
+				buffer[length + 3] = hex[c >> 4];
+				buffer[length + 4] = hex[c & 0xF];
+				length += 5;
+				break;
 			}
-			rcs_free (&jsps->temp);
+		}
+	}
+	buffer[length++] = '\"';
+	return (rcs_catcs (output, buffer, length) == RS_OK) ? JSON_OK : JSON_MEMORY;
+}
 
-			if (jsf->label_value_separator != NULL)
-				jsf->label_value_separator ();
-			jsps->state = 27;	/* sibling followup */
-			break;
 
-		default:
-			return JSON_ILLEGAL_CHARACTER;
+/**
+Writes a number as ECMAScript's Number.prototype.toString() would, which is what RFC 8785 asks for
+@return JSON_OK, JSON_INCOMPATIBLE_TYPE if the number does not fit in a double or JSON_MEMORY
+**/
+static enum json_error
+json_canonical_number (rcstring * output, const json_t * node)
+{
+	const char *p = node->text;
+	char digits[32], buffer[48];
+	double value;
+	int precision, exponent, count, length = 0, i;
+
+	/* integers of up to 15 digits are written alike */
+	if (*p == '-')
+		p++;
+	for (i = 0; (p[i] >= '0') && (p[i] <= '9'); i++)
+		;
+	if ((p[i] == '\0') && (i > 0) && (i <= 15) && (strcmp (node->text, "-0") != 0))
+		return (rcs_catcs (output, node->text, strlen (node->text)) == RS_OK) ? JSON_OK : JSON_MEMORY;
+
+	value = strtod (node->text, NULL);
+	if ((value > DBL_MAX) || (value < -DBL_MAX))
+		return JSON_INCOMPATIBLE_TYPE;
+	if (value == 0)
+		return (rcs_catc (output, '0') == RS_OK) ? JSON_OK : JSON_MEMORY;
+
+	/* the shortest digits that read back as the same double */
+	for (precision = 0; precision < 17; precision++)
+	{
+		snprintf (buffer, sizeof (buffer), "%.*e", precision, value);
+		if (strtod (buffer, NULL) == value)
 			break;
-		}
-		return JSON_OK;
 	}
+	p = buffer;
+	if (*p == '-')
+		buffer[length++] = *p++;
+	for (count = 0; *p != 'e'; p++)
+	{
+		if (*p != '.')
+			digits[count++] = *p;
+	}
+	exponent = atoi (p + 1) + 1;	/* the position of the decimal point relative to the digits */
+	while ((count > 1) && (digits[count - 1] == '0'))
+		count--;
 
-      state25:			/* open object */
+	if ((count <= exponent) && (exponent <= 21))
 	{
-		switch (c)
+		memcpy (buffer + length, digits, (size_t) count);
+		length += count;
+		for (i = count; i < exponent; i++)
+			buffer[length++] = '0';
+	}
+	else if ((0 < exponent) && (exponent <= 21))
+	{
+		memcpy (buffer + length, digits, (size_t) exponent);
+		length += exponent;
+		buffer[length++] = '.';
+		memcpy (buffer + length, digits + exponent, (size_t) (count - exponent));
+		length += count - exponent;
+	}
+	else if ((-6 < exponent) && (exponent <= 0))
+	{
+		buffer[length++] = '0';
+		buffer[length++] = '.';
+		for (i = exponent; i < 0; i++)
+			buffer[length++] = '0';
+		memcpy (buffer + length, digits, (size_t) count);
+		length += count;
+	}
+	else
+	{
+		buffer[length++] = digits[0];
+		if (count > 1)
 		{
-		case '\x20':
-		case '\x09':
-		case '\x0A':
-		case '\x0D':	/* JSON insignificant white spaces */
-			break;
-
-		case '\"':
-			jsps->temp = NULL;
-			jsps->state = 1;
-			break;
-
-		case '}':
-			if (jsf->close_object != NULL)
-				jsf->close_object ();
-			jsps->state = 26;	/* close object */
-			break;
-
-		default:
-			return JSON_ILLEGAL_CHARACTER;
-			break;
+			buffer[length++] = '.';
+			memcpy (buffer + length, digits + 1, (size_t) (count - 1));
+			length += count - 1;
 		}
-		return JSON_OK;
+		length += snprintf (buffer + length, sizeof (buffer) - (size_t) length, "e%c%d", (exponent > 0) ? '+' : '-', (exponent > 0) ? exponent - 1 : 1 - exponent);
 	}
+	return (rcs_catcs (output, buffer, (size_t) length) == RS_OK) ? JSON_OK : JSON_MEMORY;
+}
 
-      state26:			/* close object/array */
-	{
-		switch (c)
-		{
-		case '\x20':
-		case '\x09':
-		case '\x0A':
-		case '\x0D':	/* JSON insignificant white spaces */
-			break;
 
-		case '}':
-			if (jsf->close_object != NULL)
-				jsf->close_object ();
-/*                      jsp->state = 26;        // close object*/
-			break;
+/**
+An object or array being written. The labels of objects are kept, sorted, in a vector shared by all the open objects
+**/
+struct json_canonical_frame
+{
+	const json_t *node;
+	const json_t *cursor;	/* the element being written */
+	size_t base;		/* the position of the object's first label in the vector */
+	size_t count;
+	size_t position;	/* the label being written */
+};
 
-		case ']':
-			if (jsf->close_array != NULL)
-				jsf->close_array ();
-/*                      jsps->state = 26;       // close object/array*/
-			break;
 
-		case ',':
-			if (jsf->sibling_separator != NULL)
-				jsf->sibling_separator ();
-			jsps->state = 27;	/* sibling followup */
-			break;
+enum json_error
+json_tree_to_canonical_string (const json_t * root, char **text)
+{
+	struct json_canonical_frame *frames = NULL, *frame, *grown;
+	size_t depth = 0, capacity = 0, labels_count = 0, labels_capacity = 0;
+	const json_t **labels = NULL, **grown_labels, *node = root, *cursor;
+	enum json_error error = JSON_OK;
+	rcstring *output;
 
-		default:
-			return JSON_ILLEGAL_CHARACTER;
-			break;
-		}
-		return JSON_OK;
-	}
+	assert (root != NULL);
+	assert (text != NULL);
 
-      state27:			/* sibling followup */
+	if ((output = rcs_create (RSTRING_DEFAULT)) == NULL)
+		return JSON_MEMORY;
+
+	for (;;)
 	{
-		switch (c)
+		/* write the value at node, opening containers */
+		switch (node->type)
 		{
-		case '\x20':
-		case '\x09':
-		case '\x0A':
-		case '\x0D':	/* JSON insignificant white spaces */
-			break;
-
-		case '\"':
-			jsps->state = 1;
-			jsps->temp = NULL;
-			break;
-
-		case '{':
-			if (jsf->open_object != NULL)
-				jsf->open_object ();
-			jsps->state = 25;	/*open object */
+		case JSON_STRING:
+			error = (node->child == NULL) ? json_canonical_string (output, node) : JSON_BAD_TREE_STRUCTURE;
 			break;
-
-		case '[':
-			if (jsf->open_array != NULL)
-				jsf->open_array ();
-/*                      jsps->state = 0;        // redundant*/
+		case JSON_NUMBER:
+			error = json_canonical_number (output, node);
 			break;
-
-		case 't':
-			jsps->state = 7;	/* parse true: tr */
+		case JSON_TRUE:
+			error = (rcs_catcs (output, "true", 4) == RS_OK) ? JSON_OK : JSON_MEMORY;
 			break;
-
-		case 'f':
-			jsps->state = 10;	/* parse false: fa */
+		case JSON_FALSE:
+			error = (rcs_catcs (output, "false", 5) == RS_OK) ? JSON_OK : JSON_MEMORY;
 			break;
-
-		case 'n':
-			jsps->state = 14;	/* parse null: nu */
+		case JSON_NULL:
+			error = (rcs_catcs (output, "null", 4) == RS_OK) ? JSON_OK : JSON_MEMORY;
 			break;
-
-		case '0':
-			jsps->state = 17;	/* parse number: 0 */
-			if ((jsps->temp = rcs_create (5)) == NULL)
+		case JSON_OBJECT:
+		case JSON_ARRAY:
+			if (rcs_catc (output, (node->type == JSON_OBJECT) ? '{' : '[') != RS_OK)
 			{
-				return JSON_MEMORY;
+				error = JSON_MEMORY;
+				break;
 			}
-			if (rcs_catc ((jsps->temp), '0') != RS_OK)
+			if (depth == capacity)
 			{
-				return JSON_MEMORY;
+				grown = (struct json_canonical_frame *)realloc (frames, 2 * (capacity + 8) * sizeof (struct json_canonical_frame));
+				if (grown == NULL)
+				{
+					error = JSON_MEMORY;
+					break;
+				}
+				frames = grown;
+				capacity = 2 * (capacity + 8);
+			}
+			frame = &frames[depth++];
+			frame->node = node;
+			frame->cursor = NULL;
+			frame->base = labels_count;
+			frame->count = 0;
+			frame->position = 0;
+			if (node->type == JSON_ARRAY)
+				break;
+			for (cursor = node->child; cursor != NULL; cursor = cursor->next)
+			{
+				if (labels_count == labels_capacity)
+				{
+					grown_labels = (const json_t **)realloc (labels, 2 * (labels_capacity + 32) * sizeof (json_t *));
+					if (grown_labels == NULL)
+					{
+						error = JSON_MEMORY;
+						break;
+					}
+					labels = grown_labels;
+					labels_capacity = 2 * (labels_capacity + 32);
+				}
+				labels[labels_count++] = cursor;
 			}
+			frame->count = labels_count - frame->base;
+			qsort (labels + frame->base, frame->count, sizeof (json_t *), json_canonical_compare);
+			break;
+		default:
+			error = JSON_UNKNOWN_PROBLEM;
+			break;
+		}
+		if (error != JSON_OK)
 			break;
 
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			jsps->state = 24;	/* parse number: decimal */
-			if ((jsps->temp = rcs_create (5)) == NULL)
-			{
-				return JSON_MEMORY;
-			}
-			if (rcs_catc ((jsps->temp), c) != RS_OK)
+		/* find the next value to write, closing the containers which are done */
+		for (node = NULL; (node == NULL) && (depth > 0);)
+		{
+			frame = &frames[depth - 1];
+			if (frame->node->type == JSON_ARRAY)
 			{
-				return JSON_MEMORY;
+				cursor = (frame->cursor == NULL) ? frame->node->child : frame->cursor->next;
+				if ((cursor != NULL) && (frame->cursor != NULL) && (rcs_catc (output, ',') != RS_OK))
+					error = JSON_MEMORY;
+				frame->cursor = node = cursor;
 			}
-			break;
-
-		case '-':
-			jsps->state = 23;	/* number: */
-			if ((jsps->temp = rcs_create (RSTRING_DEFAULT)) == NULL)
+			else if (frame->position < frame->count)
 			{
-				return JSON_MEMORY;
+				cursor = labels[frame->base + frame->position];
+				if (cursor->type != JSON_STRING || cursor->child == NULL)
+					error = JSON_BAD_TREE_STRUCTURE;
+				else if (((frame->position > 0) && (rcs_catc (output, ',') != RS_OK)) || (json_canonical_string (output, cursor) != JSON_OK) || (rcs_catc (output, ':') != RS_OK))
+					error = JSON_MEMORY;
+				frame->position++;
+				node = cursor->child;
 			}
-			if (rcs_catc ((jsps->temp), '-') != RS_OK)
+			if (error != JSON_OK)
+				break;
+			if (node == NULL)
 			{
-				return JSON_MEMORY;
+				if (rcs_catc (output, (frame->node->type == JSON_OBJECT) ? '}' : ']') != RS_OK)
+				{
+					error = JSON_MEMORY;
+					break;
+				}
+				labels_count = frame->base;
+				depth--;
 			}
-			break;
-
-		default:
-			return JSON_ILLEGAL_CHARACTER;
-			break;
 		}
-		return JSON_OK;
+		if ((error != JSON_OK) || (depth == 0))
+			break;
 	}
 
-	return JSON_UNKNOWN_PROBLEM;
-}
-
-
-json_t *
-json_find_first_label (const json_t * object, const char *text_label)
-{
-	json_t *cursor;
-
-	assert (object != NULL);
-	assert (text_label != NULL);
-	assert (object->type == JSON_OBJECT);
-
-	for (cursor = object->child; cursor != NULL; cursor = cursor->next)
+	free (frames);
+	free (labels);
+	if (error != JSON_OK)
 	{
-		if (strcmp (cursor->text, text_label) == 0)
-			break;
+		rcs_free (&output);
+		return error;
 	}
-	return cursor;
+	*text = rcs_unwrap (output);
+	return JSON_OK;
 }
@@ -40,6 +40,9 @@ extern "C"
 
 #define JSON_MAX_STRING_LENGTH SIZE_MAX-1
 
+/* objects get a member index once json_find_first_label() has to scan more than this many members */
+#define JSON_INDEX_THRESHOLD 16
+
 /**
 The descriptions of the json_value node type
 **/
@@ -53,6 +56,17 @@ The descriptions of the json_value node type
 	JSON_NULL 
 	};
 
+/**
+The properties which may be set in the flags of a json_value node
+**/
+	enum json_value_flag
+	{
+		JSON_FLAG_NEEDS_ESCAPING = 1,	/*!< the text of a JSON_STRING node is plain UTF-8 which holds characters that must be escaped when the document is written */
+		JSON_FLAG_HASHED = 2,	/*!< the hash member holds the hash of the node's text as it reads once unescaped */
+		JSON_FLAG_ARENA = 4,	/*!< the node and its text live in a json_arena, which json_free_value() leaves alone */
+		JSON_FLAG_DIGESTED = 8	/*!< the digest member holds the structural hash of the node's subtree */
+	};
+
 /**
 String implementation
 **/
@@ -83,6 +97,8 @@ The error messages produced by the JSON parsers
 	};
 
 
+	struct json_index;
+
 /**
 The JSON document tree node, which is a basic JSON type
 **/
@@ -90,6 +106,10 @@ The JSON document tree node, which is a basic JSON type
 	{
 		enum json_value_type type;	/*!< the type of node */
 		char *text;	/*!< The text stored by the node. It stores UTF-8 strings and is used exclusively by the JSON_STRING and JSON_NUMBER node types */
+		unsigned int flags;	/*!< bitwise combination of json_value_flag properties */
+		uint32_t hash;	/*!< hash of the unescaped text of a JSON_STRING node, which is valid if JSON_FLAG_HASHED is set */
+		struct json_index *index;	/*!< the lookup index of a JSON_OBJECT node's labels or of a JSON_ARRAY node's elements, or NULL if it has none */
+		uint64_t digest;	/*!< the memoized json_hash() of the subtree, which is valid if JSON_FLAG_DIGESTED is set */
 
 		/* FIFO queue data */
 		struct json_value *next;	/*!< The pointer pointing to the next element in the FIFO sibling list */
@@ -112,6 +132,8 @@ The structure holding all information needed to resume parsing
 		int string_length_limit_reached;	/*!< flag informing if the string limit length defined by JSON_MAX_STRING_LENGTH was reached */
 		size_t line;	/* current document line */
 		json_t *cursor;	/*!< pointers to nodes belonging to the document tree which aid the document parsing */
+		int validate_utf8;	/*!< flag which, if set, makes the parser reject strings that aren't well-formed UTF-8 */
+		int index_arrays;	/*!< flag which, if set, makes the parser build the index of every array while it is parsed */
 	};
 
 
@@ -142,6 +164,7 @@ The structure holding the information needed for json_saxy_parse to resume parsi
 		unsigned int state;	/*!< current parser state */
 		int string_length_limit_reached;	/*!< flag informing if the string limit length defined by JSON_MAX_STRING_LENGTH was reached */
 		rcstring *temp;	/*!< temporary string which will be used to build up parsed strings between parser runs. */
+		int validate_utf8;	/*!< flag which, if set, makes the parser reject strings that aren't well-formed UTF-8 */
 	};
 
 
@@ -163,13 +186,21 @@ Creates a new JSON value and defines it's type
 
 
 /**
-Creates a new JSON string and defines it's text
+Creates a new JSON string and defines it's text. The text is taken as it is written in a JSON document, so any characters which must be escaped have to be escaped already
 @param text the value's text
 @return a pointer to the newly created JSON string value
 **/
 	json_t *json_new_string (const char *text);
 
 
+/**
+Creates a new JSON string from plain UTF-8 text. Any characters which must be escaped are flagged once here, with JSON_FLAG_NEEDS_ESCAPING, and escaped when the document is written
+@param text the value's unescaped text
+@return a pointer to the newly created JSON string value
+**/
+	json_t *json_new_plain_string (const char *text);
+
+
 /**
 Creates a new JSON number and defines it's text. The user is responsible for the number string's correctness
 @param text the value's number
@@ -229,6 +260,22 @@ Inserts a child node into a parent node, as well as performs some document tree
 	enum json_error json_insert_child (json_t * parent, json_t * child);
 
 
+/**
+Inserts a child node right before one of its future siblings, as well as performs the same document tree integrity checks as json_insert_child()
+@param sibling the node which child is placed before
+@param child the node being added as a child to the parent of sibling
+@return the error code corresponding to the operation result
+**/
+	enum json_error json_insert_child_before (json_t * sibling, json_t * child);
+
+
+/**
+Takes a node, along with its children, out of the tree it belongs to without freeing it, so that it can be inserted elsewhere or freed on its own
+@param node the node being detached
+**/
+	void json_detach (json_t * node);
+
+
 /**
 Inserts a label:value pair into a parent node, as well as performs some document tree integrity checks.
 @param parent the parent node
@@ -248,6 +295,15 @@ Produces a JSON markup text document from a document tree
 	enum json_error json_tree_to_string (json_t * root, char **text);
 
 
+/**
+Produces the canonical form (RFC 8785) of a document tree, in which object members are sorted by label, numbers are written in their shortest form and strings are escaped as little as possible. Equal documents, in the sense of json_equal(), have the same canonical form as long as their numbers fit in a double and their objects hold no duplicate labels
+@param root The document's root node
+@param text a pointer to a char string that will hold the canonical text
+@return JSON_OK, JSON_INCOMPATIBLE_TYPE if a number is out of the range of doubles, JSON_ILLEGAL_CHARACTER if a string holds an unpaired surrogate, JSON_BAD_TREE_STRUCTURE or JSON_MEMORY
+**/
+	enum json_error json_tree_to_canonical_string (const json_t * root, char **text);
+
+
 /**
 Produces a JSON markup text document from a json_t document tree to a text stream 
 @param file a opened file stream
@@ -258,12 +314,63 @@ Produces a JSON markup text document from a json_t document tree to a text strea
 
 
 /**
-Strips all JSON white spaces from the text string
+The indentation of formatted text
+**/
+	struct json_indentation
+	{
+		char character;	/*!< the character which indents lines, a space or a tab */
+		unsigned int width;	/*!< the number of characters per nesting level */
+	};
+
+
+/**
+Produces an indented JSON markup text document from a json_t document tree in a single walk, laid out as json_format_chunk() lays out text
+@param root The document's root node
+@param text a reference to a char pointer which will point to the text
+@param indentation the indentation to use, or NULL for a tab per nesting level
+@return  a json_error code describing how the operation went
+**/
+	enum json_error json_tree_to_formatted_string (const json_t * root, char **text, const struct json_indentation *indentation);
+
+
+/**
+Produces an indented JSON markup text document from a json_t document tree to a text stream in a single walk, as json_tree_to_formatted_string() lays it out
+@param file a opened file stream
+@param root The document's root node
+@param indentation the indentation to use, or NULL for a tab per nesting level
+@return  a json_error code describing how the operation went, JSON_UNKNOWN_PROBLEM if the stream could not be written
+**/
+	enum json_error json_stream_output_formatted (FILE * file, const json_t * root, const struct json_indentation *indentation);
+
+
+/**
+Strips all JSON white spaces from the text string, leaving those within strings
 @param text a char string holding a JSON document or document snippet 
 **/
 	void json_strip_white_spaces (char *text);
 
 
+/**
+The state json_minify() carries from one chunk of a text to the next, to be zeroed before the first one
+**/
+	struct json_minifier
+	{
+		int in_string;	/*!< set within a string */
+		int escaped;	/*!< set after a reverse solidus which escapes the next byte */
+	};
+
+
+/**
+Strips the JSON white spaces from a chunk of a text, which needs neither be a whole document nor end with a nul character. Feeding the chunks of a text in turn to the same minifier strips it as a whole, however it was cut
+@param minifier the state left by the previous chunk
+@param input the chunk
+@param length the number of bytes in input
+@param output receives the stripped chunk, which is never longer than input. It may be input itself, to strip it in place
+@return the number of bytes written to output
+**/
+	size_t json_minify (struct json_minifier *minifier, const char *input, size_t length, char *output);
+
+
 /**
 Formats a JSON markup text contained in the given string
 @param text a JSON formatted document
@@ -272,6 +379,62 @@ Formats a JSON markup text contained in the given string
 	char *json_format_string (const char *text);
 
 
+/**
+The state of a streaming formatter, which holds nothing of the text but its nesting level and what the last byte left to write
+**/
+	struct json_formatter
+	{
+		struct json_indentation indentation;	/*!< the indentation of the output */
+		size_t depth;	/*!< the number of open objects and arrays */
+		size_t pending;	/*!< the number of indentation characters left to write */
+		char closing;	/*!< a closing bracket left to write after them, or '\0' */
+		int opened;	/*!< set after an opening bracket, until its first value or its closing bracket */
+		int in_string;	/*!< set within a string */
+		int escaped;	/*!< set after a reverse solidus within a string */
+	};
+
+
+/**
+Sets up a streaming formatter
+@param formatter the formatter
+@param indentation the indentation to use, or NULL for a tab per nesting level
+**/
+	void json_formatter_init (struct json_formatter *formatter, const struct json_indentation *indentation);
+
+
+/**
+Formats a chunk of a JSON text, which is fed in chunks of any size. White spaces outside strings are replaced: objects and arrays put each of their members on a line of its own, indented by nesting level, unless empty, and a space follows each colon. The formatter stops when the output is full, so that the rest of the chunk is to be fed again once it is emptied, and an empty chunk writes what it still holds
+@param formatter the formatter
+@param input the chunk
+@param length the number of bytes in input
+@param used receives the number of bytes taken from input
+@param output receives the formatted text
+@param size the number of bytes output holds, at least 2
+@return the number of bytes written to output
+**/
+	size_t json_format_chunk (struct json_formatter *formatter, const char *input, size_t length, size_t * used, char *output, size_t size);
+
+
+/**
+Formats the JSON text read from a stream into another, in constant memory, and ends it with a new line
+@param input the stream to read
+@param output the stream to write
+@param indentation the indentation to use, or NULL for a tab per nesting level
+@return JSON_OK, JSON_INCOMPLETE_DOCUMENT if the text ended within a string, an object or an array, or JSON_UNKNOWN_PROBLEM if a stream could not be read or written
+**/
+	enum json_error json_format_stream (FILE * input, FILE * output, const struct json_indentation *indentation);
+
+
+/**
+Formats the JSON text read from a file descriptor into another, as json_format_stream() does
+@param input the file descriptor to read
+@param output the file descriptor to write
+@param indentation the indentation to use, or NULL for a tab per nesting level
+@return JSON_OK, JSON_INCOMPLETE_DOCUMENT if the text ended within a string, an object or an array, or JSON_UNKNOWN_PROBLEM if a file descriptor could not be read or written
+**/
+	enum json_error json_format_descriptor (int input, int output, const struct json_indentation *indentation);
+
+
 /**
 Outputs a new UTF8 c-string which replaces all characters that must be escaped with their respective escaped versions
 @param text an UTF8 char text string
@@ -307,7 +470,7 @@ Produces a document tree sequentially from a JSON markup text fragment
 
 
 /**
-Produces a document tree from a JSON markup text string that contains a complete document
+Produces a document tree from a JSON markup text string that contains a complete document, whose root is an object or an array
 @param root a reference to a pointer to a json_t type. The function allocates memory to the passed pointer and sets up the value
 @param text a c-string containing a complete JSON text document
 @return a pointer to the new document tree or NULL if some error occurred
@@ -315,6 +478,16 @@ Produces a document tree from a JSON markup text string that contains a complete
 	enum json_error json_parse_document (json_t ** root, const char *text);
 
 
+/**
+Checks if a buffer holds a well-formed JSON document without building a document tree or allocating any strings
+@param buffer a JSON text document, which doesn't need to be null-terminated
+@param length the number of bytes held by buffer
+@param error_offset if not NULL, it receives the offset of the first offending byte whenever the document isn't valid
+@return JSON_OK if the document is valid or else a json_error code describing the first problem that was found
+**/
+	enum json_error json_validate (const char *buffer, size_t length, size_t * error_offset);
+
+
 /**
 Function to perform a SAX-like parsing of any JSON document or document fragment that is passed to it
 @param jsps a structure holding the status information of the current parser
@@ -326,7 +499,32 @@ Function to perform a SAX-like parsing of any JSON document or document fragment
 
 
 /**
-Searches through the object's children for a label holding the text text_label
+Builds the index of a container node: the hash table that json_find_first_label() uses to look up an object's labels, or the vector of an array's elements behind json_array_get() and json_array_size(). Objects get one automatically once lookups have to scan more than JSON_INDEX_THRESHOLD labels and arrays on their first indexed access. From then on json_insert_child(), json_insert_pair_into_object() and json_free_value() keep it up to date, while labels must not be renamed in place. An index built on a lookup is published whole, once complete, and lookups store nothing else in the tree, so that any number of threads may read a tree which none of them modifies
+@param node a json_value of type JSON_OBJECT or JSON_ARRAY
+@return JSON_OK or JSON_MEMORY
+**/
+	enum json_error json_build_index (json_t * node);
+
+
+/**
+Counts the elements of an array in constant time, building the array's index if it has none
+@param array a json_value of type JSON_ARRAY
+@return the number of elements held by array
+**/
+	size_t json_array_size (const json_t * array);
+
+
+/**
+Fetches an array element by its position in constant time, building the array's index if it has none
+@param array a json_value of type JSON_ARRAY
+@param position the zero-based position of the element
+@return a pointer to the element or NULL if position is out of range
+**/
+	json_t *json_array_get (const json_t * array, size_t position);
+
+
+/**
+Searches through the object's children for a label holding the text text_label. The search goes through the object's index if it has one
 @param object a json_value of type JSON_OBJECT
 @param text_label the c-string to search for through the object's child labels
 @return a pointer to the first label holding a text equal to text_label or NULL if there is no such label or if object has no children
@@ -334,6 +532,100 @@ Searches through the object's children for a label holding the text text_label
 	json_t *json_find_first_label (const json_t * object, const char *text_label);
 
 
+/**
+A JSON pointer (RFC 6901) whose reference tokens have been unescaped and hashed in advance, so that it can be evaluated against any number of documents
+**/
+	struct json_pointer;
+
+
+/**
+Compiles a JSON pointer such as "/store/book/0/title"
+@param pointer the c-string holding the pointer, which is either empty or starts with '/'
+@return a compiled pointer, to be freed with json_pointer_free(), or NULL if pointer is malformed or memory ran out
+**/
+	struct json_pointer *json_pointer_compile (const char *pointer);
+
+
+/**
+Resolves a compiled JSON pointer. Object members are matched by the unescaped text of their labels, however these were written, and array elements are fetched through json_array_get()
+@param pointer a compiled JSON pointer
+@param root the document the pointer is evaluated against
+@return the value the pointer refers to, which for object members is the child of the matching label, or NULL if there is no such value
+**/
+	json_t *json_pointer_eval (const struct json_pointer *pointer, const json_t * root);
+
+
+/**
+Frees a compiled JSON pointer and sets it to NULL
+@param pointer the compiled pointer
+**/
+	void json_pointer_free (struct json_pointer **pointer);
+
+
+/**
+Creates a deep copy of a subtree in a single pass, without going through text. The copy shares nothing with the original and has no parent
+@param node the root of the subtree to copy
+@return the copy or NULL if memory ran out
+**/
+	json_t *json_clone (const json_t * node);
+
+
+/**
+A region which nodes are allocated from in blocks and released all at once, for trees that are built and thrown away together such as per-request copies of a template document
+**/
+	struct json_arena;
+
+
+/**
+Creates an arena
+@param block_size the size of the blocks the arena takes from the heap, or 0 for a default size
+@return the arena or NULL if memory ran out
+**/
+	struct json_arena *json_arena_new (size_t block_size);
+
+
+/**
+Releases everything allocated from an arena at once while keeping its first block for reuse. The trees in the arena must have been released with json_free_value() beforehand
+@param arena the arena
+**/
+	void json_arena_reset (struct json_arena *arena);
+
+
+/**
+Frees an arena and sets it to NULL. The trees in the arena must have been released with json_free_value() beforehand
+@param arena the arena
+**/
+	void json_arena_free (struct json_arena **arena);
+
+
+/**
+Creates a deep copy of a subtree inside an arena. Labels with the same text share a single copy of it across all the trees cloned into the arena. The copy is an ordinary tree which may be modified; json_free_value() releases whatever the tree has gained on the heap, such as indexes or inserted nodes, without touching the arena
+@param node the root of the subtree to copy
+@param arena the arena the copy is allocated from
+@return the copy or NULL if memory ran out
+**/
+	json_t *json_clone_into_arena (const json_t * node, struct json_arena *arena);
+
+
+/**
+Computes a structural hash of a subtree, which doesn't depend on the order of object members, on how numbers are written (1, 1.0 and 10e-1 hash alike) or on how strings are escaped. Subtrees with equal hashes are very likely, but not certainly, equal according to json_equal()
+@param node the root of the subtree
+@param memoize if set, the hashes of node and of every node below it are kept in the tree, so that hashing it again or comparing it with json_equal() is cheap. json_insert_child(), json_insert_pair_into_object() and json_free_value() discard the memoized hashes they invalidate, while changing a node's text in place requires clearing JSON_FLAG_DIGESTED up to the root by hand
+@param hash receives the hash
+@return JSON_OK or JSON_MEMORY
+**/
+	enum json_error json_hash (const json_t * node, int memoize, uint64_t * hash);
+
+
+/**
+Compares two subtrees structurally: objects are compared as sets of members, numbers by their value and strings by their unescaped text. Labels which repeat within an object are paired in the order they appear, the first occurrence with the first and so on. Memoized hashes are used to tell unequal subtrees apart early
+@param a the root of the first subtree
+@param b the root of the second subtree
+@return 1 if both subtrees are equal, 0 otherwise
+**/
+	int json_equal (const json_t * a, const json_t * b);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,1142 @@
+/*
+*  C Implementation: json_cbor
+*
+* Description: conversion of document trees to and from CBOR (RFC 8949)
+*
+*
+* Copyright: See COPYING file that comes with this distribution
+*
+*/
+
+#include "json_cbor.h"
+#include "json_internal.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <assert.h>
+
+
+/* the major types of CBOR data items */
+#define JSON_CBOR_UNSIGNED 0
+#define JSON_CBOR_NEGATIVE 1
+#define JSON_CBOR_BYTES 2
+#define JSON_CBOR_TEXT 3
+#define JSON_CBOR_ARRAY 4
+#define JSON_CBOR_MAP 5
+#define JSON_CBOR_TAG 6
+#define JSON_CBOR_SIMPLE 7
+
+#define JSON_CBOR_INDEFINITE 31	/* the additional information of items of indefinite length */
+#define JSON_CBOR_BREAK 0xFF	/* the end of an item of indefinite length */
+#define JSON_CBOR_POSITIVE_BIGNUM 2
+#define JSON_CBOR_NEGATIVE_BIGNUM 3
+
+
+/**
+A growable byte buffer
+**/
+struct json_cbor_bytes
+{
+	unsigned char *data;
+	size_t length;
+	size_t capacity;
+};
+
+
+static enum json_error
+json_cbor_append (struct json_cbor_bytes *bytes, const void *data, size_t length)
+{
+	unsigned char *grown;
+
+	if (bytes->capacity - bytes->length < length)
+	{
+		grown = (unsigned char *)realloc (bytes->data, 2 * (bytes->length + length + 8));
+		if (grown == NULL)
+			return JSON_MEMORY;
+		bytes->data = grown;
+		bytes->capacity = 2 * (bytes->length + length + 8);
+	}
+	if (length > 0)
+		memcpy (bytes->data + bytes->length, data, length);
+	bytes->length += length;
+	return JSON_OK;
+}
+
+
+/* encoding part */
+
+static enum json_error
+json_cbor_head (struct json_cbor_bytes *output, unsigned int major, uint64_t argument)
+{
+	unsigned char head[9];
+	size_t size, i;
+
+	if (argument < 24)
+	{
+		head[0] = (unsigned char) ((major << 5) | argument);
+		size = 1;
+	}
+	else
+	{
+		if (argument <= 0xFF)
+			size = 2;
+		else if (argument <= 0xFFFF)
+			size = 3;
+		else if (argument <= 0xFFFFFFFFu)
+			size = 5;
+		else
+			size = 9;
+		head[0] = (unsigned char) ((major << 5) | (size == 2 ? 24 : size == 3 ? 25 : size == 5 ? 26 : 27));
+	}
+	for (i = size - 1; i > 0; i--, argument >>= 8)
+		head[i] = (unsigned char) (argument & 0xFF);
+	return json_cbor_append (output, head, size);
+}
+
+
+/**
+Encodes the text of a string or a label, unescaping it if need be
+**/
+static enum json_error
+json_cbor_text (struct json_cbor_bytes *output, struct json_cbor_bytes *scratch, const json_t * node)
+{
+	struct json_text_reader reader;
+	const char *text = (node->text != NULL) ? node->text : "";
+	unsigned char byte;
+	enum json_error error;
+	int c;
+
+	if ((node->flags & JSON_FLAG_NEEDS_ESCAPING) || (strchr (text, '\\') == NULL))
+	{
+		if ((error = json_cbor_head (output, JSON_CBOR_TEXT, strlen (text))) != JSON_OK)
+			return error;
+		return json_cbor_append (output, text, strlen (text));
+	}
+
+	scratch->length = 0;
+	json_text_reader_init (&reader, node);
+	while ((c = json_text_reader_next (&reader)) != -1)
+	{
+		byte = (unsigned char) c;
+		if ((error = json_cbor_append (scratch, &byte, 1)) != JSON_OK)
+			return error;
+	}
+	if (!json_utf8_valid ((const char *) scratch->data, scratch->length))
+		return JSON_ILLEGAL_CHARACTER;	/* a lone surrogate */
+	if ((error = json_cbor_head (output, JSON_CBOR_TEXT, scratch->length)) != JSON_OK)
+		return error;
+	return json_cbor_append (output, scratch->data, scratch->length);
+}
+
+
+/**
+Encodes an integer beyond 64 bits as a bignum
+@param digits the decimal digits of its magnitude
+**/
+static enum json_error
+json_cbor_bignum (struct json_cbor_bytes *output, const char *digits, size_t count, int negative)
+{
+	unsigned char *decimal, *bytes, swap;
+	size_t size = 0, first = 0, i;
+	unsigned int remainder;
+	enum json_error error;
+
+	decimal = (unsigned char *)malloc (count);
+	bytes = (unsigned char *)malloc (count);
+	if ((decimal == NULL) || (bytes == NULL))
+	{
+		free (decimal);
+		free (bytes);
+		return JSON_MEMORY;
+	}
+	for (i = 0; i < count; i++)
+		decimal[i] = (unsigned char) (digits[i] - '0');
+
+	/* negative bignums hold -1 - n */
+	if (negative)
+	{
+		for (i = count; i-- > 0;)
+		{
+			if (decimal[i] != 0)
+			{
+				decimal[i]--;
+				break;
+			}
+			decimal[i] = 9;
+		}
+	}
+
+	/* dividing by 256 until nothing is left gives the bytes from the least significant one */
+	while (first < count)
+	{
+		for (remainder = 0, i = first; i < count; i++)
+		{
+			remainder = remainder * 10 + decimal[i];
+			decimal[i] = (unsigned char) (remainder / 256);
+			remainder %= 256;
+		}
+		bytes[size++] = (unsigned char) remainder;
+		while ((first < count) && (decimal[first] == 0))
+			first++;
+	}
+	for (i = 0; i < size / 2; i++)
+	{
+		swap = bytes[i];
+		bytes[i] = bytes[size - 1 - i];
+		bytes[size - 1 - i] = swap;
+	}
+
+	if ((error = json_cbor_head (output, JSON_CBOR_TAG, negative ? JSON_CBOR_NEGATIVE_BIGNUM : JSON_CBOR_POSITIVE_BIGNUM)) == JSON_OK)
+		if ((error = json_cbor_head (output, JSON_CBOR_BYTES, size)) == JSON_OK)
+			error = json_cbor_append (output, bytes, size);
+	free (decimal);
+	free (bytes);
+	return error;
+}
+
+
+/**
+Converts a double to a half-precision float, if one holds it exactly
+**/
+static int
+json_cbor_half (uint64_t bits, uint16_t * half)
+{
+	uint64_t mantissa = bits & 0xFFFFFFFFFFFFFull;
+	uint16_t sign = (uint16_t) ((bits >> 48) & 0x8000);
+	int exponent = (int)((bits >> 52) & 0x7FF) - 1023, shift;
+
+	if ((bits & 0x7FFFFFFFFFFFFFFFull) == 0)
+	{
+		*half = sign;
+		return 1;
+	}
+	if ((exponent >= -14) && (exponent <= 15))
+	{
+		if ((mantissa & ((1ull << 42) - 1)) != 0)
+			return 0;
+		*half = (uint16_t) (sign | ((exponent + 15) << 10) | (mantissa >> 42));
+		return 1;
+	}
+	if ((exponent >= -24) && (exponent < -14))
+	{
+		/* a subnormal half, a multiple of 2^-24 */
+		shift = 28 - exponent;
+		mantissa |= 1ull << 52;
+		if ((mantissa & ((1ull << shift) - 1)) != 0)
+			return 0;
+		*half = (uint16_t) (sign | (mantissa >> shift));
+		return 1;
+	}
+	return 0;
+}
+
+
+/**
+Encodes a number as the smallest floating-point type which holds it exactly
+**/
+static enum json_error
+json_cbor_float (struct json_cbor_bytes *output, double value)
+{
+	unsigned char head[9];
+	uint64_t bits;
+	uint32_t single_bits;
+	uint16_t half;
+	float single;
+	size_t size, i;
+
+	memcpy (&bits, &value, sizeof (bits));
+	if (json_cbor_half (bits, &half))
+	{
+		head[0] = 0xF9;
+		bits = half;
+		size = 3;
+	}
+	else if ((value >= -FLT_MAX) && (value <= FLT_MAX) && ((double)(single = (float)value) == value))
+	{
+		memcpy (&single_bits, &single, sizeof (single_bits));
+		head[0] = 0xFA;
+		bits = single_bits;
+		size = 5;
+	}
+	else
+	{
+		head[0] = 0xFB;
+		size = 9;
+	}
+	for (i = size - 1; i > 0; i--, bits >>= 8)
+		head[i] = (unsigned char) (bits & 0xFF);
+	return json_cbor_append (output, head, size);
+}
+
+
+static enum json_error
+json_cbor_number (struct json_cbor_bytes *output, const json_t * node)
+{
+	const char *text = node->text;
+	size_t length, pos = 0, i, start;
+	uint64_t magnitude = 0;
+	int negative, overflow = 0;
+	double value;
+
+	if ((text == NULL) || ((length = strlen (text)) == 0) || (json_validate_number (text, length, &pos) != JSON_OK) || (pos != length))
+		return JSON_INCOMPATIBLE_TYPE;
+
+	negative = (text[0] == '-');
+	start = negative ? 1 : 0;
+	if (strspn (text + start, "0123456789") == length - start)
+	{
+		for (i = start; (i < length) && !overflow; i++)
+		{
+			if (magnitude > (UINT64_MAX - (uint64_t) (text[i] - '0')) / 10)
+				overflow = 1;
+			else
+				magnitude = magnitude * 10 + (uint64_t) (text[i] - '0');
+		}
+		if (!overflow && !negative)
+			return json_cbor_head (output, JSON_CBOR_UNSIGNED, magnitude);
+		if (!overflow && (magnitude > 0))
+			return json_cbor_head (output, JSON_CBOR_NEGATIVE, magnitude - 1);
+		if (overflow && negative && (strcmp (text + 1, "18446744073709551616") == 0))
+			return json_cbor_head (output, JSON_CBOR_NEGATIVE, UINT64_MAX);
+		if (overflow)
+			return json_cbor_bignum (output, text + start, length - start, negative);
+		/* -0 is left to floats, which keep its sign */
+	}
+
+	value = strtod (text, NULL);
+	if ((value > DBL_MAX) || (value < -DBL_MAX))
+		return JSON_INCOMPATIBLE_TYPE;
+	return json_cbor_float (output, value);
+}
+
+
+enum json_error
+json_to_cbor (const json_t * root, unsigned char **cbor, size_t * length)
+{
+	struct json_cbor_bytes output = { NULL, 0, 0 }, scratch = { NULL, 0, 0 };
+	const json_t *node = root, *child;
+	uint64_t count;
+	enum json_error error = JSON_OK;
+
+	assert (root != NULL);
+	assert (cbor != NULL);
+	assert (length != NULL);
+
+	*cbor = NULL;
+	*length = 0;
+	for (;;)
+	{
+		if ((node != root) && (node->parent->type == JSON_OBJECT))
+		{
+			/* a label, which has its value for only child */
+			if ((node->type != JSON_STRING) || (node->child == NULL) || (node->child->next != NULL))
+			{
+				error = JSON_BAD_TREE_STRUCTURE;
+				break;
+			}
+			if ((error = json_cbor_text (&output, &scratch, node)) != JSON_OK)
+				break;
+			node = node->child;
+			continue;
+		}
+
+		switch (node->type)
+		{
+		case JSON_OBJECT:
+		case JSON_ARRAY:
+			for (count = 0, child = node->child; child != NULL; child = child->next)
+				count++;
+			error = json_cbor_head (&output, (node->type == JSON_OBJECT) ? JSON_CBOR_MAP : JSON_CBOR_ARRAY, count);
+			break;
+
+		case JSON_STRING:
+			error = json_cbor_text (&output, &scratch, node);
+			break;
+
+		case JSON_NUMBER:
+			error = json_cbor_number (&output, node);
+			break;
+
+		case JSON_TRUE:
+			error = json_cbor_append (&output, "\xF5", 1);
+			break;
+
+		case JSON_FALSE:
+			error = json_cbor_append (&output, "\xF4", 1);
+			break;
+
+		case JSON_NULL:
+			error = json_cbor_append (&output, "\xF6", 1);
+			break;
+
+		default:
+			error = JSON_BAD_TREE_STRUCTURE;
+			break;
+		}
+		if (error != JSON_OK)
+			break;
+
+		if (((node->type == JSON_OBJECT) || (node->type == JSON_ARRAY)) && (node->child != NULL))
+		{
+			node = node->child;
+			continue;
+		}
+		while ((node != root) && (node->next == NULL))
+			node = node->parent;
+		if (node == root)
+			break;
+		node = node->next;
+	}
+
+	free (scratch.data);
+	if (error != JSON_OK)
+	{
+		free (output.data);
+		return error;
+	}
+	*cbor = output.data;
+	*length = output.length;
+	return JSON_OK;
+}
+
+
+/* decoding part */
+
+/**
+What the reader reports of a data item: the start or the end of a container, or a value
+**/
+struct json_cbor_event
+{
+	enum json_value_type type;
+	int close;		/* set at the end of a container */
+	int label;		/* set for the keys of maps */
+	char separator;		/* the separator the equivalent JSON text holds before the value, or 0 */
+	int complete;		/* set once the whole data item is read */
+	const char *text;	/* the text of strings and numbers, which is not null-terminated */
+	size_t length;
+};
+
+
+/**
+A container being read
+**/
+struct json_cbor_frame
+{
+	uint64_t remaining;	/* the items still to come, if its length is definite */
+	uint64_t items;		/* the items read so far, keys and values counted apart */
+	int indefinite;
+	int map;
+};
+
+
+struct json_cbor_reader
+{
+	struct json_cbor_frame *frames;
+	size_t depth;
+	size_t capacity;
+	unsigned char head[9];	/* the head being read */
+	size_t head_length;
+	int gathering;		/* set while the bytes of a string are read */
+	int chunked;		/* set within a string of indefinite length */
+	unsigned int string_major;
+	uint64_t string_remaining;
+	unsigned int tag;	/* the bignum tag of the coming byte string, or 0 */
+	struct json_cbor_bytes text;	/* the bytes of the string being read */
+	struct json_cbor_bytes scratch;	/* texts converted from bignums and byte strings */
+	struct json_cbor_bytes escaped;	/* texts handed to the saxy functions */
+	char number[32];
+};
+
+
+static void
+json_cbor_reader_reset (struct json_cbor_reader *reader)
+{
+	reader->depth = 0;
+	reader->head_length = 0;
+	reader->gathering = 0;
+	reader->chunked = 0;
+	reader->tag = 0;
+}
+
+
+/**
+Sets up the event of a value, or of the start of a container, from where it stands in its parent
+**/
+static void
+json_cbor_begin (struct json_cbor_reader *reader, struct json_cbor_event *event)
+{
+	const struct json_cbor_frame *frame = (reader->depth > 0) ? &reader->frames[reader->depth - 1] : NULL;
+
+	event->close = 0;
+	event->label = 0;
+	event->separator = 0;
+	event->complete = 0;
+	event->text = NULL;
+	event->length = 0;
+	if (frame == NULL)
+		return;
+	if (frame->map && (frame->items % 2 == 0))
+		event->label = 1;
+	if (frame->map && (frame->items % 2 != 0))
+		event->separator = ':';
+	else if (frame->items > 0)
+		event->separator = ',';
+}
+
+
+/**
+Counts a finished value, or container, in its parent
+**/
+static void
+json_cbor_end (struct json_cbor_reader *reader, struct json_cbor_event *event)
+{
+	struct json_cbor_frame *frame = (reader->depth > 0) ? &reader->frames[reader->depth - 1] : NULL;
+
+	if (frame == NULL)
+	{
+		event->complete = 1;
+		return;
+	}
+	frame->items++;
+	if (!frame->indefinite)
+		frame->remaining--;
+}
+
+
+static enum json_error
+json_cbor_scalar (struct json_cbor_reader *reader, enum json_value_type type, const char *text, size_t length, struct json_cbor_event *event)
+{
+	json_cbor_begin (reader, event);
+	event->type = type;
+	event->text = text;
+	event->length = length;
+	json_cbor_end (reader, event);
+	return JSON_OK;
+}
+
+
+static enum json_error
+json_cbor_close (struct json_cbor_reader *reader, struct json_cbor_event *event)
+{
+	json_cbor_begin (reader, event);
+	event->type = reader->frames[reader->depth - 1].map ? JSON_OBJECT : JSON_ARRAY;
+	event->close = 1;
+	event->label = 0;
+	event->separator = 0;
+	reader->depth--;
+	json_cbor_end (reader, event);
+	return JSON_OK;
+}
+
+
+/**
+Writes the decimal text of a bignum
+**/
+static enum json_error
+json_cbor_bignum_text (struct json_cbor_bytes *output, const unsigned char *bytes, size_t length, int negative)
+{
+	unsigned char *value, swap;
+	size_t count = length + 1, first = 0, i;
+	unsigned int remainder;
+	unsigned char digit;
+
+	if ((value = (unsigned char *)malloc (count)) == NULL)
+		return JSON_MEMORY;
+	value[0] = 0;		/* room for the carry of -1 - n */
+	if (length > 0)
+		memcpy (value + 1, bytes, length);
+	if (negative)
+	{
+		for (i = count; i-- > 0;)
+		{
+			if (++value[i] != 0)
+				break;
+		}
+	}
+
+	/* dividing by 10 until nothing is left gives the digits from the least significant one */
+	output->length = 0;
+	while ((first < count) && (value[first] == 0))
+		first++;
+	do
+	{
+		for (remainder = 0, i = first; i < count; i++)
+		{
+			remainder = remainder * 256 + value[i];
+			value[i] = (unsigned char) (remainder / 10);
+			remainder %= 10;
+		}
+		digit = (unsigned char) ('0' + remainder);
+		if (json_cbor_append (output, &digit, 1) != JSON_OK)
+		{
+			free (value);
+			return JSON_MEMORY;
+		}
+		while ((first < count) && (value[first] == 0))
+			first++;
+	}
+	while (first < count);
+	free (value);
+
+	if (negative && (json_cbor_append (output, "-", 1) != JSON_OK))
+		return JSON_MEMORY;
+	for (i = 0; i < output->length / 2; i++)
+	{
+		swap = output->data[i];
+		output->data[i] = output->data[output->length - 1 - i];
+		output->data[output->length - 1 - i] = swap;
+	}
+	return JSON_OK;
+}
+
+
+/**
+Writes the base64url text of a byte string, without padding
+**/
+static enum json_error
+json_cbor_base64url (struct json_cbor_bytes *output, const unsigned char *bytes, size_t length)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+	char quantum[4];
+	uint32_t group;
+	size_t i, size;
+
+	output->length = 0;
+	for (i = 0; i < length; i += 3)
+	{
+		group = (uint32_t) bytes[i] << 16;
+		if (i + 1 < length)
+			group |= (uint32_t) bytes[i + 1] << 8;
+		if (i + 2 < length)
+			group |= bytes[i + 2];
+		quantum[0] = alphabet[(group >> 18) & 0x3F];
+		quantum[1] = alphabet[(group >> 12) & 0x3F];
+		quantum[2] = alphabet[(group >> 6) & 0x3F];
+		quantum[3] = alphabet[group & 0x3F];
+		size = (length - i >= 3) ? 4 : (length - i == 2) ? 3 : 2;
+		if (json_cbor_append (output, quantum, size) != JSON_OK)
+			return JSON_MEMORY;
+	}
+	return JSON_OK;
+}
+
+
+/**
+Reports a string once all its bytes are read
+**/
+static enum json_error
+json_cbor_string (struct json_cbor_reader *reader, const unsigned char *bytes, size_t length, struct json_cbor_event *event)
+{
+	enum json_error error;
+
+	if (reader->tag != 0)
+	{
+		error = json_cbor_bignum_text (&reader->scratch, bytes, length, reader->tag == JSON_CBOR_NEGATIVE_BIGNUM);
+		reader->tag = 0;
+		if (error != JSON_OK)
+			return error;
+		return json_cbor_scalar (reader, JSON_NUMBER, (const char *)reader->scratch.data, reader->scratch.length, event);
+	}
+	if (reader->string_major == JSON_CBOR_TEXT)
+	{
+		if ((length > 0) && !json_utf8_valid ((const char *)bytes, length))
+			return JSON_ILLEGAL_CHARACTER;
+		return json_cbor_scalar (reader, JSON_STRING, (const char *)bytes, length, event);
+	}
+	if ((error = json_cbor_base64url (&reader->scratch, bytes, length)) != JSON_OK)
+		return error;
+	return json_cbor_scalar (reader, JSON_STRING, (const char *)reader->scratch.data, reader->scratch.length, event);
+}
+
+
+/**
+Writes the shortest text which reads back as the same double. Floats of single and half precision are written as the doubles they convert to, so that numbers survive a round trip through json_to_cbor()
+**/
+static enum json_error
+json_cbor_double (struct json_cbor_reader *reader, double value, struct json_cbor_event *event)
+{
+	int precision;
+
+	if ((value != value) || (value > DBL_MAX) || (value < -DBL_MAX))
+		return json_cbor_scalar (reader, JSON_NULL, NULL, 0, event);	/* no JSON number stands for them */
+
+	for (precision = 15; precision < 17; precision++)
+	{
+		snprintf (reader->number, sizeof (reader->number), "%.*g", precision, value);
+		if (strtod (reader->number, NULL) == value)
+			break;
+	}
+	if (precision == 17)
+		snprintf (reader->number, sizeof (reader->number), "%.17g", value);
+	return json_cbor_scalar (reader, JSON_NUMBER, reader->number, strlen (reader->number), event);
+}
+
+
+static enum json_error
+json_cbor_simple (struct json_cbor_reader *reader, unsigned int info, uint64_t argument, struct json_cbor_event *event)
+{
+	uint64_t bits;
+	uint32_t single_bits;
+	float single;
+	double value;
+	unsigned int exponent, mantissa;
+
+	switch (info)
+	{
+	case 20:
+		return json_cbor_scalar (reader, JSON_FALSE, NULL, 0, event);
+
+	case 21:
+		return json_cbor_scalar (reader, JSON_TRUE, NULL, 0, event);
+
+	case 24:
+		if (argument < 32)
+			return JSON_MALFORMED_DOCUMENT;	/* simple values below 32 take no extra byte */
+		return json_cbor_scalar (reader, JSON_NULL, NULL, 0, event);
+
+	case 25:
+		exponent = (unsigned int)((argument >> 10) & 0x1F);
+		mantissa = (unsigned int)(argument & 0x3FF);
+		if (exponent == 31)
+			return json_cbor_scalar (reader, JSON_NULL, NULL, 0, event);
+		if (exponent == 0)
+			value = (double)mantissa / 16777216.0;
+		else
+		{
+			bits = ((uint64_t) (exponent - 15 + 1023) << 52) | ((uint64_t) mantissa << 42);
+			memcpy (&value, &bits, sizeof (value));
+		}
+		return json_cbor_double (reader, (argument & 0x8000) ? -value : value, event);
+
+	case 26:
+		single_bits = (uint32_t) argument;
+		memcpy (&single, &single_bits, sizeof (single));
+		return json_cbor_double (reader, (double)single, event);
+
+	case 27:
+		memcpy (&value, &argument, sizeof (value));
+		return json_cbor_double (reader, value, event);
+
+	default:
+		/* null, undefined and the other simple values */
+		return json_cbor_scalar (reader, JSON_NULL, NULL, 0, event);
+	}
+}
+
+
+/**
+Reads bytes up to the next event
+@param pos the position within cbor, which is moved past the bytes read
+@return JSON_OK with an event, JSON_INCOMPLETE_DOCUMENT once cbor is consumed before one or an error
+**/
+static enum json_error
+json_cbor_next (struct json_cbor_reader *reader, const unsigned char *cbor, size_t length, size_t * pos, struct json_cbor_event *event)
+{
+	struct json_cbor_frame *frame, *grown;
+	unsigned int major, info;
+	size_t size, take, i;
+	uint64_t argument;
+
+	for (;;)
+	{
+		frame = (reader->depth > 0) ? &reader->frames[reader->depth - 1] : NULL;
+
+		/* containers of definite length end without a byte of their own */
+		if (!reader->gathering && !reader->chunked && (reader->head_length == 0) && (reader->tag == 0) && (frame != NULL) && !frame->indefinite && (frame->remaining == 0))
+			return json_cbor_close (reader, event);
+
+		if (reader->gathering)
+		{
+			take = length - *pos;
+			if (take > reader->string_remaining)
+				take = (size_t) reader->string_remaining;
+			if (json_cbor_append (&reader->text, cbor + *pos, take) != JSON_OK)
+				return JSON_MEMORY;
+			*pos += take;
+			reader->string_remaining -= take;
+			if (reader->string_remaining > 0)
+				return JSON_INCOMPLETE_DOCUMENT;
+			reader->gathering = 0;
+			if (!reader->chunked)
+				return json_cbor_string (reader, reader->text.data, reader->text.length, event);
+			continue;
+		}
+
+		/* the head: an initial byte followed by the bytes of its argument */
+		if (reader->head_length == 0)
+		{
+			if (*pos == length)
+				return JSON_INCOMPLETE_DOCUMENT;
+			reader->head[reader->head_length++] = cbor[(*pos)++];
+		}
+		info = reader->head[0] & 0x1F;
+		if ((info >= 28) && (info <= 30))
+			return JSON_MALFORMED_DOCUMENT;
+		size = ((info < 24) || (info == JSON_CBOR_INDEFINITE)) ? 1 : 1 + ((size_t) 1 << (info - 24));
+		while (reader->head_length < size)
+		{
+			if (*pos == length)
+				return JSON_INCOMPLETE_DOCUMENT;
+			reader->head[reader->head_length++] = cbor[(*pos)++];
+		}
+		reader->head_length = 0;
+		major = reader->head[0] >> 5;
+		for (argument = (size == 1) ? info : 0, i = 1; i < size; i++)
+			argument = (argument << 8) | reader->head[i];
+
+		if (reader->chunked)
+		{
+			/* the chunks of a string of indefinite length are strings of the same type and of definite length */
+			if (reader->head[0] == JSON_CBOR_BREAK)
+			{
+				reader->chunked = 0;
+				return json_cbor_string (reader, reader->text.data, reader->text.length, event);
+			}
+			if ((major != reader->string_major) || (info == JSON_CBOR_INDEFINITE))
+				return JSON_MALFORMED_DOCUMENT;
+			reader->string_remaining = argument;
+			reader->gathering = 1;
+			continue;
+		}
+
+		if (reader->head[0] == JSON_CBOR_BREAK)
+		{
+			if ((frame == NULL) || !frame->indefinite || (reader->tag != 0) || (frame->map && (frame->items % 2 != 0)))
+				return JSON_MALFORMED_DOCUMENT;
+			return json_cbor_close (reader, event);
+		}
+		if ((info == JSON_CBOR_INDEFINITE) && ((major < JSON_CBOR_BYTES) || (major > JSON_CBOR_MAP)))
+			return JSON_MALFORMED_DOCUMENT;
+		if ((frame != NULL) && frame->map && (frame->items % 2 == 0) && (major != JSON_CBOR_TEXT))
+			return JSON_INCOMPATIBLE_TYPE;	/* JSON labels are texts */
+		if ((reader->tag != 0) && (major != JSON_CBOR_BYTES))
+			return JSON_MALFORMED_DOCUMENT;	/* bignums are byte strings */
+
+		switch (major)
+		{
+		case JSON_CBOR_UNSIGNED:
+			snprintf (reader->number, sizeof (reader->number), "%llu", (unsigned long long)argument);
+			return json_cbor_scalar (reader, JSON_NUMBER, reader->number, strlen (reader->number), event);
+
+		case JSON_CBOR_NEGATIVE:
+			if (argument == UINT64_MAX)
+				strcpy (reader->number, "-18446744073709551616");
+			else
+				snprintf (reader->number, sizeof (reader->number), "-%llu", (unsigned long long)argument + 1);
+			return json_cbor_scalar (reader, JSON_NUMBER, reader->number, strlen (reader->number), event);
+
+		case JSON_CBOR_BYTES:
+		case JSON_CBOR_TEXT:
+			reader->string_major = major;
+			reader->text.length = 0;
+			if (info == JSON_CBOR_INDEFINITE)
+			{
+				reader->chunked = 1;
+				continue;
+			}
+			/* strings which the buffer holds whole are read in place */
+			if (length - *pos >= argument)
+			{
+				*pos += (size_t) argument;
+				return json_cbor_string (reader, cbor + *pos - argument, (size_t) argument, event);
+			}
+			reader->string_remaining = argument;
+			reader->gathering = 1;
+			continue;
+
+		case JSON_CBOR_ARRAY:
+		case JSON_CBOR_MAP:
+			if ((major == JSON_CBOR_MAP) && (info != JSON_CBOR_INDEFINITE) && (argument > UINT64_MAX / 2))
+				return JSON_MAXIMUM_LENGTH;
+			if (reader->depth == reader->capacity)
+			{
+				grown = (struct json_cbor_frame *)realloc (reader->frames, 2 * (reader->capacity + 8) * sizeof (struct json_cbor_frame));
+				if (grown == NULL)
+					return JSON_MEMORY;
+				reader->frames = grown;
+				reader->capacity = 2 * (reader->capacity + 8);
+			}
+			json_cbor_begin (reader, event);
+			event->type = (major == JSON_CBOR_MAP) ? JSON_OBJECT : JSON_ARRAY;
+			frame = &reader->frames[reader->depth++];
+			frame->indefinite = (info == JSON_CBOR_INDEFINITE);
+			frame->map = (major == JSON_CBOR_MAP);
+			frame->remaining = frame->map ? 2 * argument : argument;
+			frame->items = 0;
+			return JSON_OK;
+
+		case JSON_CBOR_TAG:
+			/* bignums are read as numbers, while the other tags are dropped */
+			if ((argument == JSON_CBOR_POSITIVE_BIGNUM) || (argument == JSON_CBOR_NEGATIVE_BIGNUM))
+				reader->tag = (unsigned int)argument;
+			continue;
+
+		default:
+			return json_cbor_simple (reader, info, argument, event);
+		}
+	}
+}
+
+
+/**
+Appends the text of a string in the escaped form json_t holds parsed strings in, null-terminated
+**/
+static enum json_error
+json_cbor_escape (struct json_cbor_bytes *output, const char *text, size_t length)
+{
+	char sequence[7];
+	size_t i = 0, run;
+	unsigned char c;
+
+	if (text == NULL)
+		text = "";
+	while (i < length)
+	{
+		run = json_string_span (text + i, length - i);
+		if (json_cbor_append (output, text + i, run) != JSON_OK)
+			return JSON_MEMORY;
+		if ((i += run) == length)
+			break;
+		c = (unsigned char) text[i++];
+		sequence[0] = '\\';
+		run = 2;
+		switch (c)
+		{
+		case '\"':
+		case '\\':
+			sequence[1] = (char) c;
+			break;
+		case '\b':
+			sequence[1] = 'b';
+			break;
+		case '\f':
+			sequence[1] = 'f';
+			break;
+		case '\n':
+			sequence[1] = 'n';
+			break;
+		case '\r':
+			sequence[1] = 'r';
+			break;
+		case '\t':
+			sequence[1] = 't';
+			break;
+		default:
+			snprintf (sequence, sizeof (sequence), "\\u%04x", c);
+			run = 6;
+			break;
+		}
+		if (json_cbor_append (output, sequence, run) != JSON_OK)
+			return JSON_MEMORY;
+	}
+	return json_cbor_append (output, "", 1);
+}
+
+
+/**
+Creates the node of a value the reader reported
+@param escaped a buffer for the texts which hold null characters, which only their escaped form can keep
+**/
+static json_t *
+json_cbor_node (const struct json_cbor_event *event, struct json_cbor_bytes *escaped)
+{
+	json_t *node;
+	const char *text = event->text;
+	size_t length = event->length;
+	int flags = 0;
+
+	if ((event->type != JSON_STRING) && (event->type != JSON_NUMBER))
+		return json_new_value (event->type);
+
+	if (text == NULL)
+		text = "";
+	if ((event->type == JSON_STRING) && (memchr (text, '\0', length) != NULL))
+	{
+		escaped->length = 0;
+		if (json_cbor_escape (escaped, text, length) != JSON_OK)
+			return NULL;
+		text = (const char *)escaped->data;
+		length = escaped->length - 1;
+	}
+	else if ((event->type == JSON_STRING) && (json_string_span (text, length) != length))
+		flags = JSON_FLAG_NEEDS_ESCAPING;
+
+	if ((node = json_new_value (event->type)) == NULL)
+		return NULL;
+	if ((node->text = (char *)malloc (length + 1)) == NULL)
+	{
+		free (node);
+		return NULL;
+	}
+	memcpy (node->text, text, length);
+	node->text[length] = '\0';
+	node->flags = flags;
+	return node;
+}
+
+
+enum json_error
+json_from_cbor (const unsigned char *cbor, size_t length, json_t ** root)
+{
+	struct json_cbor_reader reader;
+	struct json_cbor_bytes escaped = { NULL, 0, 0 };
+	struct json_cbor_event event;
+	json_t *document = NULL, *current = NULL, *node;
+	size_t pos = 0;
+	enum json_error error;
+
+	assert ((cbor != NULL) || (length == 0));
+	assert (root != NULL);
+
+	*root = NULL;
+	memset (&reader, 0, sizeof (reader));
+	while ((error = json_cbor_next (&reader, cbor, length, &pos, &event)) == JSON_OK)
+	{
+		if (event.close)
+		{
+			/* the container ends, along with the member it is the value of */
+			current = current->parent;
+			if ((current != NULL) && (current->type == JSON_STRING))
+				current = current->parent;
+		}
+		else
+		{
+			if ((node = json_cbor_node (&event, &escaped)) == NULL)
+			{
+				error = JSON_MEMORY;
+				break;
+			}
+			if (current == NULL)
+				document = node;
+			else if ((error = json_insert_child (current, node)) != JSON_OK)
+			{
+				json_free_value (&node);
+				break;
+			}
+
+			if (event.label || (event.type == JSON_OBJECT) || (event.type == JSON_ARRAY))
+				current = node;
+			else if ((current != NULL) && (current->type == JSON_STRING))
+				current = current->parent;	/* the value of a label ends its member */
+		}
+		if (event.complete)
+			break;
+	}
+	if ((error == JSON_OK) && (pos != length))
+		error = JSON_MALFORMED_DOCUMENT;
+
+	free (reader.frames);
+	free (reader.text.data);
+	free (reader.scratch.data);
+	free (escaped.data);
+	if (error != JSON_OK)
+	{
+		if (document != NULL)
+			json_free_value (&document);
+		return error;
+	}
+	*root = document;
+	return JSON_OK;
+}
+
+
+struct json_cbor_reader *
+json_cbor_reader_new (void)
+{
+	return (struct json_cbor_reader *)calloc (1, sizeof (struct json_cbor_reader));
+}
+
+
+enum json_error
+json_cbor_reader_feed (struct json_cbor_reader *reader, struct json_saxy_functions *jsf, const unsigned char *cbor, size_t length, size_t * used)
+{
+	struct json_cbor_event event;
+	size_t pos = 0;
+	enum json_error error;
+
+	assert (reader != NULL);
+	assert (jsf != NULL);
+	assert ((cbor != NULL) || (length == 0));
+	assert (used != NULL);
+
+	while ((error = json_cbor_next (reader, cbor, length, &pos, &event)) == JSON_OK)
+	{
+		if ((event.separator == ',') && (jsf->sibling_separator != NULL))
+			jsf->sibling_separator ();
+		else if ((event.separator == ':') && (jsf->label_value_separator != NULL))
+			jsf->label_value_separator ();
+
+		switch (event.type)
+		{
+		case JSON_OBJECT:
+			if (event.close && (jsf->close_object != NULL))
+				jsf->close_object ();
+			else if (!event.close && (jsf->open_object != NULL))
+				jsf->open_object ();
+			break;
+
+		case JSON_ARRAY:
+			if (event.close && (jsf->close_array != NULL))
+				jsf->close_array ();
+			else if (!event.close && (jsf->open_array != NULL))
+				jsf->open_array ();
+			break;
+
+		case JSON_STRING:
+		case JSON_NUMBER:
+			reader->escaped.length = 0;
+			if (event.type == JSON_STRING)
+				error = json_cbor_escape (&reader->escaped, event.text, event.length);
+			else if ((error = json_cbor_append (&reader->escaped, event.text, event.length)) == JSON_OK)
+				error = json_cbor_append (&reader->escaped, "", 1);
+			if (error != JSON_OK)
+				break;
+			if ((event.type == JSON_STRING) && (jsf->new_string != NULL))
+				jsf->new_string ((char *)reader->escaped.data);
+			else if ((event.type == JSON_NUMBER) && (jsf->new_number != NULL))
+				jsf->new_number ((char *)reader->escaped.data);
+			break;
+
+		case JSON_TRUE:
+			if (jsf->new_true != NULL)
+				jsf->new_true ();
+			break;
+
+		case JSON_FALSE:
+			if (jsf->new_false != NULL)
+				jsf->new_false ();
+			break;
+
+		default:
+			if (jsf->new_null != NULL)
+				jsf->new_null ();
+			break;
+		}
+		if ((error != JSON_OK) || event.complete)
+			break;
+	}
+
+	*used = pos;
+	if ((error != JSON_OK) && (error != JSON_INCOMPLETE_DOCUMENT))
+		json_cbor_reader_reset (reader);
+	return error;
+}
+
+
+void
+json_cbor_reader_free (struct json_cbor_reader **reader)
+{
+	assert (reader != NULL);
+	if (*reader == NULL)
+		return;
+
+	free ((*reader)->frames);
+	free ((*reader)->text.data);
+	free ((*reader)->scratch.data);
+	free ((*reader)->escaped.data);
+	free (*reader);
+	*reader = NULL;
+}
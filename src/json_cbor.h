@@ -0,0 +1,72 @@
+/*// C Interface: json_cbor*/
+/*// Description: conversion of document trees to and from CBOR (RFC 8949)*/
+/*// Copyright: See COPYING file that comes with this distribution*/
+
+
+#ifndef JSON_CBOR_H
+#define JSON_CBOR_H
+
+#include "json.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+Encodes a document tree as CBOR. Strings and labels become text strings holding their unescaped text. Numbers take their native encodings, with the shortest of the preferred serialization: integers fitting 64 bits become integers, larger ones bignums, and the others the smallest floating-point type which holds them exactly
+@param root the root of the tree, which may be of any type
+@param cbor receives the encoded bytes, to be freed with free()
+@param length receives the number of encoded bytes
+@return JSON_OK, JSON_BAD_TREE_STRUCTURE if the tree is malformed, JSON_INCOMPATIBLE_TYPE if a number is not a JSON number or lies beyond the range of doubles, JSON_ILLEGAL_CHARACTER if a string escapes a lone surrogate, or JSON_MEMORY
+**/
+	enum json_error json_to_cbor (const json_t * root, unsigned char **cbor, size_t * length);
+
+
+/**
+Decodes a CBOR data item into a document tree, as section 6.1 of RFC 8949 converts CBOR to JSON: byte strings become base64url strings, bignums integers, non-finite floats, undefined and the other simple values null, and tags other than bignums are dropped. Strings keep their plain text, flagged JSON_FLAG_NEEDS_ESCAPING where required
+@param cbor the encoded bytes
+@param length the number of bytes in cbor, which must hold exactly one data item
+@param root receives the tree, to be freed with json_free_value()
+@return JSON_OK, JSON_INCOMPLETE_DOCUMENT if cbor ends within the data item, JSON_MALFORMED_DOCUMENT if it is not well-formed CBOR or holds more than the item, JSON_ILLEGAL_CHARACTER if a text string is not valid UTF-8, JSON_INCOMPATIBLE_TYPE if a map key is not a text string, JSON_MAXIMUM_LENGTH if a map announces more members than can be counted, or JSON_MEMORY
+**/
+	enum json_error json_from_cbor (const unsigned char *cbor, size_t length, json_t ** root);
+
+
+/**
+A streaming CBOR reader, which is fed a sequence of data items in chunks of any size and calls the functions of the saxy parser as it goes
+**/
+	struct json_cbor_reader;
+
+
+/**
+@return a new reader or NULL if memory ran out
+**/
+	struct json_cbor_reader *json_cbor_reader_new (void);
+
+
+/**
+Feeds bytes to a reader, which calls the functions jsf holds for the events json_saxy_parse() would report on the equivalent JSON text, separators included. Strings, labels and numbers are handed over in the form json_saxy_parse() hands them, and are converted as json_from_cbor() converts them. The reader stops at the end of each data item, so that it reads sequences of them
+@param reader the reader
+@param jsf the functions to call, any of which may be NULL
+@param cbor the bytes
+@param length the number of bytes in cbor
+@param used receives the number of bytes the reader took from cbor
+@return JSON_OK once a data item has ended, after which the rest of cbor, from *used on, holds the next one, JSON_INCOMPLETE_DOCUMENT once cbor is consumed within a data item, or one of the errors of json_from_cbor(), after which the reader is reset
+**/
+	enum json_error json_cbor_reader_feed (struct json_cbor_reader *reader, struct json_saxy_functions *jsf, const unsigned char *cbor, size_t length, size_t * used);
+
+
+/**
+Frees a reader and sets it to NULL
+@param reader the reader
+**/
+	void json_cbor_reader_free (struct json_cbor_reader **reader);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
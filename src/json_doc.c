@@ -0,0 +1,154 @@
+/*
+*  C Implementation: json_doc
+*
+* Description: document handles which readers share while writers replace the document
+*
+*
+* Copyright: See COPYING file that comes with this distribution
+*
+*/
+
+#include "json_doc.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sched.h>
+#include <assert.h>
+
+
+/**
+A reader counter, alone in its cache line
+**/
+struct json_doc_counter
+{
+	size_t readers;
+	char padding[64 - sizeof (size_t)];
+};
+
+
+/**
+Readers count themselves in the counters of the current phase. A writer swaps the document, then flips the phase twice, each time waiting for the counters of the phase it left to drain. A reader that counted itself in a phase before the first flip is waited for by either round, while one counting itself afterwards can only load the new document
+**/
+struct json_doc_handle
+{
+	struct json_doc_counter counters[2][JSON_DOC_STRIPES];
+	json_t *document;
+	unsigned int phase;
+	int publishing;		/* set while a writer publishes */
+	json_doc_destructor destructor;
+	void *data;
+};
+
+
+/* a variable of every thread, whose address tells the threads apart */
+static __thread char json_doc_thread;
+
+
+static unsigned int
+json_doc_stripe (void)
+{
+	uintptr_t address = (uintptr_t) & json_doc_thread;
+
+	address ^= address >> 17;
+	address *= 0x9E3779B1u;
+	return (unsigned int)((address >> 12) % JSON_DOC_STRIPES);
+}
+
+
+struct json_doc_handle *
+json_doc_handle_new (json_t * document, json_doc_destructor destructor, void *data)
+{
+	struct json_doc_handle *handle;
+
+	assert (document != NULL);
+
+	if ((handle = (struct json_doc_handle *)calloc (1, sizeof (struct json_doc_handle))) == NULL)
+		return NULL;
+	handle->document = document;
+	handle->destructor = destructor;
+	handle->data = data;
+	return handle;
+}
+
+
+const json_t *
+json_doc_acquire (struct json_doc_handle *handle, unsigned int *token)
+{
+	unsigned int phase, stripe = json_doc_stripe ();
+
+	assert (handle != NULL);
+	assert (token != NULL);
+
+	phase = __atomic_load_n (&handle->phase, __ATOMIC_RELAXED);
+	__atomic_add_fetch (&handle->counters[phase][stripe].readers, 1, __ATOMIC_SEQ_CST);
+	*token = phase * JSON_DOC_STRIPES + stripe;
+	return __atomic_load_n (&handle->document, __ATOMIC_SEQ_CST);
+}
+
+
+void
+json_doc_release (struct json_doc_handle *handle, unsigned int token)
+{
+	assert (handle != NULL);
+	assert (token < 2 * JSON_DOC_STRIPES);
+
+	__atomic_sub_fetch (&handle->counters[token / JSON_DOC_STRIPES][token % JSON_DOC_STRIPES].readers, 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+Moves readers on to the other phase and waits for those of the phase left to be done
+**/
+static void
+json_doc_flip (struct json_doc_handle *handle)
+{
+	unsigned int phase = __atomic_load_n (&handle->phase, __ATOMIC_RELAXED), stripe;
+
+	__atomic_store_n (&handle->phase, 1 - phase, __ATOMIC_SEQ_CST);
+	for (stripe = 0; stripe < JSON_DOC_STRIPES; stripe++)
+	{
+		/* sequentially consistent, as acquire loads could be ordered before the stores of the document and the phase, missing a reader which has just counted itself and still loads the old document */
+		while (__atomic_load_n (&handle->counters[phase][stripe].readers, __ATOMIC_SEQ_CST) != 0)
+			sched_yield ();
+	}
+}
+
+
+void
+json_doc_publish (struct json_doc_handle *handle, json_t * document)
+{
+	json_t *old;
+
+	assert (handle != NULL);
+	assert (document != NULL);
+
+	while (__atomic_exchange_n (&handle->publishing, 1, __ATOMIC_ACQUIRE) != 0)
+		sched_yield ();
+
+	old = __atomic_exchange_n (&handle->document, document, __ATOMIC_SEQ_CST);
+	json_doc_flip (handle);
+	json_doc_flip (handle);
+
+	__atomic_store_n (&handle->publishing, 0, __ATOMIC_RELEASE);
+
+	if (handle->destructor != NULL)
+		handle->destructor (old, handle->data);
+	else
+		json_free_value (&old);
+}
+
+
+void
+json_doc_handle_free (struct json_doc_handle **handle)
+{
+	assert (handle != NULL);
+	if (*handle == NULL)
+		return;
+
+	if ((*handle)->destructor != NULL)
+		(*handle)->destructor ((*handle)->document, (*handle)->data);
+	else
+		json_free_value (&(*handle)->document);
+	free (*handle);
+	*handle = NULL;
+}
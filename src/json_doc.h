@@ -0,0 +1,81 @@
+/*// C Interface: json_doc*/
+/*// Description: document handles which readers share while writers replace the document*/
+/*// Copyright: See COPYING file that comes with this distribution*/
+
+
+#ifndef JSON_DOC_H
+#define JSON_DOC_H
+
+#include "json.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/* the number of counters readers are spread over, so that threads seldom write to the same cache line */
+#define JSON_DOC_STRIPES 16
+
+
+/**
+A handle on a document which any number of threads read while others publish new versions of it, in the manner of read-copy-update. Readers never wait: acquiring and releasing the document costs an atomic increment and decrement of a counter which few other threads touch. A writer publishing a version waits until every reader of the previous one has released it, then frees it
+**/
+	struct json_doc_handle;
+
+
+/**
+The function which frees a document that is no longer published nor read
+@param document the document
+@param data the user data given to json_doc_handle_new()
+**/
+	typedef void (*json_doc_destructor) (json_t * document, void *data);
+
+
+/**
+Creates a document handle
+@param document the first version of the document, which the handle takes over
+@param destructor the function which frees the versions of the document, such as one dropping the json_arena they were cloned into, or NULL to free them with json_free_value()
+@param data user data handed to destructor
+@return the handle or NULL if memory ran out
+**/
+	struct json_doc_handle *json_doc_handle_new (json_t * document, json_doc_destructor destructor, void *data);
+
+
+/**
+Acquires the current version of a document. The version remains valid, and must not be modified, until it is released. Any number of threads may read it at once through the library's lookup functions, such as json_find_first_label() or json_array_get(), as the indexes these build on first use are only ever published whole
+@param handle the document handle
+@param token receives what json_doc_release() needs to release the version
+@return the current version
+**/
+	const json_t *json_doc_acquire (struct json_doc_handle *handle, unsigned int *token);
+
+
+/**
+Releases a version of a document acquired with json_doc_acquire()
+@param handle the document handle
+@param token the token json_doc_acquire() gave
+**/
+	void json_doc_release (struct json_doc_handle *handle, unsigned int token);
+
+
+/**
+Publishes a new version of a document. Readers which acquire the document from then on get the new version; once the readers of the previous version have all released it, it is freed and the function returns. Writers publishing at the same time take turns. A thread must not publish while it holds a version of the same document
+@param handle the document handle
+@param document the new version, which the handle takes over
+**/
+	void json_doc_publish (struct json_doc_handle *handle, json_t * document);
+
+
+/**
+Frees a document handle along with the current version of the document, and sets it to NULL. No thread may be reading the document
+@param handle the document handle
+**/
+	void json_doc_handle_free (struct json_doc_handle **handle);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
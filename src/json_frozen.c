@@ -0,0 +1,643 @@
+/*
+*  C Implementation: json_frozen
+*
+* Description: frozen, read-only documents held in a single allocation
+*
+*
+* Copyright: See COPYING file that comes with this distribution
+*
+*/
+
+#include "json_frozen.h"
+#include "json_internal.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+
+struct json_frozen_node
+{
+	uint16_t type;		/* the enum json_value_type */
+	uint16_t flags;		/* JSON_FLAG_NEEDS_ESCAPING for texts which hold no escape sequences */
+	uint32_t count;		/* the number of elements or members, or the length of the text */
+	int64_t offset;		/* from this node to its elements, its members or its text */
+};
+
+
+struct json_frozen_label
+{
+	int64_t text;		/* from this label to its text */
+	uint32_t length;
+	uint32_t flags;		/* JSON_FLAG_NEEDS_ESCAPING if the text holds no escape sequences, and on the first label of a shape JSON_FROZEN_ESCAPED_SHAPE */
+};
+
+
+/**
+The members of an object: its shape, that is the vector of its labels sorted, which every object with the same labels shares, followed by the vector of its values in the same order
+**/
+struct json_frozen_members
+{
+	int64_t shape;		/* from these members to the labels of the shape */
+	struct json_frozen_node values[1];
+};
+
+
+/**
+The image starts with this header, which is followed by the vectors of nodes, the shapes and the texts
+**/
+struct json_frozen
+{
+	uint64_t size;		/* the size of the whole image */
+	struct json_frozen_node root;
+};
+
+
+#define JSON_FROZEN_AT(node, offset) ((const char *)(node) + (offset))
+/* set on the first label of a shape in which some label holds escape sequences */
+#define JSON_FROZEN_ESCAPED_SHAPE 0x100
+#define JSON_FROZEN_MEMBERS_SIZE(count) (offsetof (struct json_frozen_members, values) + (count) * sizeof (struct json_frozen_node))
+
+
+static const struct json_frozen_members *
+json_frozen_members (const struct json_frozen_node *object)
+{
+	return (const struct json_frozen_members *)JSON_FROZEN_AT (object, object->offset);
+}
+
+
+static const struct json_frozen_label *
+json_frozen_shape (const struct json_frozen_members *members)
+{
+	return (const struct json_frozen_label *)JSON_FROZEN_AT (members, members->shape);
+}
+
+
+/* freezing part */
+
+/**
+A label of the object being frozen, along with what is needed to sort it
+**/
+struct json_frozen_sorted
+{
+	const json_t *label;
+	size_t length;
+	size_t index;
+};
+
+
+/**
+A shape already in the image, found again by the hash of its labels
+**/
+struct json_frozen_known_shape
+{
+	uint64_t hash;
+	size_t count;
+	const struct json_frozen_label *labels;
+};
+
+
+/**
+A vector of nodes whose values are being frozen
+**/
+struct json_frozen_frame
+{
+	struct json_frozen_node *nodes;
+	size_t count;
+	size_t position;
+};
+
+
+struct json_frozen_builder
+{
+	char *end;		/* where the next vector or text goes */
+	struct json_frozen_sorted *sorted;
+	struct json_frozen_known_shape *shapes;
+	size_t shapes_count;
+	size_t shapes_capacity;	/* a power of two */
+};
+
+
+static int
+json_frozen_sorted_compare (const void *a, const void *b)
+{
+	const struct json_frozen_sorted *x = (const struct json_frozen_sorted *)a, *y = (const struct json_frozen_sorted *)b;
+	int result = memcmp (x->label->text, y->label->text, (x->length < y->length) ? x->length : y->length);
+
+	if (result != 0)
+		return result;
+	if (x->length != y->length)
+		return (x->length < y->length) ? -1 : 1;
+	return (x->index < y->index) ? -1 : (x->index > y->index);
+}
+
+
+static size_t
+json_frozen_children (const json_t * node)
+{
+	const json_t *cursor;
+	size_t count = 0;
+
+	for (cursor = node->child; cursor != NULL; cursor = cursor->next)
+		count++;
+	return count;
+}
+
+
+/**
+Works out an upper bound of the size of the image of a tree, before any shape is shared, and checks that the tree can be frozen
+@param size receives the bound, header excluded
+@param widest receives the largest number of members of an object
+**/
+static enum json_error
+json_frozen_measure (const json_t * root, size_t *size, size_t *widest)
+{
+	const json_t *node = root;
+	size_t count, length;
+
+	*size = *widest = 0;
+	for (;;)
+	{
+		if ((node != root) && (node->parent->type == JSON_OBJECT))
+		{
+			/* a label */
+			if ((node->type != JSON_STRING) || (node->child == NULL) || (node->child->next != NULL))
+				return JSON_BAD_TREE_STRUCTURE;
+			if ((length = strlen (node->text)) > UINT32_MAX)
+				return JSON_MAXIMUM_LENGTH;
+			*size += length + 1;
+			node = node->child;
+			continue;
+		}
+
+		switch (node->type)
+		{
+		case JSON_OBJECT:
+			if ((count = json_frozen_children (node)) > UINT32_MAX)
+				return JSON_MAXIMUM_LENGTH;
+			*size += JSON_FROZEN_MEMBERS_SIZE (count) + count * sizeof (struct json_frozen_label) + 2 * sizeof (int64_t);	/* each vector may need aligning */
+			if (count > *widest)
+				*widest = count;
+			break;
+		case JSON_ARRAY:
+			if ((count = json_frozen_children (node)) > UINT32_MAX)
+				return JSON_MAXIMUM_LENGTH;
+			*size += count * sizeof (struct json_frozen_node) + sizeof (int64_t);
+			break;
+		case JSON_STRING:
+		case JSON_NUMBER:
+			if ((length = strlen (node->text)) > UINT32_MAX)
+				return JSON_MAXIMUM_LENGTH;
+			*size += length + 1;
+			break;
+		default:
+			break;
+		}
+
+		if (((node->type == JSON_OBJECT) || (node->type == JSON_ARRAY)) && (node->child != NULL))
+		{
+			node = node->child;
+			continue;
+		}
+		while ((node != root) && (node->next == NULL))
+			node = node->parent;
+		if (node == root)
+			return JSON_OK;
+		node = node->next;
+	}
+}
+
+
+static char *
+json_frozen_reserve (struct json_frozen_builder *builder, size_t size)
+{
+	char *block;
+
+	builder->end += (sizeof (int64_t) - ((uintptr_t) builder->end % sizeof (int64_t))) % sizeof (int64_t);
+	block = builder->end;
+	builder->end += size;
+	return block;
+}
+
+
+static const char *
+json_frozen_text_copy (struct json_frozen_builder *builder, const char *text, size_t length)
+{
+	char *copy = builder->end;
+
+	memcpy (copy, text, length + 1);
+	builder->end += length + 1;
+	return copy;
+}
+
+
+/**
+Finds the shape of the sorted labels of an object among those already in the image, or adds it
+@return the labels of the shape or NULL if memory ran out
+**/
+static const struct json_frozen_label *
+json_frozen_intern_shape (struct json_frozen_builder *builder, size_t count)
+{
+	struct json_frozen_known_shape *known, *grown;
+	struct json_frozen_label *labels;
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i, slot, capacity;
+
+	for (i = 0; i < count; i++)
+		hash = (hash ^ json_hash_text (builder->sorted[i].label->text, builder->sorted[i].length)) * 1099511628211ULL;
+
+	for (slot = hash & (builder->shapes_capacity - 1);; slot = (slot + 1) & (builder->shapes_capacity - 1))
+	{
+		known = &builder->shapes[slot];
+		if (known->labels == NULL)
+			break;
+		if ((known->hash != hash) || (known->count != count))
+			continue;
+		for (i = 0; i < count; i++)
+		{
+			if ((known->labels[i].length != builder->sorted[i].length) || (memcmp (JSON_FROZEN_AT (&known->labels[i], known->labels[i].text), builder->sorted[i].label->text, builder->sorted[i].length) != 0))
+				break;
+		}
+		if (i == count)
+			return known->labels;
+	}
+
+	labels = (struct json_frozen_label *)json_frozen_reserve (builder, count * sizeof (struct json_frozen_label));
+	for (i = 0; i < count; i++)
+	{
+		labels[i].text = json_frozen_text_copy (builder, builder->sorted[i].label->text, builder->sorted[i].length) - (const char *)&labels[i];
+		labels[i].length = (uint32_t) builder->sorted[i].length;
+		labels[i].flags = (uint32_t) (builder->sorted[i].label->flags & JSON_FLAG_NEEDS_ESCAPING);
+		if (!(labels[i].flags & JSON_FLAG_NEEDS_ESCAPING) && (memchr (builder->sorted[i].label->text, '\\', builder->sorted[i].length) != NULL))
+			labels[0].flags |= JSON_FROZEN_ESCAPED_SHAPE;
+	}
+	known->hash = hash;
+	known->count = count;
+	known->labels = labels;
+
+	/* the table is kept at most half full */
+	if (2 * ++builder->shapes_count > builder->shapes_capacity)
+	{
+		capacity = 2 * builder->shapes_capacity;
+		if ((grown = (struct json_frozen_known_shape *)calloc (capacity, sizeof (struct json_frozen_known_shape))) == NULL)
+			return NULL;
+		for (i = 0; i < builder->shapes_capacity; i++)
+		{
+			if (builder->shapes[i].labels == NULL)
+				continue;
+			for (slot = builder->shapes[i].hash & (capacity - 1); grown[slot].labels != NULL; slot = (slot + 1) & (capacity - 1))
+				;
+			grown[slot] = builder->shapes[i];
+		}
+		free (builder->shapes);
+		builder->shapes = grown;
+		builder->shapes_capacity = capacity;
+	}
+	return labels;
+}
+
+
+/**
+Freezes a node into its record. The nodes of the children of containers are laid out, each holding for now the address of the json_t it is to be filled from in place of its offset
+@return JSON_OK or JSON_MEMORY
+**/
+static enum json_error
+json_frozen_fill (struct json_frozen_builder *builder, struct json_frozen_node *record, const json_t * node)
+{
+	struct json_frozen_members *members;
+	struct json_frozen_node *elements;
+	const struct json_frozen_label *shape;
+	const json_t *cursor;
+	size_t count, i;
+
+	record->type = (uint16_t) node->type;
+	record->flags = 0;
+	record->count = 0;
+	record->offset = 0;
+
+	switch (node->type)
+	{
+	case JSON_STRING:
+	case JSON_NUMBER:
+		count = strlen (node->text);
+		record->flags = (uint16_t) (node->flags & JSON_FLAG_NEEDS_ESCAPING);
+		record->count = (uint32_t) count;
+		record->offset = json_frozen_text_copy (builder, node->text, count) - (const char *)record;
+		break;
+
+	case JSON_ARRAY:
+		if ((count = json_frozen_children (node)) == 0)
+			break;
+		elements = (struct json_frozen_node *)json_frozen_reserve (builder, count * sizeof (struct json_frozen_node));
+		record->count = (uint32_t) count;
+		record->offset = (const char *)elements - (const char *)record;
+		for (i = 0, cursor = node->child; cursor != NULL; i++, cursor = cursor->next)
+			elements[i].offset = (int64_t) (intptr_t) cursor;
+		break;
+
+	case JSON_OBJECT:
+		for (count = 0, cursor = node->child; cursor != NULL; count++, cursor = cursor->next)
+		{
+			builder->sorted[count].label = cursor;
+			builder->sorted[count].length = strlen (cursor->text);
+			builder->sorted[count].index = count;
+		}
+		if (count == 0)
+			break;
+		qsort (builder->sorted, count, sizeof (struct json_frozen_sorted), json_frozen_sorted_compare);
+		if ((shape = json_frozen_intern_shape (builder, count)) == NULL)
+			return JSON_MEMORY;
+		members = (struct json_frozen_members *)json_frozen_reserve (builder, JSON_FROZEN_MEMBERS_SIZE (count));
+		members->shape = (const char *)shape - (const char *)members;
+		record->count = (uint32_t) count;
+		record->offset = (const char *)members - (const char *)record;
+		for (i = 0; i < count; i++)
+			members->values[i].offset = (int64_t) (intptr_t) builder->sorted[i].label->child;
+		break;
+
+	default:
+		break;
+	}
+	return JSON_OK;
+}
+
+
+enum json_error
+json_freeze (const json_t * root, struct json_frozen **frozen)
+{
+	struct json_frozen_builder builder;
+	struct json_frozen_frame *frames = NULL, *frame, *grown;
+	size_t depth = 0, capacity = 0, size, widest;
+	struct json_frozen *image, *shrunk;
+	struct json_frozen_node *record;
+	enum json_error error;
+
+	assert (root != NULL);
+	assert (frozen != NULL);
+
+	if ((error = json_frozen_measure (root, &size, &widest)) != JSON_OK)
+		return error;
+	image = (struct json_frozen *)malloc (sizeof (struct json_frozen) + size);
+	builder.sorted = (struct json_frozen_sorted *)malloc ((widest + 1) * sizeof (struct json_frozen_sorted));
+	builder.shapes_capacity = 16;
+	builder.shapes_count = 0;
+	builder.shapes = (struct json_frozen_known_shape *)calloc (builder.shapes_capacity, sizeof (struct json_frozen_known_shape));
+	if ((image == NULL) || (builder.sorted == NULL) || (builder.shapes == NULL))
+	{
+		free (image);
+		free (builder.sorted);
+		free (builder.shapes);
+		return JSON_MEMORY;
+	}
+	builder.end = (char *)(image + 1);
+
+	/* the vectors of the containers are walked depth first, filling the nodes of their values */
+	record = &image->root;
+	error = json_frozen_fill (&builder, record, root);
+	while (error == JSON_OK)
+	{
+		if (((record->type == JSON_OBJECT) || (record->type == JSON_ARRAY)) && (record->count > 0))
+		{
+			if (depth == capacity)
+			{
+				grown = (struct json_frozen_frame *)realloc (frames, 2 * (capacity + 8) * sizeof (struct json_frozen_frame));
+				if (grown == NULL)
+				{
+					error = JSON_MEMORY;
+					break;
+				}
+				frames = grown;
+				capacity = 2 * (capacity + 8);
+			}
+			frame = &frames[depth++];
+			if (record->type == JSON_OBJECT)
+				frame->nodes = ((struct json_frozen_members *)((char *)record + record->offset))->values;
+			else
+				frame->nodes = (struct json_frozen_node *)((char *)record + record->offset);
+			frame->count = record->count;
+			frame->position = 0;
+		}
+
+		while ((depth > 0) && (frames[depth - 1].position == frames[depth - 1].count))
+			depth--;
+		if (depth == 0)
+			break;
+		frame = &frames[depth - 1];
+		record = &frame->nodes[frame->position++];
+		error = json_frozen_fill (&builder, record, (const json_t *)(intptr_t) record->offset);
+	}
+
+	free (frames);
+	free (builder.sorted);
+	free (builder.shapes);
+	if (error != JSON_OK)
+	{
+		free (image);
+		return error;
+	}
+
+	/* shared shapes leave the end of the block unused */
+	image->size = (uint64_t) (builder.end - (char *)image);
+	if ((shrunk = (struct json_frozen *)realloc (image, (size_t) image->size)) != NULL)
+		image = shrunk;
+	*frozen = image;
+	return JSON_OK;
+}
+
+
+void
+json_frozen_free (struct json_frozen **frozen)
+{
+	assert (frozen != NULL);
+	free (*frozen);
+	*frozen = NULL;
+}
+
+
+size_t
+json_frozen_size (const struct json_frozen *frozen)
+{
+	assert (frozen != NULL);
+	return (size_t) frozen->size;
+}
+
+
+/* reading part */
+
+const struct json_frozen_node *
+json_frozen_root (const struct json_frozen *frozen)
+{
+	assert (frozen != NULL);
+	return &frozen->root;
+}
+
+
+enum json_value_type
+json_frozen_type (const struct json_frozen_node *node)
+{
+	assert (node != NULL);
+	return (enum json_value_type)node->type;
+}
+
+
+const char *
+json_frozen_text (const struct json_frozen_node *node)
+{
+	assert (node != NULL);
+	if ((node->type != JSON_STRING) && (node->type != JSON_NUMBER))
+		return NULL;
+	return JSON_FROZEN_AT (node, node->offset);
+}
+
+
+size_t
+json_frozen_count (const struct json_frozen_node *node)
+{
+	assert (node != NULL);
+	return ((node->type == JSON_OBJECT) || (node->type == JSON_ARRAY)) ? node->count : 0;
+}
+
+
+const struct json_frozen_node *
+json_frozen_element (const struct json_frozen_node *array, size_t position)
+{
+	assert (array != NULL);
+	if ((array->type != JSON_ARRAY) || (position >= array->count))
+		return NULL;
+	return (const struct json_frozen_node *)JSON_FROZEN_AT (array, array->offset) + position;
+}
+
+
+const char *
+json_frozen_label (const struct json_frozen_node *object, size_t position)
+{
+	const struct json_frozen_label *label;
+
+	assert (object != NULL);
+	if ((object->type != JSON_OBJECT) || (position >= object->count))
+		return NULL;
+	label = json_frozen_shape (json_frozen_members (object)) + position;
+	return JSON_FROZEN_AT (label, label->text);
+}
+
+
+const struct json_frozen_node *
+json_frozen_member (const struct json_frozen_node *object, size_t position)
+{
+	assert (object != NULL);
+	if ((object->type != JSON_OBJECT) || (position >= object->count))
+		return NULL;
+	return &json_frozen_members (object)->values[position];
+}
+
+
+/**
+@return the position of the first label of an object equal to the one searched for, or the number of members if there is none
+**/
+static size_t
+json_frozen_search (const struct json_frozen_node *object, const char *text, size_t length)
+{
+	const struct json_frozen_label *labels;
+	size_t low = 0, high = object->count, middle;
+	int result;
+
+	if (object->count == 0)
+		return 0;
+	labels = json_frozen_shape (json_frozen_members (object));
+
+	/* the leftmost label which is not below the one searched for */
+	while (low < high)
+	{
+		middle = low + (high - low) / 2;
+		result = memcmp (JSON_FROZEN_AT (&labels[middle], labels[middle].text), text, (labels[middle].length < length) ? labels[middle].length : length);
+		if ((result < 0) || ((result == 0) && (labels[middle].length < length)))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if ((low == object->count) || (labels[low].length != length) || (memcmp (JSON_FROZEN_AT (&labels[low], labels[low].text), text, length) != 0))
+		return object->count;
+	return low;
+}
+
+
+/**
+Looks up a label by the text it reads as once unescaped. The labels written as they read are found by binary search, while those holding escape sequences are only looked for, one after the other, in the shapes which have any
+@return the position of the first label which reads as text, or the number of members if there is none
+**/
+static size_t
+json_frozen_search_reading (const struct json_frozen_node *object, const char *text)
+{
+	const struct json_frozen_label *labels;
+	size_t position = json_frozen_search (object, text, strlen (text)), i;
+
+	if (object->count == 0)
+		return position;
+	labels = json_frozen_shape (json_frozen_members (object));
+	if (!(labels[0].flags & JSON_FROZEN_ESCAPED_SHAPE) || ((position < object->count) && (strchr (text, '\\') == NULL)))
+		return position;
+	for (i = 0; i < object->count; i++)
+	{
+		if (json_text_reads (JSON_FROZEN_AT (&labels[i], labels[i].text), labels[i].flags & JSON_FLAG_NEEDS_ESCAPING, text))
+			return i;
+	}
+	return object->count;
+}
+
+
+size_t
+json_frozen_position (const struct json_frozen_node *object, const char *label)
+{
+	assert (object != NULL);
+	assert (label != NULL);
+	if (object->type != JSON_OBJECT)
+		return 0;
+	return json_frozen_search (object, label, strlen (label));
+}
+
+
+int
+json_frozen_same_shape (const struct json_frozen_node *a, const struct json_frozen_node *b)
+{
+	assert (a != NULL);
+	assert (b != NULL);
+	if ((a->type != JSON_OBJECT) || (b->type != JSON_OBJECT) || (a->count != b->count))
+		return 0;
+	return (a->count == 0) || (json_frozen_shape (json_frozen_members (a)) == json_frozen_shape (json_frozen_members (b)));
+}
+
+
+const struct json_frozen_node *
+json_frozen_find (const struct json_frozen_node *object, const char *label)
+{
+	assert (object != NULL);
+	assert (label != NULL);
+	if (object->type != JSON_OBJECT)
+		return NULL;
+	return json_frozen_member (object, json_frozen_search (object, label, strlen (label)));
+}
+
+
+const struct json_frozen_node *
+json_frozen_pointer_eval (const struct json_pointer *pointer, const struct json_frozen_node *root)
+{
+	const struct json_frozen_node *cursor = root;
+	const struct json_pointer_segment *segment;
+	size_t i;
+
+	assert (pointer != NULL);
+	assert (root != NULL);
+
+	for (i = 0; (i < pointer->count) && (cursor != NULL); i++)
+	{
+		segment = &pointer->segments[i];
+		if (cursor->type == JSON_OBJECT)
+			cursor = json_frozen_member (cursor, json_frozen_search_reading (cursor, segment->text));
+		else if ((cursor->type == JSON_ARRAY) && segment->is_position)
+			cursor = json_frozen_element (cursor, segment->position);
+		else
+			cursor = NULL;
+	}
+	return cursor;
+}
@@ -0,0 +1,144 @@
+/*// C Interface: json_frozen*/
+/*// Description: frozen, read-only documents held in a single allocation*/
+/*// Copyright: See COPYING file that comes with this distribution*/
+
+
+#ifndef JSON_FROZEN_H
+#define JSON_FROZEN_H
+
+#include "json.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+A frozen document: an immutable image of a tree in one block of memory, in which arrays are vectors of values and objects vectors of values sorted by label. The sorted labels of an object make up its shape, which the image holds once for all the objects with the same labels, as the records of tabular arrays are. Nothing in an image ever changes after json_freeze() returns, so any number of threads may read it at once without locks. The nodes refer to each other through offsets relative to themselves, which keeps the image valid wherever it is copied to
+**/
+	struct json_frozen;
+
+
+/**
+A value inside a frozen document, valid as long as the document is
+**/
+	struct json_frozen_node;
+
+
+/**
+Freezes a document tree
+@param root the root of the tree, which is left untouched
+@param frozen receives the frozen document, to be freed with json_frozen_free()
+@return JSON_OK, JSON_BAD_TREE_STRUCTURE if the tree is malformed, JSON_MAXIMUM_LENGTH if a container or a text holds more than 2^32 - 1 elements or bytes, or JSON_MEMORY
+**/
+	enum json_error json_freeze (const json_t * root, struct json_frozen **frozen);
+
+
+/**
+Frees a frozen document and sets it to NULL
+@param frozen the frozen document
+**/
+	void json_frozen_free (struct json_frozen **frozen);
+
+
+/**
+@param frozen the frozen document
+@return the number of bytes of the image, header included
+**/
+	size_t json_frozen_size (const struct json_frozen *frozen);
+
+
+/**
+@param frozen the frozen document
+@return the document's root value
+**/
+	const struct json_frozen_node *json_frozen_root (const struct json_frozen *frozen);
+
+
+/**
+@param node the value
+@return the value's type
+**/
+	enum json_value_type json_frozen_type (const struct json_frozen_node *node);
+
+
+/**
+@param node the value
+@return the text of a string or a number, in the form json_t holds it, or NULL for other types
+**/
+	const char *json_frozen_text (const struct json_frozen_node *node);
+
+
+/**
+@param node the value
+@return the number of members of an object or of elements of an array, or 0 for other types
+**/
+	size_t json_frozen_count (const struct json_frozen_node *node);
+
+
+/**
+@param array the array
+@param position the element's position
+@return the element or NULL if position is out of the array
+**/
+	const struct json_frozen_node *json_frozen_element (const struct json_frozen_node *array, size_t position);
+
+
+/**
+@param object the object
+@param position the member's position in label order
+@return the label of the member or NULL if position is out of the object
+**/
+	const char *json_frozen_label (const struct json_frozen_node *object, size_t position);
+
+
+/**
+@param object the object
+@param position the member's position in label order
+@return the value of the member or NULL if position is out of the object
+**/
+	const struct json_frozen_node *json_frozen_member (const struct json_frozen_node *object, size_t position);
+
+
+/**
+Looks up the member of an object by binary search over its labels, which are compared as they were stored in the tree. Of several members with the same label, the first one the tree held is found
+@param object the object
+@param label the label
+@return the value of the member or NULL if there is none
+**/
+	const struct json_frozen_node *json_frozen_find (const struct json_frozen_node *object, const char *label);
+
+
+/**
+Finds the position of a member of an object, which is the same in every object of the same shape, so that the records of a tabular array are read through json_frozen_member() with a single search
+@param object the object
+@param label the label
+@return the position of the member in label order, or the number of members if there is none
+**/
+	size_t json_frozen_position (const struct json_frozen_node *object, const char *label);
+
+
+/**
+Tells whether two objects have the same shape, that is the same labels
+@param a an object
+@param b another object
+@return 1 if a and b are objects of the same shape, 0 otherwise
+**/
+	int json_frozen_same_shape (const struct json_frozen_node *a, const struct json_frozen_node *b);
+
+
+/**
+Resolves a compiled JSON pointer against a frozen value. Unlike json_frozen_find(), tokens are matched against labels once unescaped, as json_pointer_eval() does; labels holding escape sequences are looked for by going through their object
+@param pointer the pointer, compiled with json_pointer_compile()
+@param root the value
+@return the value pointed to or NULL if there is none
+**/
+	const struct json_frozen_node *json_frozen_pointer_eval (const struct json_pointer *pointer, const struct json_frozen_node *root);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
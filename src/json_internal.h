@@ -0,0 +1,214 @@
+/*// C Interface: json_internal*/
+/*// Description: declarations shared between the library's modules. This header is not installed*/
+/*// Copyright: See COPYING file that comes with this distribution*/
+
+
+#ifndef JSON_INTERNAL_H
+#define JSON_INTERNAL_H
+
+#include "json.h"
+
+
+/**
+Hashes a text with 32-bit FNV-1a
+@param text the text to hash
+@param length the number of bytes in text
+@return the text's hash
+**/
+uint32_t json_hash_text (const char *text, size_t length);
+
+/**
+Hashes the text of a label as it reads once unescaped, which is what the object member index is keyed by
+@param text the label's nul-terminated text
+@param length the number of bytes in text
+@param plain set if text holds no escape sequences, as is the case of labels flagged JSON_FLAG_NEEDS_ESCAPING
+@return the hash of the unescaped text, which is json_hash_text() of it
+**/
+uint32_t json_hash_label_text (const char *text, size_t length, int plain);
+
+/**
+@return the hash of a label's unescaped text, the stored one if the label is flagged JSON_FLAG_HASHED
+**/
+uint32_t json_label_hash (const json_t * label);
+
+/**
+Looks up a label by its text and its precomputed hash, going through the object's index if it has one
+@param object a json_value of type JSON_OBJECT
+@param text_label the label's text
+@param hash the hash of text_label, as computed by json_hash_label_text()
+@return the first label holding text_label or NULL if there is none
+**/
+json_t *json_find_label (const json_t * object, const char *text_label, uint32_t hash);
+
+/**
+Looks up a label by the text it reads as once unescaped, however it is written, going through the object's index if it has one
+@param object a json_value of type JSON_OBJECT
+@param text the unescaped text
+@param hash json_hash_text() of text
+@return the first label which reads as text or NULL if there is none
+**/
+json_t *json_find_reading_label (const json_t * object, const char *text, uint32_t hash);
+
+/**
+Looks up the first label of an object which reads like a label of another object once both are unescaped
+@return the label or NULL if there is none
+**/
+json_t *json_find_equal_label (const json_t * object, const json_t * label);
+
+/**
+Tells whether a string's text reads as a given text once unescaped
+@param text the string's text as it is written
+@param plain set if text holds no escape sequences, as is the case of strings flagged JSON_FLAG_NEEDS_ESCAPING
+@param reading the unescaped text
+@return 1 if it does, 0 otherwise
+**/
+int json_text_reads (const char *text, int plain, const char *reading);
+
+/**
+Checks if a plain UTF-8 c-string holds characters which must be escaped in a JSON document
+@param text an UTF-8 c-string
+@return 1 if text must be escaped, 0 if it can be written verbatim
+**/
+int json_text_needs_escaping (const char *text);
+
+
+/* validation part */
+
+/**
+Skips the white spaces of a buffer
+@return the position of the first byte past them
+**/
+size_t json_validate_white_spaces (const char *buffer, size_t length, size_t pos);
+
+/**
+Checks the string, the literal or the number that starts at *pos, which is moved past it, or to the offending byte
+@return JSON_OK, JSON_INCOMPLETE_DOCUMENT if the buffer ends first or JSON_ILLEGAL_CHARACTER
+**/
+enum json_error json_validate_string (const char *buffer, size_t length, size_t * pos);
+enum json_error json_validate_literal (const char *buffer, size_t length, size_t * pos, const char *literal, size_t literal_length);
+enum json_error json_validate_number (const char *buffer, size_t length, size_t * pos);
+
+
+/**
+Checks if a byte sequence is well-formed UTF-8
+@param text the bytes to check
+@param length the number of bytes in text
+@return 1 if text is valid UTF-8, 0 otherwise
+**/
+int json_utf8_valid (const char *text, size_t length);
+
+/**
+Counts the leading bytes of text which can be taken verbatim as part of a JSON string, stopping at the first quote, reverse solidus or control character
+@param text the bytes to scan
+@param length the number of bytes available in text
+@return the number of plain string bytes found at the beginning of text
+**/
+size_t json_string_span (const char *text, size_t length);
+
+
+/**
+Reads the text of a string node a byte at a time as it would read once unescaped
+**/
+struct json_text_reader
+{
+	const char *p;
+	int plain;		/* the text holds no escape sequences, as is the case of strings flagged JSON_FLAG_NEEDS_ESCAPING */
+	unsigned char pending[4];	/* the rest of the UTF-8 encoding of an escaped code point */
+	int pending_count;
+	int pending_position;
+};
+
+void json_text_reader_init (struct json_text_reader *reader, const json_t * node);
+
+/**
+Starts reading a text which isn't held by a node
+@param plain set if text holds no escape sequences
+**/
+void json_text_reader_init_text (struct json_text_reader *reader, const char *text, int plain);
+
+/**
+@return the next unescaped byte or -1 at the end of the text
+**/
+int json_text_reader_next (struct json_text_reader *reader);
+
+
+/* JSON pointer part */
+
+/**
+A reference token of a compiled JSON pointer
+**/
+struct json_pointer_segment
+{
+	char *text;		/* unescaped token text */
+	uint32_t hash;		/* hash of text, used for object labels */
+	int is_position;	/* flag set if text is a valid array position */
+	size_t position;	/* the array position held by text */
+};
+
+
+/**
+A compiled JSON pointer. The segments and their text live in the same allocation
+**/
+struct json_pointer
+{
+	size_t count;
+	struct json_pointer_segment *segments;
+};
+
+
+/* lexer part */
+
+enum LEX_VALUE
+{ LEX_MORE = 0,
+	LEX_INVALID_CHARACTER,
+	LEX_TRUE,
+	LEX_FALSE,
+	LEX_NULL,
+	LEX_BEGIN_OBJECT,
+	LEX_END_OBJECT,
+	LEX_BEGIN_ARRAY,
+	LEX_END_ARRAY,
+	LEX_NAME_SEPARATOR,
+	LEX_VALUE_SEPARATOR,
+	LEX_STRING,
+	LEX_NUMBER,
+	LEX_ERROR,
+	LEX_MEMORY
+};
+
+
+/* rc_string part */
+
+#define RSTRING_INCSTEP 5
+#define RSTRING_DEFAULT 8
+
+
+enum rui_string_error_codes
+{ RS_MEMORY, RS_OK = 1, RS_UNKNOWN };
+
+typedef enum rui_string_error_codes rstring_code;
+
+
+rcstring *rcs_create (size_t length);
+void rcs_free (rcstring ** rcs);
+rstring_code rcs_resize (rcstring * rcs, size_t length);
+rstring_code rcs_catcs (rcstring * pre, const char *pos, const size_t length);
+rstring_code rcs_catc (rcstring * pre, const char c);
+char *rcs_unwrap (rcstring * rcs);
+size_t rcs_length (rcstring * rcs);
+
+
+/**
+Splits a buffer into JSON tokens. A token which the buffer ends in the middle of is resumed by the next call with the same state and text
+@param buffer the NUL-terminated buffer
+@param p the position within buffer, set to NULL once the buffer is consumed
+@param state the lexer's state, 0 between tokens
+@param text receives the text of string and number tokens
+@param line the line counter
+@param validate_utf8 reject strings that are not valid UTF-8
+@return the enum LEX_VALUE of the token that was read, or LEX_MORE once the buffer is consumed
+**/
+int lexer (const char *buffer, const char **p, unsigned int *state, rcstring ** text, size_t *line, int validate_utf8);
+
+
+#endif
@@ -0,0 +1,1033 @@
+/*
+*  C Implementation: json_patch
+*
+* Description: JSON Patch (RFC 6902) and JSON Merge Patch (RFC 7386)
+*
+*
+* Copyright: See COPYING file that comes with this distribution
+*
+*/
+
+#include "json_patch.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+
+/* patch building part */
+
+/**
+Inserts a label:value pair whose label is given as plain text, such as a decoded JSON pointer token, hashing the label on the way
+**/
+static enum json_error
+json_patch_insert_pair (json_t * object, const char *label_text, size_t length, json_t * value)
+{
+	json_t *label = json_new_plain_string (label_text);
+
+	if (label == NULL)
+		return JSON_MEMORY;
+	label->hash = json_hash_text (label_text, length);
+	label->flags |= JSON_FLAG_HASHED;
+	if ((json_insert_child (label, value) != JSON_OK) || (json_insert_child (object, label) != JSON_OK))
+	{
+		json_detach (value);
+		json_free_value (&label);
+		return JSON_BAD_TREE_STRUCTURE;
+	}
+	return JSON_OK;
+}
+
+
+/**
+Appends an operation to a patch
+@param path the operation's path
+@param value the operation's value, which is copied, or NULL
+@return JSON_OK or JSON_MEMORY
+**/
+static enum json_error
+json_patch_operation (json_t * patch, const char *op, const rcstring * path, const json_t * value)
+{
+	json_t *operation, *node;
+
+	if ((operation = json_new_object ()) == NULL)
+		return JSON_MEMORY;
+	if (json_insert_child (patch, operation) != JSON_OK)
+	{
+		json_free_value (&operation);
+		return JSON_MEMORY;
+	}
+
+	if ((node = json_new_string (op)) == NULL)
+		return JSON_MEMORY;
+	if (json_patch_insert_pair (operation, "op", 2, node) != JSON_OK)
+	{
+		json_free_value (&node);
+		return JSON_MEMORY;
+	}
+	if ((node = json_new_plain_string (path->text)) == NULL)
+		return JSON_MEMORY;
+	if (json_patch_insert_pair (operation, "path", 4, node) != JSON_OK)
+	{
+		json_free_value (&node);
+		return JSON_MEMORY;
+	}
+	if (value == NULL)
+		return JSON_OK;
+	if ((node = json_clone (value)) == NULL)
+		return JSON_MEMORY;
+	if (json_patch_insert_pair (operation, "value", 5, node) != JSON_OK)
+	{
+		json_free_value (&node);
+		return JSON_MEMORY;
+	}
+	return JSON_OK;
+}
+
+
+/**
+Appends a label to a path as a JSON pointer token, made of the label's unescaped text. Paths are held as plain text
+@return JSON_OK or JSON_MEMORY
+**/
+static enum json_error
+json_patch_append_label (rcstring * path, const json_t * label)
+{
+	struct json_text_reader reader;
+	int c;
+
+	if (rcs_catc (path, '/') != RS_OK)
+		return JSON_MEMORY;
+	json_text_reader_init (&reader, label);
+	while ((c = json_text_reader_next (&reader)) != -1)
+	{
+		if (((c == '~') ? rcs_catcs (path, "~0", 2) : (c == '/') ? rcs_catcs (path, "~1", 2) : rcs_catc (path, (char) c)) != RS_OK)
+			return JSON_MEMORY;
+	}
+	return JSON_OK;
+}
+
+
+static enum json_error
+json_patch_append_position (rcstring * path, size_t position)
+{
+	char buffer[24];
+	int length = snprintf (buffer, sizeof (buffer), "/%zu", position);
+
+	return (rcs_catcs (path, buffer, (size_t) length) == RS_OK) ? JSON_OK : JSON_MEMORY;
+}
+
+
+static void
+json_patch_truncate (rcstring * path, size_t length)
+{
+	path->length = length;
+	path->text[length] = '\0';
+}
+
+
+/* diff part */
+
+enum json_diff_item_kind
+{
+	JSON_DIFF_PAIR,		/* turn a into b */
+	JSON_DIFF_RUN		/* a stretch of an array edit script between two kept elements */
+};
+
+
+/**
+A pending piece of work. Items are popped in the reverse order of the positions they touch, so that every operation on an array refers to positions which the operations before it left alone
+**/
+struct json_diff_item
+{
+	enum json_diff_item_kind kind;
+	const json_t *a, *b;	/* JSON_DIFF_PAIR: the values. JSON_DIFF_RUN: the arrays */
+	size_t depth;		/* the number of tokens in the path of a, or of the arrays for runs */
+	const json_t *label;	/* JSON_DIFF_PAIR: the label holding a, or NULL if a is an array element */
+	size_t position;	/* JSON_DIFF_PAIR: the position of an element. JSON_DIFF_RUN: the position of the first element of a */
+	size_t b_position;	/* JSON_DIFF_RUN: the position of the first element of b */
+	size_t removed;		/* JSON_DIFF_RUN: the number of elements of a */
+	size_t added;		/* JSON_DIFF_RUN: the number of elements of b */
+};
+
+
+struct json_diff
+{
+	json_t *patch;
+	rcstring *path;
+	size_t *lengths;	/* the length of the path at each depth */
+	size_t lengths_capacity;
+	struct json_diff_item *items;
+	size_t count;
+	size_t capacity;
+};
+
+
+static enum json_error
+json_diff_push (struct json_diff *diff, const struct json_diff_item *item)
+{
+	struct json_diff_item *grown;
+
+	if (diff->count == diff->capacity)
+	{
+		grown = (struct json_diff_item *)realloc (diff->items, 2 * (diff->capacity + 8) * sizeof (struct json_diff_item));
+		if (grown == NULL)
+			return JSON_MEMORY;
+		diff->items = grown;
+		diff->capacity = 2 * (diff->capacity + 8);
+	}
+	diff->items[diff->count++] = *item;
+	return JSON_OK;
+}
+
+
+static enum json_error
+json_diff_push_pair (struct json_diff *diff, const json_t * a, const json_t * b, size_t depth, const json_t * label, size_t position)
+{
+	struct json_diff_item item;
+
+	memset (&item, 0, sizeof (item));
+	item.kind = JSON_DIFF_PAIR;
+	item.a = a;
+	item.b = b;
+	item.depth = depth;
+	item.label = label;
+	item.position = position;
+	return json_diff_push (diff, &item);
+}
+
+
+/**
+Tells whether two subtrees are equal, rejecting most unequal pairs on their memoized hashes alone
+**/
+static int
+json_diff_same (const json_t * a, const json_t * b)
+{
+	if ((a->flags & b->flags & JSON_FLAG_DIGESTED) && (a->digest != b->digest))
+		return 0;
+	return json_equal (a, b);
+}
+
+
+static enum json_error
+json_diff_object (struct json_diff *diff, const json_t * a, const json_t * b, size_t depth)
+{
+	const json_t *label, *other;
+	size_t length = diff->path->length;
+
+	for (label = a->child; label != NULL; label = label->next)
+	{
+		other = json_find_equal_label (b, label);
+		if (other == NULL)
+		{
+			if ((json_patch_append_label (diff->path, label) != JSON_OK) || (json_patch_operation (diff->patch, "remove", diff->path, NULL) != JSON_OK))
+				return JSON_MEMORY;
+			json_patch_truncate (diff->path, length);
+		}
+		else if ((label->child != NULL) && (other->child != NULL) && !json_diff_same (label->child, other->child))
+		{
+			if (json_diff_push_pair (diff, label->child, other->child, depth + 1, label, 0) != JSON_OK)
+				return JSON_MEMORY;
+		}
+	}
+
+	for (label = b->child; label != NULL; label = label->next)
+	{
+		if ((label->child == NULL) || (json_find_equal_label (a, label) != NULL))
+			continue;
+		if ((json_patch_append_label (diff->path, label) != JSON_OK) || (json_patch_operation (diff->patch, "add", diff->path, label->child) != JSON_OK))
+			return JSON_MEMORY;
+		json_patch_truncate (diff->path, length);
+	}
+	return JSON_OK;
+}
+
+
+enum json_diff_edit
+{
+	JSON_DIFF_KEEP,
+	JSON_DIFF_DELETE,
+	JSON_DIFF_INSERT
+};
+
+
+/**
+Finds the shortest edit script between two sequences of elements with Myers' algorithm, comparing the elements by their hashes
+@param script receives the edits from the end of the sequences to their start
+@return the number of edits in script, 0 if the sequences need more than JSON_DIFF_MAX_EDITS insertions and deletions, or -1 if memory ran out
+**/
+static long
+json_diff_script (json_t ** x, size_t n, json_t ** y, size_t m, enum json_diff_edit *script)
+{
+	long max = (long) ((n + m < JSON_DIFF_MAX_EDITS) ? n + m : JSON_DIFF_MAX_EDITS);
+	long *v, *trace, d, k, i, j, previous_k, previous_i, count = 0;
+
+	v = (long *)malloc ((2 * max + 3) * sizeof (long));
+	trace = (long *)malloc ((size_t) ((max + 1) * (max + 1)) * sizeof (long));
+	if ((v == NULL) || (trace == NULL))
+	{
+		free (v);
+		free (trace);
+		return -1;
+	}
+	v += max + 1;		/* v[k] for k in -max-1 .. max+1 */
+	v[1] = 0;
+
+	for (d = 0; d <= max; d++)
+	{
+		for (k = -d; k <= d; k += 2)
+		{
+			if ((k == -d) || ((k != d) && (v[k - 1] < v[k + 1])))
+				i = v[k + 1];	/* an insertion */
+			else
+				i = v[k - 1] + 1;	/* a deletion */
+			j = i - k;
+			while ((i < (long) n) && (j < (long) m) && (x[i]->digest == y[j]->digest))
+				i++, j++;
+			v[k] = i;
+		}
+		/* trace holds v[-d..d] of every round, the one of round d starting at d * d */
+		memcpy (&trace[d * d], &v[-d], (2 * d + 1) * sizeof (long));
+		for (k = -d; k <= d; k += 2)
+		{
+			if ((v[k] >= (long) n) && (v[k] - k >= (long) m))
+				break;
+		}
+		if (k <= d)
+			break;
+	}
+
+	if (d > max)
+	{
+		free (v - max - 1);
+		free (trace);
+		return 0;
+	}
+
+	/* walk back from the end */
+	i = (long) n;
+	j = (long) m;
+	for (; d > 0; d--)
+	{
+		k = i - j;
+#define JSON_DIFF_TRACE(round, diagonal) trace[(round) * (round) + (diagonal) + (round)]
+		if ((k == -d) || ((k != d) && (JSON_DIFF_TRACE (d - 1, k - 1) < JSON_DIFF_TRACE (d - 1, k + 1))))
+			previous_k = k + 1;
+		else
+			previous_k = k - 1;
+		previous_i = JSON_DIFF_TRACE (d - 1, previous_k);
+#undef JSON_DIFF_TRACE
+		while ((i > previous_i) && (i - k > previous_i - previous_k))
+		{
+			script[count++] = JSON_DIFF_KEEP;
+			i--;
+			j--;
+		}
+		script[count++] = (previous_k == k + 1) ? JSON_DIFF_INSERT : JSON_DIFF_DELETE;
+		i = previous_i;
+		j = previous_i - previous_k;
+	}
+	while (i > 0)
+	{
+		script[count++] = JSON_DIFF_KEEP;
+		i--;
+	}
+
+	free (v - max - 1);
+	free (trace);
+	return count;
+}
+
+
+static enum json_error
+json_diff_push_run (struct json_diff *diff, const json_t * a, const json_t * b, size_t depth, size_t position, size_t b_position, size_t removed, size_t added)
+{
+	struct json_diff_item item;
+
+	if ((removed == 0) && (added == 0))
+		return JSON_OK;
+	memset (&item, 0, sizeof (item));
+	item.kind = JSON_DIFF_RUN;
+	item.a = a;
+	item.b = b;
+	item.depth = depth;
+	item.position = position;
+	item.b_position = b_position;
+	item.removed = removed;
+	item.added = added;
+	return json_diff_push (diff, &item);
+}
+
+
+static enum json_error
+json_diff_array (struct json_diff *diff, const json_t * a, const json_t * b, size_t depth)
+{
+	size_t n = json_array_size (a), m = json_array_size (b);
+	size_t prefix = 0, suffix = 0, i, j, run_i, run_j;
+	json_t **x = NULL, **y = NULL;
+	enum json_diff_edit *script = NULL;
+	enum json_error error = JSON_MEMORY;
+	long count, e;
+
+	/* common ends are left out of the edit script */
+	while ((prefix < n) && (prefix < m) && json_diff_same (json_array_get (a, prefix), json_array_get (b, prefix)))
+		prefix++;
+	while ((suffix < n - prefix) && (suffix < m - prefix) && json_diff_same (json_array_get (a, n - 1 - suffix), json_array_get (b, m - 1 - suffix)))
+		suffix++;
+	n -= prefix + suffix;
+	m -= prefix + suffix;
+	if ((n == 0) && (m == 0))
+		return JSON_OK;
+
+	x = (json_t **)malloc ((n + 1) * sizeof (json_t *));
+	y = (json_t **)malloc ((m + 1) * sizeof (json_t *));
+	script = (enum json_diff_edit *)malloc ((n + m + 1) * sizeof (enum json_diff_edit));
+	if ((x == NULL) || (y == NULL) || (script == NULL))
+		goto end;
+	for (i = 0; i < n; i++)
+		x[i] = json_array_get (a, prefix + i);
+	for (j = 0; j < m; j++)
+		y[j] = json_array_get (b, prefix + j);
+
+	count = json_diff_script (x, n, y, m, script);
+	if (count < 0)
+		goto end;
+	if (count == 0)
+	{
+		/* too many edits to search for the shortest script: one run pairs the elements up */
+		error = json_diff_push_run (diff, a, b, depth, prefix, prefix, n, m);
+		goto end;
+	}
+
+	/* push the runs in script order, so that they are popped from the last one */
+	i = 0;
+	j = 0;
+	run_i = 0;
+	run_j = 0;
+	for (e = count - 1; e >= 0; e--)
+	{
+		if (script[e] == JSON_DIFF_DELETE)
+			i++;
+		else if (script[e] == JSON_DIFF_INSERT)
+			j++;
+		else
+		{
+			if ((json_diff_push_run (diff, a, b, depth, prefix + run_i, prefix + run_j, i - run_i, j - run_j) != JSON_OK) || (!json_equal (x[i], y[j]) && (json_diff_push_pair (diff, x[i], y[j], depth + 1, NULL, prefix + i) != JSON_OK)))
+				goto end;
+			i++;
+			j++;
+			run_i = i;
+			run_j = j;
+		}
+	}
+	error = json_diff_push_run (diff, a, b, depth, prefix + run_i, prefix + run_j, i - run_i, j - run_j);
+
+end:
+	free (x);
+	free (y);
+	free (script);
+	return error;
+}
+
+
+/**
+Emits the operations of a run: the elements left over after pairing are removed or added first, as they come after the pairs, and the pairs are pushed to be diffed
+**/
+static enum json_error
+json_diff_run (struct json_diff *diff, const struct json_diff_item *run)
+{
+	size_t pairs = (run->removed < run->added) ? run->removed : run->added;
+	size_t length = diff->path->length, t;
+
+	for (t = run->removed; t > pairs; t--)
+	{
+		if ((json_patch_append_position (diff->path, run->position + t - 1) != JSON_OK) || (json_patch_operation (diff->patch, "remove", diff->path, NULL) != JSON_OK))
+			return JSON_MEMORY;
+		json_patch_truncate (diff->path, length);
+	}
+	for (t = pairs; t < run->added; t++)
+	{
+		if ((json_patch_append_position (diff->path, run->position + t) != JSON_OK) || (json_patch_operation (diff->patch, "add", diff->path, json_array_get (run->b, run->b_position + t)) != JSON_OK))
+			return JSON_MEMORY;
+		json_patch_truncate (diff->path, length);
+	}
+	for (t = 0; t < pairs; t++)
+	{
+		if (json_diff_push_pair (diff, json_array_get (run->a, run->position + t), json_array_get (run->b, run->b_position + t), run->depth + 1, NULL, run->position + t) != JSON_OK)
+			return JSON_MEMORY;
+	}
+	return JSON_OK;
+}
+
+
+enum json_error
+json_diff (const json_t * a, const json_t * b, json_t ** patch)
+{
+	struct json_diff diff;
+	struct json_diff_item item;
+	enum json_error error = JSON_OK;
+	uint64_t hash;
+	size_t *grown;
+
+	assert (a != NULL);
+	assert (b != NULL);
+	assert (patch != NULL);
+
+	memset (&diff, 0, sizeof (diff));
+	if ((json_hash (a, 1, &hash) != JSON_OK) || (json_hash (b, 1, &hash) != JSON_OK))
+		return JSON_MEMORY;
+	diff.patch = json_new_array ();
+	diff.path = rcs_create (RSTRING_DEFAULT);
+	if ((diff.patch == NULL) || (diff.path == NULL) || (json_diff_push_pair (&diff, a, b, 0, NULL, 0) != JSON_OK))
+		error = JSON_MEMORY;
+
+	while ((error == JSON_OK) && (diff.count > 0))
+	{
+		item = diff.items[--diff.count];
+
+		if (item.depth >= diff.lengths_capacity)
+		{
+			grown = (size_t *)realloc (diff.lengths, 2 * (item.depth + 8) * sizeof (size_t));
+			if (grown == NULL)
+			{
+				error = JSON_MEMORY;
+				break;
+			}
+			diff.lengths = grown;
+			diff.lengths_capacity = 2 * (item.depth + 8);
+		}
+
+		/* rebuild the path of the item from the one of its parent */
+		if (item.kind == JSON_DIFF_RUN)
+		{
+			json_patch_truncate (diff.path, (item.depth > 0) ? diff.lengths[item.depth] : 0);
+			error = json_diff_run (&diff, &item);
+			continue;
+		}
+		json_patch_truncate (diff.path, (item.depth > 0) ? diff.lengths[item.depth - 1] : 0);
+		if (item.depth > 0)
+			error = (item.label != NULL) ? json_patch_append_label (diff.path, item.label) : json_patch_append_position (diff.path, item.position);
+		diff.lengths[item.depth] = diff.path->length;
+		if (error != JSON_OK)
+			break;
+
+		if (json_diff_same (item.a, item.b))
+			continue;
+		if ((item.a->type != item.b->type) || ((item.a->type != JSON_OBJECT) && (item.a->type != JSON_ARRAY)))
+			error = json_patch_operation (diff.patch, "replace", diff.path, item.b);
+		else if (item.a->type == JSON_OBJECT)
+			error = json_diff_object (&diff, item.a, item.b, item.depth);
+		else
+			error = json_diff_array (&diff, item.a, item.b, item.depth);
+	}
+
+	free (diff.items);
+	free (diff.lengths);
+	rcs_free (&diff.path);
+	if (error != JSON_OK)
+	{
+		if (diff.patch != NULL)
+			json_free_value (&diff.patch);
+		return error;
+	}
+	*patch = diff.patch;
+	return JSON_OK;
+}
+
+
+/* patch application part */
+
+/**
+Reads the next token of a JSON pointer into token, undoing the ~0 and ~1 escapes
+@param p the position in the unescaped pointer, at the token's '/', which is left at the next '/' or at the end
+@return JSON_OK, JSON_MALFORMED_DOCUMENT or JSON_MEMORY
+**/
+static enum json_error
+json_patch_token (const char **p, rcstring * token)
+{
+	const char *q = *p + 1;
+
+	json_patch_truncate (token, 0);
+	for (; (*q != '/') && (*q != '\0'); q++)
+	{
+		char c = *q;
+
+		if (c == '~')
+		{
+			if ((q[1] != '0') && (q[1] != '1'))
+				return JSON_MALFORMED_DOCUMENT;
+			c = (*++q == '0') ? '~' : '/';
+		}
+		if (rcs_catc (token, c) != RS_OK)
+			return JSON_MEMORY;
+	}
+	*p = q;
+	return JSON_OK;
+}
+
+
+/**
+Reads a token as an array position
+@return 1 for a valid position, or for "-" which stands for the end of the array
+**/
+static int
+json_patch_position (const json_t * array, const rcstring * token, size_t *position)
+{
+	size_t i;
+
+	if ((token->length == 1) && (token->text[0] == '-'))
+	{
+		*position = json_array_size (array);
+		return 1;
+	}
+	if ((token->length == 0) || ((token->text[0] == '0') && (token->length > 1)))
+		return 0;
+	*position = 0;
+	for (i = 0; i < token->length; i++)
+	{
+		if ((token->text[i] < '0') || (token->text[i] > '9') || (*position > (SIZE_MAX - (size_t) (token->text[i] - '0')) / 10))
+			return 0;	/* not a number, or one beyond any array */
+		*position = *position * 10 + (size_t) (token->text[i] - '0');
+	}
+	return 1;
+}
+
+
+/**
+A place in the document a patch operation refers to
+**/
+struct json_patch_place
+{
+	json_t *parent;		/* the container holding the place, or NULL for the root */
+	json_t *target;		/* the label of the member or the element at the place, or NULL if there is none */
+	size_t position;	/* the position of an element */
+};
+
+
+/**
+Resolves a JSON pointer, given as plain text, up to its last token. Members are matched by the unescaped text of their labels
+@return JSON_OK, JSON_MALFORMED_DOCUMENT if the path is malformed, JSON_BAD_TREE_STRUCTURE if it leads nowhere, or JSON_MEMORY
+**/
+static enum json_error
+json_patch_locate (json_t * document, const char *path, rcstring * token, struct json_patch_place *place)
+{
+	enum json_error error;
+	json_t *cursor = document;
+	const char *p = path;
+
+	place->parent = NULL;
+	place->target = document;
+	place->position = 0;
+	if (*p == '\0')
+		return JSON_OK;
+	if (*p != '/')
+		return JSON_MALFORMED_DOCUMENT;
+
+	while (*p == '/')
+	{
+		if ((error = json_patch_token (&p, token)) != JSON_OK)
+			return error;
+		if (cursor == NULL)
+			return JSON_BAD_TREE_STRUCTURE;	/* an intermediate token that leads nowhere */
+
+		place->parent = cursor;
+		if (cursor->type == JSON_OBJECT)
+		{
+			place->target = json_find_reading_label (cursor, token->text, json_hash_text (token->text, token->length));
+			cursor = (place->target != NULL) ? place->target->child : NULL;
+		}
+		else if ((cursor->type == JSON_ARRAY) && json_patch_position (cursor, token, &place->position))
+		{
+			place->target = json_array_get (cursor, place->position);
+			cursor = place->target;
+		}
+		else
+			return JSON_BAD_TREE_STRUCTURE;
+	}
+	return JSON_OK;
+}
+
+
+/**
+Returns the value at a place, which for object members is the label's child
+**/
+static json_t *
+json_patch_value (const struct json_patch_place *place)
+{
+	if ((place->target != NULL) && (place->parent != NULL) && (place->parent->type == JSON_OBJECT))
+		return place->target->child;
+	return place->target;
+}
+
+
+/**
+Adds a value at a place, replacing the member or, with replace set, the element which is there. The value is taken over on success only
+**/
+static enum json_error
+json_patch_put (json_t ** document, const struct json_patch_place *place, const rcstring * token, json_t * value, int replace)
+{
+	json_t *old;
+	enum json_error error;
+
+	if (place->parent == NULL)
+	{
+		json_free_value (document);
+		*document = value;
+		return JSON_OK;
+	}
+
+	if (place->parent->type == JSON_OBJECT)
+	{
+		if (place->target == NULL)
+			return json_patch_insert_pair (place->parent, token->text, token->length, value);
+		if ((old = place->target->child) != NULL)
+			json_free_value (&old);
+		return json_insert_child (place->target, value);
+	}
+
+	if (place->target == NULL)
+	{
+		if (place->position != json_array_size (place->parent))
+			return JSON_BAD_TREE_STRUCTURE;
+		return json_insert_child (place->parent, value);
+	}
+	if ((error = json_insert_child_before (place->target, value)) != JSON_OK)
+		return error;
+	if (replace)
+	{
+		old = place->target;
+		json_free_value (&old);
+	}
+	return JSON_OK;
+}
+
+
+/**
+Takes the value at a place out of the document
+**/
+static json_t *
+json_patch_take (const struct json_patch_place *place)
+{
+	json_t *value = json_patch_value (place), *label;
+
+	json_detach (value);
+	if ((place->parent != NULL) && (place->parent->type == JSON_OBJECT))
+	{
+		label = place->target;
+		json_free_value (&label);
+	}
+	return value;
+}
+
+
+static const char *
+json_patch_member_text (const json_t * operation, const char *name)
+{
+	const json_t *label = json_find_first_label (operation, name);
+
+	if ((label == NULL) || (label->child == NULL) || (label->child->type != JSON_STRING))
+		return NULL;
+	return label->child->text;
+}
+
+
+/**
+Reads a path member of an operation, unescaped
+@param path receives the plain text of the path, to be freed with free(), or NULL if the operation has no such member
+@return JSON_OK or JSON_MEMORY
+**/
+static enum json_error
+json_patch_member_path (const json_t * operation, const char *name, char **path)
+{
+	const json_t *label = json_find_first_label (operation, name);
+
+	*path = NULL;
+	if ((label == NULL) || (label->child == NULL) || (label->child->type != JSON_STRING))
+		return JSON_OK;
+	*path = (label->child->flags & JSON_FLAG_NEEDS_ESCAPING) ? strdup (label->child->text) : json_unescape (label->child->text);
+	return (*path != NULL) ? JSON_OK : JSON_MEMORY;
+}
+
+
+enum json_error
+json_patch_apply (json_t ** document, const json_t * patch)
+{
+	const json_t *operation, *label;
+	const char *op;
+	char *path = NULL, *from = NULL;
+	struct json_patch_place place, source;
+	enum json_error error = JSON_OK;
+	rcstring *token;
+	json_t *value;
+	size_t length;
+
+	assert (document != NULL);
+	assert (*document != NULL);
+	assert (patch != NULL);
+
+	if (patch->type != JSON_ARRAY)
+		return JSON_MALFORMED_DOCUMENT;
+	if ((token = rcs_create (RSTRING_DEFAULT)) == NULL)
+		return JSON_MEMORY;
+
+	for (operation = patch->child; (operation != NULL) && (error == JSON_OK); operation = operation->next)
+	{
+		/* paths are JSON strings holding JSON pointers, which are unescaped before their tokens are split */
+		free (path);
+		free (from);
+		path = from = NULL;
+		op = (operation->type == JSON_OBJECT) ? json_patch_member_text (operation, "op") : NULL;
+		if ((op == NULL) || ((error = json_patch_member_path (operation, "path", &path)) != JSON_OK) || ((error = json_patch_member_path (operation, "from", &from)) != JSON_OK) || (path == NULL))
+		{
+			if (error == JSON_OK)
+				error = JSON_MALFORMED_DOCUMENT;
+			break;
+		}
+		label = json_find_first_label (operation, "value");
+		value = NULL;
+
+		if ((strcmp (op, "add") == 0) || (strcmp (op, "replace") == 0) || (strcmp (op, "test") == 0))
+		{
+			if ((label == NULL) || (label->child == NULL))
+				error = JSON_MALFORMED_DOCUMENT;
+			else if ((error = json_patch_locate (*document, path, token, &place)) != JSON_OK)
+				break;
+			else if (strcmp (op, "test") == 0)
+				error = ((json_patch_value (&place) != NULL) && json_equal (json_patch_value (&place), label->child)) ? JSON_OK : JSON_INCOMPATIBLE_TYPE;
+			else if ((op[0] == 'r') && (json_patch_value (&place) == NULL))
+				error = JSON_BAD_TREE_STRUCTURE;
+			else if ((value = json_clone (label->child)) == NULL)
+				error = JSON_MEMORY;
+			else
+				error = json_patch_put (document, &place, token, value, op[0] == 'r');
+		}
+		else if (strcmp (op, "remove") == 0)
+		{
+			if ((error = json_patch_locate (*document, path, token, &place)) != JSON_OK)
+				break;
+			if ((place.parent == NULL) || (json_patch_value (&place) == NULL))
+				error = JSON_BAD_TREE_STRUCTURE;
+			else
+			{
+				value = json_patch_take (&place);
+				json_free_value (&value);
+			}
+		}
+		else if ((strcmp (op, "move") == 0) || (strcmp (op, "copy") == 0))
+		{
+			if (from == NULL)
+			{
+				error = JSON_MALFORMED_DOCUMENT;
+				break;
+			}
+			length = strlen (from);
+			if ((op[0] == 'm') && (strcmp (from, path) == 0))
+				continue;
+			if ((op[0] == 'm') && (strncmp (from, path, length) == 0) && (path[length] == '/'))
+			{
+				error = JSON_BAD_TREE_STRUCTURE;	/* a value can't be moved into itself */
+				break;
+			}
+			if ((error = json_patch_locate (*document, from, token, &source)) != JSON_OK)
+				break;
+			if (json_patch_value (&source) == NULL)
+			{
+				error = JSON_BAD_TREE_STRUCTURE;
+				break;
+			}
+			if (op[0] == 'm')
+			{
+				if (source.parent == NULL)
+				{
+					error = JSON_BAD_TREE_STRUCTURE;
+					break;
+				}
+				value = json_patch_take (&source);
+			}
+			else if ((value = json_clone (json_patch_value (&source))) == NULL)
+			{
+				error = JSON_MEMORY;
+				break;
+			}
+			if ((error = json_patch_locate (*document, path, token, &place)) == JSON_OK)
+				error = json_patch_put (document, &place, token, value, 0);
+		}
+		else
+			error = JSON_MALFORMED_DOCUMENT;
+
+		if ((error != JSON_OK) && (value != NULL) && (value->parent == NULL) && (value != *document))
+			json_free_value (&value);
+	}
+
+	free (path);
+	free (from);
+	rcs_free (&token);
+	return error;
+}
+
+
+/* merge patch part */
+
+/**
+Makes a node of a patch part of the target, taking it over unless it lives in an arena, in which case it is copied
+@return the node to insert into the target or NULL if memory ran out
+**/
+static json_t *
+json_merge_take (json_t * node)
+{
+	if (node->flags & JSON_FLAG_ARENA)
+		return json_clone (node);
+	json_detach (node);
+	return node;
+}
+
+
+/**
+Creates a label holding an empty object in an object of the target, after the label of a patch
+@return the new object or NULL if memory ran out
+**/
+static json_t *
+json_merge_new_member (json_t * object, const json_t * label)
+{
+	json_t *copy, *value;
+
+	if ((copy = json_new_value (JSON_STRING)) == NULL)
+		return NULL;
+	copy->text = strdup (label->text);
+	copy->flags = label->flags & (JSON_FLAG_NEEDS_ESCAPING | JSON_FLAG_HASHED);
+	copy->hash = label->hash;
+	if ((copy->text == NULL) || ((value = json_new_object ()) == NULL))
+	{
+		json_free_value (&copy);
+		return NULL;
+	}
+	json_insert_child (copy, value);
+	if (json_insert_child (object, copy) != JSON_OK)
+	{
+		json_free_value (&copy);
+		return NULL;
+	}
+	return value;
+}
+
+
+enum json_error
+json_merge_patch (json_t ** target, json_t ** patch)
+{
+	json_t *t, *p, *label, *next, *member, *value;
+	enum json_error error = JSON_OK;
+
+	assert (target != NULL);
+	assert (*target != NULL);
+	assert (patch != NULL);
+	assert (*patch != NULL);
+
+	if ((*patch)->type != JSON_OBJECT)
+	{
+		/* anything but an object replaces the target as a whole */
+		if ((value = json_merge_take (*patch)) == NULL)
+			error = JSON_MEMORY;
+		else
+		{
+			json_free_value (target);
+			*target = value;
+		}
+		if (value == *patch)
+			*patch = NULL;
+		else
+			json_free_value (patch);
+		return error;
+	}
+	if ((*target)->type != JSON_OBJECT)
+	{
+		if ((value = json_new_object ()) == NULL)
+		{
+			json_free_value (patch);
+			return JSON_MEMORY;
+		}
+		json_free_value (target);
+		*target = value;
+	}
+
+	/* walk the patch and the target in lockstep, climbing back up through the parent links of both */
+	t = *target;
+	p = *patch;
+	label = p->child;
+	for (;;)
+	{
+		if (label == NULL)
+		{
+			if (p == *patch)
+				break;
+			label = p->parent->next;
+			p = p->parent->parent;
+			t = t->parent->parent;
+			continue;
+		}
+		next = label->next;
+		if (label->child == NULL)
+		{
+			error = JSON_BAD_TREE_STRUCTURE;
+			break;
+		}
+		member = json_find_equal_label (t, label);
+
+		if (label->child->type == JSON_NULL)
+		{
+			if (member != NULL)
+				json_free_value (&member);
+		}
+		else if (label->child->type == JSON_OBJECT)
+		{
+			/* objects are merged member by member, as nulls in them must not reach the target */
+			if (member == NULL)
+				value = json_merge_new_member (t, label);
+			else if ((member->child != NULL) && (member->child->type == JSON_OBJECT))
+				value = member->child;
+			else
+			{
+				if ((value = member->child) != NULL)
+					json_free_value (&value);
+				if (((value = json_new_object ()) != NULL) && (json_insert_child (member, value) != JSON_OK))
+					json_free_value (&value);
+			}
+			if (value == NULL)
+			{
+				error = JSON_MEMORY;
+				break;
+			}
+			t = value;
+			p = label->child;
+			next = p->child;
+		}
+		else if (member != NULL)
+		{
+			if ((value = json_merge_take (label->child)) == NULL)
+			{
+				error = JSON_MEMORY;
+				break;
+			}
+			if ((member->child != NULL) && (member->child != value))
+			{
+				json_t *old = member->child;
+
+				json_free_value (&old);
+			}
+			json_insert_child (member, value);
+		}
+		else
+		{
+			if ((value = json_merge_take (label)) == NULL)
+			{
+				error = JSON_MEMORY;
+				break;
+			}
+			json_insert_child (t, value);
+		}
+		label = next;
+	}
+
+	json_free_value (patch);
+	return error;
+}
@@ -0,0 +1,53 @@
+/*// C Interface: json_patch*/
+/*// Description: JSON Patch (RFC 6902) and JSON Merge Patch (RFC 7386)*/
+/*// Copyright: See COPYING file that comes with this distribution*/
+
+
+#ifndef JSON_PATCH_H
+#define JSON_PATCH_H
+
+#include "json.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/* array diffs which need more edits than this replace the differing elements pairwise instead of searching for the shortest edit script */
+#define JSON_DIFF_MAX_EDITS 512
+
+
+/**
+Computes a JSON Patch (RFC 6902) which turns one document into another. Unchanged subtrees are told apart through structural hashes, which are memoized in both documents, object members are matched through their labels and arrays through a shortest edit script. Elements that changed in place are patched recursively rather than replaced. Labels go into the paths by their unescaped text
+@param a the original document
+@param b the target document
+@param patch receives the patch, an array of operation objects, to be freed with json_free_value()
+@return JSON_OK or JSON_MEMORY
+**/
+	enum json_error json_diff (const json_t * a, const json_t * b, json_t ** patch);
+
+
+/**
+Applies a JSON Patch (RFC 6902) to a document in place. The operations are applied in order and the document keeps those applied before a failing one, so callers that need all or nothing apply the patch to a json_clone() of the document
+@param document the document, which may be replaced as a whole by operations on the root
+@param patch an array of add, remove, replace, move, copy and test operations, as json_parse_document() reads a patch document. Paths are matched against the unescaped text of labels
+@return JSON_OK, JSON_MALFORMED_DOCUMENT if an operation is malformed, JSON_BAD_TREE_STRUCTURE if a path does not lead to a place in the document, JSON_INCOMPATIBLE_TYPE if a test operation failed or JSON_MEMORY
+**/
+	enum json_error json_patch_apply (json_t ** document, const json_t * patch);
+
+
+/**
+Applies a JSON Merge Patch (RFC 7386) to a document in place. The nodes of the target are kept wherever the patch does not replace them, members are looked up through the objects' label indexes, and the values of the patch are moved into the target rather than copied, except for those living in a json_arena. Labels are matched by their unescaped text, however they are escaped
+@param target the document, which is replaced as a whole if the patch is not an object
+@param patch the patch, which is taken over: what is left of it is freed and it is set to NULL. Callers that need to keep it pass a json_clone()
+@return JSON_OK, JSON_BAD_TREE_STRUCTURE if the patch holds a label without a value or JSON_MEMORY, in which case the target may be partially patched
+**/
+	enum json_error json_merge_patch (json_t ** target, json_t ** patch);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
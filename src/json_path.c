@@ -0,0 +1,1338 @@
+/*
+*  C Implementation: json_path
+*
+* Description: JSONPath expressions compiled into plans of steps and evaluated iteratively over json_t trees
+*
+*
+* Copyright: See COPYING file that comes with this distribution
+*
+*/
+
+#include "json_path.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+
+enum json_path_step_type
+{
+	JSON_PATH_MEMBER,	/* ['name'] */
+	JSON_PATH_WILDCARD,	/* [*] */
+	JSON_PATH_INDEX,	/* [n] */
+	JSON_PATH_SLICE,	/* [start:end:step] */
+	JSON_PATH_FILTER	/* [?(@.a op literal)] */
+};
+
+
+enum json_path_operator
+{
+	JSON_PATH_EXISTS,
+	JSON_PATH_EQUAL,
+	JSON_PATH_NOT_EQUAL,
+	JSON_PATH_LESS,
+	JSON_PATH_LESS_EQUAL,
+	JSON_PATH_GREATER,
+	JSON_PATH_GREATER_EQUAL
+};
+
+
+struct json_path_step
+{
+	enum json_path_step_type type;
+	int descendant;		/* the step was written after .. and applies to every node below as well */
+
+	char *name;		/* JSON_PATH_MEMBER */
+	uint32_t hash;
+	int is_position;	/* JSON pointer tokens that are array positions match the element at index as well */
+
+	long index;		/* JSON_PATH_INDEX */
+
+	long start, end, stride;	/* JSON_PATH_SLICE */
+	int has_start, has_end;
+
+	struct json_path_step *operand;	/* JSON_PATH_FILTER: relative path made of member and index steps */
+	size_t operand_count;
+	enum json_path_operator operator;
+	enum json_value_type literal_type;
+	char *literal;
+	double number;
+};
+
+
+enum json_path_frame_state
+{
+	JSON_PATH_VISIT,	/* apply the step to the node, or report the node once every step is done */
+	JSON_PATH_SELECT,	/* apply the step's selector to the node's children */
+	JSON_PATH_ITERATE,	/* go through the children matching a wildcard or a filter */
+	JSON_PATH_STRIDE,	/* go through the elements of a slice */
+	JSON_PATH_DESCEND	/* apply the step to the node and then to every node below it */
+};
+
+
+struct json_path_frame
+{
+	enum json_path_frame_state state;
+	const json_t *node;
+	size_t step;
+	const json_t *cursor;	/* the next child to consider */
+	size_t remaining;	/* JSON_PATH_STRIDE: elements left in the slice. JSON_PATH_DESCEND: set until the node itself was selected from */
+};
+
+
+struct json_path
+{
+	struct json_path_step *steps;
+	size_t count;
+	struct json_path_frame *stack;	/* kept between evaluations */
+	size_t capacity;
+};
+
+
+/* compiler part */
+
+static const char *
+json_path_skip_white_spaces (const char *p)
+{
+	while ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r'))
+		p++;
+	return p;
+}
+
+
+static int
+json_path_is_name_character (char c)
+{
+	return (c != '\0') && (strchr (".[]()=!<>&|,' \t\r\n\"", c) == NULL);
+}
+
+
+/**
+Copies a quoted string, unescaped. Inside single quotes \' stands for a quote, besides the escape sequences of JSON strings
+@param p points at the opening quote, and is left past the closing one
+@return the copied text or NULL if the string is not terminated or memory ran out
+**/
+static char *
+json_path_quoted (const char **p)
+{
+	const char quote = **p;
+	const char *start = *p + 1, *end;
+	char *text, *unescaped;
+	size_t length = 0;
+
+	for (end = start; (*end != quote) && (*end != '\0'); end++)
+	{
+		if ((end[0] == '\\') && (end[1] != '\0'))
+			end++;
+	}
+	if (*end != quote)
+		return NULL;
+
+	text = malloc (end - start + 1);
+	if (text == NULL)
+		return NULL;
+	for (; start < end; start++)
+	{
+		if ((quote == '\'') && (start[0] == '\\') && (start[1] == '\''))
+			start++;
+		else if (start[0] == '\\')
+			text[length++] = *start++;	/* keep the escape sequence whole for json_unescape() */
+		text[length++] = *start;
+	}
+	text[length] = '\0';
+	*p = end + 1;
+
+	unescaped = json_unescape (text);
+	free (text);
+	return unescaped;
+}
+
+
+static char *
+json_path_name (const char **p)
+{
+	const char *start = *p;
+	char *text;
+
+	while (json_path_is_name_character (**p))
+		(*p)++;
+	if (*p == start)
+		return NULL;
+	text = malloc (*p - start + 1);
+	if (text == NULL)
+		return NULL;
+	memcpy (text, start, *p - start);
+	text[*p - start] = '\0';
+	return text;
+}
+
+
+static int
+json_path_integer (const char **p, long *value)
+{
+	char *end;
+
+	if ((**p != '-') && ((**p < '0') || (**p > '9')))
+		return 0;
+	*value = strtol (*p, &end, 10);
+	if (end == *p || ((**p == '-') && (end == *p + 1)))
+		return 0;
+	*p = end;
+	return 1;
+}
+
+
+static struct json_path_step *
+json_path_add_step (struct json_path_step **steps, size_t *count, enum json_path_step_type type)
+{
+	struct json_path_step *grown = realloc (*steps, (*count + 1) * sizeof (struct json_path_step));
+
+	if (grown == NULL)
+		return NULL;
+	*steps = grown;
+	memset (&grown[*count], 0, sizeof (struct json_path_step));
+	grown[*count].type = type;
+	return &grown[(*count)++];
+}
+
+
+static void
+json_path_free_steps (struct json_path_step *steps, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		free (steps[i].name);
+		free (steps[i].literal);
+		json_path_free_steps (steps[i].operand, steps[i].operand_count);
+	}
+	free (steps);
+}
+
+
+/**
+Compiles the body of a filter, from the @ of the relative path to the end of the comparison
+@return 0 if the filter is malformed or memory ran out
+**/
+static int
+json_path_filter (const char **p, struct json_path_step *filter)
+{
+	struct json_path_step *step;
+	const char *q = json_path_skip_white_spaces (*p);
+	char *end;
+
+	if (*q++ != '@')
+		return 0;
+
+	/* the relative path */
+	for (;;)
+	{
+		if (*q == '.')
+		{
+			q++;
+			step = json_path_add_step (&filter->operand, &filter->operand_count, JSON_PATH_MEMBER);
+			if ((step == NULL) || ((step->name = json_path_name (&q)) == NULL))
+				return 0;
+		}
+		else if (*q == '[')
+		{
+			q = json_path_skip_white_spaces (q + 1);
+			if ((*q == '\'') || (*q == '"'))
+			{
+				step = json_path_add_step (&filter->operand, &filter->operand_count, JSON_PATH_MEMBER);
+				if ((step == NULL) || ((step->name = json_path_quoted (&q)) == NULL))
+					return 0;
+			}
+			else
+			{
+				step = json_path_add_step (&filter->operand, &filter->operand_count, JSON_PATH_INDEX);
+				if ((step == NULL) || !json_path_integer (&q, &step->index))
+					return 0;
+			}
+			q = json_path_skip_white_spaces (q);
+			if (*q++ != ']')
+				return 0;
+		}
+		else
+			break;
+		if (step->type == JSON_PATH_MEMBER)
+			step->hash = json_hash_text (step->name, strlen (step->name));
+	}
+
+	/* the comparison */
+	q = json_path_skip_white_spaces (q);
+	if ((q[0] == '=') && (q[1] == '='))
+		filter->operator = JSON_PATH_EQUAL, q += 2;
+	else if ((q[0] == '!') && (q[1] == '='))
+		filter->operator = JSON_PATH_NOT_EQUAL, q += 2;
+	else if ((q[0] == '<') && (q[1] == '='))
+		filter->operator = JSON_PATH_LESS_EQUAL, q += 2;
+	else if ((q[0] == '>') && (q[1] == '='))
+		filter->operator = JSON_PATH_GREATER_EQUAL, q += 2;
+	else if (q[0] == '<')
+		filter->operator = JSON_PATH_LESS, q++;
+	else if (q[0] == '>')
+		filter->operator = JSON_PATH_GREATER, q++;
+	else
+	{
+		filter->operator = JSON_PATH_EXISTS;
+		*p = q;
+		return 1;
+	}
+
+	q = json_path_skip_white_spaces (q);
+	if ((*q == '\'') || (*q == '"'))
+	{
+		filter->literal_type = JSON_STRING;
+		if ((filter->literal = json_path_quoted (&q)) == NULL)
+			return 0;
+	}
+	else if (strncmp (q, "true", 4) == 0)
+		filter->literal_type = JSON_TRUE, q += 4;
+	else if (strncmp (q, "false", 5) == 0)
+		filter->literal_type = JSON_FALSE, q += 5;
+	else if (strncmp (q, "null", 4) == 0)
+		filter->literal_type = JSON_NULL, q += 4;
+	else
+	{
+		filter->literal_type = JSON_NUMBER;
+		filter->number = strtod (q, &end);
+		if (end == q)
+			return 0;
+		q = end;
+	}
+	*p = q;
+	return 1;
+}
+
+
+/**
+Compiles the content of a bracketed step, from past the [ to past the ]
+@return 0 if the step is malformed or memory ran out
+**/
+static int
+json_path_bracket (const char **p, struct json_path_step *step)
+{
+	const char *q = json_path_skip_white_spaces (*p);
+	int parenthesized;
+
+	if ((*q == '\'') || (*q == '"'))
+	{
+		step->type = JSON_PATH_MEMBER;
+		if ((step->name = json_path_quoted (&q)) == NULL)
+			return 0;
+		step->hash = json_hash_text (step->name, strlen (step->name));
+	}
+	else if (*q == '*')
+	{
+		step->type = JSON_PATH_WILDCARD;
+		q++;
+	}
+	else if (*q == '?')
+	{
+		step->type = JSON_PATH_FILTER;
+		q = json_path_skip_white_spaces (q + 1);
+		parenthesized = (*q == '(');
+		if (parenthesized)
+			q++;
+		if (!json_path_filter (&q, step))
+			return 0;
+		q = json_path_skip_white_spaces (q);
+		if (parenthesized && (*q++ != ')'))
+			return 0;
+	}
+	else
+	{
+		step->type = JSON_PATH_INDEX;
+		step->has_start = json_path_integer (&q, &step->start);
+		q = json_path_skip_white_spaces (q);
+		if (*q != ':')
+		{
+			if (!step->has_start)
+				return 0;
+			step->index = step->start;
+		}
+		else
+		{
+			step->type = JSON_PATH_SLICE;
+			step->stride = 1;
+			q = json_path_skip_white_spaces (q + 1);
+			step->has_end = json_path_integer (&q, &step->end);
+			q = json_path_skip_white_spaces (q);
+			if (*q == ':')
+			{
+				q = json_path_skip_white_spaces (q + 1);
+				if (!json_path_integer (&q, &step->stride))
+					step->stride = 1;
+			}
+		}
+	}
+
+	q = json_path_skip_white_spaces (q);
+	if (*q++ != ']')
+		return 0;
+	*p = q;
+	return 1;
+}
+
+
+struct json_path *
+json_path_compile (const char *expression)
+{
+	struct json_path *path;
+	struct json_path_step *step;
+	const char *p;
+	int descendant;
+
+	assert (expression != NULL);
+
+	p = json_path_skip_white_spaces (expression);
+	if (*p++ != '$')
+		return NULL;
+
+	path = calloc (1, sizeof (struct json_path));
+	if (path == NULL)
+		return NULL;
+
+	while (*(p = json_path_skip_white_spaces (p)) != '\0')
+	{
+		descendant = 0;
+		if ((p[0] == '.') && (p[1] == '.'))
+		{
+			descendant = 1;
+			p += 2;
+		}
+		else if (p[0] == '.')
+			p++;
+		else if (p[0] != '[')
+			goto error;
+
+		step = json_path_add_step (&path->steps, &path->count, JSON_PATH_MEMBER);
+		if (step == NULL)
+			goto error;
+		step->descendant = descendant;
+
+		if (*p == '[')
+		{
+			p++;
+			if (!json_path_bracket (&p, step))
+				goto error;
+		}
+		else if (*p == '*')
+		{
+			step->type = JSON_PATH_WILDCARD;
+			p++;
+		}
+		else
+		{
+			if ((step->name = json_path_name (&p)) == NULL)
+				goto error;
+			step->hash = json_hash_text (step->name, strlen (step->name));
+		}
+	}
+	return path;
+
+error:
+	json_path_free (&path);
+	return NULL;
+}
+
+
+void
+json_path_free (struct json_path **path)
+{
+	assert (path != NULL);
+	if (*path != NULL)
+	{
+		json_path_free_steps ((*path)->steps, (*path)->count);
+		free ((*path)->stack);
+		free (*path);
+		*path = NULL;
+	}
+}
+
+
+/* evaluation part */
+
+/**
+Returns the value held by a child of a container: the child itself for arrays or the label's value for objects
+**/
+static const json_t *
+json_path_value (const json_t * child)
+{
+	return (child->parent->type == JSON_OBJECT) ? child->child : child;
+}
+
+
+/**
+Applies a member or index step to a node
+@return the selected node or NULL if there is none
+**/
+static const json_t *
+json_path_select_one (const json_t * node, const struct json_path_step *step)
+{
+	long position;
+
+	if ((step->type == JSON_PATH_MEMBER) && (node->type == JSON_OBJECT))
+	{
+		node = json_find_reading_label (node, step->name, step->hash);
+		return (node != NULL) ? node->child : NULL;
+	}
+	if ((step->type == JSON_PATH_INDEX) && (node->type == JSON_ARRAY))
+	{
+		position = step->index;
+		if (position < 0)
+			position += (long) json_array_size (node);
+		return (position >= 0) ? json_array_get (node, (size_t) position) : NULL;
+	}
+	return NULL;
+}
+
+
+/**
+Compares the unescaped text of a string with a literal, byte by byte, which orders UTF-8 texts by code point
+@return a negative number, zero or a positive number as the string sorts before, with or after the literal
+**/
+static int
+json_path_compare_text (const json_t * node, const char *literal)
+{
+	struct json_text_reader reader;
+	int c;
+
+	json_text_reader_init (&reader, node);
+	while ((c = json_text_reader_next (&reader)) != -1)
+	{
+		if (c != (unsigned char) *literal)
+			return c - (unsigned char) *literal;
+		literal++;
+	}
+	return (*literal == '\0') ? 0 : -1;
+}
+
+
+static int
+json_path_test (const json_t * node, const struct json_path_step *filter)
+{
+	size_t i;
+	int comparison;
+
+	for (i = 0; (i < filter->operand_count) && (node != NULL); i++)
+		node = json_path_select_one (node, &filter->operand[i]);
+
+	if (filter->operator == JSON_PATH_EXISTS)
+		return node != NULL;
+	if ((node == NULL) || (node->type != filter->literal_type))
+		return filter->operator == JSON_PATH_NOT_EQUAL;
+
+	switch (node->type)
+	{
+	case JSON_NUMBER:
+		{
+			double number = strtod (node->text, NULL);
+			comparison = (number > filter->number) - (number < filter->number);
+		}
+		break;
+	case JSON_STRING:
+		comparison = json_path_compare_text (node, filter->literal);
+		break;
+	default:
+		comparison = 0;	/* true, false and null only equal themselves */
+		break;
+	}
+
+	switch (filter->operator)
+	{
+	case JSON_PATH_EQUAL:
+		return comparison == 0;
+	case JSON_PATH_NOT_EQUAL:
+		return comparison != 0;
+	case JSON_PATH_LESS:
+		return comparison < 0;
+	case JSON_PATH_LESS_EQUAL:
+		return comparison <= 0;
+	case JSON_PATH_GREATER:
+		return comparison > 0;
+	default:
+		return comparison >= 0;
+	}
+}
+
+
+/**
+Normalizes a slice against the length of an array the way Python does
+@param first set to the position of the slice's first element
+@return the number of elements in the slice
+**/
+static size_t
+json_path_slice (const struct json_path_step *step, long length, long *first)
+{
+	long start, end;
+
+	if (step->stride == 0)
+		return 0;
+
+	if (step->stride > 0)
+	{
+		start = step->has_start ? step->start : 0;
+		end = step->has_end ? step->end : length;
+		if (start < 0)
+			start = (start + length < 0) ? 0 : start + length;
+		if (end < 0)
+			end = (end + length < 0) ? 0 : end + length;
+		if (start > length)
+			start = length;
+		if (end > length)
+			end = length;
+		*first = start;
+		return (end > start) ? (size_t) ((end - start + step->stride - 1) / step->stride) : 0;
+	}
+
+	start = step->has_start ? step->start : length - 1;
+	end = step->has_end ? step->end : -length - 1;
+	if (start < 0)
+		start = (start + length < 0) ? -1 : start + length;
+	if (end < 0)
+		end = (end + length < 0) ? -1 : end + length;
+	if (start >= length)
+		start = length - 1;
+	if (end >= length)
+		end = length - 1;
+	*first = start;
+	return (start > end) ? (size_t) ((start - end - step->stride - 1) / -step->stride) : 0;
+}
+
+
+static enum json_error
+json_path_push (struct json_path *path, size_t *depth, enum json_path_frame_state state, const json_t * node, size_t step)
+{
+	struct json_path_frame *frame;
+
+	if (*depth == path->capacity)
+	{
+		size_t capacity = (path->capacity == 0) ? 32 : path->capacity * 2;
+		frame = realloc (path->stack, capacity * sizeof (struct json_path_frame));
+		if (frame == NULL)
+			return JSON_MEMORY;
+		path->stack = frame;
+		path->capacity = capacity;
+	}
+	frame = &path->stack[(*depth)++];
+	frame->state = state;
+	frame->node = node;
+	frame->step = step;
+	frame->cursor = NULL;
+	frame->remaining = 0;
+	return JSON_OK;
+}
+
+
+enum json_error
+json_path_eval (struct json_path *path, const json_t * root, json_path_callback callback, void *data)
+{
+	struct json_path_frame *frame;
+	const struct json_path_step *step;
+	const json_t *child;
+	size_t depth = 0;
+	long first;
+	int stride;
+
+	assert (path != NULL);
+	assert (root != NULL);
+	assert (callback != NULL);
+
+	if (json_path_push (path, &depth, JSON_PATH_VISIT, root, 0) != JSON_OK)
+		return JSON_MEMORY;
+
+	/* frames are addressed through the stack on every pass, as pushing may move it */
+	while (depth > 0)
+	{
+		frame = &path->stack[depth - 1];
+		step = (frame->step < path->count) ? &path->steps[frame->step] : NULL;
+		child = NULL;
+
+		switch (frame->state)
+		{
+		case JSON_PATH_VISIT:
+			if (frame->step == path->count)
+			{
+				depth--;
+				if (callback ((json_t *) frame->node, data) != 0)
+					return JSON_OK;
+			}
+			else if (step->descendant)
+			{
+				frame->state = JSON_PATH_DESCEND;
+				frame->cursor = frame->node->child;
+				frame->remaining = 1;
+			}
+			else
+				frame->state = JSON_PATH_SELECT;
+			break;
+
+		case JSON_PATH_SELECT:
+			if ((frame->node->type != JSON_OBJECT) && (frame->node->type != JSON_ARRAY))
+			{
+				depth--;
+				break;
+			}
+			switch (step->type)
+			{
+			case JSON_PATH_MEMBER:
+			case JSON_PATH_INDEX:
+				/* a single match takes over the frame */
+				child = json_path_select_one (frame->node, step);
+				if (child == NULL)
+					depth--;
+				else
+				{
+					frame->state = JSON_PATH_VISIT;
+					frame->node = child;
+					frame->step++;
+				}
+				break;
+
+			case JSON_PATH_SLICE:
+				if (frame->node->type != JSON_ARRAY)
+				{
+					depth--;
+					break;
+				}
+				frame->remaining = json_path_slice (step, (long) json_array_size (frame->node), &first);
+				frame->cursor = (frame->remaining > 0) ? json_array_get (frame->node, (size_t) first) : NULL;
+				frame->state = JSON_PATH_STRIDE;
+				break;
+
+			default:
+				frame->cursor = frame->node->child;
+				frame->state = JSON_PATH_ITERATE;
+				break;
+			}
+			break;
+
+		case JSON_PATH_ITERATE:
+			while ((frame->cursor != NULL) && (child == NULL))
+			{
+				child = json_path_value (frame->cursor);
+				frame->cursor = frame->cursor->next;
+				if ((child != NULL) && (step->type == JSON_PATH_FILTER) && !json_path_test (child, step))
+					child = NULL;
+			}
+			if (child == NULL)
+				depth--;
+			else if (json_path_push (path, &depth, JSON_PATH_VISIT, child, frame->step + 1) != JSON_OK)
+				return JSON_MEMORY;
+			break;
+
+		case JSON_PATH_STRIDE:
+			if ((frame->remaining == 0) || (frame->cursor == NULL))
+			{
+				depth--;
+				break;
+			}
+			child = frame->cursor;
+			frame->remaining--;
+			for (stride = 0; (stride < labs (step->stride)) && (frame->cursor != NULL); stride++)
+				frame->cursor = (step->stride > 0) ? frame->cursor->next : frame->cursor->previous;
+			if (json_path_push (path, &depth, JSON_PATH_VISIT, child, frame->step + 1) != JSON_OK)
+				return JSON_MEMORY;
+			break;
+
+		case JSON_PATH_DESCEND:
+			if (frame->remaining)
+			{
+				/* the node itself comes first, then the nodes below it in document order */
+				frame->remaining = 0;
+				if (json_path_push (path, &depth, JSON_PATH_SELECT, frame->node, frame->step) != JSON_OK)
+					return JSON_MEMORY;
+				break;
+			}
+			while ((frame->cursor != NULL) && (child == NULL))
+			{
+				child = json_path_value (frame->cursor);
+				frame->cursor = frame->cursor->next;
+				if ((child == NULL) || (child->child == NULL))
+					child = NULL;	/* leaves have nothing to select from */
+			}
+			if (child == NULL)
+				depth--;
+			else if (json_path_push (path, &depth, JSON_PATH_DESCEND, child, frame->step) != JSON_OK)
+				return JSON_MEMORY;
+			else
+			{
+				frame = &path->stack[depth - 1];
+				frame->cursor = child->child;
+				frame->remaining = 1;
+			}
+			break;
+		}
+	}
+	return JSON_OK;
+}
+
+
+/* streaming selector part */
+
+enum json_selector_state
+{
+	JSON_SELECTOR_VALUE,	/* expecting a value */
+	JSON_SELECTOR_FIRST_ELEMENT,	/* just opened an array: a value or ] */
+	JSON_SELECTOR_FIRST_LABEL,	/* just opened an object: a label or } */
+	JSON_SELECTOR_LABEL,	/* expecting a label */
+	JSON_SELECTOR_NAME_SEPARATOR,	/* expecting : */
+	JSON_SELECTOR_AFTER_VALUE,	/* expecting , or the end of the container */
+	JSON_SELECTOR_SKIP	/* skipping the rest of a container nobody subscribed to */
+};
+
+
+struct json_selector_subscription
+{
+	struct json_path_step *steps;
+	size_t count;
+	json_selector_callback callback;
+	void *data;
+};
+
+
+struct json_selector_frame
+{
+	int is_object;
+	size_t position;	/* the position of the current array element */
+	json_t *node;		/* the container, if it is being materialized */
+	json_t *label;		/* the label waiting for its value, if the object is being materialized */
+};
+
+
+struct json_selector
+{
+	struct json_selector_subscription *subscriptions;
+	size_t count;
+
+	struct json_selector_frame *frames;	/* the open containers */
+	unsigned char *alive;	/* per nesting level, a flag per subscription whose steps still match the path to that level */
+	size_t depth;
+	size_t capacity;
+
+	json_t *match;		/* the root of the subtree being materialized */
+	enum json_selector_state state;
+	size_t skip_depth;	/* JSON_SELECTOR_SKIP: the containers still open in the skipped subtree */
+	int skip_string;	/* JSON_SELECTOR_SKIP: set inside a string, 2 right after a backslash */
+
+	unsigned int lex_state;
+	rcstring *lex_text;
+	size_t line;
+};
+
+
+struct json_selector *
+json_selector_new (void)
+{
+	struct json_selector *selector = calloc (1, sizeof (struct json_selector));
+
+	if (selector != NULL)
+		selector->line = 1;
+	return selector;
+}
+
+
+/**
+Compiles a JSON pointer into member steps, marking the tokens that may also address array elements
+@return JSON_OK, JSON_MALFORMED_DOCUMENT or JSON_MEMORY
+**/
+static enum json_error
+json_selector_pointer (const char *pointer, struct json_selector_subscription *subscription)
+{
+	struct json_path_step *step;
+	const char *p = pointer;
+	size_t length;
+
+	while (*p == '/')
+	{
+		p++;
+		length = strcspn (p, "/");
+		step = json_path_add_step (&subscription->steps, &subscription->count, JSON_PATH_MEMBER);
+		if ((step == NULL) || ((step->name = malloc (length + 1)) == NULL))
+			return JSON_MEMORY;
+		for (length = 0; (*p != '/') && (*p != '\0'); p++)
+		{
+			if (*p != '~')
+				step->name[length++] = *p;
+			else if ((p[1] == '0') || (p[1] == '1'))
+				step->name[length++] = (*++p == '0') ? '~' : '/';
+			else
+				return JSON_MALFORMED_DOCUMENT;
+		}
+		step->name[length] = '\0';
+		step->hash = json_hash_text (step->name, length);
+		step->is_position = (length > 0) && (strspn (step->name, "0123456789") == length) && ((step->name[0] != '0') || (length == 1));
+		if (step->is_position)
+			step->index = strtol (step->name, NULL, 10);
+	}
+	return (*p == '\0') ? JSON_OK : JSON_MALFORMED_DOCUMENT;
+}
+
+
+enum json_error
+json_selector_subscribe (struct json_selector *selector, const char *expression, json_selector_callback callback, void *data)
+{
+	struct json_selector_subscription *subscription;
+	struct json_path *path;
+	enum json_error error = JSON_OK;
+	size_t i;
+
+	assert (selector != NULL);
+	assert (expression != NULL);
+	assert (callback != NULL);
+	assert (selector->capacity == 0);	/* subscriptions come before the first fragment */
+
+	subscription = realloc (selector->subscriptions, (selector->count + 1) * sizeof (struct json_selector_subscription));
+	if (subscription == NULL)
+		return JSON_MEMORY;
+	selector->subscriptions = subscription;
+	subscription = &subscription[selector->count];
+	memset (subscription, 0, sizeof (struct json_selector_subscription));
+	subscription->callback = callback;
+	subscription->data = data;
+
+	if (expression[0] != '$')
+		error = json_selector_pointer (expression, subscription);
+	else if ((path = json_path_compile (expression)) == NULL)
+		error = JSON_MALFORMED_DOCUMENT;
+	else
+	{
+		/* the path's steps are taken over, as long as they can be decided without looking ahead or behind */
+		subscription->steps = path->steps;
+		subscription->count = path->count;
+		path->steps = NULL;
+		path->count = 0;
+		json_path_free (&path);
+		for (i = 0; i < subscription->count; i++)
+		{
+			if (subscription->steps[i].descendant || (subscription->steps[i].type == JSON_PATH_SLICE) || (subscription->steps[i].type == JSON_PATH_FILTER) || ((subscription->steps[i].type == JSON_PATH_INDEX) && (subscription->steps[i].index < 0)))
+				error = JSON_INCOMPATIBLE_TYPE;
+		}
+	}
+
+	if (error != JSON_OK)
+	{
+		json_path_free_steps (subscription->steps, subscription->count);
+		return error;
+	}
+	selector->count++;
+	return JSON_OK;
+}
+
+
+void
+json_selector_free (struct json_selector **selector)
+{
+	size_t i;
+
+	assert (selector != NULL);
+	if (*selector != NULL)
+	{
+		for (i = 0; i < (*selector)->count; i++)
+			json_path_free_steps ((*selector)->subscriptions[i].steps, (*selector)->subscriptions[i].count);
+		free ((*selector)->subscriptions);
+		free ((*selector)->frames);
+		free ((*selector)->alive);
+		if ((*selector)->match != NULL)
+			json_free_value (&(*selector)->match);
+		rcs_free (&(*selector)->lex_text);
+		free (*selector);
+		*selector = NULL;
+	}
+}
+
+
+/**
+Works out which subscriptions still match after descending into a child of the innermost open container
+@param label the child's label, or NULL if the container is an array
+@return 1 if any subscription is still alive at the child's level
+**/
+static int
+json_selector_descend (struct json_selector *selector, const char *label)
+{
+	const unsigned char *parent = &selector->alive[(selector->depth - 1) * selector->count];
+	unsigned char *child = &selector->alive[selector->depth * selector->count];
+	const struct json_path_step *step;
+	size_t position = selector->frames[selector->depth - 1].position;
+	size_t i;
+	int any = 0;
+
+	for (i = 0; i < selector->count; i++)
+	{
+		child[i] = 0;
+		if (!parent[i] || (selector->subscriptions[i].count < selector->depth))
+			continue;
+		step = &selector->subscriptions[i].steps[selector->depth - 1];
+		if (step->type == JSON_PATH_WILDCARD)
+			child[i] = 1;
+		else if (label != NULL)
+			child[i] = (step->type == JSON_PATH_MEMBER) && json_text_reads (label, 0, step->name);
+		else if (step->type == JSON_PATH_INDEX)
+			child[i] = ((size_t) step->index == position);
+		else
+			child[i] = step->is_position && ((size_t) step->index == position);
+		any |= child[i];
+	}
+	return any;
+}
+
+
+/**
+Tells whether a subscription ends at the current level, which makes the value there a match
+**/
+static int
+json_selector_matched (const struct json_selector *selector)
+{
+	const unsigned char *alive = &selector->alive[selector->depth * selector->count];
+	size_t i;
+
+	for (i = 0; i < selector->count; i++)
+	{
+		if (alive[i] && (selector->subscriptions[i].count == selector->depth))
+			return 1;
+	}
+	return 0;
+}
+
+
+/**
+Tells whether some subscription goes deeper than the current level
+**/
+static int
+json_selector_deeper (const struct json_selector *selector)
+{
+	const unsigned char *alive = &selector->alive[selector->depth * selector->count];
+	size_t i;
+
+	for (i = 0; i < selector->count; i++)
+	{
+		if (alive[i] && (selector->subscriptions[i].count > selector->depth))
+			return 1;
+	}
+	return 0;
+}
+
+
+/**
+Hands a finished value to the subscriptions that end at its level and frees it if it was the root of a match
+**/
+static void
+json_selector_finish (struct json_selector *selector, json_t * value)
+{
+	const unsigned char *alive = &selector->alive[selector->depth * selector->count];
+	size_t i;
+
+	if (value == NULL)
+		return;
+	for (i = 0; i < selector->count; i++)
+	{
+		if (alive[i] && (selector->subscriptions[i].count == selector->depth))
+			selector->subscriptions[i].callback (value, selector->subscriptions[i].data);
+	}
+	if (value == selector->match)
+		json_free_value (&selector->match);
+}
+
+
+/**
+Moves on once a value at the current level is done
+**/
+static void
+json_selector_next (struct json_selector *selector)
+{
+	if (selector->depth == 0)
+		selector->state = JSON_SELECTOR_VALUE;	/* another document may follow */
+	else
+	{
+		if (!selector->frames[selector->depth - 1].is_object)
+			selector->frames[selector->depth - 1].position++;
+		selector->state = JSON_SELECTOR_AFTER_VALUE;
+	}
+}
+
+
+/**
+Handles the start of a value, materializing it if it is part of a match
+@param token the lexer token that starts the value
+@return JSON_OK, JSON_MALFORMED_DOCUMENT or JSON_MEMORY
+**/
+static enum json_error
+json_selector_value (struct json_selector *selector, int token)
+{
+	struct json_selector_frame *frame;
+	json_t *node = NULL;
+	void *grown;
+	size_t capacity;
+	int building;
+
+	if ((selector->depth > 0) && !selector->frames[selector->depth - 1].is_object)
+		json_selector_descend (selector, NULL);
+
+	building = (selector->match != NULL) || json_selector_matched (selector);
+	if (building)
+	{
+		switch (token)
+		{
+		case LEX_BEGIN_OBJECT:
+			node = json_new_object ();
+			break;
+		case LEX_BEGIN_ARRAY:
+			node = json_new_array ();
+			break;
+		case LEX_STRING:
+		case LEX_NUMBER:
+			node = json_new_value ((token == LEX_STRING) ? JSON_STRING : JSON_NUMBER);
+			if (node != NULL)
+				node->text = rcs_unwrap (selector->lex_text), selector->lex_text = NULL;
+			break;
+		case LEX_TRUE:
+			node = json_new_true ();
+			break;
+		case LEX_FALSE:
+			node = json_new_false ();
+			break;
+		case LEX_NULL:
+			node = json_new_null ();
+			break;
+		default:
+			return JSON_MALFORMED_DOCUMENT;
+		}
+		if (node == NULL)
+			return JSON_MEMORY;
+
+		if (selector->match == NULL)
+			selector->match = node;
+		else
+		{
+			frame = &selector->frames[selector->depth - 1];
+			if (json_insert_child (frame->is_object ? frame->label : frame->node, node) != JSON_OK)
+			{
+				json_free_value (&node);
+				return JSON_MEMORY;
+			}
+		}
+	}
+	rcs_free (&selector->lex_text);
+
+	if ((token != LEX_BEGIN_OBJECT) && (token != LEX_BEGIN_ARRAY))
+	{
+		json_selector_finish (selector, node);
+		json_selector_next (selector);
+		return JSON_OK;
+	}
+
+	/* containers nobody looks into are skipped over without going through the lexer */
+	if (!building && !json_selector_deeper (selector))
+	{
+		selector->state = JSON_SELECTOR_SKIP;
+		selector->skip_depth = 1;
+		selector->skip_string = 0;
+		return JSON_OK;
+	}
+
+	if (selector->depth + 1 >= selector->capacity)
+	{
+		capacity = (selector->capacity == 0) ? 16 : selector->capacity * 2;
+		if ((grown = realloc (selector->frames, capacity * sizeof (struct json_selector_frame))) == NULL)
+			return JSON_MEMORY;
+		selector->frames = grown;
+		if ((grown = realloc (selector->alive, capacity * selector->count + 1)) == NULL)
+			return JSON_MEMORY;
+		selector->alive = grown;
+		selector->capacity = capacity;
+	}
+	frame = &selector->frames[selector->depth++];
+	frame->is_object = (token == LEX_BEGIN_OBJECT);
+	frame->position = 0;
+	frame->node = node;
+	frame->label = NULL;
+	selector->state = frame->is_object ? JSON_SELECTOR_FIRST_LABEL : JSON_SELECTOR_FIRST_ELEMENT;
+	return JSON_OK;
+}
+
+
+/**
+Handles a label, attaching it to the object if the object is being materialized
+@return JSON_OK or JSON_MEMORY
+**/
+static enum json_error
+json_selector_label (struct json_selector *selector)
+{
+	struct json_selector_frame *frame = &selector->frames[selector->depth - 1];
+	json_t *label;
+
+	json_selector_descend (selector, selector->lex_text->text);
+	if (frame->node != NULL)
+	{
+		if ((label = json_new_value (JSON_STRING)) == NULL)
+			return JSON_MEMORY;
+		label->hash = json_hash_label_text (selector->lex_text->text, selector->lex_text->length, 0);
+		label->flags |= JSON_FLAG_HASHED;
+		label->text = rcs_unwrap (selector->lex_text), selector->lex_text = NULL;
+		if (json_insert_child (frame->node, label) != JSON_OK)
+		{
+			json_free_value (&label);
+			return JSON_MEMORY;
+		}
+		frame->label = label;
+	}
+	rcs_free (&selector->lex_text);
+	selector->state = JSON_SELECTOR_NAME_SEPARATOR;
+	return JSON_OK;
+}
+
+
+/**
+Closes the innermost container
+@return JSON_OK or JSON_MALFORMED_DOCUMENT if the container is of the other kind
+**/
+static enum json_error
+json_selector_close (struct json_selector *selector, int is_object)
+{
+	json_t *node;
+
+	if (selector->frames[selector->depth - 1].is_object != is_object)
+		return JSON_MALFORMED_DOCUMENT;
+	node = selector->frames[--selector->depth].node;
+	json_selector_finish (selector, node);
+	json_selector_next (selector);
+	return JSON_OK;
+}
+
+
+/**
+Skips over the rest of a container, only keeping track of strings and brackets
+@param p the position in the fragment, advanced up to the end of the container or of the fragment
+**/
+static void
+json_selector_skip (struct json_selector *selector, const char **p)
+{
+	const char *q = *p;
+
+	while ((*q != '\0') && (selector->skip_depth > 0))
+	{
+		if (selector->skip_string)
+		{
+			if (selector->skip_string == 2)
+				selector->skip_string = 1, q++;	/* the escaped character */
+			else
+			{
+				q += strcspn (q, "\"\\");
+				if (*q == '"')
+					selector->skip_string = 0, q++;
+				else if (*q == '\\')
+					selector->skip_string = 2, q++;
+			}
+			continue;
+		}
+		q += strcspn (q, "\"{}[]");
+		switch (*q)
+		{
+		case '"':
+			selector->skip_string = 1;
+			break;
+		case '{':
+		case '[':
+			selector->skip_depth++;
+			break;
+		case '}':
+		case ']':
+			selector->skip_depth--;
+			break;
+		default:
+			continue;
+		}
+		q++;
+	}
+	*p = q;
+	if (selector->skip_depth == 0)
+		json_selector_next (selector);
+}
+
+
+enum json_error
+json_selector_feed (struct json_selector *selector, const char *buffer)
+{
+	const char *p = buffer;
+	enum json_error error = JSON_OK;
+	int token;
+
+	assert (selector != NULL);
+	assert (buffer != NULL);
+
+	if (selector->capacity == 0)
+	{
+		/* the root level, where every subscription is alive */
+		if ((selector->alive = malloc (16 * selector->count + 1)) == NULL)
+			return JSON_MEMORY;
+		if ((selector->frames = malloc (16 * sizeof (struct json_selector_frame))) == NULL)
+			return JSON_MEMORY;
+		selector->capacity = 16;
+		memset (selector->alive, 1, selector->count);
+	}
+
+	while ((p != NULL) && (*p != '\0'))
+	{
+		if (selector->state == JSON_SELECTOR_SKIP)
+		{
+			json_selector_skip (selector, &p);
+			continue;
+		}
+
+		token = lexer (buffer, &p, &selector->lex_state, &selector->lex_text, &selector->line, 0);
+		switch (token)
+		{
+		case LEX_MORE:
+			break;
+
+		case LEX_MEMORY:
+			return JSON_MEMORY;
+
+		case LEX_INVALID_CHARACTER:
+		case LEX_ERROR:
+			return JSON_MALFORMED_DOCUMENT;
+
+		case LEX_NAME_SEPARATOR:
+			if (selector->state != JSON_SELECTOR_NAME_SEPARATOR)
+				return JSON_MALFORMED_DOCUMENT;
+			selector->state = JSON_SELECTOR_VALUE;
+			break;
+
+		case LEX_VALUE_SEPARATOR:
+			if (selector->state != JSON_SELECTOR_AFTER_VALUE)
+				return JSON_MALFORMED_DOCUMENT;
+			selector->state = selector->frames[selector->depth - 1].is_object ? JSON_SELECTOR_LABEL : JSON_SELECTOR_VALUE;
+			break;
+
+		case LEX_END_OBJECT:
+		case LEX_END_ARRAY:
+			if ((selector->state != JSON_SELECTOR_AFTER_VALUE) && (selector->state != ((token == LEX_END_OBJECT) ? JSON_SELECTOR_FIRST_LABEL : JSON_SELECTOR_FIRST_ELEMENT)))
+				return JSON_MALFORMED_DOCUMENT;
+			error = json_selector_close (selector, token == LEX_END_OBJECT);
+			break;
+
+		case LEX_STRING:
+			if ((selector->state == JSON_SELECTOR_FIRST_LABEL) || (selector->state == JSON_SELECTOR_LABEL))
+			{
+				error = json_selector_label (selector);
+				break;
+			}
+			/* fall through */
+		default:
+			if ((selector->state != JSON_SELECTOR_VALUE) && (selector->state != JSON_SELECTOR_FIRST_ELEMENT))
+				return JSON_MALFORMED_DOCUMENT;
+			error = json_selector_value (selector, token);
+			break;
+		}
+		if (error != JSON_OK)
+			return error;
+	}
+
+	if ((selector->depth == 0) && (selector->state == JSON_SELECTOR_VALUE) && (selector->lex_state == 0))
+		return JSON_WAITING_FOR_EOF;
+	return JSON_INCOMPLETE_DOCUMENT;
+}
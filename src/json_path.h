@@ -0,0 +1,111 @@
+/*// C Interface: json_path*/
+/*// Description: JSONPath queries over json_t trees*/
+/*// Copyright: See COPYING file that comes with this distribution*/
+
+
+#ifndef JSON_PATH_H
+#define JSON_PATH_H
+
+#include "json.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+A JSONPath expression compiled into a plan of steps. A plan keeps the evaluation stack it used last, so that running it again over other documents does not allocate; for the same reason a plan must not be evaluated by two threads at once
+**/
+	struct json_path;
+
+
+/**
+The function which receives the matches of a JSONPath query
+@param match the matching node
+@param data the user data passed to json_path_eval()
+@return 0 to go on with the query or any other value to stop it
+**/
+	typedef int (*json_path_callback) (json_t * match, void *data);
+
+
+/**
+Compiles a JSONPath expression. The supported syntax is the root $ followed by any number of steps:
+.name and ['name'] select object members, .* and [*] every member or element, [n] an array element (negative positions count from the end), [start:end:step] a slice with Python's semantics, [?(@.a.b op literal)] the members or elements for which a scalar comparison holds, op being one of == != < <= > >= and the literal a number, a quoted string, true, false or null, and [?(@.a.b)] those which hold the given relative path. Prefixing a step with .. (as in $..name or $..[0]) applies it to every node below as well. Quoted names and strings may hold the escape sequences of JSON strings, and are compared with the unescaped text of labels and strings, however these were written
+@param expression the c-string holding the JSONPath expression
+@return the compiled plan, to be freed with json_path_free(), or NULL if expression is malformed or memory ran out
+**/
+	struct json_path *json_path_compile (const char *expression);
+
+
+/**
+Runs a compiled JSONPath plan over a document, handing every match to callback in document order. The walk is iterative, so deep documents do not exhaust the call stack
+@param path the compiled plan
+@param root the document's root node
+@param callback the function that receives the matches
+@param data user data handed to callback
+@return JSON_OK or JSON_MEMORY if the evaluation stack could not grow
+**/
+	enum json_error json_path_eval (struct json_path *path, const json_t * root, json_path_callback callback, void *data);
+
+
+/**
+Frees a compiled JSONPath plan and sets it to NULL
+@param path the compiled plan
+**/
+	void json_path_free (struct json_path **path);
+
+
+/**
+A streaming selector, which runs a set of subscriptions over a document fed to it in fragments and only builds the subtrees they match. It keeps a few bytes per nesting level, however large the document is
+**/
+	struct json_selector;
+
+
+/**
+The function which receives the values matched by a subscription
+@param value the matching subtree. It belongs to the selector and is freed once the callbacks return. If a subscription also matches a value above it, value is part of that larger subtree, which is still being built
+@param data the user data given to json_selector_subscribe()
+**/
+	typedef void (*json_selector_callback) (json_t * value, void *data);
+
+
+/**
+Creates a streaming selector
+@return the new selector or NULL if memory ran out
+**/
+	struct json_selector *json_selector_new (void);
+
+
+/**
+Adds a subscription to a selector, which must not have been fed yet. The expression is either a JSON pointer (RFC 6901), whose tokens select object members or array elements alike, or a JSONPath expression made only of member, wildcard and non-negative index steps
+@param selector the selector
+@param expression the JSON pointer or JSONPath expression
+@param callback the function that receives every match
+@param data user data handed to callback
+@return JSON_OK, JSON_MALFORMED_DOCUMENT if the expression is malformed, JSON_INCOMPATIBLE_TYPE if it uses steps which cannot be decided while streaming, or JSON_MEMORY
+**/
+	enum json_error json_selector_subscribe (struct json_selector *selector, const char *expression, json_selector_callback callback, void *data);
+
+
+/**
+Feeds a fragment of the input to a selector. The input may hold a sequence of documents of any type, such as newline-delimited JSON. Containers which no subscription looks into are skipped over by only matching their brackets, without tokenizing them
+@param selector the selector
+@param buffer the NUL-terminated fragment
+@return JSON_WAITING_FOR_EOF if the fragment ended between documents, JSON_INCOMPLETE_DOCUMENT if it ended inside one, or the json_error that stopped the selector, which can't be fed any further afterwards
+**/
+	enum json_error json_selector_feed (struct json_selector *selector, const char *buffer);
+
+
+/**
+Frees a selector, along with any match it was still building, and sets it to NULL
+@param selector the selector
+**/
+	void json_selector_free (struct json_selector **selector);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,770 @@
+/*
+*  C Implementation: json_persistent
+*
+* Description: persistent, immutable JSON values with structural sharing
+*
+*
+* Copyright: See COPYING file that comes with this distribution
+*
+*/
+
+#include "json_persistent.h"
+#include "json_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+
+struct json_pvalue
+{
+	enum json_value_type type;
+	int flags;		/* JSON_FLAG_NEEDS_ESCAPING for texts which hold no escape sequences */
+	uint32_t hash;		/* the hash of the unescaped text of strings, which labels are looked up by */
+	size_t references;
+	size_t count;		/* the number of elements of an array or of members of an object */
+	char *text;		/* the text of strings, labels and numbers */
+	struct json_pvalue **children;	/* the elements of an array, or the label and the value of each member of an object in turn */
+	struct json_pvalue *released;	/* the next value in the list of those being freed */
+};
+
+
+/**
+Allocates a value along with its children, which are set to NULL, and a copy of its text
+**/
+static struct json_pvalue *
+json_pvalue_new (enum json_value_type type, size_t count, const char *text, int flags)
+{
+	size_t slots = (type == JSON_OBJECT) ? 2 * count : count;
+	size_t length = (text != NULL) ? strlen (text) + 1 : 0;
+	struct json_pvalue *value;
+
+	value = (struct json_pvalue *)malloc (sizeof (struct json_pvalue) + slots * sizeof (struct json_pvalue *) + length);
+	if (value == NULL)
+		return NULL;
+	value->type = type;
+	value->flags = flags & JSON_FLAG_NEEDS_ESCAPING;
+	value->references = 1;
+	value->count = count;
+	value->children = (struct json_pvalue **)(value + 1);
+	memset (value->children, 0, slots * sizeof (struct json_pvalue *));
+	value->text = NULL;
+	value->hash = 0;
+	if (text != NULL)
+	{
+		value->text = (char *)(value->children + slots);
+		memcpy (value->text, text, length);
+		if (type == JSON_STRING)
+			value->hash = json_hash_label_text (text, length - 1, flags & JSON_FLAG_NEEDS_ESCAPING);
+	}
+	value->released = NULL;
+	return value;
+}
+
+
+static size_t
+json_pvalue_slots (const struct json_pvalue *value)
+{
+	return (value->type == JSON_OBJECT) ? 2 * value->count : (value->type == JSON_ARRAY) ? value->count : 0;
+}
+
+
+struct json_pvalue *
+json_pvalue_acquire (struct json_pvalue *value)
+{
+	assert (value != NULL);
+
+	__atomic_add_fetch (&value->references, 1, __ATOMIC_RELAXED);
+	return value;
+}
+
+
+void
+json_pvalue_release (struct json_pvalue **value)
+{
+	struct json_pvalue *list, *node, *child;
+	size_t i;
+
+	assert (value != NULL);
+
+	list = *value;
+	*value = NULL;
+	if ((list == NULL) || (__atomic_sub_fetch (&list->references, 1, __ATOMIC_ACQ_REL) != 0))
+		return;
+
+	/* the values left without references are chained through their released pointer rather than recursed into */
+	list->released = NULL;
+	while (list != NULL)
+	{
+		node = list;
+		list = node->released;
+		for (i = json_pvalue_slots (node); i > 0; i--)
+		{
+			child = node->children[i - 1];
+			if ((child != NULL) && (__atomic_sub_fetch (&child->references, 1, __ATOMIC_ACQ_REL) == 0))
+			{
+				child->released = list;
+				list = child;
+			}
+		}
+		free (node);
+	}
+}
+
+
+enum json_value_type
+json_pvalue_type (const struct json_pvalue *value)
+{
+	assert (value != NULL);
+	return value->type;
+}
+
+
+const char *
+json_pvalue_text (const struct json_pvalue *value)
+{
+	assert (value != NULL);
+	return value->text;
+}
+
+
+size_t
+json_pvalue_size (const struct json_pvalue *value)
+{
+	assert (value != NULL);
+	return ((value->type == JSON_OBJECT) || (value->type == JSON_ARRAY)) ? value->count : 0;
+}
+
+
+const struct json_pvalue *
+json_pvalue_element (const struct json_pvalue *array, size_t position)
+{
+	assert (array != NULL);
+	if ((array->type != JSON_ARRAY) || (position >= array->count))
+		return NULL;
+	return array->children[position];
+}
+
+
+const char *
+json_pvalue_label (const struct json_pvalue *object, size_t position)
+{
+	assert (object != NULL);
+	if ((object->type != JSON_OBJECT) || (position >= object->count))
+		return NULL;
+	return object->children[2 * position]->text;
+}
+
+
+const struct json_pvalue *
+json_pvalue_member (const struct json_pvalue *object, size_t position)
+{
+	assert (object != NULL);
+	if ((object->type != JSON_OBJECT) || (position >= object->count))
+		return NULL;
+	return object->children[2 * position + 1];
+}
+
+
+/* conversion part */
+
+/**
+A container whose children are being filled in while converting a tree
+**/
+struct json_pvalue_frame
+{
+	struct json_pvalue *value;
+	json_t *tree;
+	size_t position;
+};
+
+
+static enum json_error
+json_pvalue_push (struct json_pvalue_frame **frames, size_t *depth, size_t *capacity)
+{
+	struct json_pvalue_frame *grown;
+
+	if (*depth == *capacity)
+	{
+		grown = (struct json_pvalue_frame *)realloc (*frames, 2 * (*capacity + 8) * sizeof (struct json_pvalue_frame));
+		if (grown == NULL)
+			return JSON_MEMORY;
+		*frames = grown;
+		*capacity = 2 * (*capacity + 8);
+	}
+	(*depth)++;
+	return JSON_OK;
+}
+
+
+/**
+A table of the values already built, through which equal values are shared. Containers are only compared once their children have been shared, so that two of them are equal if they hold the same children
+**/
+struct json_pvalue_table
+{
+	struct json_pvalue_entry
+	{
+		uint64_t hash;
+		struct json_pvalue *value;
+	} *entries;
+	size_t count;
+	size_t capacity;	/* a power of two */
+};
+
+
+static uint64_t
+json_pvalue_digest (const struct json_pvalue *value)
+{
+	uint64_t hash = 14695981039346656037ULL ^ (uint64_t) value->type;
+	size_t i;
+
+	if (value->text != NULL)
+		hash = (hash * 1099511628211ULL) ^ json_hash_text (value->text, strlen (value->text));
+	for (i = 0; i < json_pvalue_slots (value); i++)
+		hash = (hash ^ (uint64_t) (uintptr_t) value->children[i]) * 1099511628211ULL;
+	return hash ^ (hash >> 29);
+}
+
+
+static int
+json_pvalue_same (const struct json_pvalue *a, const struct json_pvalue *b)
+{
+	if ((a->type != b->type) || (a->count != b->count) || (a->flags != b->flags))
+		return 0;
+	if ((a->text != NULL) && (strcmp (a->text, b->text) != 0))
+		return 0;
+	return memcmp (a->children, b->children, json_pvalue_slots (a) * sizeof (struct json_pvalue *)) == 0;
+}
+
+
+/**
+Shares a finished value through the table
+@return the value to use in its place, which may be value itself, or NULL if memory ran out, in which case value is released
+**/
+static struct json_pvalue *
+json_pvalue_share (struct json_pvalue_table *table, struct json_pvalue *value)
+{
+	struct json_pvalue_entry *entries;
+	uint64_t hash = json_pvalue_digest (value);
+	size_t slot, i;
+
+	for (slot = hash & (table->capacity - 1); table->entries[slot].value != NULL; slot = (slot + 1) & (table->capacity - 1))
+	{
+		if ((table->entries[slot].hash == hash) && json_pvalue_same (table->entries[slot].value, value))
+		{
+			json_pvalue_release (&value);
+			return json_pvalue_acquire (table->entries[slot].value);
+		}
+	}
+	table->entries[slot].hash = hash;
+	table->entries[slot].value = value;
+
+	/* the table is kept at most half full */
+	if (2 * ++table->count > table->capacity)
+	{
+		if ((entries = (struct json_pvalue_entry *)calloc (2 * table->capacity, sizeof (struct json_pvalue_entry))) == NULL)
+		{
+			json_pvalue_release (&value);
+			return NULL;
+		}
+		for (i = 0; i < table->capacity; i++)
+		{
+			if (table->entries[i].value == NULL)
+				continue;
+			for (slot = table->entries[i].hash & (2 * table->capacity - 1); entries[slot].value != NULL; slot = (slot + 1) & (2 * table->capacity - 1))
+				;
+			entries[slot] = table->entries[i];
+		}
+		free (table->entries);
+		table->entries = entries;
+		table->capacity *= 2;
+	}
+	return value;
+}
+
+
+/**
+Puts a finished value in its place: the slot of its container, or the result
+**/
+static void
+json_pvalue_place (struct json_pvalue_frame *frames, size_t depth, struct json_pvalue **result, struct json_pvalue *value)
+{
+	if (depth == 0)
+		*result = value;
+	else
+		frames[depth - 1].value->children[frames[depth - 1].position - 1] = value;
+}
+
+
+/**
+Builds a persistent value out of a tree
+@param table the table through which equal subtrees are shared, or NULL
+**/
+static struct json_pvalue *
+json_pvalue_build (const json_t * root, struct json_pvalue_table *table)
+{
+	struct json_pvalue_frame *frames = NULL, *frame;
+	size_t depth = 0, capacity = 0, count;
+	struct json_pvalue *result = NULL, *value;
+	const json_t *node = root, *cursor;
+	enum json_error error = JSON_OK;
+
+	assert (root != NULL);
+
+	for (;;)
+	{
+		if ((node->type == JSON_OBJECT) || (node->type == JSON_ARRAY))
+		{
+			for (count = 0, cursor = node->child; cursor != NULL; cursor = cursor->next)
+				count++;
+			value = json_pvalue_new (node->type, count, NULL, 0);
+		}
+		else if ((node->type == JSON_STRING) || (node->type == JSON_NUMBER))
+			value = json_pvalue_new (node->type, 0, node->text, node->flags);
+		else
+			value = json_pvalue_new (node->type, 0, NULL, 0);
+		if ((value != NULL) && (table != NULL) && (node->type != JSON_OBJECT) && (node->type != JSON_ARRAY))
+			value = json_pvalue_share (table, value);
+		if (value == NULL)
+		{
+			error = JSON_MEMORY;
+			break;
+		}
+
+		/* labels and their values take two slots of their object in turn */
+		if (depth == 0)
+			result = value;
+		else
+		{
+			frame = &frames[depth - 1];
+			frame->value->children[frame->position++] = value;
+		}
+		if ((node != root) && (node->parent->type == JSON_OBJECT) && ((node->type != JSON_STRING) || (node->child == NULL) || (node->child->next != NULL)))
+		{
+			error = JSON_BAD_TREE_STRUCTURE;	/* objects hold labels with a single value */
+			break;
+		}
+
+		if ((node->type == JSON_OBJECT) || (node->type == JSON_ARRAY))
+		{
+			if (json_pvalue_push (&frames, &depth, &capacity) != JSON_OK)
+			{
+				error = JSON_MEMORY;
+				break;
+			}
+			frames[depth - 1].value = value;
+			frames[depth - 1].position = 0;
+			if (node->child != NULL)
+			{
+				node = node->child;
+				continue;
+			}
+			depth--;
+			if ((table != NULL) && ((value = json_pvalue_share (table, value)) == NULL))
+			{
+				json_pvalue_place (frames, depth, &result, NULL);
+				error = JSON_MEMORY;
+				break;
+			}
+			json_pvalue_place (frames, depth, &result, value);
+		}
+		else if ((node->child != NULL) && (node != root))
+		{
+			node = node->child;	/* the value of a label */
+			continue;
+		}
+
+		while ((node != root) && (node->next == NULL))
+		{
+			node = node->parent;
+			if ((node->type != JSON_OBJECT) && (node->type != JSON_ARRAY))
+				continue;
+			/* a container is shared once it is complete */
+			value = frames[--depth].value;
+			if ((table != NULL) && ((value = json_pvalue_share (table, value)) == NULL))
+			{
+				json_pvalue_place (frames, depth, &result, NULL);
+				error = JSON_MEMORY;
+				break;
+			}
+			json_pvalue_place (frames, depth, &result, value);
+		}
+		if ((error != JSON_OK) || (node == root))
+			break;
+		node = node->next;
+	}
+
+	free (frames);
+	if (error != JSON_OK)
+	{
+		json_pvalue_release (&result);
+		return NULL;
+	}
+	return result;
+}
+
+
+struct json_pvalue *
+json_pvalue_from_tree (const json_t * root)
+{
+	return json_pvalue_build (root, NULL);
+}
+
+
+struct json_pvalue *
+json_pvalue_from_tree_shared (const json_t * root)
+{
+	struct json_pvalue_table table;
+	struct json_pvalue *value;
+
+	table.count = 0;
+	table.capacity = 64;
+	if ((table.entries = (struct json_pvalue_entry *)calloc (table.capacity, sizeof (struct json_pvalue_entry))) == NULL)
+		return NULL;
+	value = json_pvalue_build (root, &table);
+	free (table.entries);
+	return value;
+}
+
+
+/**
+Creates the node of a tree which holds a value, without its children
+**/
+static json_t *
+json_pvalue_node (const struct json_pvalue *value)
+{
+	json_t *node = json_new_value (value->type);
+
+	if ((node == NULL) || (value->text == NULL))
+		return node;
+	if ((node->text = strdup (value->text)) == NULL)
+	{
+		json_free_value (&node);
+		return NULL;
+	}
+	node->flags |= value->flags;
+	if (value->type == JSON_STRING)
+	{
+		node->hash = value->hash;
+		node->flags |= JSON_FLAG_HASHED;
+	}
+	return node;
+}
+
+
+json_t *
+json_pvalue_to_tree (const struct json_pvalue *value)
+{
+	struct json_pvalue_frame *frames = NULL, *frame;
+	size_t depth = 0, capacity = 0;
+	const struct json_pvalue *child;
+	json_t *root, *parent, *node;
+	enum json_error error = JSON_OK;
+
+	assert (value != NULL);
+
+	if ((root = json_pvalue_node (value)) == NULL)
+		return NULL;
+	if (json_pvalue_slots (value) > 0)
+	{
+		if (json_pvalue_push (&frames, &depth, &capacity) != JSON_OK)
+			error = JSON_MEMORY;
+		else
+		{
+			frames[0].value = (struct json_pvalue *)value;
+			frames[0].tree = root;
+			frames[0].position = 0;
+		}
+	}
+
+	while ((error == JSON_OK) && (depth > 0))
+	{
+		frame = &frames[depth - 1];
+		if (frame->position == json_pvalue_slots (frame->value))
+		{
+			depth--;
+			continue;
+		}
+
+		parent = frame->tree;
+		if (frame->value->type == JSON_OBJECT)
+		{
+			if ((node = json_pvalue_node (frame->value->children[frame->position++])) == NULL)
+			{
+				error = JSON_MEMORY;
+				break;
+			}
+			json_insert_child (parent, node);
+			parent = node;
+		}
+		child = frame->value->children[frame->position++];
+		if ((node = json_pvalue_node (child)) == NULL)
+		{
+			error = JSON_MEMORY;
+			break;
+		}
+		json_insert_child (parent, node);
+		if (json_pvalue_slots (child) > 0)
+		{
+			if (json_pvalue_push (&frames, &depth, &capacity) != JSON_OK)
+			{
+				error = JSON_MEMORY;
+				break;
+			}
+			frames[depth - 1].value = (struct json_pvalue *)child;
+			frames[depth - 1].tree = node;
+			frames[depth - 1].position = 0;
+		}
+	}
+
+	free (frames);
+	if (error != JSON_OK)
+		json_free_value (&root);
+	return root;
+}
+
+
+/* update part */
+
+/**
+Compiles a JSON pointer, telling malformed pointers apart from a lack of memory
+**/
+static enum json_error
+json_pvalue_compile (const char *pointer, struct json_pointer **compiled)
+{
+	const char *p;
+
+	assert (pointer != NULL);
+
+	if ((*compiled = json_pointer_compile (pointer)) != NULL)
+		return JSON_OK;
+	if ((pointer[0] != '\0') && (pointer[0] != '/'))
+		return JSON_MALFORMED_DOCUMENT;
+	for (p = pointer; (p = strchr (p, '~')) != NULL; p++)
+	{
+		if ((p[1] != '0') && (p[1] != '1'))
+			return JSON_MALFORMED_DOCUMENT;
+	}
+	return JSON_MEMORY;
+}
+
+
+/**
+Finds the slot of a container which a pointer segment leads to
+@return the slot of the value, which for objects follows the one of the label, or the number of slots if there is none
+**/
+static size_t
+json_pvalue_find (const struct json_pvalue *container, const struct json_pointer_segment *segment)
+{
+	size_t i;
+
+	if (container->type == JSON_ARRAY)
+		return (segment->is_position && (segment->position < container->count)) ? segment->position : container->count;
+	for (i = 0; i < container->count; i++)
+	{
+		const struct json_pvalue *label = container->children[2 * i];
+
+		if ((label->hash == segment->hash) && json_text_reads (label->text, label->flags & JSON_FLAG_NEEDS_ESCAPING, segment->text))
+			return 2 * i + 1;
+	}
+	return 2 * container->count;
+}
+
+
+const struct json_pvalue *
+json_pvalue_get (const struct json_pvalue *root, const char *pointer)
+{
+	struct json_pointer *compiled;
+	const struct json_pvalue *cursor = root;
+	size_t i, slot;
+
+	assert (root != NULL);
+
+	if (json_pvalue_compile (pointer, &compiled) != JSON_OK)
+		return NULL;
+	for (i = 0; (i < compiled->count) && (cursor != NULL); i++)
+	{
+		if ((cursor->type != JSON_OBJECT) && (cursor->type != JSON_ARRAY))
+			cursor = NULL;
+		else if ((slot = json_pvalue_find (cursor, &compiled->segments[i])) == json_pvalue_slots (cursor))
+			cursor = NULL;
+		else
+			cursor = cursor->children[slot];
+	}
+	json_pointer_free (&compiled);
+	return cursor;
+}
+
+
+enum json_pvalue_edit
+{
+	JSON_PVALUE_SET,
+	JSON_PVALUE_REMOVE,
+	JSON_PVALUE_APPEND
+};
+
+
+/**
+Copies a container, referencing all its children but the one at slot, whose place is taken by child. Slots at the end add child, while removing a slot takes it and, for objects, its label out
+**/
+static struct json_pvalue *
+json_pvalue_copy (const struct json_pvalue *container, size_t slot, struct json_pvalue *child, struct json_pvalue *label, int remove)
+{
+	size_t slots = json_pvalue_slots (container), step = (container->type == JSON_OBJECT) ? 2 : 1, count = container->count, i, j;
+	struct json_pvalue *copy;
+
+	if (remove)
+		count--;
+	else if (slot == slots)
+		count++;
+	if ((copy = json_pvalue_new (container->type, count, NULL, 0)) == NULL)
+		return NULL;
+
+	for (i = 0, j = 0; i < slots; i++)
+	{
+		if (remove && (i + step > slot) && (i <= slot))
+			continue;	/* the removed member or element */
+		if (i == slot)
+			copy->children[j++] = child;
+		else
+			copy->children[j++] = json_pvalue_acquire (container->children[i]);
+	}
+	if (slot == slots)
+	{
+		if (label != NULL)
+			copy->children[j++] = label;
+		copy->children[j++] = child;
+	}
+	return copy;
+}
+
+
+static enum json_error
+json_pvalue_edit (const struct json_pvalue *root, const char *pointer, enum json_pvalue_edit edit, struct json_pvalue *value, struct json_pvalue **version)
+{
+	struct json_pointer *compiled;
+	const struct json_pvalue **path = NULL;
+	const struct json_pvalue *container;
+	const struct json_pointer_segment *segment;
+	struct json_pvalue *child = NULL, *label = NULL;
+	size_t *slots = NULL, walk, i, slot;
+	enum json_error error;
+
+	assert (root != NULL);
+	assert (version != NULL);
+
+	if ((error = json_pvalue_compile (pointer, &compiled)) != JSON_OK)
+		return error;
+	if ((edit != JSON_PVALUE_APPEND) && (compiled->count == 0))
+	{
+		json_pointer_free (&compiled);
+		if (edit == JSON_PVALUE_REMOVE)
+			return JSON_BAD_TREE_STRUCTURE;
+		*version = json_pvalue_acquire (value);
+		return JSON_OK;
+	}
+
+	/* walk down to the container holding the place to edit, remembering the path */
+	walk = (edit == JSON_PVALUE_APPEND) ? compiled->count : compiled->count - 1;
+	path = (const struct json_pvalue **)malloc ((walk + 1) * sizeof (struct json_pvalue *));
+	slots = (size_t *)malloc ((walk + 1) * sizeof (size_t));
+	if ((path == NULL) || (slots == NULL))
+	{
+		error = JSON_MEMORY;
+		goto end;
+	}
+	path[0] = root;
+	for (i = 0; i < walk; i++)
+	{
+		if (((path[i]->type != JSON_OBJECT) && (path[i]->type != JSON_ARRAY)) || ((slots[i] = json_pvalue_find (path[i], &compiled->segments[i])) == json_pvalue_slots (path[i])))
+		{
+			error = JSON_BAD_TREE_STRUCTURE;
+			goto end;
+		}
+		path[i + 1] = path[i]->children[slots[i]];
+	}
+
+	/* edit the container */
+	container = path[walk];
+	if ((container->type != JSON_OBJECT) && (container->type != JSON_ARRAY))
+	{
+		error = JSON_BAD_TREE_STRUCTURE;
+		goto end;
+	}
+	if (edit == JSON_PVALUE_APPEND)
+	{
+		if (container->type != JSON_ARRAY)
+		{
+			error = JSON_BAD_TREE_STRUCTURE;
+			goto end;
+		}
+		slot = container->count;
+	}
+	else
+	{
+		segment = &compiled->segments[walk];
+		slot = json_pvalue_find (container, segment);
+		if ((slot == json_pvalue_slots (container)) && ((edit == JSON_PVALUE_REMOVE) || ((container->type == JSON_ARRAY) && !(segment->is_position && (segment->position == container->count)) && (strcmp (segment->text, "-") != 0))))
+		{
+			error = JSON_BAD_TREE_STRUCTURE;
+			goto end;
+		}
+		if ((slot == json_pvalue_slots (container)) && (container->type == JSON_OBJECT) && ((label = json_pvalue_new (JSON_STRING, 0, segment->text, json_text_needs_escaping (segment->text) ? JSON_FLAG_NEEDS_ESCAPING : 0)) == NULL))
+		{
+			error = JSON_MEMORY;
+			goto end;
+		}
+	}
+	if ((child = json_pvalue_copy (container, slot, (edit == JSON_PVALUE_REMOVE) ? NULL : json_pvalue_acquire (value), label, edit == JSON_PVALUE_REMOVE)) == NULL)
+	{
+		if (edit != JSON_PVALUE_REMOVE)
+			json_pvalue_release (&value);
+		json_pvalue_release (&label);
+		error = JSON_MEMORY;
+		goto end;
+	}
+
+	/* copy the path above it */
+	for (i = walk; i > 0; i--)
+	{
+		struct json_pvalue *copy = json_pvalue_copy (path[i - 1], slots[i - 1], child, NULL, 0);
+
+		if (copy == NULL)
+		{
+			json_pvalue_release (&child);
+			error = JSON_MEMORY;
+			goto end;
+		}
+		child = copy;
+	}
+	*version = child;
+
+end:
+	free (path);
+	free (slots);
+	json_pointer_free (&compiled);
+	return error;
+}
+
+
+enum json_error
+json_pvalue_set (const struct json_pvalue *root, const char *pointer, struct json_pvalue *value, struct json_pvalue **version)
+{
+	assert (value != NULL);
+	return json_pvalue_edit (root, pointer, JSON_PVALUE_SET, value, version);
+}
+
+
+enum json_error
+json_pvalue_remove (const struct json_pvalue *root, const char *pointer, struct json_pvalue **version)
+{
+	return json_pvalue_edit (root, pointer, JSON_PVALUE_REMOVE, NULL, version);
+}
+
+
+enum json_error
+json_pvalue_append (const struct json_pvalue *root, const char *pointer, struct json_pvalue *value, struct json_pvalue **version)
+{
+	assert (value != NULL);
+	return json_pvalue_edit (root, pointer, JSON_PVALUE_APPEND, value, version);
+}
@@ -0,0 +1,152 @@
+/*// C Interface: json_persistent*/
+/*// Description: persistent, immutable JSON values with structural sharing*/
+/*// Copyright: See COPYING file that comes with this distribution*/
+
+
+#ifndef JSON_PERSISTENT_H
+#define JSON_PERSISTENT_H
+
+#include "json.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+An immutable JSON value. Updates never change a value: they return a new version which copies the containers on the path to the change and shares every other subtree with the original. Values are reference counted, atomically, so that versions may be handed between threads and released by any of them
+**/
+	struct json_pvalue;
+
+
+/**
+Builds a persistent value out of a document tree
+@param root the root of the tree, which is left untouched
+@return the new value, holding one reference, or NULL if the tree is malformed or memory ran out
+**/
+	struct json_pvalue *json_pvalue_from_tree (const json_t * root);
+
+
+/**
+Builds a persistent value out of a document tree, sharing its equal subtrees: every string, number, label or literal, and every container holding the same children, is held once however many times the tree repeats it. Texts are compared as they are stored in the tree. Building takes a little longer than with json_pvalue_from_tree(), while documents which repeat blocks of values take much less memory
+@param root the root of the tree, which is left untouched
+@return the new value, holding one reference, or NULL if the tree is malformed or memory ran out
+**/
+	struct json_pvalue *json_pvalue_from_tree_shared (const json_t * root);
+
+
+/**
+Builds an ordinary, mutable document tree out of a persistent value
+@param value the value
+@return the new tree, to be freed with json_free_value(), or NULL if memory ran out
+**/
+	json_t *json_pvalue_to_tree (const struct json_pvalue *value);
+
+
+/**
+Takes a reference to a value
+@param value the value
+@return value
+**/
+	struct json_pvalue *json_pvalue_acquire (struct json_pvalue *value);
+
+
+/**
+Drops a reference to a value and sets it to NULL. The value, and every subtree of it no other version shares, is freed along with the last reference
+@param value the value
+**/
+	void json_pvalue_release (struct json_pvalue **value);
+
+
+/**
+@param value the value
+@return the value's type
+**/
+	enum json_value_type json_pvalue_type (const struct json_pvalue *value);
+
+
+/**
+@param value the value
+@return the text of a string or a number, in the form json_t holds it, or NULL for other types
+**/
+	const char *json_pvalue_text (const struct json_pvalue *value);
+
+
+/**
+@param value the value
+@return the number of members of an object or of elements of an array, or 0 for other types
+**/
+	size_t json_pvalue_size (const struct json_pvalue *value);
+
+
+/**
+@param array the array
+@param position the element's position
+@return the element or NULL if position is out of the array
+**/
+	const struct json_pvalue *json_pvalue_element (const struct json_pvalue *array, size_t position);
+
+
+/**
+@param object the object
+@param position the member's position, in the order members were added
+@return the label of the member or NULL if position is out of the object
+**/
+	const char *json_pvalue_label (const struct json_pvalue *object, size_t position);
+
+
+/**
+@param object the object
+@param position the member's position, in the order members were added
+@return the value of the member or NULL if position is out of the object
+**/
+	const struct json_pvalue *json_pvalue_member (const struct json_pvalue *object, size_t position);
+
+
+/**
+Resolves a JSON pointer (RFC 6901) against a value. Tokens are matched against labels as json_pointer_eval() does
+@param root the value
+@param pointer the JSON pointer
+@return the value pointed to, which belongs to root, or NULL if pointer is malformed or leads nowhere
+**/
+	const struct json_pvalue *json_pvalue_get (const struct json_pvalue *root, const char *pointer);
+
+
+/**
+Makes a version of a value in which the place a JSON pointer leads to holds another value. The pointer may name an existing member or element, a new member of an existing object, or the end of an array as "-" or its size
+@param root the original value, which is left unchanged
+@param pointer the JSON pointer
+@param value the value to set, which is shared by the new version rather than copied
+@param version receives the new version, holding one reference
+@return JSON_OK, JSON_MALFORMED_DOCUMENT if pointer is malformed, JSON_BAD_TREE_STRUCTURE if it does not lead to a place in root or JSON_MEMORY
+**/
+	enum json_error json_pvalue_set (const struct json_pvalue *root, const char *pointer, struct json_pvalue *value, struct json_pvalue **version);
+
+
+/**
+Makes a version of a value without the member or element a JSON pointer leads to
+@param root the original value, which is left unchanged
+@param pointer the JSON pointer, which must not be empty
+@param version receives the new version, holding one reference
+@return JSON_OK, JSON_MALFORMED_DOCUMENT if pointer is malformed, JSON_BAD_TREE_STRUCTURE if there is nothing to remove or JSON_MEMORY
+**/
+	enum json_error json_pvalue_remove (const struct json_pvalue *root, const char *pointer, struct json_pvalue **version);
+
+
+/**
+Makes a version of a value in which an element is appended to the array a JSON pointer leads to
+@param root the original value, which is left unchanged
+@param pointer the JSON pointer to the array
+@param value the element, which is shared by the new version rather than copied
+@param version receives the new version, holding one reference
+@return JSON_OK, JSON_MALFORMED_DOCUMENT if pointer is malformed, JSON_BAD_TREE_STRUCTURE if it does not lead to an array or JSON_MEMORY
+**/
+	enum json_error json_pvalue_append (const struct json_pvalue *root, const char *pointer, struct json_pvalue *value, struct json_pvalue **version);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+/*
+*  C Implementation: json_snapshot
+*
+* Description: frozen documents saved to files which are mapped into memory to be read
+*
+*
+* Copyright: See COPYING file that comes with this distribution
+*
+*/
+
+#include "json_snapshot.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+
+#define JSON_SNAPSHOT_MAGIC "MJSONSNP"
+#define JSON_SNAPSHOT_VERSION 1
+#define JSON_SNAPSHOT_ORDER 0x01020304u	/* reads differently on a machine of another byte order */
+
+
+/**
+The header of a snapshot file, which the image follows. Its size keeps the image aligned on 8 bytes
+**/
+struct json_snapshot_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t order;
+	uint64_t size;		/* the size of the image */
+};
+
+
+struct json_snapshot
+{
+	void *map;		/* the mapped file */
+	size_t length;		/* the size of the file */
+};
+
+
+enum json_error
+json_snapshot_write (const json_t * root, const char *path)
+{
+	struct json_snapshot_header header;
+	struct json_frozen *frozen = NULL;
+	char *temporary;
+	FILE *file;
+	int descriptor, written;
+	enum json_error error;
+
+	assert (root != NULL);
+	assert (path != NULL);
+
+	if ((error = json_freeze (root, &frozen)) != JSON_OK)
+		return error;
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, JSON_SNAPSHOT_MAGIC, sizeof (header.magic));
+	header.version = JSON_SNAPSHOT_VERSION;
+	header.order = JSON_SNAPSHOT_ORDER;
+	header.size = json_frozen_size (frozen);
+
+	if ((temporary = (char *)malloc (strlen (path) + 8)) == NULL)
+	{
+		json_frozen_free (&frozen);
+		return JSON_MEMORY;
+	}
+	strcpy (temporary, path);
+	strcat (temporary, ".XXXXXX");
+
+	/* the file only takes the place of path once it is complete */
+	error = JSON_UNKNOWN_PROBLEM;
+	if ((descriptor = mkstemp (temporary)) != -1)
+	{
+		if ((file = fdopen (descriptor, "wb")) == NULL)
+			close (descriptor);
+		else
+		{
+			/* mkstemp() leaves the file to its owner, while snapshots are meant to be shared */
+			written = (fchmod (descriptor, 0644) == 0) && (fwrite (&header, sizeof (header), 1, file) == 1) && (fwrite (frozen, json_frozen_size (frozen), 1, file) == 1) && (fflush (file) == 0) && (fsync (descriptor) == 0);
+			if ((fclose (file) == 0) && written && (rename (temporary, path) == 0))
+				error = JSON_OK;
+		}
+		if (error != JSON_OK)
+			unlink (temporary);
+	}
+
+	free (temporary);
+	json_frozen_free (&frozen);
+	return error;
+}
+
+
+enum json_error
+json_snapshot_open (const char *path, struct json_snapshot **snapshot)
+{
+	const struct json_snapshot_header *header;
+	struct stat status;
+	void *map;
+	int descriptor;
+
+	assert (path != NULL);
+	assert (snapshot != NULL);
+
+	*snapshot = NULL;
+	if ((descriptor = open (path, O_RDONLY)) == -1)
+		return JSON_UNKNOWN_PROBLEM;
+	if (fstat (descriptor, &status) == -1)
+	{
+		close (descriptor);
+		return JSON_UNKNOWN_PROBLEM;
+	}
+	if (status.st_size < (off_t) (sizeof (struct json_snapshot_header) + sizeof (uint64_t)))
+	{
+		close (descriptor);
+		return JSON_MALFORMED_DOCUMENT;
+	}
+	map = mmap (NULL, (size_t) status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+	close (descriptor);	/* the mapping outlives the descriptor */
+	if (map == MAP_FAILED)
+		return JSON_UNKNOWN_PROBLEM;
+
+	/* the image holds its own size in its first bytes */
+	header = (const struct json_snapshot_header *)map;
+	if ((memcmp (header->magic, JSON_SNAPSHOT_MAGIC, sizeof (header->magic)) != 0) || (header->version != JSON_SNAPSHOT_VERSION) || (header->order != JSON_SNAPSHOT_ORDER) || (header->size != (uint64_t) status.st_size - sizeof (struct json_snapshot_header)) || (json_frozen_size ((const struct json_frozen *)(header + 1)) != header->size))
+	{
+		munmap (map, (size_t) status.st_size);
+		return JSON_MALFORMED_DOCUMENT;
+	}
+
+	if ((*snapshot = (struct json_snapshot *)malloc (sizeof (struct json_snapshot))) == NULL)
+	{
+		munmap (map, (size_t) status.st_size);
+		return JSON_MEMORY;
+	}
+	(*snapshot)->map = map;
+	(*snapshot)->length = (size_t) status.st_size;
+	return JSON_OK;
+}
+
+
+const struct json_frozen_node *
+json_snapshot_root (const struct json_snapshot *snapshot)
+{
+	assert (snapshot != NULL);
+	return json_frozen_root ((const struct json_frozen *)((const struct json_snapshot_header *)snapshot->map + 1));
+}
+
+
+void
+json_snapshot_close (struct json_snapshot **snapshot)
+{
+	assert (snapshot != NULL);
+	if (*snapshot == NULL)
+		return;
+
+	munmap ((*snapshot)->map, (*snapshot)->length);
+	free (*snapshot);
+	*snapshot = NULL;
+}
@@ -0,0 +1,60 @@
+/*// C Interface: json_snapshot*/
+/*// Description: frozen documents saved to files which are mapped into memory to be read*/
+/*// Copyright: See COPYING file that comes with this distribution*/
+
+
+#ifndef JSON_SNAPSHOT_H
+#define JSON_SNAPSHOT_H
+
+#include "json.h"
+#include "json_frozen.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+A snapshot: a file holding the image of a frozen document behind a short header, and mapped read-only into memory once opened. Opening a snapshot reads nothing but the header, whatever the size of the document, and the pages of the image are only loaded as they are read. Processes which open the same snapshot share its pages through the page cache
+**/
+	struct json_snapshot;
+
+
+/**
+Saves a document tree as a snapshot. The snapshot is written to a temporary file in the same directory, which then replaces path at once, so that processes which have the previous snapshot open keep reading it undisturbed
+@param root the root of the tree, which is left untouched
+@param path the path of the snapshot file
+@return JSON_OK, an error of json_freeze() or JSON_UNKNOWN_PROBLEM if the file could not be written
+**/
+	enum json_error json_snapshot_write (const json_t * root, const char *path);
+
+
+/**
+Opens a snapshot. Only its header is checked: the image itself is trusted to be as json_snapshot_write() left it
+@param path the path of the snapshot file
+@param snapshot receives the snapshot, to be closed with json_snapshot_close()
+@return JSON_OK, JSON_MALFORMED_DOCUMENT if the file is not a snapshot written by this version of the library on a machine of the same byte order, JSON_UNKNOWN_PROBLEM if it could not be read or mapped, or JSON_MEMORY
+**/
+	enum json_error json_snapshot_open (const char *path, struct json_snapshot **snapshot);
+
+
+/**
+@param snapshot the snapshot
+@return the root of the document, to be read with the json_frozen_* functions as long as the snapshot is open
+**/
+	const struct json_frozen_node *json_snapshot_root (const struct json_snapshot *snapshot);
+
+
+/**
+Closes a snapshot, unmapping it, and sets it to NULL
+@param snapshot the snapshot
+**/
+	void json_snapshot_close (struct json_snapshot **snapshot);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,520 @@
+/*
+*  C Implementation: json_tape
+*
+* Description: documents parsed into a tape, a flat vector of entries read through cursors
+*
+*
+* Copyright: See COPYING file that comes with this distribution
+*
+*/
+
+#include "json_tape.h"
+#include "json_internal.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+
+/**
+The entries follow the header in the same allocation, and the texts, each one null-terminated, make up the other
+**/
+struct json_tape
+{
+	size_t count;		/* the number of entries */
+	size_t strings_size;
+	char *strings;
+	uint64_t entries[1];
+};
+
+
+/*
+An entry holds a tag in its high byte and a payload in the rest. Texts have the offset of their text as payload. An object or an array has the number of its children in bits 32 to 55, saturated at JSON_TAPE_MAXIMUM_COUNT, and the index of the entry past its end in the low bits; while it is being parsed, the low bits hold the index of its parent instead. Container ends have the index of their start
+*/
+#define JSON_TAPE_OBJECT '{'
+#define JSON_TAPE_OBJECT_END '}'
+#define JSON_TAPE_ARRAY '['
+#define JSON_TAPE_ARRAY_END ']'
+#define JSON_TAPE_LABEL ':'
+#define JSON_TAPE_STRING '\"'
+#define JSON_TAPE_NUMBER '0'
+#define JSON_TAPE_TRUE 't'
+#define JSON_TAPE_FALSE 'f'
+#define JSON_TAPE_NULL 'n'
+
+#define JSON_TAPE_MAXIMUM_COUNT 0xFFFFFFu
+
+#define JSON_TAPE_ENTRY(tag, payload) (((uint64_t) (tag) << 56) | (uint64_t) (payload))
+#define JSON_TAPE_TAG(entry) ((unsigned int) ((entry) >> 56))
+#define JSON_TAPE_INDEX(entry) ((size_t) ((entry) & 0xFFFFFFFFu))
+#define JSON_TAPE_COUNT(entry) ((size_t) (((entry) >> 32) & JSON_TAPE_MAXIMUM_COUNT))
+
+
+/**
+Counts a child of the container being parsed
+**/
+static void
+json_tape_count_child (uint64_t * container)
+{
+	if (JSON_TAPE_COUNT (*container) < JSON_TAPE_MAXIMUM_COUNT)
+		*container += (uint64_t) 1 << 32;
+}
+
+
+/**
+Appends an entry holding a text to the tape, copying the text into the texts
+**/
+static void
+json_tape_text_entry (struct json_tape *tape, size_t * used, unsigned int tag, const char *text, size_t length)
+{
+	tape->entries[tape->count++] = JSON_TAPE_ENTRY (tag, *used);
+	memcpy (tape->strings + *used, text, length);
+	tape->strings[*used + length] = '\0';
+	*used += length + 1;
+}
+
+
+enum json_error
+json_tape_parse (const char *buffer, size_t length, struct json_tape **tape, size_t * error_offset)
+{
+	struct json_tape *result = NULL, *shrunk;
+	char *strings;
+	size_t used = 0;	/* bytes of the texts in use */
+	size_t current = 0;	/* the container being parsed */
+	size_t pos = 0, start;
+	unsigned int tag;
+	int closing;
+	enum json_error error = JSON_OK;
+	enum
+	{
+		TAPE_VALUE,	/* expecting a value */
+		TAPE_FIRST_VALUE,	/* just entered an array */
+		TAPE_MEMBER,	/* expecting a label */
+		TAPE_FIRST_MEMBER,	/* just entered an object */
+		TAPE_NAME_SEPARATOR,	/* label, pre name separator */
+		TAPE_FOLLOWUP,	/* finished a value, expecting a sibling or the end of the container */
+		TAPE_END	/* finished document. only accept whitespaces until EOF */
+	} state;
+
+	assert ((buffer != NULL) || (length == 0));
+	assert (tape != NULL);
+
+	*tape = NULL;
+	if (length >= 0xFFFFFFFFu)
+	{
+		error = JSON_MAXIMUM_LENGTH;
+		goto end;
+	}
+
+	/* every entry, and every text along with its terminator, stands for distinct bytes of the buffer, so neither outgrows it */
+	result = (struct json_tape *)malloc (offsetof (struct json_tape, entries) + (length + 1) * sizeof (uint64_t));
+	strings = (char *)malloc (length + 1);
+	if ((result == NULL) || (strings == NULL))
+	{
+		free (result);
+		free (strings);
+		result = NULL;
+		error = JSON_MEMORY;
+		goto end;
+	}
+	result->count = 0;
+	result->strings = strings;
+
+	/* only objects are accepted as the document root, as in json_parse_fragment() */
+	pos = json_validate_white_spaces (buffer, length, 0);
+	if (pos == length)
+	{
+		error = JSON_INCOMPLETE_DOCUMENT;
+		goto end;
+	}
+	if (buffer[pos] != '{')
+	{
+		error = JSON_MALFORMED_DOCUMENT;
+		goto end;
+	}
+	pos++;
+	result->entries[result->count++] = JSON_TAPE_ENTRY (JSON_TAPE_OBJECT, 0);
+	state = TAPE_FIRST_MEMBER;
+
+	while (state != TAPE_END)
+	{
+		pos = json_validate_white_spaces (buffer, length, pos);
+		if (pos == length)
+		{
+			error = JSON_INCOMPLETE_DOCUMENT;
+			goto end;
+		}
+
+		closing = 0;
+		switch (state)
+		{
+		case TAPE_FIRST_MEMBER:
+			if (buffer[pos] == '}')
+			{
+				closing = 1;
+				break;
+			}
+			/* fall through */
+		case TAPE_MEMBER:
+			if (buffer[pos] != '\"')
+			{
+				error = JSON_MALFORMED_DOCUMENT;
+				goto end;
+			}
+			start = pos;
+			if ((error = json_validate_string (buffer, length, &pos)) != JSON_OK)
+				goto end;
+			json_tape_count_child (&result->entries[current]);
+			json_tape_text_entry (result, &used, JSON_TAPE_LABEL, buffer + start + 1, pos - start - 2);
+			state = TAPE_NAME_SEPARATOR;
+			break;
+
+		case TAPE_NAME_SEPARATOR:
+			if (buffer[pos] != ':')
+			{
+				error = JSON_MALFORMED_DOCUMENT;
+				goto end;
+			}
+			pos++;
+			state = TAPE_VALUE;
+			break;
+
+		case TAPE_FIRST_VALUE:
+			if (buffer[pos] == ']')
+			{
+				closing = 1;
+				break;
+			}
+			/* fall through */
+		case TAPE_VALUE:
+			if (JSON_TAPE_TAG (result->entries[current]) == JSON_TAPE_ARRAY)
+				json_tape_count_child (&result->entries[current]);
+			state = TAPE_FOLLOWUP;
+			start = pos;
+			switch (buffer[pos])
+			{
+			case '{':
+			case '[':
+				/* the container points back to its parent until it ends */
+				tag = (buffer[pos] == '{') ? JSON_TAPE_OBJECT : JSON_TAPE_ARRAY;
+				result->entries[result->count] = JSON_TAPE_ENTRY (tag, current);
+				current = result->count++;
+				state = (tag == JSON_TAPE_OBJECT) ? TAPE_FIRST_MEMBER : TAPE_FIRST_VALUE;
+				pos++;
+				break;
+
+			case '\"':
+				if ((error = json_validate_string (buffer, length, &pos)) == JSON_OK)
+					json_tape_text_entry (result, &used, JSON_TAPE_STRING, buffer + start + 1, pos - start - 2);
+				break;
+
+			case 't':
+				if ((error = json_validate_literal (buffer, length, &pos, "true", 4)) == JSON_OK)
+					result->entries[result->count++] = JSON_TAPE_ENTRY (JSON_TAPE_TRUE, 0);
+				break;
+
+			case 'f':
+				if ((error = json_validate_literal (buffer, length, &pos, "false", 5)) == JSON_OK)
+					result->entries[result->count++] = JSON_TAPE_ENTRY (JSON_TAPE_FALSE, 0);
+				break;
+
+			case 'n':
+				if ((error = json_validate_literal (buffer, length, &pos, "null", 4)) == JSON_OK)
+					result->entries[result->count++] = JSON_TAPE_ENTRY (JSON_TAPE_NULL, 0);
+				break;
+
+			case '-':
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+			case '8':
+			case '9':
+				if ((error = json_validate_number (buffer, length, &pos)) == JSON_OK)
+					json_tape_text_entry (result, &used, JSON_TAPE_NUMBER, buffer + start, pos - start);
+				break;
+
+			default:
+				error = JSON_MALFORMED_DOCUMENT;
+				break;
+			}
+			if (error != JSON_OK)
+				goto end;
+			break;
+
+		case TAPE_FOLLOWUP:
+			tag = JSON_TAPE_TAG (result->entries[current]);
+			switch (buffer[pos])
+			{
+			case ',':
+				pos++;
+				state = (tag == JSON_TAPE_OBJECT) ? TAPE_MEMBER : TAPE_VALUE;
+				break;
+
+			case '}':
+			case ']':
+				if ((buffer[pos] == '}') != (tag == JSON_TAPE_OBJECT))
+				{
+					error = JSON_MALFORMED_DOCUMENT;
+					goto end;
+				}
+				closing = 1;
+				break;
+
+			default:
+				error = JSON_MALFORMED_DOCUMENT;
+				goto end;
+			}
+			break;
+
+		default:
+			assert (0);
+			break;
+		}
+
+		if (closing)
+		{
+			/* the container now points past its end, and the end back to the container */
+			uint64_t entry = result->entries[current];
+			size_t parent = JSON_TAPE_INDEX (entry);
+
+			tag = JSON_TAPE_TAG (entry);
+			result->entries[result->count] = JSON_TAPE_ENTRY ((tag == JSON_TAPE_OBJECT) ? JSON_TAPE_OBJECT_END : JSON_TAPE_ARRAY_END, current);
+			result->entries[current] = JSON_TAPE_ENTRY (tag, ((uint64_t) JSON_TAPE_COUNT (entry) << 32) | (result->count + 1));
+			result->count++;
+			pos++;
+			state = (current == 0) ? TAPE_END : TAPE_FOLLOWUP;
+			current = parent;
+		}
+	}
+
+	/* only whitespaces may follow the document */
+	pos = json_validate_white_spaces (buffer, length, pos);
+	if (pos != length)
+	{
+		error = JSON_MALFORMED_DOCUMENT;
+		goto end;
+	}
+
+	/* give back what the document did not need */
+	result->strings_size = used;
+	if ((used > 0) && ((strings = (char *)realloc (result->strings, used)) != NULL))
+		result->strings = strings;
+	if ((shrunk = (struct json_tape *)realloc (result, offsetof (struct json_tape, entries) + result->count * sizeof (uint64_t))) != NULL)
+		result = shrunk;
+	*tape = result;
+	return JSON_OK;
+
+      end:
+	if (result != NULL)
+	{
+		free (result->strings);
+		free (result);
+	}
+	if (error_offset != NULL)
+		*error_offset = pos;
+	return error;
+}
+
+
+void
+json_tape_free (struct json_tape **tape)
+{
+	assert (tape != NULL);
+	if (*tape == NULL)
+		return;
+
+	free ((*tape)->strings);
+	free (*tape);
+	*tape = NULL;
+}
+
+
+size_t
+json_tape_size (const struct json_tape *tape)
+{
+	assert (tape != NULL);
+	return offsetof (struct json_tape, entries) + tape->count * sizeof (uint64_t) + tape->strings_size;
+}
+
+
+struct json_tape_cursor
+json_tape_root (const struct json_tape *tape)
+{
+	struct json_tape_cursor cursor;
+
+	assert (tape != NULL);
+	cursor.tape = tape;
+	cursor.index = 0;
+	return cursor;
+}
+
+
+enum json_value_type
+json_tape_type (const struct json_tape_cursor *cursor)
+{
+	assert (cursor != NULL);
+	switch (JSON_TAPE_TAG (cursor->tape->entries[cursor->index]))
+	{
+	case JSON_TAPE_OBJECT:
+		return JSON_OBJECT;
+	case JSON_TAPE_ARRAY:
+		return JSON_ARRAY;
+	case JSON_TAPE_LABEL:
+	case JSON_TAPE_STRING:
+		return JSON_STRING;
+	case JSON_TAPE_NUMBER:
+		return JSON_NUMBER;
+	case JSON_TAPE_TRUE:
+		return JSON_TRUE;
+	case JSON_TAPE_FALSE:
+		return JSON_FALSE;
+	default:
+		return JSON_NULL;
+	}
+}
+
+
+const char *
+json_tape_text (const struct json_tape_cursor *cursor)
+{
+	uint64_t entry;
+
+	assert (cursor != NULL);
+	entry = cursor->tape->entries[cursor->index];
+	switch (JSON_TAPE_TAG (entry))
+	{
+	case JSON_TAPE_LABEL:
+	case JSON_TAPE_STRING:
+	case JSON_TAPE_NUMBER:
+		return cursor->tape->strings + (entry & 0x00FFFFFFFFFFFFFFull);
+	default:
+		return NULL;
+	}
+}
+
+
+/**
+@return the index of the entry past the value, or past the label and its value, at index
+**/
+static size_t
+json_tape_skip (const struct json_tape *tape, size_t index)
+{
+	if (JSON_TAPE_TAG (tape->entries[index]) == JSON_TAPE_LABEL)
+		index++;
+	switch (JSON_TAPE_TAG (tape->entries[index]))
+	{
+	case JSON_TAPE_OBJECT:
+	case JSON_TAPE_ARRAY:
+		return JSON_TAPE_INDEX (tape->entries[index]);
+	default:
+		return index + 1;
+	}
+}
+
+
+static int
+json_tape_is_end (uint64_t entry)
+{
+	return (JSON_TAPE_TAG (entry) == JSON_TAPE_OBJECT_END) || (JSON_TAPE_TAG (entry) == JSON_TAPE_ARRAY_END);
+}
+
+
+size_t
+json_tape_count (const struct json_tape_cursor *cursor)
+{
+	const struct json_tape *tape;
+	size_t count, index;
+
+	assert (cursor != NULL);
+	tape = cursor->tape;
+	switch (JSON_TAPE_TAG (tape->entries[cursor->index]))
+	{
+	case JSON_TAPE_OBJECT:
+	case JSON_TAPE_ARRAY:
+		count = JSON_TAPE_COUNT (tape->entries[cursor->index]);
+		if (count < JSON_TAPE_MAXIMUM_COUNT)
+			return count;
+		/* too many children to be held by the entry: count them */
+		for (count = 0, index = cursor->index + 1; !json_tape_is_end (tape->entries[index]); index = json_tape_skip (tape, index))
+			count++;
+		return count;
+
+	default:
+		return 0;
+	}
+}
+
+
+int
+json_tape_child (struct json_tape_cursor *cursor)
+{
+	const struct json_tape *tape;
+
+	assert (cursor != NULL);
+	tape = cursor->tape;
+	switch (JSON_TAPE_TAG (tape->entries[cursor->index]))
+	{
+	case JSON_TAPE_OBJECT:
+	case JSON_TAPE_ARRAY:
+		if (json_tape_is_end (tape->entries[cursor->index + 1]))
+			return 0;
+		/* fall through */
+	case JSON_TAPE_LABEL:
+		cursor->index++;
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+
+int
+json_tape_next (struct json_tape_cursor *cursor)
+{
+	const struct json_tape *tape;
+	size_t next;
+
+	assert (cursor != NULL);
+	tape = cursor->tape;
+
+	/* the root and the values of labels have no siblings */
+	if ((cursor->index == 0) || (JSON_TAPE_TAG (tape->entries[cursor->index - 1]) == JSON_TAPE_LABEL))
+		return 0;
+	next = json_tape_skip (tape, cursor->index);
+	if (json_tape_is_end (tape->entries[next]))
+		return 0;
+	cursor->index = next;
+	return 1;
+}
+
+
+int
+json_tape_find (struct json_tape_cursor *cursor, const char *label)
+{
+	const struct json_tape *tape;
+	size_t index;
+
+	assert (cursor != NULL);
+	assert (label != NULL);
+	tape = cursor->tape;
+	if (JSON_TAPE_TAG (tape->entries[cursor->index]) != JSON_TAPE_OBJECT)
+		return 0;
+
+	for (index = cursor->index + 1; JSON_TAPE_TAG (tape->entries[index]) == JSON_TAPE_LABEL; index = json_tape_skip (tape, index))
+	{
+		if (strcmp (tape->strings + (tape->entries[index] & 0x00FFFFFFFFFFFFFFull), label) == 0)
+		{
+			cursor->index = index + 1;
+			return 1;
+		}
+	}
+	return 0;
+}
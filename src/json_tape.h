@@ -0,0 +1,115 @@
+/*// C Interface: json_tape*/
+/*// Description: documents parsed into a tape, a flat vector of entries read through cursors*/
+/*// Copyright: See COPYING file that comes with this distribution*/
+
+
+#ifndef JSON_TAPE_H
+#define JSON_TAPE_H
+
+#include "json.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+A document parsed into a tape: a vector of 64-bit entries, one for every value, label and container end in document order, and a buffer holding the texts of strings, labels and numbers. Each entry holds a tag and either the offset of its text or, for containers, the number of their children and where they end, so that cursors walk the document through sequential memory and skip whole containers in one step. A tape takes two allocations whatever the size of the document, and is read-only once parsed
+**/
+	struct json_tape;
+
+
+/**
+A position on a tape. Cursors are plain values which may be copied freely and are valid as long as their tape is. Like a document tree, a tape holds objects whose children are labels, each of which has its value as its only child
+**/
+	struct json_tape_cursor
+	{
+		const struct json_tape *tape;
+		size_t index;
+	};
+
+
+/**
+Parses a document into a tape. As with json_parse_document(), the root must be an object
+@param buffer a JSON text document, which doesn't need to be null-terminated
+@param length the number of bytes held by buffer, which must be less than 2^32 - 1
+@param tape receives the tape, to be freed with json_tape_free()
+@param error_offset if not NULL, it receives the offset of the first offending byte whenever the document isn't valid
+@return JSON_OK, a json_error code describing the first problem found as json_validate() does, JSON_MAXIMUM_LENGTH if the buffer is too long or JSON_MEMORY
+**/
+	enum json_error json_tape_parse (const char *buffer, size_t length, struct json_tape **tape, size_t * error_offset);
+
+
+/**
+Frees a tape and sets it to NULL
+@param tape the tape
+**/
+	void json_tape_free (struct json_tape **tape);
+
+
+/**
+@param tape the tape
+@return the number of bytes the tape takes, entries and texts included
+**/
+	size_t json_tape_size (const struct json_tape *tape);
+
+
+/**
+@param tape the tape
+@return a cursor on the document's root object
+**/
+	struct json_tape_cursor json_tape_root (const struct json_tape *tape);
+
+
+/**
+@param cursor the cursor
+@return the type of the value under the cursor, JSON_STRING for labels
+**/
+	enum json_value_type json_tape_type (const struct json_tape_cursor *cursor);
+
+
+/**
+@param cursor the cursor
+@return the text of the string, label or number under the cursor, in the form json_t holds it, or NULL for other types
+**/
+	const char *json_tape_text (const struct json_tape_cursor *cursor);
+
+
+/**
+@param cursor the cursor
+@return the number of members of the object or of elements of the array under the cursor, or 0 for other types
+**/
+	size_t json_tape_count (const struct json_tape_cursor *cursor);
+
+
+/**
+Moves a cursor down to the first child of the value under it: the first label of an object, the first element of an array or the value of a label
+@param cursor the cursor
+@return 1 if the cursor moved, 0 if there is no child, in which case the cursor is left where it was
+**/
+	int json_tape_child (struct json_tape_cursor *cursor);
+
+
+/**
+Moves a cursor to the next sibling of the value under it, stepping over containers as a whole
+@param cursor the cursor
+@return 1 if the cursor moved, 0 if the value is the last child of its parent or the root, in which case the cursor is left where it was
+**/
+	int json_tape_next (struct json_tape_cursor *cursor);
+
+
+/**
+Moves a cursor from an object to the value of one of its members. Labels are compared as they are stored in the document, and the first member with the label is found
+@param cursor the cursor, on an object
+@param label the label
+@return 1 if the cursor moved, 0 if the object has no such member or the cursor is not on an object, in which case the cursor is left where it was
+**/
+	int json_tape_find (struct json_tape_cursor *cursor, const char *label);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
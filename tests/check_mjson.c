@@ -18,9 +18,20 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <check.h>
 #include <json.h>
+#include <json_cbor.h>
+#include <json_doc.h>
+#include <json_frozen.h>
+#include <json_path.h>
+#include <json_patch.h>
+#include <json_persistent.h>
+#include <json_snapshot.h>
+#include <json_tape.h>
 
 
 START_TEST(test_parser_empty_object_document)
@@ -107,6 +118,1502 @@ START_TEST(test_parser_object_document)
 END_TEST
 
 
+START_TEST(test_validate_document)
+{
+	enum json_error error;
+	const char * json_document = "{\"foo\":[1, -2.5e3, \"b\\u00e9r\", {}], \"bar\":{\"baz\":[true, false, null]}}\n";
+	error = json_validate (json_document, strlen (json_document), NULL);
+
+	ck_assert_int_eq(error, JSON_OK);
+}
+END_TEST
+
+
+START_TEST(test_validate_error_offset)
+{
+	enum json_error error;
+	size_t offset = 0;
+	const char * json_document = "{\"foo\":[1, 2,], \"bar\":0}";
+	error = json_validate (json_document, strlen (json_document), &offset);
+
+	ck_assert_int_eq(error, JSON_MALFORMED_DOCUMENT);
+	ck_assert_int_eq(offset, 13);
+
+	error = json_validate (json_document, 10, &offset);
+	ck_assert_int_eq(error, JSON_INCOMPLETE_DOCUMENT);
+	ck_assert_int_eq(offset, 10);
+}
+END_TEST
+
+
+/* a fragment which failed to parse leaves the cursor wherever the parser stopped */
+static void
+free_fragment_tree (json_t * cursor)
+{
+	if (cursor == NULL)
+		return;
+	while (cursor->parent != NULL)
+		cursor = cursor->parent;
+	json_free_value (&cursor);
+}
+
+
+START_TEST(test_parser_utf8_validation)
+{
+	struct json_parsing_info parsing_info;
+	enum json_error error;
+
+	json_jpi_init(&parsing_info);
+	parsing_info.validate_utf8 = 1;
+	error = json_parse_fragment (&parsing_info, "{\"caf\xc3\xa9\":\"\xe2\x82\xac \xf0\x9f\x98\x80\"}\n");
+	ck_assert_int_eq(error, JSON_WAITING_FOR_EOF);
+	json_free_value (&parsing_info.cursor);
+
+	json_jpi_init(&parsing_info);
+	parsing_info.validate_utf8 = 1;
+	error = json_parse_fragment (&parsing_info, "{\"foo\":\"\xed\xa0\x80\"}\n");
+	ck_assert_int_ne(error, JSON_WAITING_FOR_EOF);
+	ck_assert_int_ne(error, JSON_INCOMPLETE_DOCUMENT);
+	free_fragment_tree (parsing_info.cursor);
+}
+END_TEST
+
+
+/* decodes each sequence and checks the code point, independently of the table driven and SSSE3 validators in the library */
+static int
+utf8_reference_valid (const unsigned char *text, size_t length)
+{
+	size_t i = 0, n, k;
+	unsigned long c;
+
+	while (i < length)
+	{
+		if (text[i] < 0x80)
+		{
+			i++;
+			continue;
+		}
+		if ((text[i] & 0xE0) == 0xC0)
+			n = 1, c = text[i] & 0x1F;
+		else if ((text[i] & 0xF0) == 0xE0)
+			n = 2, c = text[i] & 0x0F;
+		else if ((text[i] & 0xF8) == 0xF0)
+			n = 3, c = text[i] & 0x07;
+		else
+			return 0;
+		if (i + n >= length)
+			return 0;
+		for (k = 1; k <= n; k++)
+		{
+			if ((text[i + k] & 0xC0) != 0x80)
+				return 0;
+			c = (c << 6) | (text[i + k] & 0x3F);
+		}
+		if ((n == 1 && c < 0x80) || (n == 2 && c < 0x800) || (n == 3 && c < 0x10000) || (c > 0x10FFFF) || (c >= 0xD800 && c <= 0xDFFF))
+			return 0;
+		i += n + 1;
+	}
+	return 1;
+}
+
+
+START_TEST(test_utf8_validation_cross_check)
+{
+	static const unsigned char bytes[] = { 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC1, 0xC2, 0xDF, 0xE0, 0xE1, 0xED, 0xEE, 0xEF, 0xF0, 0xF1, 0xF4, 0xF5, 0xFF };
+	static const char *sequences[] = { "\xc3\xa9", "\xe2\x82\xac", "\xed\x9f\xbf", "\xee\x80\x80", "\xf0\x9f\x98\x80", "\xf4\x8f\xbf\xbf" };
+	struct json_parsing_info parsing_info;
+	enum json_error error;
+	unsigned long seed = 1;
+	char buffer[256];
+	size_t length, start, target;
+	int round;
+
+	for (round = 0; round < 20000; round++)
+	{
+		strcpy (buffer, "{\"k\":\"");
+		start = length = strlen (buffer);
+		seed = seed * 1103515245 + 12345;
+		target = start + (seed >> 16) % 48;
+		while (length < target)
+		{
+			seed = seed * 1103515245 + 12345;
+			switch ((seed >> 16) % 4)
+			{
+			case 0:
+			case 1:
+				buffer[length++] = 'a';
+				break;
+			case 2:
+				strcpy (buffer + length, sequences[(seed >> 20) % (sizeof (sequences) / sizeof (sequences[0]))]);
+				length += strlen (buffer + length);
+				break;
+			default:
+				buffer[length++] = (char) bytes[(seed >> 20) % sizeof (bytes)];
+				break;
+			}
+		}
+		strcpy (buffer + length, "\"}\n");
+
+		json_jpi_init (&parsing_info);
+		parsing_info.validate_utf8 = 1;
+		error = json_parse_fragment (&parsing_info, buffer);
+		if (utf8_reference_valid ((const unsigned char *) buffer + start, length - start))
+			ck_assert_int_eq(error, JSON_WAITING_FOR_EOF);
+		else
+		{
+			ck_assert_int_ne(error, JSON_WAITING_FOR_EOF);
+			ck_assert_int_ne(error, JSON_INCOMPLETE_DOCUMENT);
+		}
+		free_fragment_tree (parsing_info.cursor);
+	}
+}
+END_TEST
+
+
+static int saxy_strings;
+
+static int
+saxy_count_string (char *text)
+{
+	saxy_strings++;
+	return 0;
+}
+
+
+START_TEST(test_saxy_utf8_validation)
+{
+	struct json_saxy_functions functions = { NULL };
+	struct json_saxy_parser_status status = { 0 };
+	enum json_error error = JSON_OK;
+	const char * p;
+
+	functions.new_string = saxy_count_string;
+	status.validate_utf8 = 1;
+	saxy_strings = 0;
+	for (p = "{\"caf\xc3\xa9\":\"ok\", \"bar\":[\"\\u00e9\"]}"; *p != '\0' && error == JSON_OK; p++)
+		error = json_saxy_parse (&status, &functions, *p);
+	ck_assert_int_eq(error, JSON_OK);
+	ck_assert_int_eq(saxy_strings, 4);
+
+	error = JSON_OK;
+	for (p = "{\"foo\":\"\xc0\xaf\"}"; *p != '\0' && error == JSON_OK; p++)
+		error = json_saxy_parse (&status, &functions, *p);
+	ck_assert_int_eq(error, JSON_ILLEGAL_CHARACTER);
+}
+END_TEST
+
+
+START_TEST(test_escape_unescape)
+{
+	char * escaped;
+	char * unescaped;
+	const char * text = "plain text long enough to span a few blocks: \"quoted\" C:\\dir/file\n\ttab\x01 caf\xc3\xa9";
+
+	escaped = json_escape (text);
+	ck_assert_str_eq(escaped, "plain text long enough to span a few blocks: \\\"quoted\\\" C:\\\\dir\\/file\\n\\ttab\\u0001 caf\xc3\xa9");
+	unescaped = json_unescape (escaped);
+	ck_assert_str_eq(unescaped, text);
+	free (escaped);
+	free (unescaped);
+}
+END_TEST
+
+
+START_TEST(test_parser_fragmented_string)
+{
+	struct json_parsing_info parsing_info;
+	enum json_error error;
+
+	json_jpi_init(&parsing_info);
+	error = json_parse_fragment (&parsing_info, "{\"foo\":\"a string which is split across");
+	ck_assert_int_eq(error, JSON_INCOMPLETE_DOCUMENT);
+	error = json_parse_fragment (&parsing_info, " two fragments \\\"with\\\" escapes\"}");
+	ck_assert_int_eq(error, JSON_WAITING_FOR_EOF);
+	ck_assert_str_eq(parsing_info.cursor->child->child->text, "a string which is split across two fragments \\\"with\\\" escapes");
+	json_free_value (&parsing_info.cursor);
+}
+END_TEST
+
+
+START_TEST(test_tree_to_string_escaping)
+{
+	json_t * root = NULL;
+	char * text = NULL;
+	enum json_error error;
+
+	error = json_parse_document (&root, "{\"parsed\":\"a\\\"b\"}");
+	ck_assert_int_eq(error, JSON_OK);
+	ck_assert_int_eq(root->child->child->flags & JSON_FLAG_NEEDS_ESCAPING, 0);
+
+	ck_assert_int_eq(json_insert_pair_into_object (root, "built", json_new_plain_string ("say \"hi\"\n")), JSON_OK);
+	ck_assert_int_eq(json_insert_pair_into_object (root, "plain", json_new_plain_string ("no escapes")), JSON_OK);
+	ck_assert_int_ne(root->child_end->previous->child->flags & JSON_FLAG_NEEDS_ESCAPING, 0);
+	ck_assert_int_eq(root->child_end->child->flags & JSON_FLAG_NEEDS_ESCAPING, 0);
+	ck_assert_int_eq(json_insert_pair_into_object (root, "escaped", json_new_string ("say \\\"hi\\\"\\n")), JSON_OK);
+	ck_assert_int_eq(root->child_end->child->flags & JSON_FLAG_NEEDS_ESCAPING, 0);
+
+	error = json_tree_to_string (root, &text);
+	ck_assert_int_eq(error, JSON_OK);
+	ck_assert_str_eq(text, "{\"parsed\":\"a\\\"b\",\"built\":\"say \\\"hi\\\"\\n\",\"plain\":\"no escapes\",\"escaped\":\"say \\\"hi\\\"\\n\"}");
+	free (text);
+	json_free_value (&root);
+}
+END_TEST
+
+
+START_TEST(test_find_first_label_index)
+{
+	json_t * object = json_new_object ();
+	json_t * label;
+	char text[16];
+	int i;
+
+	for (i = 0; i < 100; i++)
+	{
+		sprintf (text, "key%d", i);
+		ck_assert_int_eq(json_insert_pair_into_object (object, text, json_new_null ()), JSON_OK);
+	}
+	ck_assert_int_eq(json_insert_pair_into_object (object, "key7", json_new_true ()), JSON_OK);
+
+	/* a long scan builds the index */
+	label = json_find_first_label (object, "key99");
+	ck_assert_ptr_ne(label, NULL);
+	ck_assert_ptr_ne(object->index, NULL);
+
+	/* duplicated labels resolve to the first one */
+	label = json_find_first_label (object, "key7");
+	ck_assert_int_eq(label->child->type, JSON_NULL);
+
+	/* the index follows removals and insertions */
+	json_free_value (&label);
+	label = json_find_first_label (object, "key7");
+	ck_assert_int_eq(label->child->type, JSON_TRUE);
+	ck_assert_int_eq(json_insert_pair_into_object (object, "late", json_new_false ()), JSON_OK);
+	ck_assert_ptr_eq(json_find_first_label (object, "late"), object->child_end);
+	ck_assert_ptr_eq(json_find_first_label (object, "missing"), NULL);
+
+	json_free_value (&object);
+}
+END_TEST
+
+
+START_TEST(test_array_random_access)
+{
+	struct json_parsing_info parsing_info;
+	json_t * array;
+	json_t * element;
+	enum json_error error;
+
+	json_jpi_init(&parsing_info);
+	parsing_info.index_arrays = 1;
+	error = json_parse_fragment (&parsing_info, "{\"foo\":[10, 11, 12, 13, 14]}");
+	ck_assert_int_eq(error, JSON_WAITING_FOR_EOF);
+	array = parsing_info.cursor->child->child;
+	ck_assert_ptr_ne(array->index, NULL);
+	ck_assert_int_eq(json_array_size (array), 5);
+	ck_assert_str_eq(json_array_get (array, 3)->text, "13");
+	ck_assert_ptr_eq(json_array_get (array, 5), NULL);
+
+	element = json_array_get (array, 1);
+	json_free_value (&element);
+	ck_assert_int_eq(json_insert_child (array, json_new_number ("15")), JSON_OK);
+	ck_assert_int_eq(json_array_size (array), 5);
+	ck_assert_str_eq(json_array_get (array, 1)->text, "12");
+	ck_assert_str_eq(json_array_get (array, 4)->text, "15");
+
+	/* an indexed element freed whole leaves its parent's index in step */
+	element = json_new_array ();
+	json_insert_child (element, json_new_number ("16"));
+	json_insert_child (element, json_new_number ("17"));
+	ck_assert_int_eq(json_array_size (element), 2);
+	ck_assert_int_eq(json_insert_child (array, element), JSON_OK);
+	ck_assert_int_eq(json_array_size (array), 6);
+	json_free_value (&element);
+	ck_assert_int_eq(json_array_size (array), 5);
+	ck_assert_str_eq(json_array_get (array, 4)->text, "15");
+
+	json_free_value (&parsing_info.cursor);
+}
+END_TEST
+
+
+START_TEST(test_pointer_eval)
+{
+	struct json_parsing_info parsing_info;
+	struct json_pointer * pointer;
+	json_t * value;
+	enum json_error error;
+
+	json_jpi_init(&parsing_info);
+	error = json_parse_fragment (&parsing_info, "{\"foo\":[\"bar\", \"baz\"], \"a~b\":1, \"c/d\":{\"e\":true}, \"\":0}");
+	ck_assert_int_eq(error, JSON_WAITING_FOR_EOF);
+
+	pointer = json_pointer_compile ("/foo/1");
+	ck_assert_ptr_ne(pointer, NULL);
+	value = json_pointer_eval (pointer, parsing_info.cursor);
+	ck_assert_ptr_ne(value, NULL);
+	ck_assert_str_eq(value->text, "baz");
+	json_pointer_free (&pointer);
+	ck_assert_ptr_eq(pointer, NULL);
+
+	pointer = json_pointer_compile ("/a~0b");
+	ck_assert_str_eq(json_pointer_eval (pointer, parsing_info.cursor)->text, "1");
+	json_pointer_free (&pointer);
+
+	pointer = json_pointer_compile ("/c~1d/e");
+	ck_assert_int_eq(json_pointer_eval (pointer, parsing_info.cursor)->type, JSON_TRUE);
+	json_pointer_free (&pointer);
+
+	pointer = json_pointer_compile ("/");
+	ck_assert_str_eq(json_pointer_eval (pointer, parsing_info.cursor)->text, "0");
+	json_pointer_free (&pointer);
+
+	pointer = json_pointer_compile ("");
+	ck_assert_ptr_eq(json_pointer_eval (pointer, parsing_info.cursor), parsing_info.cursor);
+	json_pointer_free (&pointer);
+
+	pointer = json_pointer_compile ("/foo/01");
+	ck_assert_ptr_eq(json_pointer_eval (pointer, parsing_info.cursor), NULL);
+	json_pointer_free (&pointer);
+
+	pointer = json_pointer_compile ("/foo/-");
+	ck_assert_ptr_eq(json_pointer_eval (pointer, parsing_info.cursor), NULL);
+	json_pointer_free (&pointer);
+
+	ck_assert_ptr_eq(json_pointer_compile ("foo"), NULL);
+	ck_assert_ptr_eq(json_pointer_compile ("/foo~2"), NULL);
+
+	json_free_value (&parsing_info.cursor);
+}
+END_TEST
+
+
+/* concatenates the text of every match, or the type of matches without text, separated by commas */
+static int
+collect_matches (json_t * match, void *data)
+{
+	char *matches = data;
+
+	if (matches[0] != '\0')
+		strcat (matches, ",");
+	if (match->text != NULL)
+		strcat (matches, match->text);
+	else
+		strcat (matches, (match->type == JSON_OBJECT) ? "{}" : "[]");
+	return 0;
+}
+
+
+static const char *
+run_path (const char *expression, json_t * root, char *matches)
+{
+	struct json_path *path = json_path_compile (expression);
+
+	if (path == NULL)
+		return "malformed";
+	matches[0] = '\0';
+	if (json_path_eval (path, root, collect_matches, matches) != JSON_OK)
+		strcpy (matches, "out of memory");
+	json_path_free (&path);
+	return matches;
+}
+
+
+START_TEST(test_path_eval)
+{
+	struct json_parsing_info parsing_info;
+	char matches[256];
+	enum json_error error;
+
+	json_jpi_init(&parsing_info);
+	error = json_parse_fragment (&parsing_info, "{\"store\":{\"book\":[{\"title\":\"a\",\"price\":8},{\"title\":\"b\",\"price\":12,\"isbn\":\"x\"},{\"title\":\"c\",\"price\":9}],\"bicycle\":{\"price\":20}}}");
+	ck_assert_int_eq(error, JSON_WAITING_FOR_EOF);
+
+	ck_assert_str_eq(run_path ("$.store.book[*].title", parsing_info.cursor, matches), "a,b,c");
+	ck_assert_str_eq(run_path ("$['store']['book'][1]['title']", parsing_info.cursor, matches), "b");
+	ck_assert_str_eq(run_path ("$.store.book[-1].title", parsing_info.cursor, matches), "c");
+	ck_assert_str_eq(run_path ("$..price", parsing_info.cursor, matches), "8,12,9,20");
+	ck_assert_str_eq(run_path ("$.store.book[?(@.price < 10)].title", parsing_info.cursor, matches), "a,c");
+	ck_assert_str_eq(run_path ("$.store.book[?(@.title == 'b')].price", parsing_info.cursor, matches), "12");
+	ck_assert_str_eq(run_path ("$..book[?(@.isbn)].title", parsing_info.cursor, matches), "b");
+	ck_assert_str_eq(run_path ("$.store.book[0:2].title", parsing_info.cursor, matches), "a,b");
+	ck_assert_str_eq(run_path ("$.store.book[::-2].title", parsing_info.cursor, matches), "c,a");
+	ck_assert_str_eq(run_path ("$.store.*", parsing_info.cursor, matches), "[],{}");
+	ck_assert_str_eq(run_path ("$.store.book[7]", parsing_info.cursor, matches), "");
+
+	ck_assert_ptr_eq(json_path_compile ("store"), NULL);
+	ck_assert_ptr_eq(json_path_compile ("$.store[?(@.price <)]"), NULL);
+	ck_assert_ptr_eq(json_path_compile ("$['store'"), NULL);
+
+	json_free_value (&parsing_info.cursor);
+
+	/* names and strings are compared unescaped on both sides */
+	json_jpi_init(&parsing_info);
+	error = json_parse_fragment (&parsing_info, "{\"caf\\u00e9\":1,\"a\\/b\":2,\"x\":[{\"q\":\"caf\\u00e9\",\"n\":3},{\"q\":\"cafe\",\"n\":4}]}");
+	ck_assert_int_eq(error, JSON_WAITING_FOR_EOF);
+	ck_assert_str_eq(run_path ("$['caf\xc3\xa9']", parsing_info.cursor, matches), "1");
+	ck_assert_str_eq(run_path ("$[\"caf\\u00e9\"]", parsing_info.cursor, matches), "1");
+	ck_assert_str_eq(run_path ("$['a/b']", parsing_info.cursor, matches), "2");
+	ck_assert_str_eq(run_path ("$.x[?(@.q == 'caf\xc3\xa9')].n", parsing_info.cursor, matches), "3");
+	ck_assert_str_eq(run_path ("$.x[?(@.q > 'cafe')].n", parsing_info.cursor, matches), "3");
+	json_free_value (&parsing_info.cursor);
+}
+END_TEST
+
+
+/* renders every match of a subscription, separated by commas */
+static void
+collect_selected (json_t * value, void *data)
+{
+	char *matches = data;
+	char *text;
+
+	if (matches[0] != '\0')
+		strcat (matches, ",");
+	if (value->type == JSON_STRING)
+	{
+		/* json_tree_to_string() takes a string without a parent for a label */
+		strcat (matches, "\"");
+		strcat (matches, value->text);
+		strcat (matches, "\"");
+	}
+	else if (json_tree_to_string (value, &text) == JSON_OK)
+	{
+		strcat (matches, text);
+		free (text);
+	}
+}
+
+
+START_TEST(test_selector_feed)
+{
+	struct json_selector * selector;
+	char titles[256] = "", second[256] = "", ids[256] = "", escaped[256] = "";
+	const char * fragments[] = { "{\"skip\":{\"a\":[1,{\"b\":\"}]\\\"\"}]},\"bo", "ok\":[{\"title\":\"x\",\"n\":[1,2]},{\"tit", "le\":\"y\",\"n\":[3]}],\"id\":4", "2}\n{\"id\":7}\n", NULL };
+	enum json_error error = JSON_OK;
+	int i;
+
+	selector = json_selector_new ();
+	ck_assert_ptr_ne(selector, NULL);
+	ck_assert_int_eq(json_selector_subscribe (selector, "$.book[*].title", collect_selected, titles), JSON_OK);
+	ck_assert_int_eq(json_selector_subscribe (selector, "/book/1", collect_selected, second), JSON_OK);
+	ck_assert_int_eq(json_selector_subscribe (selector, "$['id']", collect_selected, ids), JSON_OK);
+	ck_assert_int_eq(json_selector_subscribe (selector, "$..id", collect_selected, ids), JSON_INCOMPATIBLE_TYPE);
+	ck_assert_int_eq(json_selector_subscribe (selector, "/a~2", collect_selected, ids), JSON_MALFORMED_DOCUMENT);
+
+	for (i = 0; fragments[i] != NULL; i++)
+		error = json_selector_feed (selector, fragments[i]);
+	ck_assert_int_eq(error, JSON_WAITING_FOR_EOF);
+	ck_assert_str_eq(titles, "\"x\",\"y\"");
+	ck_assert_str_eq(second, "{\"title\":\"y\",\"n\":[3]}");
+	ck_assert_str_eq(ids, "42,7");
+
+	ck_assert_int_eq(json_selector_feed (selector, "{\"id\":]"), JSON_MALFORMED_DOCUMENT);
+	json_selector_free (&selector);
+	ck_assert_ptr_eq(selector, NULL);
+
+	/* labels are matched by their unescaped text */
+	selector = json_selector_new ();
+	ck_assert_int_eq(json_selector_subscribe (selector, "/a~1b", collect_selected, escaped), JSON_OK);
+	ck_assert_int_eq(json_selector_subscribe (selector, "$['caf\xc3\xa9']", collect_selected, escaped), JSON_OK);
+	ck_assert_int_eq(json_selector_feed (selector, "{\"a\\/b\":1,\"caf\\u00e9\":2,\"a\\\\/b\":3}\n"), JSON_WAITING_FOR_EOF);
+	ck_assert_str_eq(escaped, "1,2");
+	json_selector_free (&selector);
+}
+END_TEST
+
+
+START_TEST(test_clone)
+{
+	const char * document = "{\"a\":[1,\"two\",{\"b\":null,\"c\":[true,false]}],\"d\":{}}";
+	json_t * root = NULL;
+	json_t * copy;
+	json_t * second;
+	struct json_arena * arena;
+	char * text;
+
+	ck_assert_int_eq(json_parse_document (&root, document), JSON_OK);
+
+	copy = json_clone (root);
+	ck_assert_ptr_ne(copy, NULL);
+	ck_assert_ptr_ne(copy->child, root->child);
+	ck_assert_int_eq(json_tree_to_string (copy, &text), JSON_OK);
+	ck_assert_str_eq(text, document);
+	free (text);
+	json_free_value (&copy);
+
+	arena = json_arena_new (256);
+	ck_assert_ptr_ne(arena, NULL);
+	copy = json_clone_into_arena (root, arena);
+	second = json_clone_into_arena (root, arena);
+	ck_assert_ptr_ne(copy, NULL);
+	ck_assert_ptr_ne(second, NULL);
+	ck_assert_ptr_eq(copy->child->text, second->child->text);	/* interned labels */
+	ck_assert_int_eq(json_insert_pair_into_object (copy, "e", json_new_number ("5")), JSON_OK);
+	ck_assert_int_eq(json_tree_to_string (copy, &text), JSON_OK);
+	ck_assert_str_eq(text, "{\"a\":[1,\"two\",{\"b\":null,\"c\":[true,false]}],\"d\":{},\"e\":5}");
+	free (text);
+	json_free_value (&copy);
+	json_free_value (&second);
+	json_arena_reset (arena);
+	copy = json_clone_into_arena (root->child, arena);
+	ck_assert_str_eq(copy->text, "a");
+	json_free_value (&copy);
+	json_arena_free (&arena);
+	ck_assert_ptr_eq(arena, NULL);
+
+	json_free_value (&root);
+}
+END_TEST
+
+
+START_TEST(test_hash_equal)
+{
+	json_t * a = NULL;
+	json_t * b = NULL;
+	json_t * c = NULL;
+	uint64_t hash_a, hash_b, hash_c;
+
+	ck_assert_int_eq(json_parse_document (&a, "{\"x\":[1,2.50,{\"k\":\"A\"}],\"y\":null,\"z\":-0}"), JSON_OK);
+	ck_assert_int_eq(json_parse_document (&b, "{\"z\":0,\"y\":null,\"x\":[1.0,25e-1,{\"k\":\"\\u0041\"}]}"), JSON_OK);
+	ck_assert_int_eq(json_parse_document (&c, "{\"x\":[2.50,1,{\"k\":\"A\"}],\"y\":null,\"z\":0}"), JSON_OK);
+
+	ck_assert_int_eq(json_equal (a, b), 1);
+	ck_assert_int_eq(json_equal (b, a), 1);
+	ck_assert_int_eq(json_equal (a, c), 0);
+	ck_assert_int_eq(json_hash (a, 0, &hash_a), JSON_OK);
+	ck_assert_int_eq(json_hash (b, 1, &hash_b), JSON_OK);
+	ck_assert_int_eq(json_hash (c, 1, &hash_c), JSON_OK);
+	ck_assert(hash_a == hash_b);
+	ck_assert(hash_a != hash_c);
+	ck_assert_int_eq(b->flags & JSON_FLAG_DIGESTED, JSON_FLAG_DIGESTED);
+
+	/* changes discard the memoized hashes above them */
+	ck_assert_int_eq(json_insert_child (json_find_first_label (b, "x")->child, json_new_null ()), JSON_OK);
+	ck_assert_int_eq(b->flags & JSON_FLAG_DIGESTED, 0);
+	ck_assert_int_eq(json_equal (a, b), 0);
+	ck_assert_int_eq(json_hash (b, 1, &hash_b), JSON_OK);
+	ck_assert(hash_a != hash_b);
+
+	/* a one-byte escape sequence after a multibyte one */
+	json_free_value (&a);
+	json_free_value (&b);
+	ck_assert_int_eq(json_parse_document (&a, "{\"s\":\"\\u00e9\\u0041\"}"), JSON_OK);
+	ck_assert_int_eq(json_parse_document (&b, "{\"s\":\"\xC3\xA9" "A\"}"), JSON_OK);
+	ck_assert_int_eq(json_equal (a, b), 1);
+	ck_assert_int_eq(json_hash (a, 0, &hash_a), JSON_OK);
+	ck_assert_int_eq(json_hash (b, 0, &hash_b), JSON_OK);
+	ck_assert(hash_a == hash_b);
+
+	json_free_value (&a);
+	json_free_value (&b);
+	json_free_value (&c);
+}
+END_TEST
+
+
+START_TEST(test_patch)
+{
+	const char * pairs[][2] = {
+		{ "{\"a\":1,\"b\":[1,2,3,4],\"c\":{\"d\":\"x\"}}", "{\"b\":[1,3,4,5],\"c\":{\"d\":\"y\",\"e\":null},\"f~/g\":true}" },
+		{ "{\"v\":[{\"id\":1},{\"id\":2},{\"id\":3}]}", "{\"v\":[{\"id\":0},{\"id\":1},{\"id\":3,\"n\":[]}]}" },
+		{ "{\"v\":[1,2]}", "{\"v\":{\"a\":[1,2]}}" },
+		{ "{\"v\":[]}", "{\"v\":[[],{},\"s\"]}" },
+		{ "{\"a\\/b\":1,\"x~y\":2,\"caf\\u00e9\":[1],\"q\\\"\":{}}", "{\"a\\/b\":2,\"caf\xc3\xa9\":[1,2],\"q\\u0022\":{\"\\n\":0}}" },
+		{ NULL, NULL }
+	};
+	json_t * a = NULL;
+	json_t * b = NULL;
+	json_t * patch = NULL;
+	char * text;
+	int i;
+
+	for (i = 0; pairs[i][0] != NULL; i++)
+	{
+		ck_assert_int_eq(json_parse_document (&a, pairs[i][0]), JSON_OK);
+		ck_assert_int_eq(json_parse_document (&b, pairs[i][1]), JSON_OK);
+		ck_assert_int_eq(json_diff (a, b, &patch), JSON_OK);
+		ck_assert_int_eq(json_patch_apply (&a, patch), JSON_OK);
+		ck_assert_int_eq(json_equal (a, b), 1);
+		json_free_value (&a);
+		json_free_value (&b);
+		json_free_value (&patch);
+	}
+
+	/* unchanged elements are kept and changed ones patched in place */
+	ck_assert_int_eq(json_parse_document (&a, "{\"v\":[\"a\",{\"k\":1},\"c\"]}"), JSON_OK);
+	ck_assert_int_eq(json_parse_document (&b, "{\"v\":[\"a\",{\"k\":2},\"c\",\"d\"]}"), JSON_OK);
+	ck_assert_int_eq(json_diff (a, b, &patch), JSON_OK);
+	ck_assert_int_eq(json_tree_to_string (patch, &text), JSON_OK);
+	ck_assert_str_eq(text, "[{\"op\":\"add\",\"path\":\"/v/3\",\"value\":\"d\"},{\"op\":\"replace\",\"path\":\"/v/1/k\",\"value\":2}]");
+	free (text);
+	json_free_value (&a);
+	json_free_value (&b);
+	json_free_value (&patch);
+
+	/* patches read from text */
+	ck_assert_int_eq(json_parse_document (&a, "{\"a\":{\"b\":[1,2]},\"c\":3}"), JSON_OK);
+	ck_assert_int_eq(json_parse_document (&patch, "[{\"op\":\"move\",\"from\":\"/a/b\",\"path\":\"/d\"},{\"op\":\"copy\",\"from\":\"/d\",\"path\":\"/d/0\"},{\"op\":\"test\",\"path\":\"/c\",\"value\":3},{\"op\":\"remove\",\"path\":\"/c\"}]"), JSON_OK);
+	ck_assert_int_eq(json_patch_apply (&a, patch), JSON_OK);
+	ck_assert_int_eq(json_tree_to_string (a, &text), JSON_OK);
+	ck_assert_str_eq(text, "{\"a\":{},\"d\":[[1,2],1,2]}");
+	free (text);
+	json_free_value (&patch);
+
+	ck_assert_int_eq(json_parse_document (&patch, "[{\"op\":\"test\",\"path\":\"/a\",\"value\":null}]"), JSON_OK);
+	ck_assert_int_eq(json_patch_apply (&a, patch), JSON_INCOMPATIBLE_TYPE);
+	json_free_value (&patch);
+	ck_assert_int_eq(json_parse_document (&patch, "[{\"op\":\"add\",\"path\":\"/d/9\",\"value\":0}]"), JSON_OK);
+	ck_assert_int_eq(json_patch_apply (&a, patch), JSON_BAD_TREE_STRUCTURE);
+	json_free_value (&patch);
+	ck_assert_int_eq(json_parse_document (&patch, "[{\"op\":\"move\",\"from\":\"/d\",\"path\":\"/d/0\"}]"), JSON_OK);
+	ck_assert_int_eq(json_patch_apply (&a, patch), JSON_BAD_TREE_STRUCTURE);
+	json_free_value (&patch);
+	ck_assert_int_eq(json_parse_document (&patch, "[{\"path\":\"/a\"}]"), JSON_OK);
+	ck_assert_int_eq(json_patch_apply (&a, patch), JSON_MALFORMED_DOCUMENT);
+	json_free_value (&patch);
+	/* a position beyond any array, which would wrap around to 1 */
+	ck_assert_int_eq(json_parse_document (&patch, "[{\"op\":\"replace\",\"path\":\"/d/18446744073709551617\",\"value\":99}]"), JSON_OK);
+	ck_assert_int_eq(json_patch_apply (&a, patch), JSON_BAD_TREE_STRUCTURE);
+	json_free_value (&patch);
+	ck_assert_int_eq(json_tree_to_string (a, &text), JSON_OK);
+	ck_assert_str_eq(text, "{\"a\":{},\"d\":[[1,2],1,2]}");
+	free (text);
+	json_free_value (&a);
+
+	/* paths are JSON strings, whose pointers are matched against unescaped labels */
+	ck_assert_int_eq(json_parse_document (&a, "{\"caf\\u00e9\":1,\"a\\/b\":1}"), JSON_OK);
+	ck_assert_int_eq(json_parse_document (&patch, "[{\"op\":\"replace\",\"path\":\"/caf\\u00e9\",\"value\":2},{\"op\":\"replace\",\"path\":\"\\/a~1b\",\"value\":3},{\"op\":\"add\",\"path\":\"/q\\\"\\\\\",\"value\":4}]"), JSON_OK);
+	ck_assert_int_eq(json_patch_apply (&a, patch), JSON_OK);
+	ck_assert_int_eq(json_tree_to_string (a, &text), JSON_OK);
+	ck_assert_str_eq(text, "{\"caf\\u00e9\":2,\"a\\/b\":3,\"q\\\"\\\\\":4}");
+	free (text);
+	json_free_value (&patch);
+
+	/* and diff writes them from the unescaped labels */
+	ck_assert_int_eq(json_parse_document (&b, "{\"caf\\u00e9\":2,\"a\\/b\":4}"), JSON_OK);
+	ck_assert_int_eq(json_diff (a, b, &patch), JSON_OK);
+	ck_assert_int_eq(json_tree_to_string (patch, &text), JSON_OK);
+	ck_assert_str_eq(text, "[{\"op\":\"remove\",\"path\":\"\\/q\\\"\\\\\"},{\"op\":\"replace\",\"path\":\"/a~1b\",\"value\":4}]");
+	free (text);
+	json_free_value (&b);
+	json_free_value (&patch);
+
+	json_free_value (&a);
+}
+END_TEST
+
+
+START_TEST(test_merge_patch)
+{
+	const char * cases[][3] = {
+		{ "{\"a\":\"b\",\"c\":{\"d\":\"e\",\"f\":\"g\"}}", "{\"a\":\"z\",\"c\":{\"f\":null}}", "{\"a\":\"z\",\"c\":{\"d\":\"e\"}}" },
+		{ "{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}" },
+		{ "{\"a\":\"foo\"}", "{\"b\":{\"c\":null,\"d\":{\"e\":1}}}", "{\"a\":\"foo\",\"b\":{\"d\":{\"e\":1}}}" },
+		{ "{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}" },
+		{ "{\"a\":{\"b\":1}}", "{\"a\":{\"b\":{\"c\":2}},\"x\":null}", "{\"a\":{\"b\":{\"c\":2}}}" },
+		/* labels are matched by their unescaped text */
+		{ "{\"caf\xc3\xa9\":1}", "{\"caf\\u00e9\":3}", "{\"caf\xc3\xa9\":3}" },
+		{ "{\"a\":0,\"a\\/b\":{\"x\":1,\"y\":2}}", "{\"\\u0061\":null,\"a/b\":{\"x\":null}}", "{\"a\\/b\":{\"y\":2}}" },
+		{ NULL, NULL, NULL }
+	};
+	json_t * target = NULL;
+	json_t * patch = NULL;
+	json_t * kept;
+	char * text;
+	int i;
+
+	for (i = 0; cases[i][0] != NULL; i++)
+	{
+		ck_assert_int_eq(json_parse_document (&target, cases[i][0]), JSON_OK);
+		ck_assert_int_eq(json_parse_document (&patch, cases[i][1]), JSON_OK);
+		ck_assert_int_eq(json_merge_patch (&target, &patch), JSON_OK);
+		ck_assert_ptr_eq(patch, NULL);
+		ck_assert_int_eq(json_tree_to_string (target, &text), JSON_OK);
+		ck_assert_str_eq(text, cases[i][2]);
+		free (text);
+		json_free_value (&target);
+	}
+
+	/* the values of the patch are moved into the target */
+	ck_assert_int_eq(json_parse_document (&target, "{\"a\":1}"), JSON_OK);
+	ck_assert_int_eq(json_parse_document (&patch, "{\"a\":[true],\"b\":2}"), JSON_OK);
+	kept = patch->child->child;
+	ck_assert_int_eq(json_merge_patch (&target, &patch), JSON_OK);
+	ck_assert_ptr_eq(target->child->child, kept);
+
+	/* a patch which is not an object replaces the target */
+	ck_assert_int_eq(json_parse_document (&patch, "{\"p\":[0]}"), JSON_OK);
+	kept = patch->child->child;
+	json_detach (kept);
+	json_free_value (&patch);
+	ck_assert_int_eq(json_merge_patch (&target, &kept), JSON_OK);
+	ck_assert_int_eq(json_tree_to_string (target, &text), JSON_OK);
+	ck_assert_str_eq(text, "[0]");
+	free (text);
+	json_free_value (&target);
+}
+END_TEST
+
+
+START_TEST(test_canonical_string)
+{
+	/* the examples of RFC 8785 */
+	const char * document = "{\"numbers\":[333333333.33333329,1E30,4.50,2e-3,0.000000000000000000000000001],\"string\":\"\\u20ac$\\u000F\\u000aA'\\u0042\\u0022\\u005c\\\\\\\"\\/\",\"literals\":[null,true,false]}";
+	const char * sorting = "{\"\\u20ac\":\"Euro Sign\",\"\\r\":\"Carriage Return\",\"\\ufb33\":\"Hebrew Letter Dalet With Dagesh\",\"1\":\"One\",\"\\ud83d\\ude00\":\"Emoji: Grinning Face\",\"\\u0080\":\"Control\",\"\\u00f6\":\"Latin Small Letter O With Diaeresis\"}";
+	const char * numbers = "{\"n\":[0,-0,-0.0,1e21,1e20,1e-7,0.000001,4.5e-324,1.7976931348623157e308,9007199254740992,-12,1.5e3]}";
+	json_t * root = NULL;
+	char * text;
+
+	ck_assert_int_eq(json_parse_document (&root, document), JSON_OK);
+	ck_assert_int_eq(json_tree_to_canonical_string (root, &text), JSON_OK);
+	ck_assert_str_eq(text, "{\"literals\":[null,true,false],\"numbers\":[333333333.3333333,1e+30,4.5,0.002,1e-27],\"string\":\"\xe2\x82\xac$\\u000f\\nA'B\\\"\\\\\\\\\\\"/\"}");
+	free (text);
+	json_free_value (&root);
+
+	ck_assert_int_eq(json_parse_document (&root, sorting), JSON_OK);
+	ck_assert_int_eq(json_tree_to_canonical_string (root, &text), JSON_OK);
+	ck_assert_str_eq(text, "{\"\\r\":\"Carriage Return\",\"1\":\"One\",\"\xc2\x80\":\"Control\",\"\xc3\xb6\":\"Latin Small Letter O With Diaeresis\",\"\xe2\x82\xac\":\"Euro Sign\",\"\xf0\x9f\x98\x80\":\"Emoji: Grinning Face\",\"\xef\xac\xb3\":\"Hebrew Letter Dalet With Dagesh\"}");
+	free (text);
+	json_free_value (&root);
+
+	ck_assert_int_eq(json_parse_document (&root, numbers), JSON_OK);
+	ck_assert_int_eq(json_tree_to_canonical_string (root, &text), JSON_OK);
+	ck_assert_str_eq(text, "{\"n\":[0,0,0,1e+21,100000000000000000000,1e-7,0.000001,5e-324,1.7976931348623157e+308,9007199254740992,-12,1500]}");
+	free (text);
+	json_free_value (&root);
+
+	ck_assert_int_eq(json_parse_document (&root, "{\"a\":1e400}"), JSON_OK);
+	ck_assert_int_eq(json_tree_to_canonical_string (root, &text), JSON_INCOMPATIBLE_TYPE);
+	json_free_value (&root);
+	ck_assert_int_eq(json_parse_document (&root, "{\"a\":\"\\ud800\"}"), JSON_OK);
+	ck_assert_int_eq(json_tree_to_canonical_string (root, &text), JSON_ILLEGAL_CHARACTER);
+	json_free_value (&root);
+}
+END_TEST
+
+
+START_TEST(test_pvalue)
+{
+	json_t * root = NULL;
+	json_t * tree;
+	struct json_pvalue * first;
+	struct json_pvalue * second;
+	struct json_pvalue * third;
+	struct json_pvalue * value;
+	char * text;
+
+	ck_assert_int_eq(json_parse_document (&root, "{\"a\":{\"b\":[1,2]},\"c\":{\"d\":true}}"), JSON_OK);
+	first = json_pvalue_from_tree (root);
+	json_free_value (&root);
+	ck_assert_ptr_ne(first, NULL);
+	ck_assert_int_eq(json_pvalue_size (first), 2);
+	ck_assert_str_eq(json_pvalue_label (first, 1), "c");
+	ck_assert_str_eq(json_pvalue_text (json_pvalue_get (first, "/a/b/1")), "2");
+
+	/* updates copy the path to the change and share the rest */
+	root = json_new_number ("3");
+	value = json_pvalue_from_tree (root);
+	json_free_value (&root);
+	ck_assert_int_eq(json_pvalue_append (first, "/a/b", value, &second), JSON_OK);
+	ck_assert_int_eq(json_pvalue_set (second, "/a/e", value, &third), JSON_OK);
+	json_pvalue_release (&value);
+	ck_assert_ptr_eq(json_pvalue_get (first, "/c"), json_pvalue_get (third, "/c"));
+	ck_assert_ptr_ne(json_pvalue_get (first, "/a"), json_pvalue_get (second, "/a"));
+	ck_assert_ptr_eq(json_pvalue_get (second, "/a/b/2"), json_pvalue_get (third, "/a/e"));
+	ck_assert_int_eq(json_pvalue_size (json_pvalue_get (first, "/a/b")), 2);
+	json_pvalue_release (&second);
+
+	ck_assert_int_eq(json_pvalue_remove (third, "/a/b/0", &second), JSON_OK);
+	tree = json_pvalue_to_tree (second);
+	ck_assert_int_eq(json_tree_to_string (tree, &text), JSON_OK);
+	ck_assert_str_eq(text, "{\"a\":{\"b\":[2,3],\"e\":3},\"c\":{\"d\":true}}");
+	free (text);
+	json_free_value (&tree);
+	json_pvalue_release (&second);
+
+	tree = json_pvalue_to_tree (first);
+	ck_assert_int_eq(json_tree_to_string (tree, &text), JSON_OK);
+	ck_assert_str_eq(text, "{\"a\":{\"b\":[1,2]},\"c\":{\"d\":true}}");
+	free (text);
+	json_free_value (&tree);
+
+	ck_assert_int_eq(json_pvalue_remove (first, "/x", &second), JSON_BAD_TREE_STRUCTURE);
+	ck_assert_int_eq(json_pvalue_set (first, "/a/b/5", third, &second), JSON_BAD_TREE_STRUCTURE);
+	ck_assert_int_eq(json_pvalue_append (first, "/c", third, &second), JSON_BAD_TREE_STRUCTURE);
+	ck_assert_int_eq(json_pvalue_set (first, "a", third, &second), JSON_MALFORMED_DOCUMENT);
+	json_pvalue_release (&first);
+	json_pvalue_release (&third);
+	ck_assert_ptr_eq(third, NULL);
+
+	/* pointers reach labels by their unescaped text, and new labels are escaped when written */
+	ck_assert_int_eq(json_parse_document (&root, "{\"a\\/b\":1,\"caf\\u00e9\":2}"), JSON_OK);
+	first = json_pvalue_from_tree (root);
+	json_free_value (&root);
+	ck_assert_str_eq(json_pvalue_text (json_pvalue_get (first, "/a~1b")), "1");
+	ck_assert_str_eq(json_pvalue_text (json_pvalue_get (first, "/caf\xc3\xa9")), "2");
+	root = json_new_number ("3");
+	value = json_pvalue_from_tree (root);
+	json_free_value (&root);
+	ck_assert_int_eq(json_pvalue_set (first, "/a~1b", value, &second), JSON_OK);
+	ck_assert_int_eq(json_pvalue_set (second, "/q\"\\", value, &third), JSON_OK);
+	json_pvalue_release (&value);
+	ck_assert_str_eq(json_pvalue_text (json_pvalue_get (third, "/q\"\\")), "3");
+	tree = json_pvalue_to_tree (third);
+	ck_assert_int_eq(json_tree_to_string (tree, &text), JSON_OK);
+	ck_assert_str_eq(text, "{\"a\\/b\":3,\"caf\\u00e9\":2,\"q\\\"\\\\\":3}");
+	free (text);
+	json_free_value (&tree);
+	json_pvalue_release (&first);
+	json_pvalue_release (&second);
+	json_pvalue_release (&third);
+}
+END_TEST
+
+
+START_TEST(test_pvalue_shared)
+{
+	json_t * root = NULL;
+	json_t * tree;
+	struct json_pvalue * value;
+	char * text;
+	const char * document = "{\"p\":[{\"x\":1,\"y\":[true,\"s\"]},{\"x\":1,\"y\":[true,\"s\"]},{\"x\":2,\"y\":[true,\"s\"]},{}],\"q\":{}}";
+
+	ck_assert_int_eq(json_parse_document (&root, document), JSON_OK);
+	value = json_pvalue_from_tree_shared (root);
+	json_free_value (&root);
+	ck_assert_ptr_ne(value, NULL);
+
+	/* equal subtrees are held once */
+	ck_assert_ptr_eq(json_pvalue_get (value, "/p/0"), json_pvalue_get (value, "/p/1"));
+	ck_assert_ptr_ne(json_pvalue_get (value, "/p/0"), json_pvalue_get (value, "/p/2"));
+	ck_assert_ptr_eq(json_pvalue_get (value, "/p/0/y"), json_pvalue_get (value, "/p/2/y"));
+	ck_assert_ptr_eq(json_pvalue_get (value, "/p/0/x"), json_pvalue_get (value, "/p/1/x"));
+	ck_assert_ptr_eq(json_pvalue_get (value, "/p/3"), json_pvalue_get (value, "/q"));
+
+	tree = json_pvalue_to_tree (value);
+	ck_assert_int_eq(json_tree_to_string (tree, &text), JSON_OK);
+	ck_assert_str_eq(text, document);
+	free (text);
+	json_free_value (&tree);
+	json_pvalue_release (&value);
+}
+END_TEST
+
+START_TEST(test_tape)
+{
+	const char * document = " {\"a\":[1,\"t\\\"x\",{\"b\":null},[]],\"c\":{},\"d\":-2.5e3,\"a\":true} ";
+	struct json_tape * tape = NULL;
+	struct json_tape_cursor cursor;
+	struct json_tape_cursor element;
+	size_t offset;
+
+	ck_assert_int_eq(json_tape_parse (document, strlen (document), &tape, NULL), JSON_OK);
+	cursor = json_tape_root (tape);
+	ck_assert_int_eq(json_tape_type (&cursor), JSON_OBJECT);
+	ck_assert_int_eq(json_tape_count (&cursor), 4);
+	ck_assert_int_eq(json_tape_next (&cursor), 0);
+
+	/* objects hold labels, which hold their value */
+	ck_assert_int_eq(json_tape_child (&cursor), 1);
+	ck_assert_str_eq(json_tape_text (&cursor), "a");
+	ck_assert_int_eq(json_tape_child (&cursor), 1);
+	ck_assert_int_eq(json_tape_type (&cursor), JSON_ARRAY);
+	ck_assert_int_eq(json_tape_count (&cursor), 4);
+	ck_assert_int_eq(json_tape_next (&cursor), 0);
+
+	element = cursor;
+	ck_assert_int_eq(json_tape_child (&element), 1);
+	ck_assert_str_eq(json_tape_text (&element), "1");
+	ck_assert_int_eq(json_tape_next (&element), 1);
+	ck_assert_str_eq(json_tape_text (&element), "t\\\"x");
+	ck_assert_int_eq(json_tape_next (&element), 1);
+	ck_assert_int_eq(json_tape_find (&element, "b"), 1);
+	ck_assert_int_eq(json_tape_type (&element), JSON_NULL);
+	ck_assert_ptr_eq(json_tape_text (&element), NULL);
+
+	/* containers are stepped over as a whole */
+	cursor = json_tape_root (tape);
+	ck_assert_int_eq(json_tape_child (&cursor), 1);
+	ck_assert_int_eq(json_tape_next (&cursor), 1);
+	ck_assert_str_eq(json_tape_text (&cursor), "c");
+	ck_assert_int_eq(json_tape_child (&cursor), 1);
+	ck_assert_int_eq(json_tape_child (&cursor), 0);
+	ck_assert_int_eq(json_tape_count (&cursor), 0);
+
+	cursor = json_tape_root (tape);
+	ck_assert_int_eq(json_tape_find (&cursor, "d"), 1);
+	ck_assert_str_eq(json_tape_text (&cursor), "-2.5e3");
+	cursor = json_tape_root (tape);
+	ck_assert_int_eq(json_tape_find (&cursor, "a"), 1);	/* the first of duplicate labels */
+	ck_assert_int_eq(json_tape_type (&cursor), JSON_ARRAY);
+	ck_assert_int_eq(json_tape_find (&cursor, "a"), 0);
+	json_tape_free (&tape);
+	ck_assert_ptr_eq(tape, NULL);
+
+	ck_assert_int_eq(json_tape_parse ("{\"a\":[1,}", 9, &tape, &offset), JSON_MALFORMED_DOCUMENT);
+	ck_assert_int_eq(offset, 8);
+	ck_assert_ptr_eq(tape, NULL);
+	ck_assert_int_eq(json_tape_parse ("{\"a\":1", 6, &tape, NULL), JSON_INCOMPLETE_DOCUMENT);
+	ck_assert_int_eq(json_tape_parse ("[1]", 3, &tape, NULL), JSON_MALFORMED_DOCUMENT);
+}
+END_TEST
+
+START_TEST(test_snapshot)
+{
+	const char * path = "check_mjson.snapshot";
+	json_t * root = NULL;
+	struct json_snapshot * snapshot = NULL;
+	const struct json_frozen_node * node;
+	FILE * file;
+
+	ck_assert_int_eq(json_parse_document (&root, "{\"name\":\"mjson\",\"ports\":[80,443],\"tls\":{\"on\":true}}"), JSON_OK);
+	ck_assert_int_eq(json_snapshot_write (root, path), JSON_OK);
+	json_free_value (&root);
+
+	ck_assert_int_eq(json_snapshot_open (path, &snapshot), JSON_OK);
+	node = json_snapshot_root (snapshot);
+	ck_assert_int_eq(json_frozen_count (node), 3);
+	ck_assert_str_eq(json_frozen_text (json_frozen_find (node, "name")), "mjson");
+	ck_assert_str_eq(json_frozen_text (json_frozen_element (json_frozen_find (node, "ports"), 1)), "443");
+	ck_assert_int_eq(json_frozen_type (json_frozen_find (json_frozen_find (node, "tls"), "on")), JSON_TRUE);
+
+	/* replacing the file leaves the open snapshot untouched */
+	ck_assert_int_eq(json_parse_document (&root, "{\"name\":\"other\"}"), JSON_OK);
+	ck_assert_int_eq(json_snapshot_write (root, path), JSON_OK);
+	json_free_value (&root);
+	ck_assert_str_eq(json_frozen_text (json_frozen_find (node, "name")), "mjson");
+	json_snapshot_close (&snapshot);
+	ck_assert_ptr_eq(snapshot, NULL);
+
+	file = fopen (path, "wb");
+	fputs ("{\"not\":\"a snapshot\"}", file);
+	fclose (file);
+	ck_assert_int_eq(json_snapshot_open (path, &snapshot), JSON_MALFORMED_DOCUMENT);
+	ck_assert_ptr_eq(snapshot, NULL);
+	remove (path);
+	ck_assert_int_eq(json_snapshot_open (path, &snapshot), JSON_UNKNOWN_PROBLEM);
+}
+END_TEST
+
+static char cbor_events[128];
+
+
+static int
+cbor_open_object (void)
+{
+	strcat (cbor_events, "{");
+	return 0;
+}
+
+
+static int
+cbor_close_object (void)
+{
+	strcat (cbor_events, "}");
+	return 0;
+}
+
+
+static int
+cbor_open_array (void)
+{
+	strcat (cbor_events, "[");
+	return 0;
+}
+
+
+static int
+cbor_close_array (void)
+{
+	strcat (cbor_events, "]");
+	return 0;
+}
+
+
+static int
+cbor_string (char *text)
+{
+	strcat (cbor_events, "\"");
+	strcat (cbor_events, text);
+	strcat (cbor_events, "\"");
+	return 0;
+}
+
+
+static int
+cbor_number (char *text)
+{
+	strcat (cbor_events, text);
+	return 0;
+}
+
+
+static int
+cbor_label_value_separator (void)
+{
+	strcat (cbor_events, ":");
+	return 0;
+}
+
+
+static int
+cbor_sibling_separator (void)
+{
+	strcat (cbor_events, ",");
+	return 0;
+}
+
+
+START_TEST(test_cbor)
+{
+	/* examples of RFC 8949, appendix A */
+	static const unsigned char expected[] = { 0xA2, 0x61, 0x61, 0x85, 0x01, 0x29, 0xF9, 0x3E, 0x00, 0xFA, 0x47, 0xC3, 0x50, 0x00, 0x62, 0xC3, 0xBC, 0x61, 0x62, 0xC2, 0x49, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	static const unsigned char indefinite[] = { 0xBF, 0x61, 0x61, 0x9F, 0x01, 0x7F, 0x62, 0x61, 0x62, 0x61, 0x63, 0xFF, 0xFF, 0x61, 0x62, 0xC3, 0x49, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x01 };
+	struct json_saxy_functions functions = { cbor_open_object, cbor_close_object, cbor_open_array, cbor_close_array, cbor_string, cbor_number, NULL, NULL, NULL, cbor_label_value_separator, cbor_sibling_separator };
+	struct json_cbor_reader * reader;
+	json_t * root = NULL;
+	json_t * copy = NULL;
+	unsigned char * cbor;
+	size_t length, used, i;
+	enum json_error error = JSON_INCOMPLETE_DOCUMENT;
+
+	ck_assert_int_eq(json_parse_document (&root, "{\"a\":[1,-10,1.5,100000.0,\"\\u00fc\"],\"b\":18446744073709551616}"), JSON_OK);
+	ck_assert_int_eq(json_to_cbor (root, &cbor, &length), JSON_OK);
+	ck_assert_int_eq(length, sizeof (expected));
+	ck_assert(memcmp (cbor, expected, length) == 0);
+	ck_assert_int_eq(json_from_cbor (cbor, length, &copy), JSON_OK);
+	ck_assert(json_equal (root, copy));
+	json_free_value (&copy);
+	ck_assert_int_eq(json_from_cbor (cbor, length - 1, &copy), JSON_INCOMPLETE_DOCUMENT);
+	ck_assert_ptr_eq(copy, NULL);
+	free (cbor);
+	json_free_value (&root);
+
+	/* items of indefinite length, read a byte at a time */
+	reader = json_cbor_reader_new ();
+	cbor_events[0] = '\0';
+	for (i = 0; (i < sizeof (indefinite)) && (error == JSON_INCOMPLETE_DOCUMENT); i++)
+	{
+		error = json_cbor_reader_feed (reader, &functions, indefinite + i, 1, &used);
+		ck_assert_int_eq(used, 1);
+	}
+	ck_assert_int_eq(error, JSON_OK);
+	ck_assert_int_eq(i, sizeof (indefinite) - 1);
+	ck_assert_str_eq(cbor_events, "{\"a\":[1,\"abc\"],\"b\":-18446744073709551617}");
+	ck_assert_int_eq(json_cbor_reader_feed (reader, &functions, indefinite + i, 1, &used), JSON_OK);
+	ck_assert_str_eq(cbor_events, "{\"a\":[1,\"abc\"],\"b\":-18446744073709551617}1");
+	json_cbor_reader_free (&reader);
+	ck_assert_ptr_eq(reader, NULL);
+
+	ck_assert_int_eq(json_from_cbor (indefinite, sizeof (indefinite), &root), JSON_MALFORMED_DOCUMENT);
+	ck_assert_int_eq(json_from_cbor ((const unsigned char *)"\xA1\x01\x02", 3, &root), JSON_INCOMPATIBLE_TYPE);
+	ck_assert_int_eq(json_from_cbor ((const unsigned char *)"\x62\xC0\xAF", 3, &root), JSON_ILLEGAL_CHARACTER);
+}
+END_TEST
+
+START_TEST(test_freeze)
+{
+	json_t * root = NULL;
+	struct json_frozen * frozen = NULL;
+	struct json_frozen * copy;
+	struct json_pointer * pointer;
+	const struct json_frozen_node * node;
+
+	ck_assert_int_eq(json_parse_document (&root, "{\"zeta\":[1,\"two\",{}],\"alpha\":{\"k\":null,\"b\":true},\"mid\":-2.5,\"alpha\":0}"), JSON_OK);
+	ck_assert_int_eq(json_freeze (root, &frozen), JSON_OK);
+	json_free_value (&root);
+
+	node = json_frozen_root (frozen);
+	ck_assert_int_eq(json_frozen_type (node), JSON_OBJECT);
+	ck_assert_int_eq(json_frozen_count (node), 4);
+	ck_assert_str_eq(json_frozen_label (node, 0), "alpha");
+	ck_assert_str_eq(json_frozen_label (node, 3), "zeta");
+	ck_assert_int_eq(json_frozen_type (json_frozen_find (node, "alpha")), JSON_OBJECT);	/* the first of duplicate labels */
+	ck_assert_str_eq(json_frozen_text (json_frozen_find (node, "mid")), "-2.5");
+	ck_assert_ptr_eq(json_frozen_find (node, "beta"), NULL);
+	ck_assert_str_eq(json_frozen_text (json_frozen_element (json_frozen_find (node, "zeta"), 1)), "two");
+	ck_assert_ptr_eq(json_frozen_element (json_frozen_find (node, "zeta"), 3), NULL);
+
+	/* images hold no absolute addresses */
+	copy = (struct json_frozen *)malloc (json_frozen_size (frozen));
+	memcpy (copy, frozen, json_frozen_size (frozen));
+	json_frozen_free (&frozen);
+	pointer = json_pointer_compile ("/alpha/b");
+	ck_assert_int_eq(json_frozen_type (json_frozen_pointer_eval (pointer, json_frozen_root (copy))), JSON_TRUE);
+	json_pointer_free (&pointer);
+	pointer = json_pointer_compile ("/zeta/2");
+	ck_assert_int_eq(json_frozen_count (json_frozen_pointer_eval (pointer, json_frozen_root (copy))), 0);
+	json_pointer_free (&pointer);
+	json_frozen_free (&copy);
+	ck_assert_ptr_eq(copy, NULL);
+
+	/* records with the same labels share their shape */
+	ck_assert_int_eq(json_parse_document (&root, "{\"rows\":[{\"id\":1,\"name\":\"a\"},{\"name\":\"b\",\"id\":2},{\"id\":3}]}"), JSON_OK);
+	ck_assert_int_eq(json_freeze (root, &frozen), JSON_OK);
+	json_free_value (&root);
+	node = json_frozen_find (json_frozen_root (frozen), "rows");
+	ck_assert_int_eq(json_frozen_same_shape (json_frozen_element (node, 0), json_frozen_element (node, 1)), 1);
+	ck_assert_int_eq(json_frozen_same_shape (json_frozen_element (node, 0), json_frozen_element (node, 2)), 0);
+	ck_assert_int_eq(json_frozen_position (json_frozen_element (node, 0), "name"), 1);
+	ck_assert_str_eq(json_frozen_text (json_frozen_member (json_frozen_element (node, 1), 1)), "b");
+	ck_assert_int_eq(json_frozen_position (json_frozen_element (node, 2), "name"), 1);
+	json_frozen_free (&frozen);
+
+	/* pointers match labels by their unescaped text, json_frozen_find() as they are stored */
+	ck_assert_int_eq(json_parse_document (&root, "{\"a\\/b\":1,\"caf\\u00e9\":2,\"x\":3,\"q\\\\\":4}"), JSON_OK);
+	ck_assert_int_eq(json_freeze (root, &frozen), JSON_OK);
+	json_free_value (&root);
+	node = json_frozen_root (frozen);
+	ck_assert_str_eq(json_frozen_text (json_frozen_find (node, "a\\/b")), "1");
+	pointer = json_pointer_compile ("/a~1b");
+	ck_assert_str_eq(json_frozen_text (json_frozen_pointer_eval (pointer, node)), "1");
+	json_pointer_free (&pointer);
+	pointer = json_pointer_compile ("/caf\xc3\xa9");
+	ck_assert_str_eq(json_frozen_text (json_frozen_pointer_eval (pointer, node)), "2");
+	json_pointer_free (&pointer);
+	pointer = json_pointer_compile ("/x");
+	ck_assert_str_eq(json_frozen_text (json_frozen_pointer_eval (pointer, node)), "3");
+	json_pointer_free (&pointer);
+	pointer = json_pointer_compile ("/q\\");
+	ck_assert_str_eq(json_frozen_text (json_frozen_pointer_eval (pointer, node)), "4");
+	json_pointer_free (&pointer);
+	pointer = json_pointer_compile ("/a\\~1b");
+	ck_assert_ptr_eq(json_frozen_pointer_eval (pointer, node), NULL);
+	json_pointer_free (&pointer);
+	json_frozen_free (&frozen);
+}
+END_TEST
+
+
+static void
+count_destroyed (json_t * document, void *data)
+{
+	(*(int *)data)++;
+	json_free_value (&document);
+}
+
+
+START_TEST(test_doc_handle)
+{
+	struct json_doc_handle * handle;
+	const json_t * version;
+	json_t * root = NULL;
+	unsigned int token;
+	int destroyed = 0;
+
+	ck_assert_int_eq(json_parse_document (&root, "{\"version\":1}"), JSON_OK);
+	handle = json_doc_handle_new (root, count_destroyed, &destroyed);
+	ck_assert_ptr_ne(handle, NULL);
+
+	version = json_doc_acquire (handle, &token);
+	ck_assert_ptr_eq(version, root);
+	json_doc_release (handle, token);
+
+	root = NULL;
+	ck_assert_int_eq(json_parse_document (&root, "{\"version\":2}"), JSON_OK);
+	json_doc_publish (handle, root);
+	ck_assert_int_eq(destroyed, 1);
+	version = json_doc_acquire (handle, &token);
+	ck_assert_str_eq(json_find_first_label (version, "version")->child->text, "2");
+	json_doc_release (handle, token);
+
+	json_doc_handle_free (&handle);
+	ck_assert_ptr_eq(handle, NULL);
+	ck_assert_int_eq(destroyed, 2);
+}
+END_TEST
+
+
+START_TEST(test_minify)
+{
+	struct json_minifier minifier = { 0, 0 };
+	const char *text = "{ \"a\\\\\" :\t[ 1 , \"b \\\" c\" ],\r\n \"d\" : \" \\\\\\\\ \" }";
+	const char *expected = "{\"a\\\\\":[1,\"b \\\" c\"],\"d\":\" \\\\\\\\ \"}";
+	char buffer[64], output[64];
+	size_t cut, length;
+
+	strcpy (buffer, text);
+	json_strip_white_spaces (buffer);
+	ck_assert_str_eq(buffer, expected);
+
+	/* however the text is cut, the chunks strip as the whole */
+	for (cut = 0; cut <= strlen (text); cut++)
+	{
+		memset (&minifier, 0, sizeof (minifier));
+		length = json_minify (&minifier, text, cut, output);
+		length += json_minify (&minifier, text + cut, strlen (text) - cut, output + length);
+		output[length] = '\0';
+		ck_assert_str_eq(output, expected);
+		ck_assert_int_eq(minifier.in_string, 0);
+	}
+}
+END_TEST
+
+
+START_TEST(test_format_chunk)
+{
+	struct json_indentation indentation = { ' ', 2 };
+	struct json_formatter formatter;
+	const char *text = "{ \"a\\\\\" : [ 1 , { \"b\" : \"c \\\" }\" } ] ,\n\"d\" : [ ] }";
+	const char *expected = "{\n  \"a\\\\\": [\n    1,\n    {\n      \"b\": \"c \\\" }\"\n    }\n  ],\n  \"d\": []\n}";
+	char output[128];
+	size_t in = 0, out = 0, used, written;
+
+	/* a byte in, at most three bytes out at a time */
+	json_formatter_init (&formatter, &indentation);
+	do
+	{
+		written = json_format_chunk (&formatter, text + in, (text[in] != '\0') ? 1 : 0, &used, output + out, 3);
+		in += used;
+		out += written;
+	}
+	while ((text[in] != '\0') || (written > 0));
+	output[out] = '\0';
+	ck_assert_str_eq(output, expected);
+	ck_assert_int_eq(formatter.depth, 0);
+}
+END_TEST
+
+
+START_TEST(test_tree_to_formatted_string)
+{
+	struct json_indentation indentation = { ' ', 2 };
+	json_t *root = NULL, *label;
+	char *text = NULL;
+
+	ck_assert_int_eq(json_parse_document (&root, "{\"a\":[1,{\"b\":null}],\"c\":{},\"d\":[]}"), JSON_OK);
+	label = json_new_plain_string ("e\"");
+	json_insert_child (label, json_new_plain_string ("f\n"));
+	json_insert_child (root, label);
+
+	ck_assert_int_eq(json_tree_to_formatted_string (root, &text, &indentation), JSON_OK);
+	ck_assert_str_eq(text, "{\n  \"a\": [\n    1,\n    {\n      \"b\": null\n    }\n  ],\n  \"c\": {},\n  \"d\": [],\n  \"e\\\"\": \"f\\n\"\n}");
+	free (text);
+
+	ck_assert_int_eq(json_tree_to_formatted_string (json_find_first_label (root, "a"), &text, NULL), JSON_OK);
+	ck_assert_str_eq(text, "\"a\": [\n\t1,\n\t{\n\t\t\"b\": null\n\t}\n]");
+	free (text);
+
+	json_free_value (&root);
+}
+END_TEST
+
+
+START_TEST(test_pointer_escaped_labels)
+{
+	struct json_pointer * pointer;
+	json_t * root = NULL;
+	int indexed;
+
+	ck_assert_int_eq(json_parse_document (&root, "{\"caf\\u00e9\":1,\"a\\/b\":2,\"a\\\\b\":3,\"c\\\"\":4}"), JSON_OK);
+
+	/* the same lookups by scan and through the index, which is keyed by the unescaped labels */
+	for (indexed = 0; indexed < 2; indexed++)
+	{
+		if (indexed)
+			ck_assert_int_eq(json_build_index (root), JSON_OK);
+
+		pointer = json_pointer_compile ("/caf\xC3\xA9");
+		ck_assert_str_eq(json_pointer_eval (pointer, root)->text, "1");
+		json_pointer_free (&pointer);
+
+		pointer = json_pointer_compile ("/a~1b");
+		ck_assert_str_eq(json_pointer_eval (pointer, root)->text, "2");
+		json_pointer_free (&pointer);
+
+		pointer = json_pointer_compile ("/a\\b");
+		ck_assert_str_eq(json_pointer_eval (pointer, root)->text, "3");
+		json_pointer_free (&pointer);
+
+		pointer = json_pointer_compile ("/c\"");
+		ck_assert_str_eq(json_pointer_eval (pointer, root)->text, "4");
+		json_pointer_free (&pointer);
+
+		/* the escaped text itself is not a label */
+		pointer = json_pointer_compile ("/a\\\\b");
+		ck_assert_ptr_eq(json_pointer_eval (pointer, root), NULL);
+		json_pointer_free (&pointer);
+
+		/* while json_find_first_label() still takes labels as they are written */
+		ck_assert_str_eq(json_find_first_label (root, "a\\/b")->child->text, "2");
+		ck_assert_ptr_eq(json_find_first_label (root, "a/b"), NULL);
+	}
+
+	json_free_value (&root);
+}
+END_TEST
+
+
+START_TEST(test_equal_duplicate_labels)
+{
+	json_t * a = NULL;
+	json_t * b = NULL;
+	json_t * c = NULL;
+
+	ck_assert_int_eq(json_parse_document (&a, "{\"a\":1,\"a\":2}"), JSON_OK);
+	ck_assert_int_eq(json_parse_document (&b, "{\"a\":1,\"a\":1}"), JSON_OK);
+	ck_assert_int_eq(json_parse_document (&c, "{\"b\":0,\"a\":1,\"a\":2}"), JSON_OK);
+
+	/* repeated labels pair up in order, whichever tree comes first */
+	ck_assert_int_eq(json_equal (a, b), 0);
+	ck_assert_int_eq(json_equal (b, a), 0);
+	ck_assert_int_eq(json_equal (a, c), 0);
+	json_free_value (&b);
+	ck_assert_int_eq(json_parse_document (&b, "{\"a\":1,\"\\u0061\":2}"), JSON_OK);
+	ck_assert_int_eq(json_equal (a, b), 1);
+	ck_assert_int_eq(json_equal (b, a), 1);
+	json_free_value (&b);
+	ck_assert_int_eq(json_parse_document (&b, "{\"a\":2,\"a\":1}"), JSON_OK);
+	ck_assert_int_eq(json_equal (a, b), 0);
+	ck_assert_int_eq(json_equal (b, a), 0);
+
+	/* the same through indexes, which hold labels written both ways */
+	json_build_index (a);
+	json_free_value (&b);
+	ck_assert_int_eq(json_parse_document (&b, "{\"\\u0061\":1,\"a\":2}"), JSON_OK);
+	json_build_index (b);
+	ck_assert_int_eq(json_equal (a, b), 1);
+	ck_assert_int_eq(json_equal (b, a), 1);
+	json_free_value (&c);
+	ck_assert_int_eq(json_parse_document (&c, "{\"a\":2,\"\\u0061\":1}"), JSON_OK);
+	json_build_index (c);
+	ck_assert_int_eq(json_equal (a, c), 0);
+	ck_assert_int_eq(json_equal (c, a), 0);
+
+	json_free_value (&a);
+	json_free_value (&b);
+	json_free_value (&c);
+}
+END_TEST
+
+
+START_TEST(test_canonical_buffer_boundary)
+{
+	char text[64], expected[512];
+	json_t * root;
+	char * canonical = NULL;
+	int i;
+
+	/* the escaped text fills the 256 bytes json_canonical_string() gathers it in, right before its closing quote */
+	memset (text, '\x01', 41);
+	memcpy (text + 41, "aaaa\x02", 6);
+	strcpy (expected, "[\"");
+	for (i = 0; i < 41; i++)
+		strcat (expected, "\\u0001");
+	strcat (expected, "aaaa\\u0002\"]");
+
+	root = json_new_array ();
+	ck_assert_int_eq(json_insert_child (root, json_new_plain_string (text)), JSON_OK);
+	ck_assert_int_eq(json_tree_to_canonical_string (root, &canonical), JSON_OK);
+	ck_assert_int_eq(strlen (canonical), 2 + 256 + 2);
+	ck_assert_str_eq(canonical, expected);
+	free (canonical);
+	json_free_value (&root);
+}
+END_TEST
+
+
+/* builds version n of a document whose 40 members and 50 elements are all worth n, wide enough to get indexes on first use */
+static json_t *
+doc_version (int n)
+{
+	char text[1024];
+	size_t length;
+	json_t * root = NULL;
+	int i;
+
+	length = sprintf (text, "{");
+	for (i = 0; i < 40; i++)
+		length += sprintf (text + length, "\"k%d\":%d,", i, n);
+	length += sprintf (text + length, "\"v\":[");
+	for (i = 0; i < 50; i++)
+		length += sprintf (text + length, "%s%d", (i > 0) ? "," : "", n);
+	sprintf (text + length, "]}");
+	json_parse_document (&root, text);
+	return root;
+}
+
+
+struct doc_reader
+{
+	struct json_doc_handle * handle;
+	int mismatches;
+};
+
+
+/* reads every member and element of each version it acquires, checking that they all agree */
+static void *
+read_versions (void *data)
+{
+	struct doc_reader * reader = (struct doc_reader *) data;
+	const json_t * version;
+	const json_t * label;
+	const json_t * element;
+	unsigned int token;
+	char name[16];
+	int round, i;
+
+	for (round = 0; round < 200; round++)
+	{
+		version = json_doc_acquire (reader->handle, &token);
+		label = json_find_first_label (version, "k0");
+		for (i = 0; (label != NULL) && (i < 40); i++)
+		{
+			sprintf (name, "k%d", i);
+			if (((label = json_find_first_label (version, name)) == NULL) || (strcmp (label->child->text, json_find_first_label (version, "k0")->child->text) != 0))
+				reader->mismatches++;
+		}
+		label = json_find_first_label (version, "v");
+		if ((label == NULL) || (json_array_size (label->child) != 50))
+			reader->mismatches++;
+		else
+		{
+			for (i = 0; i < 50; i++)
+			{
+				element = json_array_get (label->child, i);
+				if ((element == NULL) || (strcmp (element->text, json_find_first_label (version, "k0")->child->text) != 0))
+					reader->mismatches++;
+			}
+		}
+		json_doc_release (reader->handle, token);
+	}
+	return NULL;
+}
+
+
+START_TEST(test_doc_concurrent_readers)
+{
+	struct json_doc_handle * handle;
+	struct doc_reader readers[8];
+	pthread_t threads[8];
+	int destroyed = 0;
+	int i, n;
+
+	handle = json_doc_handle_new (doc_version (0), count_destroyed, &destroyed);
+	ck_assert_ptr_ne(handle, NULL);
+	for (i = 0; i < 8; i++)
+	{
+		readers[i].handle = handle;
+		readers[i].mismatches = 0;
+		ck_assert_int_eq(pthread_create (&threads[i], NULL, read_versions, &readers[i]), 0);
+	}
+
+	/* fresh versions have no index yet, which the readers build as they go */
+	for (n = 1; n <= 20; n++)
+		json_doc_publish (handle, doc_version (n));
+
+	for (i = 0; i < 8; i++)
+	{
+		ck_assert_int_eq(pthread_join (threads[i], NULL), 0);
+		ck_assert_int_eq(readers[i].mismatches, 0);
+	}
+	json_doc_handle_free (&handle);
+	ck_assert_int_eq(destroyed, 21);
+}
+END_TEST
+
+
 Suite * parser_suite(void)
 {
 	Suite *s;
@@ -123,6 +1630,38 @@ Suite * parser_suite(void)
 	tcase_add_test(tc_core, test_parser_string_document);
 	tcase_add_test(tc_core, test_parser_array_document);
 	tcase_add_test(tc_core, test_parser_object_document);
+	tcase_add_test(tc_core, test_validate_document);
+	tcase_add_test(tc_core, test_validate_error_offset);
+	tcase_add_test(tc_core, test_parser_utf8_validation);
+	tcase_add_test(tc_core, test_saxy_utf8_validation);
+	tcase_add_test(tc_core, test_escape_unescape);
+	tcase_add_test(tc_core, test_parser_fragmented_string);
+	tcase_add_test(tc_core, test_tree_to_string_escaping);
+	tcase_add_test(tc_core, test_find_first_label_index);
+	tcase_add_test(tc_core, test_array_random_access);
+	tcase_add_test(tc_core, test_pointer_eval);
+	tcase_add_test(tc_core, test_path_eval);
+	tcase_add_test(tc_core, test_selector_feed);
+	tcase_add_test(tc_core, test_clone);
+	tcase_add_test(tc_core, test_hash_equal);
+	tcase_add_test(tc_core, test_patch);
+	tcase_add_test(tc_core, test_merge_patch);
+	tcase_add_test(tc_core, test_canonical_string);
+	tcase_add_test(tc_core, test_pvalue);
+	tcase_add_test(tc_core, test_freeze);
+	tcase_add_test(tc_core, test_doc_handle);
+	tcase_add_test(tc_core, test_pvalue_shared);
+	tcase_add_test(tc_core, test_tape);
+	tcase_add_test(tc_core, test_snapshot);
+	tcase_add_test(tc_core, test_cbor);
+	tcase_add_test(tc_core, test_minify);
+	tcase_add_test(tc_core, test_format_chunk);
+	tcase_add_test(tc_core, test_tree_to_formatted_string);
+	tcase_add_test(tc_core, test_pointer_escaped_labels);
+	tcase_add_test(tc_core, test_equal_duplicate_labels);
+	tcase_add_test(tc_core, test_canonical_buffer_boundary);
+	tcase_add_test(tc_core, test_doc_concurrent_readers);
+	tcase_add_test(tc_core, test_utf8_validation_cross_check);
 	suite_add_tcase(s, tc_core);
 
 	return s;